@@ -0,0 +1,546 @@
+// Renders a fixed set of synthetic scenes for a fixed number of frames with
+// vsync off and reports frame time percentiles and draw calls per second.
+//
+//   engine_bench [frames] [primitives] [textures] [level sprites]
+//
+// Scenes are generated from a fixed seed, so runs on one machine are
+// comparable across commits. The level scenes pan a camera over a large
+// static level and draw what it sees, once culled through a spatial_grid
+// and once by testing every sprite. The CPU quad kernels are timed on their own
+// after the scenes, against the scalar kernel.
+
+#include "engine.hxx"
+#include "quad_builder.hxx"
+#include "spatial_grid.hxx"
+#include <SDL2/SDL_main.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct bench_config
+{
+  size_t frames = 500;
+  size_t primitives = 10000;
+  size_t textures = 16;
+  size_t level_sprites = 1000000;
+};
+
+struct scene
+{
+  std::string name;
+  std::function<void()> draw;
+  // Runs with engine::set_retained_mode() on.
+  bool retained = false;
+  // Runs with engine::set_multi_texture_batching() on.
+  bool multi_texture = true;
+};
+
+// Deterministic, platform independent generator (Numerical Recipes LCG).
+class random_source
+{
+  uint32_t state;
+
+public:
+  explicit random_source(uint32_t seed)
+    : state(seed)
+  {}
+  float next(float lo, float hi)
+  {
+    state = state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * static_cast<float>(state >> 8) / 16777216.f;
+  }
+};
+
+uchiha::vertex
+make_vertex(float x, float y, float r, float g, float b, float u, float v)
+{
+  return uchiha::vertex(x, y, 0.f, r, g, b, 1.f, u, v);
+}
+
+// Two triangles covering a size by size square centered on (x, y).
+void
+append_quad(std::vector<uchiha::triangle>& out,
+            float x,
+            float y,
+            float size,
+            float r,
+            float g,
+            float b)
+{
+  float h = size * 0.5f;
+  uchiha::vertex v0 = make_vertex(x - h, y - h, r, g, b, 0.f, 1.f);
+  uchiha::vertex v1 = make_vertex(x + h, y - h, r, g, b, 1.f, 1.f);
+  uchiha::vertex v2 = make_vertex(x + h, y + h, r, g, b, 1.f, 0.f);
+  uchiha::vertex v3 = make_vertex(x - h, y + h, r, g, b, 0.f, 0.f);
+  out.emplace_back(v0, v1, v2);
+  out.emplace_back(v0, v2, v3);
+}
+
+std::vector<uchiha::triangle>
+make_triangles(size_t count, random_source& rng)
+{
+  std::vector<uchiha::triangle> out;
+  out.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    float x = rng.next(-1.f, 1.f);
+    float y = rng.next(-1.f, 1.f);
+    float r = rng.next(0.f, 1.f);
+    float g = rng.next(0.f, 1.f);
+    float b = rng.next(0.f, 1.f);
+    out.emplace_back(make_vertex(x, y, r, g, b, 0.f, 0.f),
+                     make_vertex(x + 0.02f, y, r, g, b, 0.f, 0.f),
+                     make_vertex(x, y + 0.02f, r, g, b, 0.f, 0.f));
+  }
+  return out;
+}
+
+double
+percentile(std::vector<double> sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>(
+    std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+  return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+bool
+pump_events(uchiha::engine& engine)
+{
+  uchiha::event e;
+  while (engine.read_input(e)) {
+    if (e.type == uchiha::event::quit ||
+        (e.type == uchiha::event::pressed &&
+         e.key == uchiha::event::escape)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Writes a size x size uncompressed 32-bit TGA in one color with a darker
+// checker pattern, so every generated texture is its own image.
+bool
+write_texture(const std::filesystem::path& path,
+              uint16_t size,
+              uint8_t r,
+              uint8_t g,
+              uint8_t b)
+{
+  std::ofstream file(path, std::ios::binary);
+  uint8_t header[18] = {};
+  header[2] = 2;
+  header[12] = static_cast<uint8_t>(size & 0xff);
+  header[13] = static_cast<uint8_t>(size >> 8);
+  header[14] = header[12];
+  header[15] = header[13];
+  header[16] = 32;
+  header[17] = 8;
+  file.write(reinterpret_cast<const char*>(header), sizeof(header));
+  std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+  for (size_t y = 0; y < size; ++y) {
+    for (size_t x = 0; x < size; ++x) {
+      const bool dark = ((x / 8) + (y / 8)) % 2 != 0;
+      uint8_t* p = &pixels[(y * size + x) * 4];
+      // TGA stores BGRA.
+      p[0] = dark ? b / 2 : b;
+      p[1] = dark ? g / 2 : g;
+      p[2] = dark ? r / 2 : r;
+      p[3] = 255;
+    }
+  }
+  file.write(reinterpret_cast<const char*>(pixels.data()),
+             static_cast<std::streamsize>(pixels.size()));
+  return static_cast<bool>(file);
+}
+
+// Returns false when the window was closed during the run.
+bool
+run_scene(uchiha::engine& engine, const scene& s, const bench_config& cfg)
+{
+  engine.set_retained_mode(s.retained);
+  engine.set_multi_texture_batching(s.multi_texture);
+  // One profiled frame counts the draw calls the scene issues. The timed
+  // frames run with profiling off so timer queries do not skew them.
+  engine.set_profiling_enabled(true);
+  s.draw();
+  engine.swap_buffers();
+  s.draw();
+  engine.swap_buffers();
+  uint32_t draws_per_frame = engine.get_frame_stats().draw_calls;
+  engine.set_profiling_enabled(false);
+
+  using clock = std::chrono::steady_clock;
+  std::vector<double> frame_ms;
+  frame_ms.reserve(cfg.frames);
+  clock::time_point run_start = clock::now();
+  clock::time_point frame_start = run_start;
+  for (size_t i = 0; i < cfg.frames; ++i) {
+    if (!pump_events(engine)) {
+      return false;
+    }
+    s.draw();
+    engine.swap_buffers();
+    clock::time_point now = clock::now();
+    frame_ms.push_back(
+      std::chrono::duration<double, std::milli>(now - frame_start).count());
+    frame_start = now;
+  }
+  double total_s =
+    std::chrono::duration<double>(clock::now() - run_start).count();
+
+  std::sort(frame_ms.begin(), frame_ms.end());
+  double draws_per_second =
+    total_s > 0.0 ? draws_per_frame * static_cast<double>(cfg.frames) / total_s
+                  : 0.0;
+  std::printf("%-28s %8.3f %8.3f %8.3f %8.3f %8u %12.0f\n",
+              s.name.c_str(),
+              percentile(frame_ms, 50.0),
+              percentile(frame_ms, 90.0),
+              percentile(frame_ms, 99.0),
+              frame_ms.empty() ? 0.0 : frame_ms.back(),
+              draws_per_frame,
+              draws_per_second);
+  std::fflush(stdout);
+  return true;
+}
+
+// Builds the sprites' vertices into ordinary memory on every supported
+// kernel and reports the best time of several passes, so the numbers show
+// the kernels rather than the cache or the scheduler.
+void
+run_quad_kernels(const std::vector<uchiha::sprite_instance>& sprites)
+{
+  using clock = std::chrono::steady_clock;
+  std::vector<uchiha::vertex> out(sprites.size() * 6);
+  std::printf("\n%-28s %8s %8s\n", "quad kernel", "ns/quad", "speedup");
+  double scalar_ns = 0.0;
+  for (uchiha::simd_level level : { uchiha::simd_level::scalar,
+                                    uchiha::simd_level::sse2,
+                                    uchiha::simd_level::avx2,
+                                    uchiha::simd_level::neon }) {
+    if (!uchiha::is_supported(level)) {
+      continue;
+    }
+    double best_ns = 0.0;
+    for (int pass = 0; pass < 50; ++pass) {
+      clock::time_point start = clock::now();
+      uchiha::build_quads(
+        out.data(), sprites.data(), sprites.size(), uchiha::uv_rect(), level);
+      double ns =
+        std::chrono::duration<double, std::nano>(clock::now() - start)
+          .count() /
+        static_cast<double>(sprites.size());
+      best_ns = pass == 0 ? ns : std::min(best_ns, ns);
+    }
+    if (level == uchiha::simd_level::scalar) {
+      scalar_ns = best_ns;
+    }
+    std::printf("%-28s %8.2f %7.2fx\n",
+                uchiha::simd_level_name(level),
+                best_ns,
+                best_ns > 0.0 ? scalar_ns / best_ns : 0.0);
+  }
+  std::fflush(stdout);
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+  bench_config cfg;
+  if (argc > 1) {
+    cfg.frames = std::max<size_t>(1, std::strtoul(argv[1], nullptr, 10));
+  }
+  if (argc > 2) {
+    cfg.primitives = std::max<size_t>(1, std::strtoul(argv[2], nullptr, 10));
+  }
+  if (argc > 3) {
+    cfg.textures = std::max<size_t>(1, std::strtoul(argv[3], nullptr, 10));
+  }
+  if (argc > 4) {
+    cfg.level_sprites =
+      std::max<size_t>(1, std::strtoul(argv[4], nullptr, 10));
+  }
+
+  uchiha::engine* engine = uchiha::create_engine();
+  if (!engine->init(800, 600, false)) {
+    uchiha::destroy_engine(engine);
+    return EXIT_FAILURE;
+  }
+  if (!engine->set_vsync(false)) {
+    std::fprintf(stderr, "warning: vsync could not be disabled\n");
+  }
+
+  // Every texture is a distinct generated image in its own file, so the
+  // textured scenes really switch textures.
+  random_source colors(0xc0105);
+  std::error_code ec;
+  const std::filesystem::path texture_dir =
+    std::filesystem::temp_directory_path(ec) / "engine_bench_textures";
+  std::filesystem::create_directories(texture_dir, ec);
+  std::vector<uchiha::texture*> textures;
+  uchiha::texture_atlas* atlas = engine->create_atlas();
+  std::vector<uchiha::texture*> atlas_textures;
+  for (size_t i = 0; i < cfg.textures; ++i) {
+    const std::filesystem::path path =
+      texture_dir / ("texture_" + std::to_string(i) + ".tga");
+    if (!write_texture(path,
+                       64,
+                       static_cast<uint8_t>(colors.next(64.f, 255.f)),
+                       static_cast<uint8_t>(colors.next(64.f, 255.f)),
+                       static_cast<uint8_t>(colors.next(64.f, 255.f)))) {
+      std::fprintf(
+        stderr, "error: could not write %s\n", path.string().c_str());
+    }
+    textures.push_back(engine->create_texture(path.string()));
+    atlas_textures.push_back(engine->create_texture(path.string(), *atlas));
+  }
+
+  random_source rng(0x5eed);
+  const size_t n = cfg.primitives;
+  std::vector<uchiha::triangle> triangles = make_triangles(n, rng);
+
+  // Small render() calls of two triangles each cover the same geometry.
+  std::vector<std::vector<uchiha::triangle>> small_chunks;
+  for (size_t i = 0; i < triangles.size(); i += 2) {
+    small_chunks.emplace_back(
+      triangles.begin() + static_cast<std::ptrdiff_t>(i),
+      triangles.begin() +
+        static_cast<std::ptrdiff_t>(std::min(i + 2, triangles.size())));
+  }
+
+  std::vector<std::vector<uchiha::triangle>> quads(n);
+  std::vector<uchiha::sprite_instance> instances(n);
+  for (size_t i = 0; i < n; ++i) {
+    float x = rng.next(-1.f, 1.f);
+    float y = rng.next(-1.f, 1.f);
+    append_quad(quads[i], x, y, 0.05f, 1.f, 1.f, 1.f);
+    uchiha::sprite_instance& s = instances[i];
+    s.x = x;
+    s.y = y;
+    s.scale_x = 0.05f;
+    s.scale_y = 0.05f;
+    s.rotation = rng.next(0.f, 6.2831853f);
+  }
+
+  uchiha::mesh* static_mesh = engine->create_mesh(triangles);
+
+  std::vector<scene> scenes;
+  scenes.push_back({ "untextured, one call",
+                     [&]() { engine->render(triangles); } });
+  scenes.push_back({ "untextured, static mesh",
+                     [&]() { engine->draw_mesh(*static_mesh); } });
+  scenes.push_back({ "untextured, small calls", [&]() {
+                      for (const auto& chunk : small_chunks) {
+                        engine->render(chunk);
+                      }
+                    } });
+  scenes.push_back({ "untextured, batched", [&]() {
+                      engine->begin_batch();
+                      for (const auto& chunk : small_chunks) {
+                        engine->submit(chunk);
+                      }
+                      engine->flush();
+                    } });
+  scenes.push_back({ "frame arena quads, batched", [&]() {
+                      // Geometry rebuilt every frame without touching the
+                      // heap, as a game would for moving sprites.
+                      uchiha::triangle* t =
+                        engine->allocate_frame<uchiha::triangle>(n * 2);
+                      for (size_t i = 0; i < n; ++i) {
+                        const uchiha::triangle* q = quads[i].data();
+                        new (&t[i * 2]) uchiha::triangle(q[0]);
+                        new (&t[i * 2 + 1]) uchiha::triangle(q[1]);
+                      }
+                      engine->begin_batch();
+                      engine->submit(t, n * 2, *atlas_textures[0]);
+                      engine->flush();
+                    } });
+  scenes.push_back({ "textured quads", [&]() {
+                      for (size_t i = 0; i < n; ++i) {
+                        engine->render(quads[i], *textures[i % textures.size()]);
+                      }
+                    } });
+  auto draw_textured_batch = [&]() {
+    engine->begin_batch();
+    for (size_t i = 0; i < n; ++i) {
+      engine->submit(quads[i], *textures[i % textures.size()]);
+    }
+    engine->flush();
+  };
+  scenes.push_back(
+    { "textured quads, batched", draw_textured_batch, false, false });
+  scenes.push_back({ "textured quads, multi", draw_textured_batch });
+  scenes.push_back({ "atlas quads, batched", [&]() {
+                      engine->begin_batch();
+                      for (size_t i = 0; i < n; ++i) {
+                        engine->submit(
+                          quads[i], *atlas_textures[i % atlas_textures.size()]);
+                      }
+                      engine->flush();
+                    } });
+  scenes.push_back({ "instanced sprites", [&]() {
+                      engine->render_instanced(
+                        instances.data(), instances.size(), textures[0]);
+                    } });
+  scenes.push_back({ "cpu built quads", [&]() {
+                      engine->render_quads(
+                        instances.data(), instances.size(), textures[0]);
+                    } });
+  // Emitters that stay full, so every frame integrates and draws n
+  // particles while about as many expire and respawn.
+  uchiha::particle_settings sparks;
+  sparks.max_particles = static_cast<uint32_t>(n / 4 + 1);
+  sparks.rate = static_cast<float>(sparks.max_particles);
+  sparks.speed_min = 0.2f;
+  sparks.speed_max = 0.8f;
+  sparks.gravity_y = -0.5f;
+  sparks.drag = 0.5f;
+  sparks.size_start = 0.02f;
+  sparks.size_end = 0.005f;
+  std::vector<uchiha::particle_emitter*> emitters;
+  for (int i = 0; i < 4; ++i) {
+    emitters.push_back(engine->create_particle_emitter(
+      sparks, rng.next(-0.5f, 0.5f), rng.next(-0.5f, 0.5f)));
+  }
+  scenes.push_back({ "particles", [&]() {
+                      engine->update_particles(1.f / 60.f);
+                      for (uchiha::particle_emitter* e : emitters) {
+                        engine->draw_particles(*e, textures[0]);
+                      }
+                    } });
+  // An idle screen, then one where a single quad moves, as a cursor would.
+  auto draw_atlas_quads = [&](size_t first) {
+    for (size_t i = first; i < n; ++i) {
+      engine->submit(quads[i], *atlas_textures[i % atlas_textures.size()]);
+    }
+  };
+  scenes.push_back({ "atlas quads, retained",
+                     [&]() {
+                       engine->begin_batch();
+                       draw_atlas_quads(0);
+                       engine->flush();
+                     },
+                     true });
+  std::vector<uchiha::triangle> cursor = quads[0];
+  size_t cursor_frame = 0;
+  scenes.push_back({ "atlas quads, retained moving",
+                     [&]() {
+                       const float dx = 0.002f * (cursor_frame++ % 200);
+                       for (size_t i = 0; i < cursor.size(); ++i) {
+                         for (int k = 0; k < 3; ++k) {
+                           cursor[i].v[k].x = quads[0][i].v[k].x + dx;
+                         }
+                       }
+                       engine->begin_batch();
+                       draw_atlas_quads(1);
+                       engine->submit(cursor, *atlas_textures[0]);
+                       engine->flush();
+                     },
+                     true });
+
+  // A static level sized so the camera sees about as many sprites as the
+  // other scenes draw. Both level scenes gather the same visible sprites;
+  // they differ only in how they find them.
+  const float level_extent = std::sqrt(static_cast<float>(cfg.level_sprites) /
+                                       static_cast<float>(n));
+  std::vector<uchiha::sprite_instance> level(cfg.level_sprites);
+  std::vector<uchiha::aabb> level_bounds(cfg.level_sprites);
+  uchiha::spatial_grid level_grid(0.25f);
+  for (size_t i = 0; i < level.size(); ++i) {
+    uchiha::sprite_instance& s = level[i];
+    s.x = rng.next(-level_extent, level_extent);
+    s.y = rng.next(-level_extent, level_extent);
+    s.scale_x = 0.05f;
+    s.scale_y = 0.05f;
+    s.rotation = rng.next(0.f, 6.2831853f);
+    // Loose enough for any rotation.
+    level_bounds[i] = { s.x - 0.05f, s.y - 0.05f, s.x + 0.05f, s.y + 0.05f };
+    level_grid.insert(level_bounds[i], static_cast<uint32_t>(i));
+  }
+  size_t level_frame = 0;
+  auto level_camera = [&]() {
+    uchiha::camera_2d camera;
+    const float t = 0.01f * static_cast<float>(level_frame++ % 628);
+    camera.x = 0.5f * level_extent * std::cos(t);
+    camera.y = 0.5f * level_extent * std::sin(t);
+    engine->set_camera(camera);
+    return camera.visible_bounds();
+  };
+  std::vector<uint32_t> level_hits;
+  std::vector<uchiha::sprite_instance> level_visible;
+  auto draw_level_visible = [&]() {
+    level_visible.clear();
+    for (uint32_t i : level_hits) {
+      level_visible.push_back(level[i]);
+    }
+    engine->render_quads(
+      level_visible.data(), level_visible.size(), atlas_textures[0]);
+  };
+  scenes.push_back({ "level, grid culled", [&]() {
+                      level_hits.clear();
+                      level_grid.query(level_camera(), level_hits);
+                      draw_level_visible();
+                    } });
+  scenes.push_back({ "level, brute force culled", [&]() {
+                      const uchiha::aabb view = level_camera();
+                      level_hits.clear();
+                      for (size_t i = 0; i < level_bounds.size(); ++i) {
+                        const uchiha::aabb& b = level_bounds[i];
+                        if (b.max_x >= view.min_x && b.min_x <= view.max_x &&
+                            b.max_y >= view.min_y && b.min_y <= view.max_y) {
+                          level_hits.push_back(static_cast<uint32_t>(i));
+                        }
+                      }
+                      draw_level_visible();
+                    } });
+
+  std::printf("frames %zu, primitives %zu, textures %zu, level sprites %zu\n",
+              cfg.frames,
+              cfg.primitives,
+              cfg.textures,
+              cfg.level_sprites);
+  std::printf("%-28s %8s %8s %8s %8s %8s %12s\n",
+              "scene",
+              "p50 ms",
+              "p90 ms",
+              "p99 ms",
+              "max ms",
+              "draws",
+              "draws/s");
+  for (const scene& s : scenes) {
+    if (!run_scene(*engine, s, cfg)) {
+      break;
+    }
+  }
+  engine->set_retained_mode(false);
+  engine->set_camera(uchiha::camera_2d());
+  run_quad_kernels(instances);
+
+  for (uchiha::particle_emitter* e : emitters) {
+    engine->destroy_particle_emitter(e);
+  }
+  engine->destroy_mesh(static_mesh);
+  for (uchiha::texture* t : textures) {
+    engine->release_texture(t);
+  }
+  engine->destroy_atlas(atlas);
+  std::filesystem::remove_all(texture_dir, ec);
+  engine->destroy();
+  uchiha::destroy_engine(engine);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,277 @@
+// Replays a trace written by engine::start_trace() on several backends, as
+// fast as possible and with the profiler on, and compares their frame
+// times with each other and with the run that recorded the trace.
+//
+//   engine_replay trace [--backend=name]... [--profile=prefix] [--paced]
+//
+// Backends are batched (the calls as recorded), unbatched (every submission
+// flushed on its own), single-texture (multi-texture batching off) and
+// threaded (the threaded engine); without --backend all of them run. With
+// --profile each backend's Chrome trace is written to prefix-name.json, and
+// --paced keeps the recorded vsync and frame rate limit. Run it from the
+// directory the game ran in, so the traced resource paths resolve.
+
+#include "engine.hxx"
+#include "engine_trace.hxx"
+#include <SDL2/SDL_main.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct backend
+{
+  std::string name;
+  bool threaded = false;
+  uchiha::trace_replay_options options;
+};
+
+struct replay_result
+{
+  std::vector<double> frame_ms;
+  double gpu_ms = 0.0;
+  double draws_per_frame = 0.0;
+};
+
+double
+percentile(std::vector<double> sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t index = static_cast<size_t>(
+    std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+  return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+double
+total(const std::vector<double>& values)
+{
+  double sum = 0.0;
+  for (double v : values) {
+    sum += v;
+  }
+  return sum;
+}
+
+void
+print_row(const std::string& name,
+          std::vector<double> frame_ms,
+          const char* gpu,
+          const char* draws,
+          const char* relative)
+{
+  std::sort(frame_ms.begin(), frame_ms.end());
+  std::printf("%-20s %8zu %8.3f %8.3f %8.3f %8.3f %8s %8s %8s\n",
+              name.c_str(),
+              frame_ms.size(),
+              percentile(frame_ms, 50.0),
+              percentile(frame_ms, 90.0),
+              percentile(frame_ms, 99.0),
+              frame_ms.empty() ? 0.0 : frame_ms.back(),
+              gpu,
+              draws,
+              relative);
+  std::fflush(stdout);
+}
+
+bool
+pump_events(uchiha::engine& engine)
+{
+  uchiha::event e;
+  while (engine.read_input(e)) {
+    if (e.type == uchiha::event::quit ||
+        (e.type == uchiha::event::pressed &&
+         e.key == uchiha::event::escape)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Each backend gets an engine of its own, so no backend inherits another's
+// resources or caches. Returns false when the replay stopped early.
+bool
+replay(const uchiha::trace_file& trace,
+       const backend& b,
+       const std::string& profile_prefix,
+       replay_result& result)
+{
+  uchiha::engine* engine = b.threaded ? uchiha::create_threaded_engine()
+                                      : uchiha::create_engine();
+  if (!engine->init(trace.width(), trace.height(), false)) {
+    uchiha::destroy_engine(engine);
+    return false;
+  }
+  engine->set_profiling_enabled(true);
+  uchiha::trace_player player(*engine, b.options);
+
+  // Reading the threaded engine's stats waits for its render thread, which
+  // would undo the overlap it is measured for, so it only reports the last
+  // frame's.
+  const bool stats_per_frame = !b.threaded;
+  using clock = std::chrono::steady_clock;
+  std::vector<uint8_t> records;
+  uint64_t draws = 0;
+  bool complete = true;
+  for (size_t i = 0; i < trace.frame_count(); ++i) {
+    if (!pump_events(*engine)) {
+      complete = false;
+      break;
+    }
+    if (!trace.read_frame(i, records)) {
+      std::fprintf(stderr, "error: frame %zu of the trace is corrupt\n", i);
+      complete = false;
+      break;
+    }
+    clock::time_point start = clock::now();
+    if (!player.play(records)) {
+      complete = false;
+      break;
+    }
+    result.frame_ms.push_back(
+      std::chrono::duration<double, std::milli>(clock::now() - start)
+        .count());
+    if (stats_per_frame) {
+      uchiha::frame_stats stats = engine->get_frame_stats();
+      result.gpu_ms += stats.gpu_milliseconds;
+      draws += stats.draw_calls;
+    }
+  }
+  if (!stats_per_frame) {
+    uchiha::frame_stats stats = engine->get_frame_stats();
+    result.gpu_ms = stats.gpu_milliseconds;
+    result.draws_per_frame = stats.draw_calls;
+  } else if (!result.frame_ms.empty()) {
+    const double frames = static_cast<double>(result.frame_ms.size());
+    result.gpu_ms /= frames;
+    result.draws_per_frame = static_cast<double>(draws) / frames;
+  }
+
+  if (!profile_prefix.empty()) {
+    engine->write_profile_trace(profile_prefix + "-" + b.name + ".json");
+  }
+  engine->destroy();
+  uchiha::destroy_engine(engine);
+  return complete;
+}
+
+std::vector<backend>
+all_backends()
+{
+  std::vector<backend> backends(4);
+  backends[0].name = "batched";
+  backends[1].name = "unbatched";
+  backends[1].options.flush_every_submission = true;
+  backends[2].name = "single-texture";
+  backends[2].options.force_single_texture = true;
+  backends[3].name = "threaded";
+  backends[3].threaded = true;
+  return backends;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+  if (argc < 2) {
+    std::fprintf(stderr,
+                 "usage: engine_replay trace [--backend=name]... "
+                 "[--profile=prefix] [--paced]\n");
+    return EXIT_FAILURE;
+  }
+  const std::vector<backend> known = all_backends();
+  std::vector<backend> backends;
+  std::string profile_prefix;
+  bool paced = false;
+  for (int i = 2; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    paced = paced || arg == "--paced";
+    if (arg.substr(0, 10) == "--profile=") {
+      profile_prefix = std::string(arg.substr(10));
+    }
+    if (arg.substr(0, 10) == "--backend=") {
+      const std::string_view name = arg.substr(10);
+      auto it = std::find_if(known.begin(),
+                             known.end(),
+                             [&](const backend& b) { return b.name == name; });
+      if (it == known.end()) {
+        std::fprintf(stderr,
+                     "error: unknown backend %.*s\n",
+                     static_cast<int>(name.size()),
+                     name.data());
+        return EXIT_FAILURE;
+      }
+      backends.push_back(*it);
+    }
+  }
+  if (backends.empty()) {
+    backends = known;
+  }
+
+  uchiha::trace_file trace;
+  if (!trace.open(argv[1])) {
+    return EXIT_FAILURE;
+  }
+  std::printf("trace %s, frames %zu, %ux%u\n",
+              argv[1],
+              trace.frame_count(),
+              static_cast<unsigned>(trace.width()),
+              static_cast<unsigned>(trace.height()));
+  std::printf("%-20s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+              "backend",
+              "frames",
+              "p50 ms",
+              "p90 ms",
+              "p99 ms",
+              "max ms",
+              "gpu ms",
+              "draws",
+              "time");
+
+  // The frame times of the recording run, which include whatever the game
+  // did besides drawing. The last frame, the calls after the final
+  // swap_buffers(), has none.
+  std::vector<double> recorded_ms;
+  for (size_t i = 0; i < trace.frame_count(); ++i) {
+    if (trace.frame_seconds(i) > 0.f) {
+      recorded_ms.push_back(trace.frame_seconds(i) * 1000.0);
+    }
+  }
+  print_row("recording run", recorded_ms, "-", "-", "-");
+
+  // Total replay time relative to the first backend.
+  double baseline_ms = 0.0;
+  for (backend& b : backends) {
+    b.options.paced = paced;
+    replay_result result;
+    const bool complete = replay(trace, b, profile_prefix, result);
+    const double replay_ms = total(result.frame_ms);
+    if (baseline_ms == 0.0) {
+      baseline_ms = replay_ms;
+    }
+    char gpu[16];
+    char draws[16];
+    char relative[16];
+    std::snprintf(gpu, sizeof(gpu), "%.3f", result.gpu_ms);
+    std::snprintf(draws, sizeof(draws), "%.0f", result.draws_per_frame);
+    std::snprintf(relative,
+                  sizeof(relative),
+                  "%.2fx",
+                  baseline_ms > 0.0 ? replay_ms / baseline_ms : 0.0);
+    print_row(b.name, result.frame_ms, gpu, draws, relative);
+    if (!complete) {
+      std::fprintf(stderr, "warning: %s stopped early\n", b.name.c_str());
+      break;
+    }
+  }
+  return EXIT_SUCCESS;
+}
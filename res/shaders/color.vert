@@ -0,0 +1,16 @@
+#version 330 core
+layout (location = 0) in vec3 a_position;
+layout (location = 1) in vec4 a_color;
+
+layout (std140) uniform camera
+{
+   mat4 u_view_projection;
+};
+uniform mat4 u_model;
+
+out vec4 v_color;
+void main()
+{
+   v_color = a_color;
+   gl_Position = u_view_projection * u_model * vec4(a_position, 1.0);
+}
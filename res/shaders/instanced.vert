@@ -0,0 +1,32 @@
+#version 330 core
+// Instanced quads: every instance expands into a 4 vertex triangle strip,
+// with the corner derived from gl_VertexID.
+layout (location = 0) in vec4 i_position_scale;
+layout (location = 1) in float i_rotation;
+layout (location = 2) in vec4 i_uv_rect;
+layout (location = 3) in vec4 i_color;
+
+layout (std140) uniform camera
+{
+   mat4 u_view_projection;
+};
+uniform mat4 u_model;
+uniform vec4 u_texture_rect;
+
+out vec4 v_color;
+out vec2 v_tex_coord;
+void main()
+{
+   vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+   vec2 local = (corner - 0.5) * i_position_scale.zw;
+   float c = cos(i_rotation);
+   float s = sin(i_rotation);
+   vec2 position = vec2(c * local.x - s * local.y,
+                        s * local.x + c * local.y);
+   vec2 uv = mix(i_uv_rect.xy, i_uv_rect.zw,
+                 vec2(corner.x, 1.0 - corner.y));
+   v_color = i_color;
+   v_tex_coord = mix(u_texture_rect.xy, u_texture_rect.zw, uv);
+   gl_Position = u_view_projection * u_model *
+                 vec4(position + i_position_scale.xy, 0.0, 1.0);
+}
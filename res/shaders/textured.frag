@@ -0,0 +1,12 @@
+#version 330 core
+
+in vec4 v_color;
+in vec2 v_tex_coord;
+
+uniform sampler2D s_texture;
+out vec4 frag_color;
+
+void main()
+{
+    frag_color = texture(s_texture, v_tex_coord) * v_color;
+}
@@ -0,0 +1,29 @@
+#version 330 core
+// GLSL 3.30 only indexes sampler arrays with constants, hence the branches.
+// The slot is flat, so a triangle never diverges; the gradients are taken
+// outside the branches all the same so mipmapped textures stay defined.
+
+in vec4 v_color;
+in vec2 v_tex_coord;
+flat in uint v_texture_slot;
+
+uniform sampler2D s_textures[8];
+out vec4 frag_color;
+
+void main()
+{
+    vec2 dx = dFdx(v_tex_coord);
+    vec2 dy = dFdy(v_tex_coord);
+    vec4 texel;
+    switch (v_texture_slot) {
+    case 0u: texel = textureGrad(s_textures[0], v_tex_coord, dx, dy); break;
+    case 1u: texel = textureGrad(s_textures[1], v_tex_coord, dx, dy); break;
+    case 2u: texel = textureGrad(s_textures[2], v_tex_coord, dx, dy); break;
+    case 3u: texel = textureGrad(s_textures[3], v_tex_coord, dx, dy); break;
+    case 4u: texel = textureGrad(s_textures[4], v_tex_coord, dx, dy); break;
+    case 5u: texel = textureGrad(s_textures[5], v_tex_coord, dx, dy); break;
+    case 6u: texel = textureGrad(s_textures[6], v_tex_coord, dx, dy); break;
+    default: texel = textureGrad(s_textures[7], v_tex_coord, dx, dy); break;
+    }
+    frag_color = texel * v_color;
+}
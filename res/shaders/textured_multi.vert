@@ -0,0 +1,24 @@
+#version 330 core
+// Batches spanning several textures: every vertex names the sampler slot
+// its triangle reads from.
+layout (location = 0) in vec3 a_position;
+layout (location = 1) in vec4 a_color;
+layout (location = 2) in vec2 a_tex_coord;
+layout (location = 3) in uint a_texture_slot;
+
+layout (std140) uniform camera
+{
+   mat4 u_view_projection;
+};
+uniform mat4 u_model;
+
+out vec4 v_color;
+out vec2 v_tex_coord;
+flat out uint v_texture_slot;
+void main()
+{
+   v_color = a_color;
+   v_tex_coord = a_tex_coord;
+   v_texture_slot = a_texture_slot;
+   gl_Position = u_view_projection * u_model * vec4(a_position, 1.0);
+}
@@ -0,0 +1,564 @@
+#include "command_buffer.hxx"
+#include <cstring>
+
+namespace uchiha {
+
+namespace {
+
+size_t
+align_up(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t
+index_size(index_type type)
+{
+  return type == index_type::u16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+}
+
+void
+command_buffer::push(command_type type,
+                     const draw_arguments& args,
+                     const void* data,
+                     size_t data_size,
+                     const void* extra,
+                     size_t extra_size)
+{
+  const size_t args_at = align_up(sizeof(command_header), alignment);
+  const size_t data_at = align_up(args_at + sizeof(draw_arguments), alignment);
+  const size_t extra_at = align_up(data_at + data_size, alignment);
+  const size_t size = align_up(extra_at + extra_size, alignment);
+
+  size_t start = bytes.size();
+  bytes.resize(start + size);
+  uint8_t* at = bytes.data() + start;
+  command_header header{ type, static_cast<uint32_t>(size) };
+  std::memcpy(at, &header, sizeof(header));
+  std::memcpy(at + args_at, &args, sizeof(args));
+  if (data_size > 0) {
+    std::memcpy(at + data_at, data, data_size);
+  }
+  if (extra_size > 0) {
+    std::memcpy(at + extra_at, extra, extra_size);
+  }
+}
+
+void
+command_buffer::render(const triangle* triangles,
+                       size_t count,
+                       const texture* tex)
+{
+  draw_arguments args;
+  args.tex = tex;
+  args.count = count;
+  push(command_type::render_triangles,
+       args,
+       triangles,
+       count * sizeof(triangle));
+}
+
+void
+command_buffer::render(const vertex* vertices,
+                       size_t vertex_count,
+                       index_span indices,
+                       const texture* tex)
+{
+  draw_arguments args;
+  args.tex = tex;
+  args.count = vertex_count;
+  args.index_count = indices.count;
+  args.indices = indices.type;
+  push(command_type::render_indexed,
+       args,
+       vertices,
+       vertex_count * sizeof(vertex),
+       indices.data,
+       indices.count * index_size(indices.type));
+}
+
+void
+command_buffer::render(const packed_vertex* vertices,
+                       size_t vertex_count,
+                       index_span indices,
+                       const texture* tex)
+{
+  draw_arguments args;
+  args.tex = tex;
+  args.count = vertex_count;
+  args.index_count = indices.count;
+  args.indices = indices.type;
+  push(command_type::render_indexed_packed,
+       args,
+       vertices,
+       vertex_count * sizeof(packed_vertex),
+       indices.data,
+       indices.count * index_size(indices.type));
+}
+
+void
+command_buffer::render_instanced(const sprite_instance* instances,
+                                 size_t count,
+                                 const texture* tex)
+{
+  draw_arguments args;
+  args.tex = tex;
+  args.count = count;
+  push(command_type::render_instanced,
+       args,
+       instances,
+       count * sizeof(sprite_instance));
+}
+
+void
+command_buffer::render_quads(const sprite_instance* instances,
+                             size_t count,
+                             const texture* tex)
+{
+  draw_arguments args;
+  args.tex = tex;
+  args.count = count;
+  push(command_type::render_quads,
+       args,
+       instances,
+       count * sizeof(sprite_instance));
+}
+
+void
+command_buffer::begin_batch()
+{
+  push(command_type::begin_batch, draw_arguments(), nullptr, 0);
+}
+
+void
+command_buffer::submit(const triangle* triangles,
+                       size_t count,
+                       const texture* tex,
+                       blend_mode blend,
+                       int16_t layer)
+{
+  draw_arguments args;
+  args.tex = tex;
+  args.count = count;
+  args.blend = blend;
+  args.layer = layer;
+  push(command_type::submit, args, triangles, count * sizeof(triangle));
+}
+
+void
+command_buffer::submit_text(const font& f,
+                            std::string_view text,
+                            float x,
+                            float y,
+                            float scale,
+                            uint32_t rgba,
+                            blend_mode blend,
+                            int16_t layer)
+{
+  draw_arguments args;
+  args.count = text.size();
+  args.blend = blend;
+  args.layer = layer;
+  text_submission submission{ &f, x, y, scale, rgba };
+  push(command_type::submit_text,
+       args,
+       &submission,
+       sizeof(submission),
+       text.data(),
+       text.size());
+}
+
+void
+command_buffer::flush()
+{
+  push(command_type::flush, draw_arguments(), nullptr, 0);
+}
+
+void
+command_buffer::set_view_projection(const mat4& view_projection)
+{
+  push(command_type::set_view_projection,
+       draw_arguments(),
+       &view_projection,
+       sizeof(view_projection));
+}
+
+void
+command_buffer::set_model_transform(const mat4& model)
+{
+  push(
+    command_type::set_model_transform, draw_arguments(), &model, sizeof(model));
+}
+
+void
+command_buffer::update_mesh(mesh& m,
+                            size_t first_vertex,
+                            const vertex* vertices,
+                            size_t count)
+{
+  draw_arguments args;
+  args.count = count;
+  mesh_update update{ &m, first_vertex };
+  push(command_type::update_mesh,
+       args,
+       &update,
+       sizeof(update),
+       vertices,
+       count * sizeof(vertex));
+}
+
+void
+command_buffer::draw_mesh(const mesh& m,
+                          const texture* tex,
+                          const mat4& transform)
+{
+  draw_arguments args;
+  args.tex = tex;
+  mesh_draw draw{ &m, transform };
+  push(command_type::draw_mesh, args, &draw, sizeof(draw));
+}
+
+void
+command_buffer::destroy_mesh(mesh* m)
+{
+  push(command_type::destroy_mesh, draw_arguments(), &m, sizeof(m));
+}
+
+void
+command_buffer::destroy_font(font* f)
+{
+  push(command_type::destroy_font, draw_arguments(), &f, sizeof(f));
+}
+
+void
+command_buffer::release_texture(texture* t)
+{
+  push(command_type::release_texture, draw_arguments(), &t, sizeof(t));
+}
+
+void
+command_buffer::destroy_atlas(texture_atlas* atlas)
+{
+  push(command_type::destroy_atlas, draw_arguments(), &atlas, sizeof(atlas));
+}
+
+void
+command_buffer::set_render_target(render_target* t)
+{
+  push(command_type::set_render_target, draw_arguments(), &t, sizeof(t));
+}
+
+void
+command_buffer::destroy_render_target(render_target* t)
+{
+  push(command_type::destroy_render_target, draw_arguments(), &t, sizeof(t));
+}
+
+void
+command_buffer::clear(float r, float g, float b, float a)
+{
+  const float color[4] = { r, g, b, a };
+  push(command_type::clear, draw_arguments(), color, sizeof(color));
+}
+
+void
+command_buffer::invalidate_frame()
+{
+  push(command_type::invalidate_frame, draw_arguments(), nullptr, 0);
+}
+
+void
+command_buffer::set_resolution_scale(float scale)
+{
+  push(command_type::set_resolution_scale,
+       draw_arguments(),
+       &scale,
+       sizeof(scale));
+}
+
+void
+command_buffer::set_retained_mode(bool enabled)
+{
+  push(command_type::set_retained_mode,
+       draw_arguments(),
+       &enabled,
+       sizeof(enabled));
+}
+
+void
+command_buffer::set_culling_enabled(bool enabled)
+{
+  push(command_type::set_culling_enabled,
+       draw_arguments(),
+       &enabled,
+       sizeof(enabled));
+}
+
+void
+command_buffer::set_multi_texture_batching(bool enabled)
+{
+  push(command_type::set_multi_texture_batching,
+       draw_arguments(),
+       &enabled,
+       sizeof(enabled));
+}
+
+void
+command_buffer::destroy_particle_emitter(particle_emitter* e)
+{
+  push(
+    command_type::destroy_particle_emitter, draw_arguments(), &e, sizeof(e));
+}
+
+void
+command_buffer::move_particle_emitter(particle_emitter& e, float x, float y)
+{
+  emitter_command command{ &e, x, y };
+  push(command_type::move_particle_emitter,
+       draw_arguments(),
+       &command,
+       sizeof(command));
+}
+
+void
+command_buffer::emit_particles(particle_emitter& e, uint32_t count)
+{
+  draw_arguments args;
+  args.count = count;
+  emitter_command command{ &e, 0.f, 0.f };
+  push(command_type::emit_particles, args, &command, sizeof(command));
+}
+
+void
+command_buffer::update_particles(float seconds)
+{
+  push(
+    command_type::update_particles, draw_arguments(), &seconds, sizeof(seconds));
+}
+
+void
+command_buffer::draw_particles(const particle_emitter& e, const texture* tex)
+{
+  draw_arguments args;
+  args.tex = tex;
+  emitter_command command{ &e, 0.f, 0.f };
+  push(command_type::draw_particles, args, &command, sizeof(command));
+}
+
+void
+command_buffer::replay(engine& target) const
+{
+  const size_t args_at = align_up(sizeof(command_header), alignment);
+  const size_t data_at = align_up(args_at + sizeof(draw_arguments), alignment);
+
+  size_t offset = 0;
+  while (offset < bytes.size()) {
+    const uint8_t* at = bytes.data() + offset;
+    command_header header;
+    std::memcpy(&header, at, sizeof(header));
+    draw_arguments args;
+    std::memcpy(&args, at + args_at, sizeof(args));
+    const uint8_t* data = at + data_at;
+    const size_t count = static_cast<size_t>(args.count);
+
+    switch (header.type) {
+      case command_type::render_triangles: {
+        const triangle* t = reinterpret_cast<const triangle*>(data);
+        if (args.tex != nullptr) {
+          target.render(t, count, *args.tex);
+        } else {
+          target.render(t, count);
+        }
+        break;
+      }
+      case command_type::render_indexed:
+      case command_type::render_indexed_packed: {
+        const bool packed = header.type == command_type::render_indexed_packed;
+        const size_t vertex_bytes =
+          count * (packed ? sizeof(packed_vertex) : sizeof(vertex));
+        const uint8_t* index_data = data + align_up(vertex_bytes, alignment);
+        const size_t index_count = static_cast<size_t>(args.index_count);
+        index_span indices =
+          args.indices == index_type::u16
+            ? index_span(reinterpret_cast<const uint16_t*>(index_data),
+                         index_count)
+            : index_span(reinterpret_cast<const uint32_t*>(index_data),
+                         index_count);
+        if (packed) {
+          target.render(reinterpret_cast<const packed_vertex*>(data),
+                        count,
+                        indices,
+                        args.tex);
+        } else {
+          target.render(
+            reinterpret_cast<const vertex*>(data), count, indices, args.tex);
+        }
+        break;
+      }
+      case command_type::render_instanced:
+        target.render_instanced(
+          reinterpret_cast<const sprite_instance*>(data), count, args.tex);
+        break;
+      case command_type::render_quads:
+        target.render_quads(
+          reinterpret_cast<const sprite_instance*>(data), count, args.tex);
+        break;
+      case command_type::begin_batch:
+        target.begin_batch();
+        break;
+      case command_type::submit: {
+        const triangle* t = reinterpret_cast<const triangle*>(data);
+        if (args.tex != nullptr) {
+          target.submit(t, count, *args.tex, args.blend, args.layer);
+        } else {
+          target.submit(t, count, args.blend, args.layer);
+        }
+        break;
+      }
+      case command_type::submit_text: {
+        text_submission submission;
+        std::memcpy(&submission, data, sizeof(submission));
+        const char* text = reinterpret_cast<const char*>(
+          data + align_up(sizeof(submission), alignment));
+        target.submit_text(*submission.f,
+                           std::string_view(text, count),
+                           submission.x,
+                           submission.y,
+                           submission.scale,
+                           submission.rgba,
+                           args.blend,
+                           args.layer);
+        break;
+      }
+      case command_type::flush:
+        target.flush();
+        break;
+      case command_type::set_view_projection:
+      case command_type::set_model_transform: {
+        mat4 m;
+        std::memcpy(&m, data, sizeof(m));
+        if (header.type == command_type::set_view_projection) {
+          target.set_view_projection(m);
+        } else {
+          target.set_model_transform(m);
+        }
+        break;
+      }
+      case command_type::update_mesh: {
+        mesh_update update;
+        std::memcpy(&update, data, sizeof(update));
+        target.update_mesh(
+          *update.target,
+          static_cast<size_t>(update.first_vertex),
+          reinterpret_cast<const vertex*>(
+            data + align_up(sizeof(mesh_update), alignment)),
+          count);
+        break;
+      }
+      case command_type::draw_mesh: {
+        mesh_draw draw;
+        std::memcpy(&draw, data, sizeof(draw));
+        target.draw_mesh(*draw.target, args.tex, draw.transform);
+        break;
+      }
+      case command_type::destroy_font: {
+        font* f = nullptr;
+        std::memcpy(&f, data, sizeof(f));
+        target.destroy_font(f);
+        break;
+      }
+      case command_type::destroy_mesh: {
+        mesh* m = nullptr;
+        std::memcpy(&m, data, sizeof(m));
+        target.destroy_mesh(m);
+        break;
+      }
+      case command_type::release_texture: {
+        texture* t = nullptr;
+        std::memcpy(&t, data, sizeof(t));
+        target.release_texture(t);
+        break;
+      }
+      case command_type::destroy_atlas: {
+        texture_atlas* atlas = nullptr;
+        std::memcpy(&atlas, data, sizeof(atlas));
+        target.destroy_atlas(atlas);
+        break;
+      }
+      case command_type::set_render_target: {
+        render_target* t = nullptr;
+        std::memcpy(&t, data, sizeof(t));
+        target.set_render_target(t);
+        break;
+      }
+      case command_type::destroy_render_target: {
+        render_target* t = nullptr;
+        std::memcpy(&t, data, sizeof(t));
+        target.destroy_render_target(t);
+        break;
+      }
+      case command_type::clear: {
+        float color[4];
+        std::memcpy(color, data, sizeof(color));
+        target.clear(color[0], color[1], color[2], color[3]);
+        break;
+      }
+      case command_type::invalidate_frame:
+        target.invalidate_frame();
+        break;
+      case command_type::set_resolution_scale: {
+        float scale = 1.f;
+        std::memcpy(&scale, data, sizeof(scale));
+        target.set_resolution_scale(scale);
+        break;
+      }
+      case command_type::set_retained_mode:
+      case command_type::set_culling_enabled:
+      case command_type::set_multi_texture_batching: {
+        bool enabled = false;
+        std::memcpy(&enabled, data, sizeof(enabled));
+        if (header.type == command_type::set_retained_mode) {
+          target.set_retained_mode(enabled);
+        } else if (header.type == command_type::set_culling_enabled) {
+          target.set_culling_enabled(enabled);
+        } else {
+          target.set_multi_texture_batching(enabled);
+        }
+        break;
+      }
+      case command_type::destroy_particle_emitter: {
+        particle_emitter* e = nullptr;
+        std::memcpy(&e, data, sizeof(e));
+        target.destroy_particle_emitter(e);
+        break;
+      }
+      case command_type::move_particle_emitter:
+      case command_type::emit_particles:
+      case command_type::draw_particles: {
+        emitter_command command;
+        std::memcpy(&command, data, sizeof(command));
+        // Only draw_particles is handed a const emitter by the caller.
+        auto& e = const_cast<particle_emitter&>(*command.target);
+        if (header.type == command_type::move_particle_emitter) {
+          target.move_particle_emitter(e, command.x, command.y);
+        } else if (header.type == command_type::emit_particles) {
+          target.emit_particles(e, static_cast<uint32_t>(count));
+        } else {
+          target.draw_particles(e, args.tex);
+        }
+        break;
+      }
+      case command_type::update_particles: {
+        float seconds = 0.f;
+        std::memcpy(&seconds, data, sizeof(seconds));
+        target.update_particles(seconds);
+        break;
+      }
+    }
+    offset += header.size;
+  }
+}
+
+}
@@ -0,0 +1,177 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace uchiha {
+
+// Linear recording of engine draw calls. Vertex, index and instance data is
+// copied in next to each command, so the caller's arrays may be reused as
+// soon as the recording call returns; textures are referenced by pointer and
+// must stay alive until the frame has been replayed. clear() keeps the
+// storage, so once a buffer has reached its high-water mark recording no
+// longer allocates.
+class command_buffer
+{
+public:
+  void clear() { bytes.clear(); }
+  bool empty() const { return bytes.empty(); }
+
+  void render(const triangle* triangles, size_t count, const texture* tex);
+  void render(const vertex* vertices,
+              size_t vertex_count,
+              index_span indices,
+              const texture* tex);
+  void render(const packed_vertex* vertices,
+              size_t vertex_count,
+              index_span indices,
+              const texture* tex);
+  void render_instanced(const sprite_instance* instances,
+                        size_t count,
+                        const texture* tex);
+  void render_quads(const sprite_instance* instances,
+                    size_t count,
+                    const texture* tex);
+  void begin_batch();
+  void submit(const triangle* triangles,
+              size_t count,
+              const texture* tex,
+              blend_mode blend,
+              int16_t layer);
+  // The text is copied.
+  void submit_text(const font& f,
+                   std::string_view text,
+                   float x,
+                   float y,
+                   float scale,
+                   uint32_t rgba,
+                   blend_mode blend,
+                   int16_t layer);
+  void flush();
+  void set_view_projection(const mat4& view_projection);
+  void set_model_transform(const mat4& model);
+  // The mesh is referenced by pointer; the vertices are copied.
+  void update_mesh(mesh& m,
+                   size_t first_vertex,
+                   const vertex* vertices,
+                   size_t count);
+  void draw_mesh(const mesh& m, const texture* tex, const mat4& transform);
+  void destroy_mesh(mesh* m);
+  void destroy_font(font* f);
+  void release_texture(texture* t);
+  void destroy_atlas(texture_atlas* atlas);
+  void set_render_target(render_target* t);
+  void destroy_render_target(render_target* t);
+  void clear(float r, float g, float b, float a);
+  void invalidate_frame();
+  // Settings that change how the draws after them are issued.
+  void set_resolution_scale(float scale);
+  void set_retained_mode(bool enabled);
+  void set_culling_enabled(bool enabled);
+  void set_multi_texture_batching(bool enabled);
+  // Emitters are referenced by pointer, like meshes.
+  void destroy_particle_emitter(particle_emitter* e);
+  void move_particle_emitter(particle_emitter& e, float x, float y);
+  void emit_particles(particle_emitter& e, uint32_t count);
+  void update_particles(float seconds);
+  void draw_particles(const particle_emitter& e, const texture* tex);
+
+  // Issues every recorded command against target in recording order.
+  void replay(engine& target) const;
+
+private:
+  enum class command_type : uint8_t
+  {
+    render_triangles,
+    render_indexed,
+    render_indexed_packed,
+    render_instanced,
+    render_quads,
+    begin_batch,
+    submit,
+    submit_text,
+    flush,
+    set_view_projection,
+    set_model_transform,
+    update_mesh,
+    draw_mesh,
+    destroy_mesh,
+    destroy_font,
+    release_texture,
+    destroy_atlas,
+    set_render_target,
+    destroy_render_target,
+    clear,
+    invalidate_frame,
+    set_resolution_scale,
+    set_retained_mode,
+    set_culling_enabled,
+    set_multi_texture_batching,
+    destroy_particle_emitter,
+    move_particle_emitter,
+    emit_particles,
+    update_particles,
+    draw_particles
+  };
+
+  // Every command starts 8-byte aligned with this header; size covers the
+  // header, its arguments and the data that follows them.
+  struct command_header
+  {
+    command_type type;
+    uint32_t size;
+  };
+
+  struct draw_arguments
+  {
+    const texture* tex = nullptr;
+    uint64_t count = 0;
+    uint64_t index_count = 0;
+    index_type indices = index_type::u16;
+    blend_mode blend = blend_mode::alpha;
+    int16_t layer = 0;
+  };
+
+  struct mesh_update
+  {
+    mesh* target;
+    uint64_t first_vertex;
+  };
+
+  struct text_submission
+  {
+    const font* f;
+    float x;
+    float y;
+    float scale;
+    uint32_t rgba;
+  };
+
+  struct mesh_draw
+  {
+    const mesh* target;
+    mat4 transform;
+  };
+
+  struct emitter_command
+  {
+    const particle_emitter* target;
+    float x;
+    float y;
+  };
+
+  static constexpr size_t alignment = 8;
+
+  void push(command_type type,
+            const draw_arguments& args,
+            const void* data,
+            size_t data_size,
+            const void* extra = nullptr,
+            size_t extra_size = 0);
+
+  std::vector<uint8_t> bytes;
+};
+
+}
@@ -0,0 +1,373 @@
+#include "compressed_texture.hxx"
+#include "gl_ext.hxx"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace uchiha {
+
+namespace {
+
+struct format_info
+{
+  GLenum internal_format;
+  compression_family family;
+  uint32_t block_width;
+  uint32_t block_height;
+  uint32_t block_bytes;
+};
+
+// Extension enums that glad's 3.3 core header does not define.
+constexpr GLenum compressed_rgb_s3tc_dxt1 = 0x83F0;
+constexpr GLenum compressed_rgba_s3tc_dxt1 = 0x83F1;
+constexpr GLenum compressed_rgba_s3tc_dxt3 = 0x83F2;
+constexpr GLenum compressed_rgba_s3tc_dxt5 = 0x83F3;
+constexpr GLenum compressed_srgb_s3tc_dxt1 = 0x8C4C;
+constexpr GLenum compressed_srgb_alpha_s3tc_dxt1 = 0x8C4D;
+constexpr GLenum compressed_srgb_alpha_s3tc_dxt3 = 0x8C4E;
+constexpr GLenum compressed_srgb_alpha_s3tc_dxt5 = 0x8C4F;
+constexpr GLenum compressed_rgba_bptc_unorm = 0x8E8C;
+constexpr GLenum compressed_srgb_alpha_bptc_unorm = 0x8E8D;
+constexpr GLenum compressed_r11_eac = 0x9270;
+constexpr GLenum compressed_signed_r11_eac = 0x9271;
+constexpr GLenum compressed_rg11_eac = 0x9272;
+constexpr GLenum compressed_signed_rg11_eac = 0x9273;
+constexpr GLenum compressed_rgb8_etc2 = 0x9274;
+constexpr GLenum compressed_srgb8_etc2 = 0x9275;
+constexpr GLenum compressed_rgb8_punchthrough_alpha1_etc2 = 0x9276;
+constexpr GLenum compressed_srgb8_punchthrough_alpha1_etc2 = 0x9277;
+constexpr GLenum compressed_rgba8_etc2_eac = 0x9278;
+constexpr GLenum compressed_srgb8_alpha8_etc2_eac = 0x9279;
+constexpr GLenum compressed_rgba_astc_4x4 = 0x93B0;
+constexpr GLenum compressed_srgb8_alpha8_astc_4x4 = 0x93D0;
+
+constexpr uint32_t astc_block_sizes[14][2] = { { 4, 4 },   { 5, 4 },  { 5, 5 },
+                                               { 6, 5 },   { 6, 6 },  { 8, 5 },
+                                               { 8, 6 },   { 8, 8 },  { 10, 5 },
+                                               { 10, 6 },  { 10, 8 }, { 10, 10 },
+                                               { 12, 10 }, { 12, 12 } };
+
+format_info
+bc(GLenum f, compression_family family, uint32_t bytes)
+{
+  return format_info{ f, family, 4, 4, bytes };
+}
+
+bool
+format_from_vk(uint32_t vk_format, format_info& out)
+{
+  const compression_family s3tc = compression_family::s3tc;
+  const compression_family rgtc = compression_family::rgtc;
+  const compression_family bptc = compression_family::bptc;
+  const compression_family etc2 = compression_family::etc2;
+  switch (vk_format) {
+    case 131: out = bc(compressed_rgb_s3tc_dxt1, s3tc, 8); return true;
+    case 132: out = bc(compressed_srgb_s3tc_dxt1, s3tc, 8); return true;
+    case 133: out = bc(compressed_rgba_s3tc_dxt1, s3tc, 8); return true;
+    case 134: out = bc(compressed_srgb_alpha_s3tc_dxt1, s3tc, 8); return true;
+    case 135: out = bc(compressed_rgba_s3tc_dxt3, s3tc, 16); return true;
+    case 136: out = bc(compressed_srgb_alpha_s3tc_dxt3, s3tc, 16); return true;
+    case 137: out = bc(compressed_rgba_s3tc_dxt5, s3tc, 16); return true;
+    case 138: out = bc(compressed_srgb_alpha_s3tc_dxt5, s3tc, 16); return true;
+    case 139: out = bc(GL_COMPRESSED_RED_RGTC1, rgtc, 8); return true;
+    case 140: out = bc(GL_COMPRESSED_SIGNED_RED_RGTC1, rgtc, 8); return true;
+    case 141: out = bc(GL_COMPRESSED_RG_RGTC2, rgtc, 16); return true;
+    case 142: out = bc(GL_COMPRESSED_SIGNED_RG_RGTC2, rgtc, 16); return true;
+    case 145: out = bc(compressed_rgba_bptc_unorm, bptc, 16); return true;
+    case 146: out = bc(compressed_srgb_alpha_bptc_unorm, bptc, 16); return true;
+    case 147: out = bc(compressed_rgb8_etc2, etc2, 8); return true;
+    case 148: out = bc(compressed_srgb8_etc2, etc2, 8); return true;
+    case 149:
+      out = bc(compressed_rgb8_punchthrough_alpha1_etc2, etc2, 8);
+      return true;
+    case 150:
+      out = bc(compressed_srgb8_punchthrough_alpha1_etc2, etc2, 8);
+      return true;
+    case 151: out = bc(compressed_rgba8_etc2_eac, etc2, 16); return true;
+    case 152: out = bc(compressed_srgb8_alpha8_etc2_eac, etc2, 16); return true;
+    case 153: out = bc(compressed_r11_eac, etc2, 8); return true;
+    case 154: out = bc(compressed_signed_r11_eac, etc2, 8); return true;
+    case 155: out = bc(compressed_rg11_eac, etc2, 16); return true;
+    case 156: out = bc(compressed_signed_rg11_eac, etc2, 16); return true;
+    default:
+      break;
+  }
+  // VK_FORMAT_ASTC_4x4_UNORM_BLOCK .. VK_FORMAT_ASTC_12x12_SRGB_BLOCK
+  // alternate UNORM/SRGB in the same block order as the GL enums.
+  if (vk_format >= 157 && vk_format <= 184) {
+    uint32_t index = (vk_format - 157) / 2;
+    bool srgb = ((vk_format - 157) % 2) == 1;
+    out.internal_format =
+      (srgb ? compressed_srgb8_alpha8_astc_4x4 : compressed_rgba_astc_4x4) +
+      index;
+    out.family = compression_family::astc;
+    out.block_width = astc_block_sizes[index][0];
+    out.block_height = astc_block_sizes[index][1];
+    out.block_bytes = 16;
+    return true;
+  }
+  return false;
+}
+
+bool
+format_from_dxgi(uint32_t dxgi_format, format_info& out)
+{
+  switch (dxgi_format) {
+    case 71: return format_from_vk(133, out);
+    case 72: return format_from_vk(134, out);
+    case 74: return format_from_vk(135, out);
+    case 75: return format_from_vk(136, out);
+    case 77: return format_from_vk(137, out);
+    case 78: return format_from_vk(138, out);
+    case 80: return format_from_vk(139, out);
+    case 81: return format_from_vk(140, out);
+    case 83: return format_from_vk(141, out);
+    case 84: return format_from_vk(142, out);
+    case 98: return format_from_vk(145, out);
+    case 99: return format_from_vk(146, out);
+    default: return false;
+  }
+}
+
+uint32_t
+fourcc(char a, char b, char c, char d)
+{
+  return static_cast<uint32_t>(static_cast<uint8_t>(a)) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24);
+}
+
+template<typename T>
+T
+read_le(const uint8_t* data, size_t offset)
+{
+  T value = 0;
+  std::memcpy(&value, data + offset, sizeof(T));
+  return value;
+}
+
+size_t
+level_size(const format_info& f, uint32_t w, uint32_t h)
+{
+  size_t blocks_x = (w + f.block_width - 1) / f.block_width;
+  size_t blocks_y = (h + f.block_height - 1) / f.block_height;
+  return blocks_x * blocks_y * f.block_bytes;
+}
+
+bool
+parse_dds(compressed_image& img)
+{
+  const uint8_t* d = img.data;
+  const size_t header_size = 4 + 124;
+  if (img.size < header_size || read_le<uint32_t>(d, 0) != fourcc('D', 'D', 'S', ' ')) {
+    return false;
+  }
+  uint32_t height = read_le<uint32_t>(d, 12);
+  uint32_t width = read_le<uint32_t>(d, 16);
+  uint32_t mip_count = std::max<uint32_t>(1, read_le<uint32_t>(d, 28));
+  uint32_t pf_fourcc = read_le<uint32_t>(d, 84);
+
+  format_info f{};
+  size_t offset = header_size;
+  if (pf_fourcc == fourcc('D', 'X', '1', '0')) {
+    if (img.size < header_size + 20) {
+      return false;
+    }
+    uint32_t resource_dimension = read_le<uint32_t>(d, header_size + 4);
+    uint32_t array_size = read_le<uint32_t>(d, header_size + 12);
+    const uint32_t texture_2d = 3;
+    if (resource_dimension != texture_2d || array_size > 1 ||
+        !format_from_dxgi(read_le<uint32_t>(d, header_size), f)) {
+      return false;
+    }
+    offset += 20;
+  } else if (pf_fourcc == fourcc('D', 'X', 'T', '1')) {
+    format_from_vk(133, f);
+  } else if (pf_fourcc == fourcc('D', 'X', 'T', '3')) {
+    format_from_vk(135, f);
+  } else if (pf_fourcc == fourcc('D', 'X', 'T', '5')) {
+    format_from_vk(137, f);
+  } else if (pf_fourcc == fourcc('A', 'T', 'I', '1') ||
+             pf_fourcc == fourcc('B', 'C', '4', 'U')) {
+    format_from_vk(139, f);
+  } else if (pf_fourcc == fourcc('A', 'T', 'I', '2') ||
+             pf_fourcc == fourcc('B', 'C', '5', 'U')) {
+    format_from_vk(141, f);
+  } else {
+    return false;
+  }
+
+  img.internal_format = f.internal_format;
+  img.family = f.family;
+  img.width = width;
+  img.height = height;
+  uint32_t w = width;
+  uint32_t h = height;
+  for (uint32_t i = 0; i < mip_count; ++i) {
+    compressed_image::level l;
+    l.width = w;
+    l.height = h;
+    l.offset = offset;
+    l.size = level_size(f, w, h);
+    if (l.offset + l.size > img.size) {
+      break;
+    }
+    img.levels.push_back(l);
+    offset += l.size;
+    w = std::max<uint32_t>(1, w / 2);
+    h = std::max<uint32_t>(1, h / 2);
+  }
+  return !img.levels.empty();
+}
+
+bool
+parse_ktx2(compressed_image& img)
+{
+  static const uint8_t identifier[12] = { 0xAB, 'K',  'T',  'X',  ' ',  '2',
+                                          '0',  0xBB, '\r', '\n', 0x1A, '\n' };
+  const uint8_t* d = img.data;
+  const size_t level_index_offset = 80;
+  if (img.size < level_index_offset ||
+      std::memcmp(d, identifier, sizeof(identifier)) != 0) {
+    return false;
+  }
+  uint32_t vk_format = read_le<uint32_t>(d, 12);
+  uint32_t width = read_le<uint32_t>(d, 20);
+  uint32_t height = read_le<uint32_t>(d, 24);
+  uint32_t depth = read_le<uint32_t>(d, 28);
+  uint32_t layers = read_le<uint32_t>(d, 32);
+  uint32_t faces = read_le<uint32_t>(d, 36);
+  uint32_t level_count = std::max<uint32_t>(1, read_le<uint32_t>(d, 40));
+  uint32_t supercompression = read_le<uint32_t>(d, 44);
+
+  format_info f{};
+  if (depth > 1 || layers > 1 || faces != 1 || supercompression != 0 ||
+      !format_from_vk(vk_format, f)) {
+    return false;
+  }
+  if (img.size < level_index_offset + level_count * 24) {
+    return false;
+  }
+
+  img.internal_format = f.internal_format;
+  img.family = f.family;
+  img.width = width;
+  img.height = height;
+  for (uint32_t i = 0; i < level_count; ++i) {
+    size_t entry = level_index_offset + i * 24;
+    compressed_image::level l;
+    l.width = std::max<uint32_t>(1, width >> i);
+    l.height = std::max<uint32_t>(1, height >> i);
+    l.offset = static_cast<size_t>(read_le<uint64_t>(d, entry));
+    l.size = static_cast<size_t>(read_le<uint64_t>(d, entry + 8));
+    if (l.offset + l.size > img.size || l.size < level_size(f, l.width, l.height)) {
+      return false;
+    }
+    img.levels.push_back(l);
+  }
+  return true;
+}
+
+bool
+ends_with(std::string_view s, std::string_view suffix)
+{
+  if (s.size() < suffix.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < suffix.size(); ++i) {
+    char c = s[s.size() - suffix.size() + i];
+    if (c >= 'A' && c <= 'Z') {
+      c = static_cast<char>(c - 'A' + 'a');
+    }
+    if (c != suffix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+bool
+is_compressed_texture_path(std::string_view path)
+{
+  return ends_with(path, ".dds") || ends_with(path, ".ktx2");
+}
+
+bool
+load_compressed_image(std::string_view path, compressed_image& out)
+{
+  std::ifstream file(std::string(path), std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  std::streamsize size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  out.storage.resize(static_cast<size_t>(std::max<std::streamsize>(size, 0)));
+  if (!file.read(reinterpret_cast<char*>(out.storage.data()), size)) {
+    return false;
+  }
+  out.data = out.storage.data();
+  out.size = out.storage.size();
+  out.levels.clear();
+  return ends_with(path, ".ktx2") ? parse_ktx2(out) : parse_dds(out);
+}
+
+bool
+parse_compressed_image(std::string_view path,
+                       const uint8_t* data,
+                       size_t size,
+                       compressed_image& out)
+{
+  out.storage.clear();
+  out.data = data;
+  out.size = size;
+  out.levels.clear();
+  return ends_with(path, ".ktx2") ? parse_ktx2(out) : parse_dds(out);
+}
+
+bool
+is_compression_supported(compression_family family)
+{
+  switch (family) {
+    case compression_family::s3tc:
+      return gl_ext::has_texture_compression_s3tc;
+    case compression_family::rgtc:
+      return true;
+    case compression_family::bptc:
+      return gl_ext::has_texture_compression_bptc;
+    case compression_family::etc2:
+      return gl_ext::has_texture_compression_etc2;
+    case compression_family::astc:
+      return gl_ext::has_texture_compression_astc;
+  }
+  return false;
+}
+
+void
+upload_compressed_image(const compressed_image& image)
+{
+  for (size_t i = 0; i < image.levels.size(); ++i) {
+    const compressed_image::level& l = image.levels[i];
+    glCompressedTexImage2D(GL_TEXTURE_2D,
+                           static_cast<GLint>(i),
+                           image.internal_format,
+                           static_cast<GLsizei>(l.width),
+                           static_cast<GLsizei>(l.height),
+                           0,
+                           static_cast<GLsizei>(l.size),
+                           image.data + l.offset);
+  }
+  glTexParameteri(GL_TEXTURE_2D,
+                  GL_TEXTURE_MAX_LEVEL,
+                  static_cast<GLint>(image.levels.size()) - 1);
+  glTexParameteri(GL_TEXTURE_2D,
+                  GL_TEXTURE_MIN_FILTER,
+                  image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR
+                                          : GL_LINEAR);
+}
+
+}
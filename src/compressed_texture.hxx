@@ -0,0 +1,67 @@
+#pragma once
+#include "glad/glad.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace uchiha {
+
+// Block compression families; support for each is queried from the context
+// because only RGTC is part of GL 3.3 core.
+enum class compression_family : uint8_t
+{
+  s3tc,
+  rgtc,
+  bptc,
+  etc2,
+  astc
+};
+
+// Pre-compressed image parsed from a DDS or KTX2 container. Levels point
+// into data and are ordered from the base level down. data is storage for a
+// container read from a file, and the caller's memory otherwise.
+struct compressed_image
+{
+  struct level
+  {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    size_t offset = 0;
+    size_t size = 0;
+  };
+
+  GLenum internal_format = 0;
+  compression_family family = compression_family::s3tc;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<level> levels;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  std::vector<uint8_t> storage;
+};
+
+bool
+is_compressed_texture_path(std::string_view path);
+
+// Reads a .dds or .ktx2 file. Only 2D, single-layer, non-supercompressed
+// images in one of the block formats above are accepted.
+bool
+load_compressed_image(std::string_view path, compressed_image& out);
+// Same for a file already in memory, such as a resource pack entry, which
+// is parsed in place and has to outlive out; path only tells the container
+// apart.
+bool
+parse_compressed_image(std::string_view path,
+                       const uint8_t* data,
+                       size_t size,
+                       compressed_image& out);
+
+bool
+is_compression_supported(compression_family family);
+
+// Uploads every level into the texture bound to GL_TEXTURE_2D.
+void
+upload_compressed_image(const compressed_image& image);
+
+}
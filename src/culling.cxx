@@ -0,0 +1,104 @@
+#include "culling.hxx"
+#include <algorithm>
+
+namespace uchiha {
+
+namespace {
+
+enum outcode : unsigned
+{
+  outside_left = 1,
+  outside_right = 2,
+  outside_bottom = 4,
+  outside_top = 8,
+  // Set for points at or behind the eye, which are never treated as out.
+  behind = 16
+};
+
+unsigned
+classify(const mat4& clip, float x, float y, float z)
+{
+  const float* m = clip.m;
+  const float cx = m[0] * x + m[4] * y + m[8] * z + m[12];
+  const float cy = m[1] * x + m[5] * y + m[9] * z + m[13];
+  const float cw = m[3] * x + m[7] * y + m[11] * z + m[15];
+  if (cw <= 0.f) {
+    return behind;
+  }
+  unsigned code = 0;
+  code |= cx < -cw ? outside_left : 0u;
+  code |= cx > cw ? outside_right : 0u;
+  code |= cy < -cw ? outside_bottom : 0u;
+  code |= cy > cw ? outside_top : 0u;
+  return code;
+}
+
+// Outcodes of all corners and-ed together: non-zero when every corner is out
+// on a common side.
+bool
+all_outside(unsigned combined)
+{
+  return (combined & ~static_cast<unsigned>(behind)) != 0 &&
+         (combined & behind) == 0;
+}
+
+}
+
+bounds_3d
+compute_bounds(const vertex* vertices, size_t count)
+{
+  bounds_3d b;
+  if (count == 0) {
+    return b;
+  }
+  b.min[0] = b.max[0] = vertices[0].x;
+  b.min[1] = b.max[1] = vertices[0].y;
+  b.min[2] = b.max[2] = vertices[0].z;
+  for (size_t i = 1; i < count; ++i) {
+    const vertex& v = vertices[i];
+    b.min[0] = std::min(b.min[0], v.x);
+    b.min[1] = std::min(b.min[1], v.y);
+    b.min[2] = std::min(b.min[2], v.z);
+    b.max[0] = std::max(b.max[0], v.x);
+    b.max[1] = std::max(b.max[1], v.y);
+    b.max[2] = std::max(b.max[2], v.z);
+  }
+  return b;
+}
+
+void
+merge_bounds(bounds_3d& into, const bounds_3d& other)
+{
+  for (int i = 0; i < 3; ++i) {
+    into.min[i] = std::min(into.min[i], other.min[i]);
+    into.max[i] = std::max(into.max[i], other.max[i]);
+  }
+}
+
+bool
+is_visible(const bounds_3d& box, const mat4& clip)
+{
+  unsigned combined = ~0u;
+  for (int corner = 0; corner < 8; ++corner) {
+    combined &= classify(clip,
+                         (corner & 1) ? box.max[0] : box.min[0],
+                         (corner & 2) ? box.max[1] : box.min[1],
+                         (corner & 4) ? box.max[2] : box.min[2]);
+    if (combined == 0) {
+      return true;
+    }
+  }
+  return !all_outside(combined);
+}
+
+bool
+is_visible(const triangle& t, const mat4& clip)
+{
+  const vertex* v = t.v;
+  const unsigned combined = classify(clip, v[0].x, v[0].y, v[0].z) &
+                            classify(clip, v[1].x, v[1].y, v[1].z) &
+                            classify(clip, v[2].x, v[2].y, v[2].z);
+  return !all_outside(combined);
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+
+namespace uchiha {
+
+// Box in object space, used for mesh bounds.
+struct bounds_3d
+{
+  float min[3] = { 0.f, 0.f, 0.f };
+  float max[3] = { 0.f, 0.f, 0.f };
+};
+
+bounds_3d
+compute_bounds(const vertex* vertices, size_t count);
+
+void
+merge_bounds(bounds_3d& into, const bounds_3d& other);
+
+// A primitive is culled when all of its corners lie outside the same side
+// of the clip volume's x or y range once transformed by clip. That is exact
+// for triangles that do not straddle a corner of the view, and never culls
+// anything visible. Corners with w <= 0 keep the primitive.
+bool
+is_visible(const bounds_3d& box, const mat4& clip);
+
+bool
+is_visible(const triangle& t, const mat4& clip);
+
+}
@@ -0,0 +1,197 @@
+#include "dirty_regions.hxx"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace uchiha {
+
+bool
+overlaps(const pixel_rect& a, const pixel_rect& b)
+{
+  return a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+}
+
+pixel_rect
+merge(const pixel_rect& a, const pixel_rect& b)
+{
+  pixel_rect r;
+  r.x0 = std::min(a.x0, b.x0);
+  r.y0 = std::min(a.y0, b.y0);
+  r.x1 = std::max(a.x1, b.x1);
+  r.y1 = std::max(a.y1, b.y1);
+  return r;
+}
+
+pixel_rect
+screen_bounds(const vertex* vertices,
+              size_t count,
+              const mat4& clip,
+              int32_t width,
+              int32_t height)
+{
+  if (count == 0) {
+    return pixel_rect();
+  }
+  const float* m = clip.m;
+  float min_x = std::numeric_limits<float>::max();
+  float min_y = min_x;
+  float max_x = -min_x;
+  float max_y = -min_x;
+  for (size_t i = 0; i < count; ++i) {
+    const vertex& v = vertices[i];
+    const float cx = m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12];
+    const float cy = m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13];
+    const float cw = m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15];
+    if (cw <= 0.f) {
+      return pixel_rect{ 0, 0, width, height };
+    }
+    const float x = cx / cw;
+    const float y = cy / cw;
+    min_x = std::min(min_x, x);
+    min_y = std::min(min_y, y);
+    max_x = std::max(max_x, x);
+    max_y = std::max(max_y, y);
+  }
+  // From normalized device coordinates to pixels, clamped before the
+  // conversion to integers so far away geometry cannot overflow it.
+  auto to_pixels = [](float ndc, int32_t size) {
+    const float extent = static_cast<float>(size);
+    return std::clamp((ndc * 0.5f + 0.5f) * extent, -1.f, extent + 1.f);
+  };
+  auto low = [&](float ndc, int32_t size) {
+    return std::max(
+      static_cast<int32_t>(std::floor(to_pixels(ndc, size))) - 1, 0);
+  };
+  auto high = [&](float ndc, int32_t size) {
+    return std::min(
+      static_cast<int32_t>(std::ceil(to_pixels(ndc, size))) + 1, size);
+  };
+  pixel_rect r;
+  r.x0 = low(min_x, width);
+  r.y0 = low(min_y, height);
+  r.x1 = high(max_x, width);
+  r.y1 = high(max_y, height);
+  return r;
+}
+
+uint64_t
+content_hash(uint64_t h, const void* data, size_t size)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  size_t i = 0;
+  for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+    uint32_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    h ^= word;
+    h *= 0x100000001b3ull;
+  }
+  for (; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+void
+dirty_tracker::add(uint64_t hash, const pixel_rect& bounds)
+{
+  current.push_back(item{ hash, bounds });
+}
+
+void
+dirty_tracker::mark(pixel_rect r)
+{
+  if (r.empty()) {
+    return;
+  }
+  // Whatever r overlaps is folded into it, so the regions stay disjoint and
+  // no pixel is repainted twice.
+  for (size_t i = 0; i < regions.size();) {
+    if (overlaps(regions[i], r)) {
+      r = merge(r, regions[i]);
+      regions[i] = regions.back();
+      regions.pop_back();
+      i = 0;
+    } else {
+      ++i;
+    }
+  }
+  regions.push_back(r);
+}
+
+void
+dirty_tracker::reduce(int32_t width, int32_t height)
+{
+  // Each region costs a pass over the batches, so past max_regions the pair
+  // whose union adds the fewest pixels is merged.
+  while (regions.size() > max_regions) {
+    size_t best_a = 0;
+    size_t best_b = 1;
+    int64_t best_growth = std::numeric_limits<int64_t>::max();
+    for (size_t a = 0; a < regions.size(); ++a) {
+      for (size_t b = a + 1; b < regions.size(); ++b) {
+        const int64_t growth = merge(regions[a], regions[b]).area() -
+                               regions[a].area() - regions[b].area();
+        if (growth < best_growth) {
+          best_growth = growth;
+          best_a = a;
+          best_b = b;
+        }
+      }
+    }
+    const pixel_rect merged = merge(regions[best_a], regions[best_b]);
+    regions.erase(regions.begin() + best_b);
+    regions.erase(regions.begin() + best_a);
+    mark(merged);
+  }
+
+  int64_t dirty = 0;
+  for (const pixel_rect& r : regions) {
+    dirty += r.area();
+  }
+  if (dirty * 2 > int64_t(width) * height) {
+    regions.assign(1, pixel_rect{ 0, 0, width, height });
+  }
+}
+
+const std::vector<pixel_rect>&
+dirty_tracker::end_frame(int32_t width, int32_t height)
+{
+  regions.clear();
+  if (width != last_width || height != last_height) {
+    everything = true;
+  }
+  if (everything) {
+    const pixel_rect full{ 0, 0, width, height };
+    if (!full.empty()) {
+      regions.push_back(full);
+    }
+  } else {
+    // The hash covers the transform and the vertices, so equal hashes also
+    // mean equal bounds.
+    const size_t count = std::max(previous.size(), current.size());
+    for (size_t i = 0; i < count; ++i) {
+      const bool had = i < previous.size();
+      const bool has = i < current.size();
+      if (had && has && previous[i].hash == current[i].hash) {
+        continue;
+      }
+      if (had) {
+        mark(previous[i].bounds);
+      }
+      if (has) {
+        mark(current[i].bounds);
+      }
+    }
+    reduce(width, height);
+  }
+  everything = false;
+  last_width = width;
+  last_height = height;
+  previous.swap(current);
+  current.clear();
+  return regions;
+}
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace uchiha {
+
+// Pixels [x0, x1) x [y0, y1) of a viewport, with the origin at the bottom
+// left as glScissor() expects.
+struct pixel_rect
+{
+  int32_t x0 = 0;
+  int32_t y0 = 0;
+  int32_t x1 = 0;
+  int32_t y1 = 0;
+
+  bool empty() const { return x0 >= x1 || y0 >= y1; }
+  int64_t area() const
+  {
+    return empty() ? 0 : int64_t(x1 - x0) * (y1 - y0);
+  }
+};
+
+bool
+overlaps(const pixel_rect& a, const pixel_rect& b);
+
+pixel_rect
+merge(const pixel_rect& a, const pixel_rect& b);
+
+// Pixels of a width x height viewport that vertices can touch once
+// transformed by clip, grown by a pixel for rasterization and filtering
+// at the edges. Vertices with w <= 0 cover the whole viewport.
+pixel_rect
+screen_bounds(const vertex* vertices,
+              size_t count,
+              const mat4& clip,
+              int32_t width,
+              int32_t height);
+
+// FNV-1a over 32-bit words, with the tail bytes mixed in one at a time.
+uint64_t
+content_hash(uint64_t h, const void* data, size_t size);
+
+constexpr uint64_t content_hash_seed = 0xcbf29ce484222325ull;
+
+// Finds what changed between two frames of a retained scene. Each frame
+// reports its items in draw order as a hash of everything that decides how
+// the item looks plus the pixels it covers. Item i is compared with item i
+// of the previous frame; where they differ, or one frame has no item i,
+// both footprints have to be repainted.
+class dirty_tracker
+{
+public:
+  void add(uint64_t hash, const pixel_rect& bounds);
+  // Makes the whole viewport dirty at the next end_frame(), for changes the
+  // hashes cannot see.
+  void invalidate() { everything = true; }
+
+  // Compares the items added since the previous call with the ones before
+  // them and returns the regions to repaint: disjoint, at most max_regions,
+  // and a single full-viewport rectangle once they would cover most of it.
+  // Empty when nothing changed.
+  const std::vector<pixel_rect>& end_frame(int32_t width, int32_t height);
+
+  static constexpr size_t max_regions = 8;
+
+private:
+  struct item
+  {
+    uint64_t hash = 0;
+    pixel_rect bounds;
+  };
+
+  void mark(pixel_rect r);
+  void reduce(int32_t width, int32_t height);
+
+  std::vector<item> previous;
+  std::vector<item> current;
+  std::vector<pixel_rect> regions;
+  bool everything = true;
+  int32_t last_width = 0;
+  int32_t last_height = 0;
+};
+
+}
@@ -1,7 +1,44 @@
 #include "engine.hxx"
+#include "compressed_texture.hxx"
+#include "culling.hxx"
+#include "dirty_regions.hxx"
+#include "engine_trace.hxx"
+#include "font.hxx"
+#include "frame_arena.hxx"
+#include "frame_capture.hxx"
+#include "frame_pacer.hxx"
+#include "gl_ext.hxx"
+#include "gl_state.hxx"
+#include "input.hxx"
+#include "job_system.hxx"
+#include "mesh_impl.hxx"
+#include "particles.hxx"
+#include "profiler.hxx"
+#include "quad_builder.hxx"
+#include "render_target.hxx"
+#include "resource_pack.hxx"
+#include "shader.hxx"
+#include "shader_cache.hxx"
+#include "slot_map.hxx"
 #include "glad/glad.h"
+#include "sprite_batch.hxx"
+#include "stream_buffer.hxx"
+#include "text_layout.hxx"
+#include "texture_atlas.hxx"
+#include "texture_impl.hxx"
+#include "texture_loader.hxx"
+#include "texture_registry.hxx"
+#include "threaded_engine.hxx"
+#include "vertex_format.hxx"
 #include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
@@ -10,125 +47,353 @@
 
 uchiha::engine::~engine() {}
 
-namespace uchiha {
-class shader
+uchiha::texture::~texture() {}
+
+uchiha::uv_rect
+uchiha::texture::get_uv_rect() const
 {
-  GLuint vertex_shader = 0;
-  GLuint fragment_shader = 0;
-  GLuint program = 0;
+  return uchiha::uv_rect();
+}
 
-  bool init_shader(GLuint shader, const char* shader_src)
-  {
-    glShaderSource(shader, 1, &shader_src, nullptr);
-    glCompileShader(shader);
-
-    GLint compile_status = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
-    if (compile_status == 0) {
-      GLint info_len = 0;
-      glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_len);
-      std::vector<char> info(static_cast<size_t>(info_len));
-      glGetShaderInfoLog(shader, info_len, nullptr, info.data());
-      glDeleteShader(shader);
-      return false;
-    }
-    return true;
-  }
+bool
+uchiha::texture::is_ready() const
+{
+  return true;
+}
 
-public:
-  shader(const char* vertex_shader_src,
-         const char* fragment_shader_src,
-         const std::vector<std::tuple<GLuint, const GLchar*>>& attributes)
-  {
-    vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-    if (!init_shader(vertex_shader, vertex_shader_src)) {
-      std::cerr << "error: Failed to create vertex shader ( engine.cxx:  )"
-                << std::endl;
-    }
+uchiha::texture_atlas::~texture_atlas() {}
 
-    fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-    if (!init_shader(fragment_shader, fragment_shader_src)) {
-      std::cerr << "error: Failed to create fragment shader ( engine.cxx:  )"
-                << std::endl;
-    }
-    program = glCreateProgram();
-    if (program == 0) {
-      std::cerr << "error: Failed to create program ( engine.cxx:  )"
-                << std::endl;
-    }
+uchiha::font::~font() {}
 
-    glAttachShader(program, vertex_shader);
-    glAttachShader(program, fragment_shader);
-    for (const auto& attr : attributes) {
-      GLuint loc = std::get<0>(attr);
-      const GLchar* attr_name = std::get<1>(attr);
-      glBindAttribLocation(program, loc, attr_name);
-    }
-    glLinkProgram(program);
-
-    GLint linked_status = 0;
-    glGetProgramiv(program, GL_LINK_STATUS, &linked_status);
-
-    if (linked_status == 0) {
-      GLint infoLen = 0;
-      glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
-      std::vector<char> infoLog(static_cast<size_t>(infoLen));
-      glGetProgramInfoLog(program, infoLen, nullptr, infoLog.data());
-      glDeleteProgram(program);
-      std::cerr << "error: Failed to link program ( engine.cxx:  )" << infoLen
-                << std::endl;
-    }
-  }
+uchiha::mesh::~mesh() {}
 
-  void use() { glUseProgram(program); }
-  void set_uniform(std::string_view attr, const texture& t)
-  {
-    int location = glGetUniformLocation(program, attr.data());
-    glActiveTexture(GL_TEXTURE0 + t.get_handle());
-    glBindTexture(GL_TEXTURE_2D, t.get_handle());
-    glUniform1i(location, 0 + t.get_handle());
-  }
-};
+uchiha::render_target::~render_target() {}
+
+// Attributes 0-2 of uchiha::vertex, read from the bound GL_ARRAY_BUFFER.
+// stride is larger when the vertex is embedded in another layout.
+static void
+set_vertex_attributes(GLsizei stride = sizeof(uchiha::vertex))
+{
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0,
+                        3,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        stride,
+                        reinterpret_cast<void*>(offsetof(uchiha::vertex, x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1,
+                        4,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        stride,
+                        reinterpret_cast<void*>(offsetof(uchiha::vertex, r)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2,
+                        2,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        stride,
+                        reinterpret_cast<void*>(offsetof(uchiha::vertex, tx)));
 }
 
-uchiha::texture::~texture() {}
+// Indices into engine_impl::shaders; sprite keys carry them as the program.
+static constexpr uint32_t color_program = 0;
+static constexpr uint32_t textured_program = 1;
+static constexpr uint32_t instanced_program = 2;
+static constexpr uint32_t multi_texture_program = 3;
+static constexpr uint32_t program_count = 4;
 
-class texture_impl : public uchiha::texture
+static bool
+is_full_uv_rect(const uchiha::uv_rect& uv)
 {
-  uint16_t texture_width = 0;
-  uint16_t texture_height = 0;
-  GLuint textrure_handle = 0;
-
-public:
-  texture_impl(uint16_t width, uint16_t height, GLuint handle)
-    : texture_width(width)
-    , texture_height(height)
-    , textrure_handle(handle)
-  {}
-  uint16_t get_width() const override { return texture_width; }
-  uint16_t get_height() const override { return texture_height; }
-  uint32_t get_handle() const override { return textrure_handle; }
-};
+  return uv.u0 == 0.f && uv.v0 == 0.f && uv.u1 == 1.f && uv.v1 == 1.f;
+}
 
 class engine_impl : public uchiha::engine
 {
+  friend bool uchiha::make_context_current(uchiha::engine&, bool);
+
   SDL_Window* window = nullptr;
   uint16_t window_width = 0;
   uint16_t window_height = 0;
   SDL_GLContext context = nullptr;
-  uint32_t gl_default_vbo = 0;
+  uint32_t stream_buffer_budget = 4 * 1024 * 1024;
+  uchiha::stream_buffer vertex_stream;
+  uchiha::stream_buffer index_stream;
+  uchiha::sprite_batch batch;
+  uchiha::frame_arena frame_memory;
+  uchiha::input_queue input;
+  uchiha::frame_pacer pacer;
+  uchiha::shader_cache program_cache;
+  // Owned by program_cache.
   std::vector<uchiha::shader*> shaders;
-  GLuint vertex_attribute_object = 0;
+  // Backs the "camera" uniform block at shader::camera_binding.
+  GLuint camera_buffer = 0;
+  uchiha::mat4 view_projection;
+  uchiha::mat4 model_transform;
+  // view_projection * model_transform, what submit() culls against.
+  uchiha::mat4 clip_transform;
+  bool culling_enabled = true;
+  // flush() draws with the multi-texture program where runs of different
+  // textures can be merged.
+  bool multi_texture_batching = true;
+  // Where draws go; nullptr is the frame, which is offscreen_frame when the
+  // resolution scale is not 1 or retained mode is on, and the window
+  // otherwise.
+  uchiha::render_target_impl* current_target = nullptr;
+  uchiha::render_target_impl* offscreen_frame = nullptr;
+  float resolution_scale = 1.f;
+  // Everything create_mesh() and create_render_target() handed out, so
+  // destroy() frees what the game did not.
+  uchiha::object_pool<uchiha::mesh_impl, uchiha::mesh> meshes;
+  uchiha::object_pool<uchiha::render_target_impl, uchiha::render_target>
+    render_targets;
+  // Retained mode keeps the batches flushed into the frame until
+  // swap_buffers() repaints the regions that differ from the last frame.
+  struct retained_batch
+  {
+    uchiha::mat4 view_projection;
+    uchiha::mat4 model_transform;
+    uint32_t first_vertex = 0;
+    uint32_t vertex_count = 0;
+    uint32_t first_group = 0;
+    uint32_t group_count = 0;
+    uchiha::pixel_rect bounds;
+  };
+  // One submit() into the batch being collected, as its range of the
+  // staged vertices and a hash of its GL state.
+  struct retained_item
+  {
+    uint32_t first_vertex = 0;
+    uint32_t vertex_count = 0;
+    uint64_t state = 0;
+  };
+  bool retained = false;
+  float retained_background[4] = { 0.f, 0.f, 1.f, 1.f };
+  uchiha::dirty_tracker dirty;
+  std::vector<retained_item> retained_items;
+  std::vector<retained_batch> retained_batches;
+  std::vector<uchiha::vertex> retained_vertices;
+  std::vector<uchiha::sprite_batch::group> retained_groups;
+  std::vector<GLint> retained_offsets;
+  uint32_t regions_redrawn = 0;
+  uint64_t pixels_redrawn = 0;
+  uchiha::texture_impl* white_texture = nullptr;
+  uchiha::texture_impl* placeholder_texture = nullptr;
+  // Worker threads for every subsystem that runs work in the background.
+  uchiha::job_system jobs;
+  uchiha::texture_loader loader;
+  uchiha::texture_registry textures;
+  uchiha::object_pool<uchiha::texture_atlas_impl, uchiha::texture_atlas>
+    atlases;
+  // Searched from the back. Packs stay mapped until destroy(), as pending
+  // loads read from them.
+  std::vector<uchiha::resource_pack*> packs;
+  std::vector<uint8_t> resource_scratch;
+  // Created with the first font.
+  uchiha::glyph_atlas* glyphs = nullptr;
+  uchiha::object_pool<uchiha::font_impl, uchiha::font> fonts;
+  uchiha::text_layout_cache text_layouts;
+  std::vector<uchiha::sprite_instance> text_quads;
+  std::vector<uchiha::vertex> text_vertices;
+  uchiha::particle_system particles;
+  uchiha::frame_capture capture;
+  uchiha::trace_writer call_trace;
+  float texture_upload_budget_ms = 2.f;
+  uchiha::gl_state state;
+  // One VAO per streamed layout with attributes fixed at offset 0 of the
+  // streams; draws select their data with first/base vertex instead.
+  GLuint vertex_arrays[uchiha::vertex_format_count] = {};
+  uint32_t vertex_stream_generation = 0;
+  uint32_t index_stream_generation = 0;
 
 public:
   bool init(uint16_t ww, uint16_t wh, bool fullscreen = false) override;
+  void set_stream_buffer_budget(uint32_t bytes) override;
   bool read_input(uchiha::event& e) override;
+  void poll_events() override;
+  const uchiha::input_state& get_input() const override;
+  bool mount_resource_pack(std::string_view path) override;
   uchiha::texture* create_texture(std::string_view path) override;
-  void render(const std::vector<uchiha::triangle>& vertex_buffer) override;
-  void render(const std::vector<uchiha::triangle>& vertex_buffer,
+  uchiha::texture* create_texture_async(std::string_view path) override;
+  void set_texture_upload_budget(float milliseconds) override;
+  uchiha::texture_atlas* create_atlas(uint16_t page_width,
+                                      uint16_t page_height) override;
+  uchiha::texture* create_texture(std::string_view path,
+                                  uchiha::texture_atlas& atlas) override;
+  void destroy_atlas(uchiha::texture_atlas* atlas) override;
+  void release_texture(uchiha::texture* t) override;
+  void set_texture_budget(uint64_t bytes) override;
+  uchiha::font* create_font(std::string_view path,
+                            uint16_t pixel_size) override;
+  void destroy_font(uchiha::font* f) override;
+  using uchiha::engine::create_mesh;
+  using uchiha::engine::render;
+  using uchiha::engine::set_vsync;
+  using uchiha::engine::submit;
+
+  uchiha::mesh* create_mesh(const uchiha::vertex* vertices,
+                            size_t vertex_count,
+                            uchiha::index_span indices,
+                            uchiha::mesh_usage usage) override;
+  bool update_mesh(uchiha::mesh& m,
+                   size_t first_vertex,
+                   const uchiha::vertex* vertices,
+                   size_t count) override;
+  void draw_mesh(const uchiha::mesh& m,
+                 const uchiha::texture* t,
+                 const uchiha::mat4& transform) override;
+  void destroy_mesh(uchiha::mesh* m) override;
+  uchiha::render_target* create_render_target(uint16_t width,
+                                              uint16_t height) override;
+  void destroy_render_target(uchiha::render_target* t) override;
+  void set_render_target(uchiha::render_target* t) override;
+  void clear(float r, float g, float b, float a) override;
+  bool set_resolution_scale(float scale) override;
+  bool set_retained_mode(bool enabled) override;
+  void invalidate_frame() override;
+
+  void render(const uchiha::triangle* triangles, size_t count) override;
+  void render(const uchiha::triangle* triangles,
+              size_t count,
               const uchiha::texture& t) override;
+  void render(const uchiha::vertex* vertices,
+              size_t vertex_count,
+              uchiha::index_span indices,
+              const uchiha::texture* t) override;
+  void render(const uchiha::packed_vertex* vertices,
+              size_t vertex_count,
+              uchiha::index_span indices,
+              const uchiha::texture* t) override;
+  void render_instanced(const uchiha::sprite_instance* instances,
+                        size_t count,
+                        const uchiha::texture* t) override;
+  void render_quads(const uchiha::sprite_instance* instances,
+                    size_t count,
+                    const uchiha::texture* t) override;
+  void begin_batch() override;
+  void submit(const uchiha::triangle* triangles,
+              size_t count,
+              uchiha::blend_mode blend,
+              int16_t layer) override;
+  void submit(const uchiha::triangle* triangles,
+              size_t count,
+              const uchiha::texture& t,
+              uchiha::blend_mode blend,
+              int16_t layer) override;
+  void submit_text(const uchiha::font& f,
+                   std::string_view text,
+                   float x,
+                   float y,
+                   float scale,
+                   uint32_t rgba,
+                   uchiha::blend_mode blend,
+                   int16_t layer) override;
+  uchiha::aabb measure_text(const uchiha::font& f,
+                            std::string_view text,
+                            float x,
+                            float y,
+                            float scale) override;
+  void flush() override;
   void swap_buffers() override;
+  uchiha::particle_emitter* create_particle_emitter(
+    const uchiha::particle_settings& settings,
+    float x,
+    float y) override;
+  void destroy_particle_emitter(uchiha::particle_emitter* e) override;
+  void move_particle_emitter(uchiha::particle_emitter& e,
+                             float x,
+                             float y) override;
+  void emit_particles(uchiha::particle_emitter& e, uint32_t count) override;
+  void update_particles(float seconds) override;
+  void draw_particles(const uchiha::particle_emitter& e,
+                      const uchiha::texture* t) override;
+  void set_view_projection(const uchiha::mat4& view_projection) override;
+  void set_model_transform(const uchiha::mat4& model) override;
+  void set_culling_enabled(bool enabled) override;
+  void set_multi_texture_batching(bool enabled) override;
+  void* allocate_frame_memory(size_t bytes, size_t alignment) override;
+
+  bool set_vsync(uchiha::vsync_mode mode) override;
+  void set_frame_rate_limit(float frames_per_second) override;
+  double get_frame_seconds() const override;
+  void set_shader_hot_reload(bool enabled) override;
+
+  void set_profiling_enabled(bool enabled) override;
+  uchiha::frame_stats get_frame_stats() const override;
+  bool write_profile_trace(std::string_view path) override;
+  void save_screenshot(std::string_view path) override;
+  bool start_recording(std::string_view path) override;
+  void stop_recording() override;
+  bool start_trace(std::string_view path) override;
+  void stop_trace() override;
   void destroy() override;
+
+private:
+  // Entry of the last mounted pack that has path.
+  bool find_resource(std::string_view path, uchiha::resource_data& out) const;
+  // Loads without looking at the registry; bytes receives the estimated
+  // GPU memory of the result.
+  uchiha::texture_impl* load_texture(std::string_view path, uint64_t& bytes);
+  uchiha::texture_impl* load_compressed_texture(std::string_view path,
+                                                uint64_t& bytes);
+  void reload_texture(uchiha::texture_impl& target, const std::string& path);
+  // Draws count instances written to the vertex stream at offset with the
+  // instanced program, which the caller has set up.
+  void draw_instances(size_t offset, size_t count);
+  void delete_mesh_objects(uchiha::mesh_impl& m);
+  // Marks t as drawn this frame, reloading it first if it had been evicted.
+  void touch_texture(const uchiha::texture& t);
+  // Binds t to the sampler of s after touch_texture().
+  void set_texture_uniform(uchiha::shader* s, const uchiha::texture& t);
+  // The same for one slot of the multi-texture program.
+  void set_texture_uniform(uchiha::shader* s,
+                           size_t slot,
+                           const uchiha::texture& t);
+  // Binds the framebuffer of current_target and sets the viewport to it.
+  void bind_current_target();
+  // Recreates offscreen_frame for the resolution scale and retained mode.
+  // Returns false when one is needed but cannot be created.
+  bool update_offscreen_frame();
+  // Retained mode with the frame as the target: batches are kept for
+  // swap_buffers() and immediate draws are dropped.
+  bool retaining() const { return retained && current_target == nullptr; }
+  void record_retained_item(size_t first_vertex,
+                            uint32_t program,
+                            const uchiha::texture* t,
+                            uchiha::blend_mode blend,
+                            int16_t layer);
+  // What both submit() overloads and submit_text() add to the batch.
+  void batch_triangles(const uchiha::triangle* triangles,
+                       size_t count,
+                       const uchiha::texture* t,
+                       uchiha::blend_mode blend,
+                       int16_t layer);
+  // The untraced bodies of flush(), set_render_target(),
+  // set_view_projection() and set_model_transform(), for the engine's own
+  // calls, which a trace replays by itself.
+  void flush_batch();
+  void change_render_target(uchiha::render_target* t);
+  void apply_view_projection(const uchiha::mat4& m);
+  void apply_model_transform(const uchiha::mat4& model);
+  void retain_batch();
+  void redraw_retained();
+  void draw_groups(const uchiha::sprite_batch::group* groups,
+                   size_t count,
+                   GLint base_vertex,
+                   uchiha::vertex_format format);
+  void setup_vertex_arrays();
+  void set_instance_attributes(GLintptr stream_offset);
+  void bind_vertex_format(uchiha::vertex_format format);
+  // Makes shaders[index] current with the model transform loaded.
+  uchiha::shader* use_shader(size_t index);
+  template<typename vertex_type>
+  void render_indexed(const vertex_type* vertices,
+                      size_t vertex_count,
+                      uchiha::index_span indices,
+                      const uchiha::texture* t,
+                      uchiha::vertex_format format);
 };
 
 bool
@@ -202,129 +467,189 @@ engine_impl::init(uint16_t ww, uint16_t wh, bool fullscreen)
     return false;
   }
 
-  glGenBuffers(1, &gl_default_vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, gl_default_vbo);
-  glGenVertexArrays(1, &vertex_attribute_object);
-  glBindVertexArray(vertex_attribute_object);
-  uint32_t data_size_in_bytes = 0;
-  glBufferData(GL_ARRAY_BUFFER, data_size_in_bytes, nullptr, GL_STATIC_DRAW);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, data_size_in_bytes, nullptr);
-
-  const char* vertex_shader_01_src = R"(
-                                     #version 330 core
-                                     layout (location = 0) in vec3 a_position;
-                                     layout (location = 1) in vec4 a_color;
-
-
-                                     out vec4 v_color;
-                                     void main()
-                                     {
-                                        v_color = a_color;
-                                        gl_Position = vec4(a_position, 1.0);
-                                     }
-                                     )";
-
-  const char* fragment_shader_01_src = R"(
-                                       #version 330 core
-
-                                       in vec4 v_color;
-
-                                       out vec4 frag_color;
-
-                                       void main()
-                                       {
-                                           frag_color = v_color;
-                                       }
-                                       )";
-  shaders.push_back(
-    new uchiha::shader(vertex_shader_01_src,
-                       fragment_shader_01_src,
-                       { { 0, "a_position" }, { 1, "a_color" } }));
-  shaders.at(0)->use();
-
-  const char* vertex_shader_02_src = R"(
-                                     #version 330 core
-                                     layout (location = 0) in vec3 a_position;
-                                     layout (location = 1) in vec4 a_color;
-                                     layout (location = 2) in vec2 a_tex_coord;
-
-
-                                     out vec4 v_color;
-                                     out vec2 v_tex_coord;
-                                     void main()
-                                     {
-                                        v_color = a_color;
-                                        v_tex_coord = a_tex_coord;
-                                        gl_Position = vec4(a_position, 1.0);
-                                     }
-                                     )";
-
-  const char* fragment_shader_02_src = R"(
-                                       #version 330 core
-
-                                       in vec4 v_color;
-                                       in vec2 v_tex_coord;
-
-                                       uniform sampler2D s_texture;
-                                       out vec4 frag_color;
-
-                                       void main()
-                                       {
-                                           frag_color = texture(s_texture, v_tex_coord) * v_color;
-                                       }
-                                       )";
-  shaders.push_back(new uchiha::shader(
-    vertex_shader_02_src,
-    fragment_shader_02_src,
-    { { 0, "a_position" }, { 1, "a_color" }, { 2, "a_tex_coord" } }));
-  shaders.at(1)->use();
-
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  uchiha::gl_ext::load(SDL_GL_GetProcAddress);
+  set_vsync(uchiha::vsync_mode::adaptive);
+
+  if (!vertex_stream.init(stream_buffer_budget) ||
+      !index_stream.init(stream_buffer_budget / 4)) {
+    std::cerr << "error: Failed to create stream buffer ( engine.cxx:  )"
+              << std::endl;
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return false;
+  }
+  state.invalidate();
+  setup_vertex_arrays();
+
+  char* pref_path = SDL_GetPrefPath("uchiha", "engine");
+  std::string binary_dir = pref_path ? std::string(pref_path) + "shaders" : "";
+  SDL_free(pref_path);
+  program_cache.init(state, binary_dir);
+
+  const uchiha::shader_cache::attribute_list vertex_attributes = {
+    { 0, "a_position" }, { 1, "a_color" }, { 2, "a_tex_coord" }
+  };
+  const uchiha::shader_cache::attribute_list slotted_attributes = {
+    { 0, "a_position" },
+    { 1, "a_color" },
+    { 2, "a_tex_coord" },
+    { 3, "a_texture_slot" }
+  };
+  const uchiha::shader_cache::attribute_list instance_attributes = {
+    { 0, "i_position_scale" },
+    { 1, "i_rotation" },
+    { 2, "i_uv_rect" },
+    { 3, "i_color" }
+  };
+  shaders.assign(program_count, nullptr);
+  shaders[color_program] = program_cache.load(
+    "res/shaders/color.vert", "res/shaders/color.frag", vertex_attributes);
+  shaders[textured_program] = program_cache.load("res/shaders/textured.vert",
+                                                 "res/shaders/textured.frag",
+                                                 vertex_attributes);
+  shaders[instanced_program] =
+    program_cache.load("res/shaders/instanced.vert",
+                       "res/shaders/textured.frag",
+                       instance_attributes);
+  shaders[multi_texture_program] =
+    program_cache.load("res/shaders/textured_multi.vert",
+                       "res/shaders/textured_multi.frag",
+                       slotted_attributes);
+  if (std::find(shaders.begin(), shaders.end(), nullptr) != shaders.end()) {
+    std::cerr << "error: Failed to load shaders ( engine.cxx:  )"
+              << std::endl;
+    shaders.clear();
+    program_cache.destroy();
+    vertex_stream.destroy();
+    index_stream.destroy();
+    SDL_GL_DeleteContext(context);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return false;
+  }
+
+  glGenBuffers(1, &camera_buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, camera_buffer);
+  glBufferData(GL_UNIFORM_BUFFER,
+               sizeof(view_projection.m),
+               view_projection.m,
+               GL_DYNAMIC_DRAW);
+  glBindBufferBase(
+    GL_UNIFORM_BUFFER, uchiha::shader::camera_binding, camera_buffer);
+
+  const uint8_t white_pixel[4] = { 255, 255, 255, 255 };
+  GLuint white_handle = 0;
+  glGenTextures(1, &white_handle);
+  glBindTexture(GL_TEXTURE_2D, white_handle);
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               GL_RGBA8,
+               1,
+               1,
+               0,
+               GL_RGBA,
+               GL_UNSIGNED_BYTE,
+               white_pixel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  white_texture = new uchiha::texture_impl(1, 1, white_handle);
+
+  const uint8_t clear_pixel[4] = { 0, 0, 0, 0 };
+  GLuint placeholder_handle = 0;
+  glGenTextures(1, &placeholder_handle);
+  glBindTexture(GL_TEXTURE_2D, placeholder_handle);
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               GL_RGBA8,
+               1,
+               1,
+               0,
+               GL_RGBA,
+               GL_UNSIGNED_BYTE,
+               clear_pixel);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  placeholder_texture = new uchiha::texture_impl(1, 1, placeholder_handle);
+  textures.set_placeholder(placeholder_handle);
+  state.invalidate_textures();
+
+  // Without a pack everything is read from its own file.
+  auto* default_pack = new uchiha::resource_pack();
+  if (default_pack->open("res.pack")) {
+    packs.push_back(default_pack);
+  } else {
+    delete default_pack;
+  }
+
+  // The main thread runs the jobs it waits for, so one core is left for it.
+  // It never takes decodes or capture encodes, so at least one worker must
+  // run those.
+  unsigned hardware_threads = std::thread::hardware_concurrency();
+  jobs.start(hardware_threads > 1 ? hardware_threads - 1 : 1u, true);
+  loader.start(jobs);
+  particles.start(jobs);
+  capture.init(jobs);
+
+  state.set_blend(uchiha::blend_mode::alpha);
   glClearColor(0.f, 0.0, 0.f, 0.0f);
   glViewport(0, 0, window_width, window_height);
   return true;
 }
 
+void
+engine_impl::set_stream_buffer_budget(uint32_t bytes)
+{
+  call_trace.set_stream_buffer_budget(bytes);
+  stream_buffer_budget = bytes;
+  if (context != nullptr) {
+    vertex_stream.destroy();
+    vertex_stream.init(stream_buffer_budget);
+    index_stream.destroy();
+    index_stream.init(stream_buffer_budget / 4);
+  }
+}
+
 bool
 engine_impl::read_input(uchiha::event& event)
 {
-  SDL_Event e;
-  if (SDL_PollEvent(&e)) {
-    if (e.type == SDL_QUIT) {
-      event.type = event.quit;
-      return true;
-    } else if (e.type == SDL_MOUSEMOTION) {
-      event.type = event.mouse_motion;
-      event.mouse_x = e.motion.x;
-      event.mouse_y = e.motion.y;
-      return true;
+  UCHIHA_PROFILE_SCOPE("read_input");
+  return input.next(event);
+}
 
-    } else if (e.type == SDL_MOUSEBUTTONUP) {
-      event.type = event.mouse_click;
-      event.mouse_x = e.motion.x;
-      event.mouse_y = e.motion.y;
-      return true;
-    } else if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
-      event.type = (e.type == SDL_KEYDOWN) ? event.pressed : event.reliased;
-      if (e.key.keysym.sym == SDLK_w || e.key.keysym.sym == SDLK_UP) {
-        event.key = event.top;
-      } else if (e.key.keysym.sym == SDLK_s || e.key.keysym.sym == SDLK_DOWN) {
-        event.key = event.bottom;
-      } else if (e.key.keysym.sym == SDLK_a || e.key.keysym.sym == SDLK_LEFT) {
-        event.key = event.left;
-      } else if (e.key.keysym.sym == SDLK_d || e.key.keysym.sym == SDLK_RIGHT) {
-        event.key = event.right;
-      } else if (e.key.keysym.sym == SDLK_ESCAPE) {
-        event.key = event.escape;
-      } else if (e.key.keysym.sym == SDLK_SPACE) {
-        event.key = event.space;
-      } else if (e.key.keysym.sym == SDLK_KP_ENTER ||
-                 e.key.keysym.sym == SDLK_RETURN) {
-        event.key = event.enter;
-      } else {
-        event.key = event.undefined_key;
-      }
+void
+engine_impl::poll_events()
+{
+  input.poll();
+}
+
+const uchiha::input_state&
+engine_impl::get_input() const
+{
+  return input.state();
+}
+
+bool
+engine_impl::mount_resource_pack(std::string_view path)
+{
+  auto* pack = new uchiha::resource_pack();
+  if (!pack->open(path)) {
+    std::cerr << "error: Failed to mount resource pack ( engine.cxx: ) "
+              << path << std::endl;
+    delete pack;
+    return false;
+  }
+  packs.push_back(pack);
+  call_trace.mount_resource_pack(path);
+  return true;
+}
+
+bool
+engine_impl::find_resource(std::string_view path,
+                           uchiha::resource_data& out) const
+{
+  for (auto it = packs.rbegin(); it != packs.rend(); ++it) {
+    if ((*it)->find(path, out)) {
       return true;
     }
   }
@@ -334,6 +659,34 @@ engine_impl::read_input(uchiha::event& event)
 uchiha::texture*
 engine_impl::create_texture(std::string_view path)
 {
+  if (uchiha::texture_impl* shared = textures.acquire(path)) {
+    call_trace.create_texture(shared, path);
+    return shared;
+  }
+  uint64_t bytes = 0;
+  uchiha::texture_impl* t = load_texture(path, bytes);
+  if (t != nullptr) {
+    textures.add(path, t, bytes);
+    call_trace.create_texture(t, path);
+  }
+  return t;
+}
+
+uchiha::texture_impl*
+engine_impl::load_texture(std::string_view path, uint64_t& bytes)
+{
+  if (uchiha::is_compressed_texture_path(path)) {
+    uchiha::texture_impl* t = load_compressed_texture(path, bytes);
+    if (t) {
+      return t;
+    }
+    // The cook step keeps the source image next to the cooked one, so fall
+    // back to it when the container or its format is not usable here.
+    std::string fallback(path.substr(0, path.rfind('.')));
+    fallback += ".png";
+    return load_texture(fallback, bytes);
+  }
+
   unsigned int texture;
   glGenTextures(1, &texture);
   glBindTexture(GL_TEXTURE_2D, texture);
@@ -343,8 +696,26 @@ engine_impl::create_texture(std::string_view path)
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  int width, height, nrChannels;
-  unsigned char* data = stbi_load(path.data(), &width, &height, &nrChannels, 0);
+  int width = 0;
+  int height = 0;
+  int nrChannels = 0;
+  uchiha::resource_data packed;
+  const uint8_t* file = find_resource(path, packed)
+                          ? uchiha::unpack(packed, resource_scratch)
+                          : nullptr;
+  // path need not be NUL-terminated, as when it points into a trace.
+  unsigned char* data = file != nullptr
+                          ? stbi_load_from_memory(file,
+                                                  static_cast<int>(packed.size),
+                                                  &width,
+                                                  &height,
+                                                  &nrChannels,
+                                                  STBI_rgb_alpha)
+                          : stbi_load(std::string(path).c_str(),
+                                      &width,
+                                      &height,
+                                      &nrChannels,
+                                      STBI_rgb_alpha);
   if (data) {
     glTexImage2D(GL_TEXTURE_2D,
                  0,
@@ -356,191 +727,1656 @@ engine_impl::create_texture(std::string_view path)
                  GL_UNSIGNED_BYTE,
                  data);
     glGenerateMipmap(GL_TEXTURE_2D);
+    uchiha::profiler::count_upload(static_cast<size_t>(width) * height * 4);
   } else {
     std::cerr << "error: Failed to load texture ( engine.cxx: )" << std::endl;
   }
   stbi_image_free(data);
-  texture_impl* texture_object = new texture_impl(width, height, texture);
+  state.invalidate_textures();
+  bytes = uchiha::rgba8_texture_bytes(static_cast<uint32_t>(width),
+                                      static_cast<uint32_t>(height));
+  uchiha::texture_impl* texture_object =
+    new uchiha::texture_impl(width, height, texture);
   return texture_object;
 }
 
+uchiha::texture_impl*
+engine_impl::load_compressed_texture(std::string_view path, uint64_t& bytes)
+{
+  uchiha::compressed_image image;
+  uchiha::resource_data packed;
+  const uint8_t* file = find_resource(path, packed)
+                          ? uchiha::unpack(packed, resource_scratch)
+                          : nullptr;
+  const bool parsed =
+    file != nullptr
+      ? uchiha::parse_compressed_image(path, file, packed.size, image)
+      : uchiha::load_compressed_image(path, image);
+  if (!parsed) {
+    std::cerr << "error: Failed to parse compressed texture ( engine.cxx: )"
+              << std::endl;
+    return nullptr;
+  }
+  if (!uchiha::is_compression_supported(image.family)) {
+    std::cerr << "error: Compressed texture format is not supported by the "
+                 "context ( engine.cxx: )"
+              << std::endl;
+    return nullptr;
+  }
+
+  unsigned int texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  uchiha::upload_compressed_image(image);
+  uchiha::profiler::count_upload(image.size);
+  state.invalidate_textures();
+  if (glGetError() != GL_NO_ERROR) {
+    std::cerr << "error: Failed to upload compressed texture ( engine.cxx: )"
+              << std::endl;
+    glDeleteTextures(1, &texture);
+    return nullptr;
+  }
+  bytes = image.size;
+  return new uchiha::texture_impl(static_cast<uint16_t>(image.width),
+                                  static_cast<uint16_t>(image.height),
+                                  texture);
+}
+
+uchiha::texture*
+engine_impl::create_texture_async(std::string_view path)
+{
+  // Cooked textures need no decode, so there is nothing to move off the
+  // calling thread.
+  if (uchiha::is_compressed_texture_path(path)) {
+    return create_texture(path);
+  }
+  if (uchiha::texture_impl* shared = textures.acquire(path)) {
+    call_trace.create_texture_async(shared, path);
+    return shared;
+  }
+  auto* t = new uchiha::texture_impl(placeholder_texture->get_width(),
+                                     placeholder_texture->get_height(),
+                                     placeholder_texture->get_handle());
+  uchiha::resource_data packed;
+  find_resource(path, packed);
+  loader.request(t, path, packed);
+  textures.add(path, t, 0);
+  call_trace.create_texture_async(t, path);
+  return t;
+}
+
 void
-engine_impl::render(const std::vector<uchiha::triangle>& vertex_buffer)
+engine_impl::release_texture(uchiha::texture* t)
 {
-  shaders.at(0)->use();
-  const uchiha::vertex* t = &vertex_buffer.data()->v[0];
-  uint32_t data_size_in_bytes =
-    static_cast<uint32_t>((vertex_buffer.size() * 3) * sizeof(uchiha::vertex));
-  glBufferData(GL_ARRAY_BUFFER, data_size_in_bytes, t, GL_DYNAMIC_DRAW);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, data_size_in_bytes, t);
+  if (t == nullptr) {
+    return;
+  }
+  call_trace.release_texture(t);
+  uchiha::texture_registry::release_result released = textures.release(t);
+  if (released.target == nullptr) {
+    return;
+  }
+  if (released.loading) {
+    loader.cancel(released.target);
+  }
+  state.invalidate_textures();
+  delete released.target;
+}
 
-  glEnableVertexAttribArray(0);
-  GLintptr position_attr_offset = 0;
-  glVertexAttribPointer(0,
-                        3,
-                        GL_FLOAT,
-                        GL_FALSE,
-                        sizeof(uchiha::vertex),
-                        reinterpret_cast<void*>(position_attr_offset));
+void
+engine_impl::set_texture_budget(uint64_t bytes)
+{
+  call_trace.set_texture_budget(bytes);
+  textures.set_budget(bytes);
+}
 
-  glEnableVertexAttribArray(1);
-  GLintptr color_attr_offset = sizeof(float) * 3;
-  glVertexAttribPointer(1,
-                        4,
-                        GL_FLOAT,
-                        GL_FALSE,
-                        sizeof(uchiha::vertex),
-                        reinterpret_cast<void*>(color_attr_offset));
-  GLsizei num_of_vertexes = static_cast<GLsizei>(vertex_buffer.size() * 3);
-  glDrawArrays(GL_TRIANGLES, 0, num_of_vertexes);
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
+void
+engine_impl::reload_texture(uchiha::texture_impl& target,
+                            const std::string& path)
+{
+  if (!uchiha::is_compressed_texture_path(path)) {
+    uchiha::resource_data packed;
+    find_resource(path, packed);
+    loader.request(&target, path, packed);
+    return;
+  }
+  // Nothing to decode, so cooked textures come back right away.
+  uint64_t bytes = 0;
+  uchiha::texture_impl* fresh = load_texture(path, bytes);
+  // A source image that failed to load comes back empty rather than null.
+  if (fresh == nullptr || fresh->get_width() == 0) {
+    if (fresh != nullptr) {
+      GLuint handle = fresh->get_handle();
+      glDeleteTextures(1, &handle);
+      delete fresh;
+    }
+    textures.fail(target);
+    return;
+  }
+  target.assign(fresh->get_width(), fresh->get_height(), fresh->get_handle());
+  delete fresh;
 }
 
 void
-engine_impl::render(const std::vector<uchiha::triangle>& vertex_buffer,
-                    const uchiha::texture& tx)
+engine_impl::touch_texture(const uchiha::texture& t)
 {
-  shaders.at(1)->use();
-  shaders.at(1)->set_uniform("s_texture", tx);
-  const uchiha::vertex* t = &vertex_buffer.data()->v[0];
-  uint32_t data_size_in_bytes =
-    static_cast<uint32_t>((vertex_buffer.size() * 3) * sizeof(uchiha::vertex));
-  glBufferData(GL_ARRAY_BUFFER, data_size_in_bytes, t, GL_DYNAMIC_DRAW);
-  glBufferSubData(GL_ARRAY_BUFFER, 0, data_size_in_bytes, t);
+  uchiha::texture_registry::reload_request reload = textures.touch(t);
+  if (reload.target != nullptr) {
+    reload_texture(*reload.target, *reload.path);
+  }
+}
 
-  glEnableVertexAttribArray(0);
-  GLintptr position_attr_offset = 0;
-  glVertexAttribPointer(0,
-                        3,
-                        GL_FLOAT,
-                        GL_FALSE,
-                        sizeof(uchiha::vertex),
-                        reinterpret_cast<void*>(position_attr_offset));
+void
+engine_impl::set_texture_uniform(uchiha::shader* s, const uchiha::texture& t)
+{
+  touch_texture(t);
+  s->set_uniform("s_texture", t);
+}
 
-  glEnableVertexAttribArray(1);
-  GLintptr color_attr_offset = sizeof(float) * 3;
-  glVertexAttribPointer(1,
-                        4,
-                        GL_FLOAT,
-                        GL_FALSE,
-                        sizeof(uchiha::vertex),
-                        reinterpret_cast<void*>(color_attr_offset));
-  glEnableVertexAttribArray(2);
-  GLintptr texture_attr_offset = sizeof(float) * 7;
-  glVertexAttribPointer(2,
-                        2,
-                        GL_FLOAT,
-                        GL_FALSE,
-                        sizeof(uchiha::vertex),
-                        reinterpret_cast<void*>(texture_attr_offset));
+void
+engine_impl::set_texture_uniform(uchiha::shader* s,
+                                 size_t slot,
+                                 const uchiha::texture& t)
+{
+  touch_texture(t);
+  s->set_uniform("s_textures", slot, t);
+}
+
+void
+engine_impl::set_texture_upload_budget(float milliseconds)
+{
+  call_trace.set_texture_upload_budget(milliseconds);
+  texture_upload_budget_ms = milliseconds;
+}
+
+uchiha::texture_atlas*
+engine_impl::create_atlas(uint16_t page_width, uint16_t page_height)
+{
+  uchiha::texture_atlas* atlas = atlases.insert(
+    std::make_unique<uchiha::texture_atlas_impl>(page_width, page_height));
+  call_trace.create_atlas(atlas, page_width, page_height);
+  return atlas;
+}
 
-  GLsizei num_of_vertexes = static_cast<GLsizei>(vertex_buffer.size() * 3);
-  glDrawArrays(GL_TRIANGLES, 0, num_of_vertexes);
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-  glDisableVertexAttribArray(2);
+uchiha::texture*
+engine_impl::create_texture(std::string_view path, uchiha::texture_atlas& atlas)
+{
+  uchiha::texture_atlas_impl* impl = atlases.find(&atlas);
+  if (impl == nullptr) {
+    std::cerr << "error: Atlas was not created by this engine ( engine.cxx: )"
+              << std::endl;
+    return nullptr;
+  }
+  int width, height, nrChannels;
+  uchiha::resource_data packed;
+  const uint8_t* file = find_resource(path, packed)
+                          ? uchiha::unpack(packed, resource_scratch)
+                          : nullptr;
+  unsigned char* data =
+    file != nullptr
+      ? stbi_load_from_memory(file,
+                              static_cast<int>(packed.size),
+                              &width,
+                              &height,
+                              &nrChannels,
+                              4)
+      : stbi_load(std::string(path).c_str(), &width, &height, &nrChannels, 4);
+  if (data == nullptr) {
+    std::cerr << "error: Failed to load texture ( engine.cxx: )" << std::endl;
+    return nullptr;
+  }
+  uchiha::texture* t = impl->add(
+    data, static_cast<uint16_t>(width), static_cast<uint16_t>(height));
+  stbi_image_free(data);
+  state.invalidate_textures();
+  call_trace.create_texture(t, path, atlas);
+  return t;
 }
 
 void
-engine_impl::swap_buffers()
+engine_impl::destroy_atlas(uchiha::texture_atlas* atlas)
 {
-  SDL_GL_SwapWindow(window);
+  if (atlas == nullptr) {
+    return;
+  }
+  if (atlases.find(atlas) == nullptr) {
+    std::cerr << "error: Atlas was not created by this engine ( engine.cxx: )"
+              << std::endl;
+    return;
+  }
+  call_trace.destroy_atlas(atlas);
+  // Batched draws may still sample its pages.
+  flush_batch();
+  state.invalidate_textures();
+  atlases.erase(atlas);
+}
 
-  glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT);
+uchiha::font*
+engine_impl::create_font(std::string_view path, uint16_t pixel_size)
+{
+  if (TTF_WasInit() == 0 && TTF_Init() != 0) {
+    std::cerr << "error: Failed to initialize SDL_ttf ( engine.cxx: ) "
+              << TTF_GetError() << std::endl;
+    return nullptr;
+  }
+  if (glyphs == nullptr) {
+    glyphs = new uchiha::glyph_atlas();
+  }
+  auto* f = new uchiha::font_impl(*glyphs);
+  uchiha::resource_data packed;
+  const bool opened = find_resource(path, packed)
+                        ? f->open(packed, pixel_size)
+                        : f->open(path, pixel_size);
+  if (!opened) {
+    delete f;
+    return nullptr;
+  }
+  fonts.insert(std::unique_ptr<uchiha::font_impl>(f));
+  call_trace.create_font(f, path, pixel_size);
+  return f;
 }
 
 void
-engine_impl::destroy()
+engine_impl::destroy_font(uchiha::font* f)
 {
-  SDL_GL_DeleteContext(context);
-  SDL_DestroyWindow(window);
-  SDL_Quit();
+  if (f == nullptr) {
+    return;
+  }
+  uchiha::font_impl* impl = fonts.find(f);
+  if (impl == nullptr) {
+    std::cerr << "error: Font was not created by this engine ( engine.cxx: )"
+              << std::endl;
+    return;
+  }
+  call_trace.destroy_font(f);
+  // Batched text keeps pointers to the atlas pages, not to the font.
+  text_layouts.remove(*impl);
+  fonts.erase(f);
 }
 
-uchiha::engine*
-create_engine()
+void
+engine_impl::set_instance_attributes(GLintptr stream_offset)
 {
-  engine_impl* engine = new engine_impl();
-  return engine;
+  const GLsizei stride = sizeof(uchiha::sprite_instance);
+  struct attribute
+  {
+    GLint size;
+    GLenum type;
+    GLboolean normalized;
+    size_t offset;
+  };
+  const attribute attributes[] = {
+    { 4, GL_FLOAT, GL_FALSE, offsetof(uchiha::sprite_instance, x) },
+    { 1, GL_FLOAT, GL_FALSE, offsetof(uchiha::sprite_instance, rotation) },
+    { 4, GL_FLOAT, GL_FALSE, offsetof(uchiha::sprite_instance, u0) },
+    { 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(uchiha::sprite_instance, r) },
+  };
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_stream.handle());
+  for (GLuint i = 0; i < 4; ++i) {
+    glVertexAttribPointer(
+      i,
+      attributes[i].size,
+      attributes[i].type,
+      attributes[i].normalized,
+      stride,
+      reinterpret_cast<void*>(stream_offset +
+                              static_cast<GLintptr>(attributes[i].offset)));
+  }
 }
 
 void
-destroy_engine(uchiha::engine* e)
+engine_impl::setup_vertex_arrays()
 {
-  if (e)
-    delete e;
+  if (vertex_arrays[0] == 0) {
+    glGenVertexArrays(uchiha::vertex_format_count, vertex_arrays);
+  }
+
+  state.bind_vertex_array(
+    vertex_arrays[static_cast<size_t>(uchiha::vertex_format::full)]);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_stream.handle());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_stream.handle());
+  set_vertex_attributes();
+
+  state.bind_vertex_array(
+    vertex_arrays[static_cast<size_t>(uchiha::vertex_format::packed)]);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_stream.handle());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_stream.handle());
+  const GLsizei packed_stride = sizeof(uchiha::packed_vertex);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(
+    0,
+    2,
+    GL_HALF_FLOAT,
+    GL_FALSE,
+    packed_stride,
+    reinterpret_cast<void*>(offsetof(uchiha::packed_vertex, x)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(
+    1,
+    4,
+    GL_UNSIGNED_BYTE,
+    GL_TRUE,
+    packed_stride,
+    reinterpret_cast<void*>(offsetof(uchiha::packed_vertex, r)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(
+    2,
+    2,
+    GL_UNSIGNED_SHORT,
+    GL_TRUE,
+    packed_stride,
+    reinterpret_cast<void*>(offsetof(uchiha::packed_vertex, tx)));
+
+  state.bind_vertex_array(
+    vertex_arrays[static_cast<size_t>(uchiha::vertex_format::instance)]);
+  for (GLuint i = 0; i < 4; ++i) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribDivisor(i, 1);
+  }
+  set_instance_attributes(0);
+
+  state.bind_vertex_array(
+    vertex_arrays[static_cast<size_t>(uchiha::vertex_format::slotted)]);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_stream.handle());
+  const GLsizei slotted_stride = sizeof(uchiha::slotted_vertex);
+  set_vertex_attributes(slotted_stride);
+  glEnableVertexAttribArray(3);
+  glVertexAttribIPointer(
+    3,
+    1,
+    GL_UNSIGNED_INT,
+    slotted_stride,
+    reinterpret_cast<void*>(offsetof(uchiha::slotted_vertex, slot)));
+
+  vertex_stream_generation = vertex_stream.generation();
+  index_stream_generation = index_stream.generation();
 }
 
-int
-main(int /*argc*/, char** /*argv*/)
+void
+engine_impl::bind_vertex_format(uchiha::vertex_format format)
 {
-  engine_impl* engine = new engine_impl();
-  engine->init(800, 600, false);
-
-  uchiha::texture* tx = engine->create_texture("res/black-horse.png");
-
-  std::vector<uchiha::triangle> vertex_buffer;
-
-  uchiha::triangle tr0(
-    { 0.3f, -0.3f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
-    { 0.0f, 0.3f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
-    { -0.3f, -0.3f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f });
-  uchiha::triangle tr1(
-    { 0.6f, 0.3f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f },
-    { 0.9f, 0.3f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f },
-    { 0.75f, 0.6f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f });
-  vertex_buffer.push_back(tr0);
-  vertex_buffer.push_back(tr1);
-
-  std::vector<uchiha::triangle> vertex_buffer_01;
-  uchiha::triangle tr2(
-    { -0.1f, 0.1f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
-    { -0.1f, 0.4f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f },
-    { -0.4f, 0.1f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f });
-  uchiha::triangle tr3(
-    { -0.4f, 0.4f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },
-    { -0.1f, 0.4f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f },
-    { -0.4f, 0.1f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f });
-  vertex_buffer_01.push_back(tr2);
-  vertex_buffer_01.push_back(tr3);
-
-  uchiha::event e;
-  bool is_loop = true;
-  while (is_loop) {
-    while (engine->read_input(e)) {
-      switch (e.type) {
-        case uchiha::event::quit: {
-          std::cout << "event: quit" << std::endl;
-          is_loop = false;
-          break;
-        }
-        case uchiha::event::mouse_motion: {
-          std::cout << "event: mouse motion" << std::endl;
-          std::cout << e.mouse_x << " " << e.mouse_y << std::endl;
-          break;
-        }
-        case uchiha::event::mouse_click: {
-          std::cout << "event: mouse click" << std::endl;
-          break;
-        }
-        case uchiha::event::pressed: {
-          std::cout << "event: key pressed" << std::endl;
-          std::cout << e.key << std::endl;
-          break;
-        }
-        case uchiha::event::reliased: {
-          std::cout << "event: key reliased" << std::endl;
-          std::cout << e.key << std::endl;
-          break;
-        }
-      }
-    }
-    engine->render(vertex_buffer);
-    engine->render(vertex_buffer_01, *tx);
-    engine->swap_buffers();
+  if (vertex_stream_generation != vertex_stream.generation() ||
+      index_stream_generation != index_stream.generation()) {
+    setup_vertex_arrays();
   }
-  engine->destroy();
-  return 0;
+  state.bind_vertex_array(vertex_arrays[static_cast<size_t>(format)]);
+}
+
+uchiha::shader*
+engine_impl::use_shader(size_t index)
+{
+  uchiha::shader* s = shaders.at(index);
+  s->use();
+  s->set_uniform("u_model", model_transform);
+  return s;
+}
+
+uchiha::mesh*
+engine_impl::create_mesh(const uchiha::vertex* vertices,
+                         size_t vertex_count,
+                         uchiha::index_span indices,
+                         uchiha::mesh_usage usage)
+{
+  if (vertices == nullptr || vertex_count == 0) {
+    std::cerr << "error: Mesh has no vertices ( engine.cxx:  )" << std::endl;
+    return nullptr;
+  }
+  const GLenum gl_usage = usage == uchiha::mesh_usage::dynamic_draw
+                            ? GL_DYNAMIC_DRAW
+                            : GL_STATIC_DRAW;
+  uchiha::mesh_impl* m = new uchiha::mesh_impl();
+  m->vertex_count = vertex_count;
+  m->usage = usage;
+
+  glGenVertexArrays(1, &m->vertex_array);
+  state.bind_vertex_array(m->vertex_array);
+  glGenBuffers(1, &m->vertex_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, m->vertex_buffer);
+  const size_t vertex_bytes = vertex_count * sizeof(uchiha::vertex);
+  glBufferData(GL_ARRAY_BUFFER,
+               static_cast<GLsizeiptr>(vertex_bytes),
+               vertices,
+               gl_usage);
+  set_vertex_attributes();
+  uchiha::profiler::count_upload(vertex_bytes);
+  m->bounds = uchiha::compute_bounds(vertices, vertex_count);
+
+  if (indices.data != nullptr && indices.count > 0) {
+    m->index_count = indices.count;
+    m->indices = indices.type;
+    const size_t index_bytes =
+      indices.count * (indices.type == uchiha::index_type::u16
+                         ? sizeof(uint16_t)
+                         : sizeof(uint32_t));
+    glGenBuffers(1, &m->index_buffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m->index_buffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 static_cast<GLsizeiptr>(index_bytes),
+                 indices.data,
+                 GL_STATIC_DRAW);
+    uchiha::profiler::count_upload(index_bytes);
+  }
+  meshes.insert(std::unique_ptr<uchiha::mesh_impl>(m));
+  call_trace.create_mesh(m, vertices, vertex_count, indices, usage);
+  return m;
+}
+
+bool
+engine_impl::update_mesh(uchiha::mesh& m,
+                         size_t first_vertex,
+                         const uchiha::vertex* vertices,
+                         size_t count)
+{
+  uchiha::mesh_impl& impl = static_cast<uchiha::mesh_impl&>(m);
+  if (vertices == nullptr || first_vertex > impl.vertex_count ||
+      count > impl.vertex_count - first_vertex) {
+    std::cerr << "error: Mesh update out of range ( engine.cxx:  )"
+              << std::endl;
+    return false;
+  }
+  call_trace.update_mesh(m, first_vertex, vertices, count);
+  if (count == 0) {
+    return true;
+  }
+  UCHIHA_PROFILE_SCOPE("update mesh");
+  glBindBuffer(GL_ARRAY_BUFFER, impl.vertex_buffer);
+  const size_t bytes = count * sizeof(uchiha::vertex);
+  if (count == impl.vertex_count &&
+      impl.usage == uchiha::mesh_usage::dynamic_draw) {
+    // Orphan the storage instead of waiting for draws still reading it.
+    glBufferData(
+      GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(bytes), vertices, GL_DYNAMIC_DRAW);
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER,
+                    static_cast<GLintptr>(first_vertex * sizeof(uchiha::vertex)),
+                    static_cast<GLsizeiptr>(bytes),
+                    vertices);
+  }
+  uchiha::profiler::count_upload(bytes);
+  uchiha::merge_bounds(impl.bounds, uchiha::compute_bounds(vertices, count));
+  return true;
+}
+
+void
+engine_impl::draw_mesh(const uchiha::mesh& m,
+                       const uchiha::texture* t,
+                       const uchiha::mat4& transform)
+{
+  call_trace.draw_mesh(m, t, transform);
+  if (retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("draw mesh");
+  const uchiha::mesh_impl& impl = static_cast<const uchiha::mesh_impl&>(m);
+  if (culling_enabled &&
+      !uchiha::is_visible(impl.bounds, view_projection * transform)) {
+    uchiha::profiler::count_culled(1);
+    return;
+  }
+  uchiha::shader* s =
+    shaders.at(t != nullptr ? textured_program : color_program);
+  s->use();
+  s->set_uniform("u_model", transform);
+  if (t != nullptr) {
+    set_texture_uniform(s, *t);
+  }
+  state.set_blend(uchiha::blend_mode::alpha);
+  state.bind_vertex_array(impl.vertex_array);
+  uchiha::profiler::count_draw();
+  if (impl.index_count > 0) {
+    glDrawElements(GL_TRIANGLES,
+                   static_cast<GLsizei>(impl.index_count),
+                   impl.indices == uchiha::index_type::u16 ? GL_UNSIGNED_SHORT
+                                                           : GL_UNSIGNED_INT,
+                   nullptr);
+  } else {
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(impl.vertex_count));
+  }
+}
+
+void
+engine_impl::destroy_mesh(uchiha::mesh* m)
+{
+  if (m == nullptr) {
+    return;
+  }
+  uchiha::mesh_impl* impl = meshes.find(m);
+  if (impl == nullptr) {
+    std::cerr << "error: Mesh was not created by this engine ( engine.cxx: )"
+              << std::endl;
+    return;
+  }
+  call_trace.destroy_mesh(m);
+  delete_mesh_objects(*impl);
+  meshes.erase(m);
+}
+
+void
+engine_impl::delete_mesh_objects(uchiha::mesh_impl& m)
+{
+  // The VAO may be the one the state cache believes is bound.
+  state.invalidate();
+  glDeleteVertexArrays(1, &m.vertex_array);
+  glDeleteBuffers(1, &m.vertex_buffer);
+  if (m.index_buffer != 0) {
+    glDeleteBuffers(1, &m.index_buffer);
+  }
+}
+
+uchiha::render_target*
+engine_impl::create_render_target(uint16_t width, uint16_t height)
+{
+  auto* t = new uchiha::render_target_impl();
+  const bool created = t->create(width, height);
+  state.invalidate_textures();
+  bind_current_target();
+  if (!created) {
+    delete t;
+    return nullptr;
+  }
+  render_targets.insert(std::unique_ptr<uchiha::render_target_impl>(t));
+  call_trace.create_render_target(t, width, height);
+  return t;
+}
+
+void
+engine_impl::destroy_render_target(uchiha::render_target* t)
+{
+  if (t == nullptr) {
+    return;
+  }
+  uchiha::render_target_impl* impl = render_targets.find(t);
+  if (impl == nullptr) {
+    std::cerr << "error: Render target was not created by this engine "
+                 "( engine.cxx: )"
+              << std::endl;
+    return;
+  }
+  call_trace.destroy_render_target(t);
+  // Batched draws may still read from or write to it.
+  flush_batch();
+  if (impl == current_target) {
+    current_target = nullptr;
+    bind_current_target();
+  }
+  impl->destroy();
+  state.invalidate_textures();
+  render_targets.erase(t);
+}
+
+void
+engine_impl::set_render_target(uchiha::render_target* t)
+{
+  call_trace.set_render_target(t);
+  change_render_target(t);
+}
+
+void
+engine_impl::change_render_target(uchiha::render_target* t)
+{
+  auto* impl = static_cast<uchiha::render_target_impl*>(t);
+  if (impl == current_target) {
+    return;
+  }
+  flush_batch();
+  current_target = impl;
+  bind_current_target();
+}
+
+void
+engine_impl::clear(float r, float g, float b, float a)
+{
+  call_trace.clear(r, g, b, a);
+  flush_batch();
+  if (retaining()) {
+    const float color[4] = { r, g, b, a };
+    if (!std::equal(color, color + 4, retained_background)) {
+      std::copy(color, color + 4, retained_background);
+      dirty.invalidate();
+    }
+    return;
+  }
+  glClearColor(r, g, b, a);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+bool
+engine_impl::set_resolution_scale(float scale)
+{
+  call_trace.set_resolution_scale(scale);
+  scale = std::clamp(scale, 0.1f, 2.f);
+  if (scale == resolution_scale) {
+    return true;
+  }
+  flush_batch();
+  resolution_scale = scale;
+  if (update_offscreen_frame()) {
+    return true;
+  }
+  std::cerr << "error: Failed to create the offscreen frame, falling back to "
+               "full resolution ( engine.cxx:  )"
+            << std::endl;
+  resolution_scale = 1.f;
+  retained = false;
+  update_offscreen_frame();
+  return false;
+}
+
+bool
+engine_impl::set_retained_mode(bool enabled)
+{
+  call_trace.set_retained_mode(enabled);
+  if (enabled == retained) {
+    return true;
+  }
+  flush_batch();
+  retained_batches.clear();
+  retained_vertices.clear();
+  retained_groups.clear();
+  retained = enabled;
+  bool created = update_offscreen_frame();
+  if (!created) {
+    std::cerr << "error: Failed to create the offscreen frame for retained "
+                 "mode ( engine.cxx:  )"
+              << std::endl;
+    retained = false;
+    update_offscreen_frame();
+  }
+  if (!retained) {
+    // swap_buffers() left the frame as it was instead of clearing it.
+    const GLuint frame =
+      offscreen_frame != nullptr ? offscreen_frame->framebuffer() : 0;
+    glBindFramebuffer(GL_FRAMEBUFFER, frame);
+    glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    bind_current_target();
+  }
+  return created;
+}
+
+void
+engine_impl::invalidate_frame()
+{
+  call_trace.invalidate_frame();
+  dirty.invalidate();
+}
+
+bool
+engine_impl::update_offscreen_frame()
+{
+  if (offscreen_frame != nullptr) {
+    offscreen_frame->destroy();
+    delete offscreen_frame;
+    offscreen_frame = nullptr;
+  }
+  bool created = true;
+  if (resolution_scale != 1.f || retained) {
+    auto* frame = new uchiha::render_target_impl();
+    auto scaled = [this](uint16_t size) {
+      return static_cast<uint16_t>(std::max(
+        1.f, std::round(static_cast<float>(size) * resolution_scale)));
+    };
+    created = frame->create(scaled(window_width), scaled(window_height));
+    if (created) {
+      offscreen_frame = frame;
+    } else {
+      delete frame;
+    }
+  }
+  // Bounds of batches kept so far this frame are in the old frame's pixels.
+  if (offscreen_frame != nullptr) {
+    for (retained_batch& b : retained_batches) {
+      b.bounds = uchiha::pixel_rect{
+        0, 0, offscreen_frame->get_width(), offscreen_frame->get_height()
+      };
+    }
+  }
+  dirty.invalidate();
+  state.invalidate_textures();
+  bind_current_target();
+  return created;
+}
+
+void
+engine_impl::bind_current_target()
+{
+  const uchiha::render_target_impl* t =
+    current_target != nullptr ? current_target : offscreen_frame;
+  if (t != nullptr) {
+    glBindFramebuffer(GL_FRAMEBUFFER, t->framebuffer());
+    glViewport(0, 0, t->get_width(), t->get_height());
+  } else {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, window_width, window_height);
+  }
+}
+
+void
+engine_impl::render(const uchiha::triangle* triangles, size_t count)
+{
+  call_trace.render(triangles, count, nullptr);
+  if (triangles == nullptr || count == 0 || retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("render");
+  use_shader(color_program);
+  state.set_blend(uchiha::blend_mode::alpha);
+  const uchiha::vertex* t = &triangles->v[0];
+  size_t data_size_in_bytes = (count * 3) * sizeof(uchiha::vertex);
+  size_t stream_offset =
+    vertex_stream.write(t, data_size_in_bytes, sizeof(uchiha::vertex));
+  bind_vertex_format(uchiha::vertex_format::full);
+
+  GLsizei num_of_vertexes = static_cast<GLsizei>(count * 3);
+  UCHIHA_PROFILE_GPU_SCOPE("render");
+  uchiha::profiler::count_draw();
+  glDrawArrays(GL_TRIANGLES,
+               static_cast<GLint>(stream_offset / sizeof(uchiha::vertex)),
+               num_of_vertexes);
+}
+
+void
+engine_impl::render(const uchiha::triangle* triangles,
+                    size_t count,
+                    const uchiha::texture& tx)
+{
+  call_trace.render(triangles, count, &tx);
+  if (triangles == nullptr || count == 0 || retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("render textured");
+  set_texture_uniform(use_shader(textured_program), tx);
+  state.set_blend(uchiha::blend_mode::alpha);
+  const uchiha::vertex* t = &triangles->v[0];
+  size_t num_of_vertices = count * 3;
+  size_t data_size_in_bytes = num_of_vertices * sizeof(uchiha::vertex);
+  uchiha::uv_rect uv = tx.get_uv_rect();
+  size_t stream_offset = 0;
+  if (is_full_uv_rect(uv)) {
+    stream_offset =
+      vertex_stream.write(t, data_size_in_bytes, sizeof(uchiha::vertex));
+  } else {
+    uchiha::stream_buffer::range r =
+      vertex_stream.map(data_size_in_bytes, sizeof(uchiha::vertex));
+    if (r.data != nullptr) {
+      uchiha::copy_vertices(
+        static_cast<uchiha::vertex*>(r.data), t, num_of_vertices, uv);
+    }
+    vertex_stream.commit();
+    stream_offset = r.offset;
+  }
+  bind_vertex_format(uchiha::vertex_format::full);
+
+  UCHIHA_PROFILE_GPU_SCOPE("render textured");
+  uchiha::profiler::count_draw();
+  glDrawArrays(GL_TRIANGLES,
+               static_cast<GLint>(stream_offset / sizeof(uchiha::vertex)),
+               static_cast<GLsizei>(num_of_vertices));
+}
+
+template<typename vertex_type>
+void
+engine_impl::render_indexed(const vertex_type* vertices,
+                            size_t vertex_count,
+                            uchiha::index_span indices,
+                            const uchiha::texture* tx,
+                            uchiha::vertex_format format)
+{
+  if (vertices == nullptr || vertex_count == 0 || indices.data == nullptr ||
+      indices.count < 3 || retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("render indexed");
+  size_t program = tx != nullptr ? textured_program : color_program;
+  uchiha::shader* s = use_shader(program);
+  if (tx != nullptr) {
+    set_texture_uniform(s, *tx);
+  }
+  state.set_blend(uchiha::blend_mode::alpha);
+
+  size_t data_size_in_bytes = vertex_count * sizeof(vertex_type);
+  uchiha::uv_rect uv = tx != nullptr ? tx->get_uv_rect() : uchiha::uv_rect();
+  size_t stream_offset = 0;
+  if (is_full_uv_rect(uv)) {
+    stream_offset =
+      vertex_stream.write(vertices, data_size_in_bytes, sizeof(vertex_type));
+  } else {
+    uchiha::stream_buffer::range r =
+      vertex_stream.map(data_size_in_bytes, sizeof(vertex_type));
+    if (r.data != nullptr) {
+      uchiha::copy_vertices(
+        static_cast<vertex_type*>(r.data), vertices, vertex_count, uv);
+    }
+    vertex_stream.commit();
+    stream_offset = r.offset;
+  }
+
+  size_t index_size = indices.type == uchiha::index_type::u16
+                        ? sizeof(uint16_t)
+                        : sizeof(uint32_t);
+  size_t index_offset =
+    index_stream.write(indices.data, indices.count * index_size, index_size);
+
+  bind_vertex_format(format);
+  UCHIHA_PROFILE_GPU_SCOPE("render indexed");
+  uchiha::profiler::count_draw();
+  glDrawElementsBaseVertex(
+    GL_TRIANGLES,
+    static_cast<GLsizei>(indices.count),
+    indices.type == uchiha::index_type::u16 ? GL_UNSIGNED_SHORT
+                                            : GL_UNSIGNED_INT,
+    reinterpret_cast<void*>(index_offset),
+    static_cast<GLint>(stream_offset / sizeof(vertex_type)));
+}
+
+void
+engine_impl::render(const uchiha::vertex* vertices,
+                    size_t vertex_count,
+                    uchiha::index_span indices,
+                    const uchiha::texture* tx)
+{
+  call_trace.render(vertices, vertex_count, indices, tx);
+  render_indexed(
+    vertices, vertex_count, indices, tx, uchiha::vertex_format::full);
+}
+
+void
+engine_impl::render(const uchiha::packed_vertex* vertices,
+                    size_t vertex_count,
+                    uchiha::index_span indices,
+                    const uchiha::texture* tx)
+{
+  call_trace.render(vertices, vertex_count, indices, tx);
+  render_indexed(
+    vertices, vertex_count, indices, tx, uchiha::vertex_format::packed);
+}
+
+void
+engine_impl::render_instanced(const uchiha::sprite_instance* instances,
+                              size_t count,
+                              const uchiha::texture* tx)
+{
+  call_trace.render_instanced(instances, count, tx);
+  if (instances == nullptr || count == 0 || retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("render instanced");
+  const uchiha::texture& t = tx != nullptr ? *tx : *white_texture;
+  uchiha::shader* s = use_shader(instanced_program);
+  set_texture_uniform(s, t);
+  s->set_uniform("u_texture_rect", t.get_uv_rect());
+  state.set_blend(uchiha::blend_mode::alpha);
+
+  const size_t stride = sizeof(uchiha::sprite_instance);
+  size_t offset = vertex_stream.write(instances, count * stride, stride);
+  UCHIHA_PROFILE_GPU_SCOPE("render instanced");
+  draw_instances(offset, count);
+}
+
+void
+engine_impl::draw_instances(size_t offset, size_t count)
+{
+  const size_t stride = sizeof(uchiha::sprite_instance);
+  bind_vertex_format(uchiha::vertex_format::instance);
+  uchiha::profiler::count_draw();
+  if (uchiha::gl_ext::has_base_instance) {
+    uchiha::gl_ext::draw_arrays_instanced_base_instance(
+      GL_TRIANGLE_STRIP,
+      0,
+      4,
+      static_cast<GLsizei>(count),
+      static_cast<GLuint>(offset / stride));
+  } else {
+    // GL 3.3 has no base instance, so the instance attributes are moved to
+    // this draw's range instead.
+    set_instance_attributes(static_cast<GLintptr>(offset));
+    glDrawArraysInstanced(
+      GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(count));
+  }
+}
+
+void
+engine_impl::render_quads(const uchiha::sprite_instance* instances,
+                          size_t count,
+                          const uchiha::texture* tx)
+{
+  call_trace.render_quads(instances, count, tx);
+  if (instances == nullptr || count == 0 || retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("render quads");
+  const uchiha::texture& t = tx != nullptr ? *tx : *white_texture;
+  set_texture_uniform(use_shader(textured_program), t);
+  state.set_blend(uchiha::blend_mode::alpha);
+
+  const size_t num_of_vertices = count * 6;
+  uchiha::stream_buffer::range r = vertex_stream.map(
+    num_of_vertices * sizeof(uchiha::vertex), sizeof(uchiha::vertex));
+  if (r.data == nullptr) {
+    vertex_stream.commit();
+    return;
+  }
+  uchiha::build_quads(static_cast<uchiha::vertex*>(r.data),
+                      instances,
+                      count,
+                      t.get_uv_rect());
+  vertex_stream.commit();
+  bind_vertex_format(uchiha::vertex_format::full);
+
+  UCHIHA_PROFILE_GPU_SCOPE("render quads");
+  uchiha::profiler::count_draw();
+  glDrawArrays(GL_TRIANGLES,
+               static_cast<GLint>(r.offset / sizeof(uchiha::vertex)),
+               static_cast<GLsizei>(num_of_vertices));
+}
+
+void
+engine_impl::begin_batch()
+{
+  call_trace.begin_batch();
+  batch.clear();
+  retained_items.clear();
+}
+
+void
+engine_impl::submit(const uchiha::triangle* triangles,
+                    size_t count,
+                    uchiha::blend_mode blend,
+                    int16_t layer)
+{
+  call_trace.submit(triangles, count, nullptr, blend, layer);
+  batch_triangles(triangles, count, nullptr, blend, layer);
+}
+
+void
+engine_impl::submit(const uchiha::triangle* triangles,
+                    size_t count,
+                    const uchiha::texture& tx,
+                    uchiha::blend_mode blend,
+                    int16_t layer)
+{
+  call_trace.submit(triangles, count, &tx, blend, layer);
+  batch_triangles(triangles, count, &tx, blend, layer);
+}
+
+void
+engine_impl::batch_triangles(const uchiha::triangle* triangles,
+                             size_t count,
+                             const uchiha::texture* tx,
+                             uchiha::blend_mode blend,
+                             int16_t layer)
+{
+  const uint32_t program = tx != nullptr ? textured_program : color_program;
+  // The batch groups by GL handle, and every evicted or loading texture
+  // shares the placeholder's, so flush() would only see the first of them.
+  // Touching here also reloads a cooked texture before its handle is keyed.
+  if (tx != nullptr) {
+    touch_texture(*tx);
+  }
+  const size_t first_vertex = batch.vertex_count();
+  size_t culled =
+    batch.add(triangles,
+              count,
+              program,
+              tx,
+              tx != nullptr ? tx->get_uv_rect() : uchiha::uv_rect(),
+              blend,
+              layer,
+              culling_enabled ? &clip_transform : nullptr);
+  uchiha::profiler::count_culled(culled);
+  if (retaining()) {
+    record_retained_item(first_vertex, program, tx, blend, layer);
+  }
+}
+
+void
+engine_impl::record_retained_item(size_t first_vertex,
+                                  uint32_t program,
+                                  const uchiha::texture* t,
+                                  uchiha::blend_mode blend,
+                                  int16_t layer)
+{
+  // Recorded even when everything was culled, so the items of consecutive
+  // frames stay lined up when a sprite leaves the view.
+  const uint64_t words[] = { program,
+                             t != nullptr ? t->get_handle() : 0u,
+                             t != nullptr && t->is_ready(),
+                             static_cast<uint64_t>(blend),
+                             static_cast<uint16_t>(layer) };
+  retained_item item;
+  item.first_vertex = static_cast<uint32_t>(first_vertex);
+  item.vertex_count =
+    static_cast<uint32_t>(batch.vertex_count() - first_vertex);
+  item.state = uchiha::content_hash(
+    uchiha::content_hash_seed, words, sizeof(words));
+  retained_items.push_back(item);
+}
+
+void
+engine_impl::submit_text(const uchiha::font& f,
+                         std::string_view text,
+                         float x,
+                         float y,
+                         float scale,
+                         uint32_t rgba,
+                         uchiha::blend_mode blend,
+                         int16_t layer)
+{
+  call_trace.submit_text(f, text, x, y, scale, rgba, blend, layer);
+  if (text.empty()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("submit text");
+  const uint32_t glyphs_before = glyphs->glyph_count();
+  const uchiha::text_layout& layout =
+    text_layouts.get(static_cast<const uchiha::font_impl&>(f), text);
+  if (glyphs->glyph_count() != glyphs_before) {
+    state.invalidate_textures();
+  }
+
+  static_assert(sizeof(uchiha::triangle) == 3 * sizeof(uchiha::vertex),
+                "quads are built as vertices and submitted as triangles");
+  for (const uchiha::text_layout::run& run : layout.runs) {
+    text_quads.assign(layout.quads.begin() + run.first,
+                      layout.quads.begin() + run.first + run.count);
+    for (uchiha::sprite_instance& q : text_quads) {
+      q.x = x + q.x * scale;
+      q.y = y + q.y * scale;
+      q.scale_x *= scale;
+      q.scale_y *= scale;
+      q.r = static_cast<uint8_t>(rgba >> 24);
+      q.g = static_cast<uint8_t>(rgba >> 16);
+      q.b = static_cast<uint8_t>(rgba >> 8);
+      q.a = static_cast<uint8_t>(rgba);
+    }
+    text_vertices.resize(text_quads.size() * 6);
+    uchiha::build_quads(text_vertices.data(),
+                        text_quads.data(),
+                        text_quads.size(),
+                        uchiha::uv_rect());
+    batch_triangles(
+      reinterpret_cast<const uchiha::triangle*>(text_vertices.data()),
+      text_quads.size() * 2,
+      run.page,
+      blend,
+      layer);
+  }
+}
+
+uchiha::aabb
+engine_impl::measure_text(const uchiha::font& f,
+                          std::string_view text,
+                          float x,
+                          float y,
+                          float scale)
+{
+  const uint32_t glyphs_before = glyphs->glyph_count();
+  const uchiha::aabb& box =
+    text_layouts.get(static_cast<const uchiha::font_impl&>(f), text).bounds;
+  if (glyphs->glyph_count() != glyphs_before) {
+    state.invalidate_textures();
+  }
+  uchiha::aabb result;
+  result.min_x = x + box.min_x * scale;
+  result.min_y = y + box.min_y * scale;
+  result.max_x = x + box.max_x * scale;
+  result.max_y = y + box.max_y * scale;
+  return result;
+}
+
+void
+engine_impl::flush()
+{
+  call_trace.flush();
+  flush_batch();
+}
+
+void
+engine_impl::flush_batch()
+{
+  if (retaining()) {
+    retain_batch();
+    return;
+  }
+  if (batch.empty()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("flush");
+  const size_t stride = multi_texture_batching ? sizeof(uchiha::slotted_vertex)
+                                               : sizeof(uchiha::vertex);
+  uchiha::stream_buffer::range r =
+    vertex_stream.map(batch.vertex_count() * stride, stride);
+  if (r.data == nullptr) {
+    vertex_stream.commit();
+    batch.clear();
+    return;
+  }
+  const auto& groups =
+    multi_texture_batching
+      ? batch.build(static_cast<uchiha::slotted_vertex*>(r.data),
+                    multi_texture_program)
+      : batch.build(static_cast<uchiha::vertex*>(r.data));
+  vertex_stream.commit();
+  draw_groups(groups.data(),
+              groups.size(),
+              static_cast<GLint>(r.offset / stride),
+              multi_texture_batching ? uchiha::vertex_format::slotted
+                                     : uchiha::vertex_format::full);
+  batch.clear();
+}
+
+void
+engine_impl::draw_groups(const uchiha::sprite_batch::group* groups,
+                         size_t count,
+                         GLint base_vertex,
+                         uchiha::vertex_format format)
+{
+  // All groups live in one contiguous range, so each group only selects its
+  // first vertex; the state cache drops the redundant binds in between.
+  bind_vertex_format(format);
+  for (size_t i = 0; i < count; ++i) {
+    const uchiha::sprite_batch::group& g = groups[i];
+    uchiha::shader* s = use_shader(g.program);
+    if (g.slot_count > 1) {
+      for (size_t slot = 0; slot < g.slot_count; ++slot) {
+        set_texture_uniform(s, slot, *g.slots[slot]);
+      }
+    } else if (g.tex != nullptr) {
+      set_texture_uniform(s, *g.tex);
+    }
+    state.set_blend(g.blend);
+    UCHIHA_PROFILE_GPU_SCOPE("batch group");
+    uchiha::profiler::count_draw();
+    glDrawArrays(GL_TRIANGLES,
+                 base_vertex + static_cast<GLint>(g.first_vertex),
+                 static_cast<GLsizei>(g.vertex_count));
+  }
+}
+
+void
+engine_impl::retain_batch()
+{
+  if (batch.empty() && retained_items.empty()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("retain batch");
+  const int32_t width = offscreen_frame->get_width();
+  const int32_t height = offscreen_frame->get_height();
+  const uint64_t transform_hash = uchiha::content_hash(
+    uchiha::content_hash_seed, clip_transform.m, sizeof(clip_transform.m));
+
+  retained_batch b;
+  b.view_projection = view_projection;
+  b.model_transform = model_transform;
+  const uchiha::vertex* staged = batch.staged_vertices();
+  for (const retained_item& item : retained_items) {
+    const uchiha::vertex* v = staged + item.first_vertex;
+    uint64_t hash = uchiha::content_hash(
+      item.state, &transform_hash, sizeof(transform_hash));
+    hash = uchiha::content_hash(
+      hash, v, item.vertex_count * sizeof(uchiha::vertex));
+    const uchiha::pixel_rect bounds = uchiha::screen_bounds(
+      v, item.vertex_count, clip_transform, width, height);
+    dirty.add(hash, bounds);
+    if (b.bounds.empty()) {
+      b.bounds = bounds;
+    } else if (!bounds.empty()) {
+      b.bounds = uchiha::merge(b.bounds, bounds);
+    }
+  }
+  retained_items.clear();
+
+  if (!batch.empty() && !b.bounds.empty()) {
+    b.first_vertex = static_cast<uint32_t>(retained_vertices.size());
+    b.vertex_count = static_cast<uint32_t>(batch.vertex_count());
+    retained_vertices.resize(b.first_vertex + b.vertex_count);
+    const auto& groups =
+      batch.build(retained_vertices.data() + b.first_vertex);
+    b.first_group = static_cast<uint32_t>(retained_groups.size());
+    b.group_count = static_cast<uint32_t>(groups.size());
+    retained_groups.insert(retained_groups.end(), groups.begin(), groups.end());
+    retained_batches.push_back(b);
+  }
+  batch.clear();
+}
+
+void
+engine_impl::redraw_retained()
+{
+  const std::vector<uchiha::pixel_rect>& regions = dirty.end_frame(
+    offscreen_frame->get_width(), offscreen_frame->get_height());
+  regions_redrawn = static_cast<uint32_t>(regions.size());
+  pixels_redrawn = 0;
+  if (!regions.empty()) {
+    UCHIHA_PROFILE_SCOPE("retained redraw");
+    UCHIHA_PROFILE_GPU_SCOPE("retained redraw");
+    const uchiha::mat4 saved_view_projection = view_projection;
+    const uchiha::mat4 saved_model_transform = model_transform;
+    // A batch is uploaded the first time a region needs it.
+    retained_offsets.assign(retained_batches.size(), -1);
+    glEnable(GL_SCISSOR_TEST);
+    glClearColor(retained_background[0],
+                 retained_background[1],
+                 retained_background[2],
+                 retained_background[3]);
+    for (const uchiha::pixel_rect& r : regions) {
+      pixels_redrawn += static_cast<uint64_t>(r.area());
+      glScissor(r.x0, r.y0, r.x1 - r.x0, r.y1 - r.y0);
+      glClear(GL_COLOR_BUFFER_BIT);
+      for (size_t i = 0; i < retained_batches.size(); ++i) {
+        const retained_batch& b = retained_batches[i];
+        if (!uchiha::overlaps(b.bounds, r)) {
+          continue;
+        }
+        if (retained_offsets[i] < 0) {
+          const size_t bytes = b.vertex_count * sizeof(uchiha::vertex);
+          uchiha::stream_buffer::range range =
+            vertex_stream.map(bytes, sizeof(uchiha::vertex));
+          if (range.data == nullptr) {
+            vertex_stream.commit();
+            continue;
+          }
+          std::memcpy(
+            range.data, retained_vertices.data() + b.first_vertex, bytes);
+          vertex_stream.commit();
+          retained_offsets[i] =
+            static_cast<GLint>(range.offset / sizeof(uchiha::vertex));
+        }
+        apply_view_projection(b.view_projection);
+        apply_model_transform(b.model_transform);
+        draw_groups(retained_groups.data() + b.first_group,
+                    b.group_count,
+                    retained_offsets[i],
+                    uchiha::vertex_format::full);
+      }
+    }
+    glDisable(GL_SCISSOR_TEST);
+    apply_view_projection(saved_view_projection);
+    apply_model_transform(saved_model_transform);
+  }
+  retained_batches.clear();
+  retained_vertices.clear();
+  retained_groups.clear();
+}
+
+void
+engine_impl::swap_buffers()
+{
+  change_render_target(nullptr);
+  flush_batch();
+  if (retained) {
+    redraw_retained();
+  } else {
+    regions_redrawn = 0;
+    pixels_redrawn = 0;
+  }
+  if (offscreen_frame != nullptr) {
+    UCHIHA_PROFILE_SCOPE("upscale");
+    UCHIHA_PROFILE_GPU_SCOPE("upscale");
+    const bool same_size = offscreen_frame->get_width() == window_width &&
+                           offscreen_frame->get_height() == window_height;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, offscreen_frame->framebuffer());
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0,
+                      0,
+                      offscreen_frame->get_width(),
+                      offscreen_frame->get_height(),
+                      0,
+                      0,
+                      window_width,
+                      window_height,
+                      GL_COLOR_BUFFER_BIT,
+                      same_size ? GL_NEAREST : GL_LINEAR);
+  }
+  capture.update();
+  if (capture.wants_frame()) {
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    capture.read_frame(window_width, window_height);
+  }
+  vertex_stream.end_frame();
+  index_stream.end_frame();
+  {
+    UCHIHA_PROFILE_SCOPE("present");
+    SDL_GL_SwapWindow(window);
+  }
+  uchiha::profiler::end_frame();
+
+  bind_current_target();
+  if (!retained) {
+    glClearColor(0.0f, 0.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+
+  loader.process_uploads(texture_upload_budget_ms);
+  for (uchiha::texture_impl* failed : loader.failed_loads()) {
+    textures.fail(*failed);
+  }
+  textures.end_frame();
+  text_layouts.end_frame();
+  state.invalidate_textures();
+  program_cache.update();
+  frame_memory.next_frame();
+
+  {
+    UCHIHA_PROFILE_SCOPE("frame limiter");
+    pacer.end_frame();
+  }
+  call_trace.end_frame(pacer.last_frame_seconds());
+}
+
+uchiha::particle_emitter*
+engine_impl::create_particle_emitter(const uchiha::particle_settings& settings,
+                                     float x,
+                                     float y)
+{
+  uchiha::particle_emitter* e = particles.create(settings, x, y);
+  call_trace.create_particle_emitter(e, settings, x, y);
+  return e;
+}
+
+void
+engine_impl::destroy_particle_emitter(uchiha::particle_emitter* e)
+{
+  call_trace.destroy_particle_emitter(e);
+  if (e != nullptr && !particles.destroy(e)) {
+    std::cerr << "error: Particle emitter was not created by this engine "
+                 "( engine.cxx: )"
+              << std::endl;
+  }
+}
+
+void
+engine_impl::move_particle_emitter(uchiha::particle_emitter& e,
+                                   float x,
+                                   float y)
+{
+  call_trace.move_particle_emitter(e, x, y);
+  static_cast<uchiha::particle_emitter_impl&>(e).move(x, y);
+}
+
+void
+engine_impl::emit_particles(uchiha::particle_emitter& e, uint32_t count)
+{
+  call_trace.emit_particles(e, count);
+  static_cast<uchiha::particle_emitter_impl&>(e).burst(count);
+}
+
+void
+engine_impl::update_particles(float seconds)
+{
+  call_trace.update_particles(seconds);
+  particles.update(seconds);
+}
+
+void
+engine_impl::draw_particles(const uchiha::particle_emitter& e,
+                            const uchiha::texture* tx)
+{
+  call_trace.draw_particles(e, tx);
+  const auto& impl = static_cast<const uchiha::particle_emitter_impl&>(e);
+  const size_t count = impl.size();
+  if (count == 0 || retaining()) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("draw particles");
+  const uchiha::texture& t = tx != nullptr ? *tx : *white_texture;
+  uchiha::shader* s = use_shader(instanced_program);
+  set_texture_uniform(s, t);
+  s->set_uniform("u_texture_rect", t.get_uv_rect());
+  state.set_blend(impl.settings().blend);
+
+  // The instances are written in place, so unlike render_instanced() there
+  // is no copy out of a caller's array.
+  const size_t stride = sizeof(uchiha::sprite_instance);
+  uchiha::stream_buffer::range r = vertex_stream.map(count * stride, stride);
+  if (r.data == nullptr) {
+    vertex_stream.commit();
+    return;
+  }
+  particles.write_instances(impl,
+                            static_cast<uchiha::sprite_instance*>(r.data));
+  vertex_stream.commit();
+  UCHIHA_PROFILE_GPU_SCOPE("draw particles");
+  draw_instances(r.offset, count);
+}
+
+void
+engine_impl::set_view_projection(const uchiha::mat4& m)
+{
+  call_trace.set_view_projection(m);
+  apply_view_projection(m);
+}
+
+void
+engine_impl::apply_view_projection(const uchiha::mat4& m)
+{
+  if (m == view_projection) {
+    return;
+  }
+  view_projection = m;
+  clip_transform = view_projection * model_transform;
+  glBindBuffer(GL_UNIFORM_BUFFER, camera_buffer);
+  glBufferSubData(
+    GL_UNIFORM_BUFFER, 0, sizeof(view_projection.m), view_projection.m);
+  uchiha::profiler::count_upload(sizeof(view_projection.m));
+}
+
+void
+engine_impl::set_model_transform(const uchiha::mat4& model)
+{
+  call_trace.set_model_transform(model);
+  apply_model_transform(model);
+}
+
+void
+engine_impl::apply_model_transform(const uchiha::mat4& model)
+{
+  model_transform = model;
+  clip_transform = view_projection * model_transform;
+}
+
+void
+engine_impl::set_culling_enabled(bool enabled)
+{
+  call_trace.set_culling_enabled(enabled);
+  culling_enabled = enabled;
+}
+
+void
+engine_impl::set_multi_texture_batching(bool enabled)
+{
+  call_trace.set_multi_texture_batching(enabled);
+  multi_texture_batching = enabled;
+}
+
+void*
+engine_impl::allocate_frame_memory(size_t bytes, size_t alignment)
+{
+  return frame_memory.allocate(bytes, alignment);
+}
+
+bool
+engine_impl::set_vsync(uchiha::vsync_mode mode)
+{
+  call_trace.set_vsync(mode);
+  if (mode == uchiha::vsync_mode::adaptive) {
+    if (SDL_GL_SetSwapInterval(-1) == 0) {
+      return true;
+    }
+    mode = uchiha::vsync_mode::on;
+  }
+  if (SDL_GL_SetSwapInterval(mode == uchiha::vsync_mode::on ? 1 : 0) != 0) {
+    std::cerr << "error: Failed to change the swap interval ( engine.cxx:  )"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void
+engine_impl::set_frame_rate_limit(float frames_per_second)
+{
+  call_trace.set_frame_rate_limit(frames_per_second);
+  pacer.set_limit(frames_per_second);
+}
+
+double
+engine_impl::get_frame_seconds() const
+{
+  return pacer.last_frame_seconds();
+}
+
+void
+engine_impl::set_shader_hot_reload(bool enabled)
+{
+  program_cache.set_hot_reload(enabled);
+}
+
+void
+engine_impl::set_profiling_enabled(bool enabled)
+{
+  uchiha::profiler::set_enabled(enabled);
+}
+
+uchiha::frame_stats
+engine_impl::get_frame_stats() const
+{
+  uchiha::frame_stats stats = uchiha::profiler::last_frame();
+  stats.texture_bytes = textures.resident_bytes();
+  stats.textures_evicted = textures.evicted_last_frame();
+  stats.regions_redrawn = regions_redrawn;
+  stats.pixels_redrawn = pixels_redrawn;
+  stats.particles = static_cast<uint32_t>(particles.live_count());
+  stats.capture_frames_dropped = capture.dropped_frames();
+  return stats;
+}
+
+bool
+engine_impl::write_profile_trace(std::string_view path)
+{
+  return uchiha::profiler::write_trace(path);
+}
+
+void
+engine_impl::save_screenshot(std::string_view path)
+{
+  capture.request_screenshot(path);
+}
+
+bool
+engine_impl::start_recording(std::string_view path)
+{
+  return capture.start_recording(path);
+}
+
+void
+engine_impl::stop_recording()
+{
+  capture.stop_recording();
+}
+
+bool
+engine_impl::start_trace(std::string_view path)
+{
+  return call_trace.start(path, jobs, window_width, window_height);
+}
+
+void
+engine_impl::stop_trace()
+{
+  call_trace.stop();
+}
+
+void
+engine_impl::destroy()
+{
+  call_trace.stop();
+  loader.stop();
+  particles.stop();
+  capture.destroy();
+  jobs.stop();
+  textures.destroy();
+  atlases.clear();
+  text_layouts.clear();
+  fonts.clear();
+  delete glyphs;
+  glyphs = nullptr;
+  if (TTF_WasInit() != 0) {
+    TTF_Quit();
+  }
+  for (uchiha::resource_pack* pack : packs) {
+    delete pack;
+  }
+  packs.clear();
+  resource_scratch = std::vector<uint8_t>();
+  for (std::unique_ptr<uchiha::mesh_impl>& m : meshes) {
+    delete_mesh_objects(*m);
+  }
+  meshes.clear();
+  for (std::unique_ptr<uchiha::render_target_impl>& t : render_targets) {
+    t->destroy();
+  }
+  render_targets.clear();
+  if (offscreen_frame != nullptr) {
+    offscreen_frame->destroy();
+    delete offscreen_frame;
+    offscreen_frame = nullptr;
+  }
+  current_target = nullptr;
+  retained = false;
+  retained_items.clear();
+  retained_batches.clear();
+  retained_vertices.clear();
+  retained_groups.clear();
+  uchiha::profiler::destroy();
+  shaders.clear();
+  program_cache.destroy();
+  glDeleteBuffers(1, &camera_buffer);
+  camera_buffer = 0;
+  vertex_stream.destroy();
+  index_stream.destroy();
+  glDeleteVertexArrays(uchiha::vertex_format_count, vertex_arrays);
+  for (GLuint& vao : vertex_arrays) {
+    vao = 0;
+  }
+  if (white_texture != nullptr) {
+    GLuint white_handle = white_texture->get_handle();
+    glDeleteTextures(1, &white_handle);
+    delete white_texture;
+    white_texture = nullptr;
+  }
+  if (placeholder_texture != nullptr) {
+    GLuint placeholder_handle = placeholder_texture->get_handle();
+    glDeleteTextures(1, &placeholder_handle);
+    delete placeholder_texture;
+    placeholder_texture = nullptr;
+  }
+  SDL_GL_DeleteContext(context);
+  SDL_DestroyWindow(window);
+  SDL_Quit();
+}
+
+bool
+uchiha::make_context_current(uchiha::engine& e, bool current)
+{
+  engine_impl& impl = static_cast<engine_impl&>(e);
+  return SDL_GL_MakeCurrent(impl.window, current ? impl.context : nullptr) ==
+         0;
+}
+
+uchiha::engine*
+uchiha::create_engine()
+{
+  engine_impl* engine = new engine_impl();
+  return engine;
+}
+
+void
+uchiha::destroy_engine(uchiha::engine* e)
+{
+  if (e)
+    delete e;
 }
@@ -1,6 +1,8 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 namespace uchiha {
 
@@ -47,6 +49,71 @@ struct vertex
   {}
 };
 
+// Compact 12 byte layout for 2D geometry: half-float position, RGBA8 color
+// and unorm16 texture coordinates. Build it with pack_vertex().
+struct packed_vertex
+{
+  uint16_t x = 0;
+  uint16_t y = 0;
+  uint8_t r = 0;
+  uint8_t g = 0;
+  uint8_t b = 0;
+  uint8_t a = 0;
+  uint16_t tx = 0;
+  uint16_t ty = 0;
+};
+
+packed_vertex
+pack_vertex(const vertex& v);
+
+uint16_t
+float_to_half(float f);
+
+enum class index_type : uint8_t
+{
+  u16,
+  u32
+};
+
+// Non-owning view of a triangle list index array.
+struct index_span
+{
+  const void* data = nullptr;
+  size_t count = 0;
+  index_type type = index_type::u16;
+  index_span() = default;
+  index_span(const uint16_t* indices, size_t index_count)
+    : data(indices)
+    , count(index_count)
+    , type(index_type::u16)
+  {}
+  index_span(const uint32_t* indices, size_t index_count)
+    : data(indices)
+    , count(index_count)
+    , type(index_type::u32)
+  {}
+};
+
+// One quad of engine::render_instanced() and render_quads(). The quad is centered on (x, y),
+// scale_x by scale_y in size and rotated counter-clockwise by rotation
+// radians; the uv rectangle is relative to the texture's own get_uv_rect().
+struct sprite_instance
+{
+  float x = 0.f;
+  float y = 0.f;
+  float scale_x = 1.f;
+  float scale_y = 1.f;
+  float rotation = 0.f;
+  float u0 = 0.f;
+  float v0 = 0.f;
+  float u1 = 1.f;
+  float v1 = 1.f;
+  uint8_t r = 255;
+  uint8_t g = 255;
+  uint8_t b = 255;
+  uint8_t a = 255;
+};
+
 struct triangle
 {
   vertex v[3];
@@ -58,26 +125,292 @@ struct triangle
   }
 };
 
+enum class blend_mode : uint8_t
+{
+  alpha,
+  additive,
+  opaque
+};
+
+// Part of a texture covered by its image, in normalized coordinates.
+struct uv_rect
+{
+  float u0 = 0.f;
+  float v0 = 0.f;
+  float u1 = 1.f;
+  float v1 = 1.f;
+};
+
+// Column-major 4x4 matrix, the layout GLSL expects. Default constructed it
+// is the identity.
+struct mat4
+{
+  float m[16] = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f,
+                  0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+
+  static mat4 translation(float x, float y, float z = 0.f);
+  static mat4 scale(float x, float y, float z = 1.f);
+  static mat4 rotation_z(float radians);
+  // Maps the box [left, right] x [bottom, top] x [near_z, far_z] to clip
+  // space.
+  static mat4 ortho(float left,
+                    float right,
+                    float bottom,
+                    float top,
+                    float near_z = -1.f,
+                    float far_z = 1.f);
+
+  bool operator==(const mat4& other) const;
+  bool operator!=(const mat4& other) const { return !(*this == other); }
+};
+
+mat4
+operator*(const mat4& a, const mat4& b);
+
+// Axis-aligned rectangle in world units.
+struct aabb
+{
+  float min_x = 0.f;
+  float min_y = 0.f;
+  float max_x = 0.f;
+  float max_y = 0.f;
+};
+
+// Orthographic camera for 2D scenes: shows width by height world units
+// around (x, y), divided by zoom and turned by rotation (radians, counter
+// clockwise). The defaults reproduce plain clip space coordinates.
+struct camera_2d
+{
+  float x = 0.f;
+  float y = 0.f;
+  float width = 2.f;
+  float height = 2.f;
+  float zoom = 1.f;
+  float rotation = 0.f;
+
+  mat4 view_projection() const;
+  // World area the camera shows; with rotation, the box around it.
+  aabb visible_bounds() const;
+};
+
+// Generational index into one of the engine's resource pools. Destroying a
+// resource bumps the generation of its slot, so a handle that outlived it
+// no longer resolves, even once the slot holds something else.
+struct slot_handle
+{
+  static constexpr uint32_t none = 0xffffffffu;
+  uint32_t index = none;
+  uint32_t generation = 0;
+};
+
 class texture
 {
 public:
   virtual ~texture();
   virtual uint16_t get_width() const = 0;
   virtual uint16_t get_height() const = 0;
-  virtual uint32_t get_handle() const = 0;
+  // GL texture object. Batching reads it for every draw, so it is a plain
+  // member rather than a virtual call.
+  uint32_t get_handle() const { return gl_handle; }
+  // Texture coordinates in [0, 1] passed to render() and submit() are mapped
+  // into this rectangle, so atlas sub-textures are used like whole ones.
+  virtual uv_rect get_uv_rect() const;
+  // False while an asynchronously created texture is still loading; until
+  // then it draws as a transparent 1x1 placeholder.
+  virtual bool is_ready() const;
+  // Slot in the engine's texture pool for textures loaded from files.
+  slot_handle get_slot() const { return slot; }
+
+protected:
+  uint32_t gl_handle = 0;
+  slot_handle slot;
+};
+
+// Offscreen color buffer that draws can be directed into with
+// engine::set_render_target(). It is a texture as well, so what was drawn
+// into it can be drawn like any image; its uv rectangle turns the bottom-up
+// framebuffer rows the right way up.
+class render_target : public texture
+{
+public:
+  ~render_target() override;
+};
+
+enum class mesh_usage : uint8_t
+{
+  // Uploaded once, or updated rarely.
+  static_draw,
+  // Rewritten most frames through update_mesh().
+  dynamic_draw
+};
+
+// Geometry that lives in GPU memory from create_mesh() until destroy_mesh(),
+// so drawing it uploads nothing.
+class mesh
+{
+public:
+  virtual ~mesh();
+  virtual size_t get_vertex_count() const = 0;
+  // 0 for a plain triangle list.
+  virtual size_t get_index_count() const = 0;
+};
+
+// Set of large pages that many small images are packed into. Textures
+// created through an atlas share the page's GL texture, which keeps them in
+// one batch group. They do not support GL_REPEAT addressing.
+class texture_atlas
+{
+public:
+  virtual ~texture_atlas();
+  virtual size_t get_page_count() const = 0;
+};
+
+// TrueType font opened by engine::create_font() at one pixel size.
+class font
+{
+public:
+  virtual ~font();
+  virtual uint16_t get_size() const = 0;
+  // Distance between baselines, in pixels.
+  virtual float get_line_height() const = 0;
+};
+
+// How an emitter spawns and animates its particles. Lengths are in world
+// units, angles in radians and times in seconds. Over its life a particle
+// goes from size_start to size_end and from color_start to color_end, both
+// 0xRRGGBBAA.
+struct particle_settings
+{
+  uint32_t max_particles = 10000;
+  // Spawned per second; engine::emit_particles() adds bursts on top.
+  float rate = 100.f;
+  // Particles start anywhere within this distance of the emitter.
+  float spawn_radius = 0.f;
+  float life_min = 1.f;
+  float life_max = 1.f;
+  // Launch velocities point within spread / 2 of direction.
+  float direction = 0.f;
+  float spread = 6.28318531f;
+  float speed_min = 0.f;
+  float speed_max = 1.f;
+  float gravity_x = 0.f;
+  float gravity_y = 0.f;
+  // Velocity decays by exp(-drag * seconds).
+  float drag = 0.f;
+  float spin_min = 0.f;
+  float spin_max = 0.f;
+  float size_start = 0.05f;
+  float size_end = 0.05f;
+  uint32_t color_start = 0xffffffffu;
+  uint32_t color_end = 0xffffff00u;
+  // Part of the texture each particle shows.
+  uv_rect uv;
+  blend_mode blend = blend_mode::additive;
+};
+
+// Emitter made by engine::create_particle_emitter(). Its particles live in
+// the engine and are only reachable through engine calls.
+class particle_emitter
+{
+public:
+  virtual ~particle_emitter();
+};
+
+// Profiler numbers for the most recently completed frame. The GPU time is
+// read back a few frames late so that the timer queries never stall.
+struct frame_stats
+{
+  float cpu_milliseconds = 0.f;
+  float gpu_milliseconds = 0.f;
+  uint32_t draw_calls = 0;
+  uint32_t texture_binds = 0;
+  uint32_t state_changes = 0;
+  uint64_t bytes_uploaded = 0;
+  // Triangles and meshes skipped for lying outside the view.
+  uint32_t primitives_culled = 0;
+  // GPU memory of the resident textures loaded from files, and how many of
+  // them the texture budget evicted at the end of the frame.
+  uint64_t texture_bytes = 0;
+  uint32_t textures_evicted = 0;
+  // In retained mode, the regions swap_buffers() repainted and their area.
+  uint32_t regions_redrawn = 0;
+  uint64_t pixels_redrawn = 0;
+  // Particles alive after the last update_particles().
+  uint32_t particles = 0;
+  // Frames the current recording skipped because its readbacks were still
+  // busy, counted since start_recording().
+  uint32_t capture_frames_dropped = 0;
+};
+
+// Swap interval used by swap_buffers(). adaptive waits for vblank only when
+// the frame is on time and tears instead of dropping to half rate when it
+// is late; drivers without EXT_swap_control_tear fall back to on.
+enum class vsync_mode : uint8_t
+{
+  off,
+  on,
+  adaptive,
+};
+
+// Accumulator for running the simulation at a fixed rate independent of
+// the frame rate:
+//
+//   sim.advance(engine->get_frame_seconds());
+//   while (sim.step()) {
+//     update(sim.step_seconds());
+//   }
+//   draw(sim.alpha()); // blend previous and current state
+//
+// A frame longer than max_steps steps drops the excess time instead of
+// trying to catch up, so a stall cannot snowball.
+class fixed_timestep
+{
+public:
+  explicit fixed_timestep(double step_seconds, unsigned max_steps = 5)
+    : step_length(step_seconds)
+    , step_limit(max_steps)
+  {}
+
+  void advance(double frame_seconds)
+  {
+    accumulator += frame_seconds;
+    if (accumulator > step_length * step_limit) {
+      accumulator = step_length * step_limit;
+    }
+  }
+  bool step()
+  {
+    if (accumulator < step_length) {
+      return false;
+    }
+    accumulator -= step_length;
+    return true;
+  }
+  // How far the current frame lies between the last two steps, in [0, 1).
+  double alpha() const { return accumulator / step_length; }
+  double step_seconds() const { return step_length; }
+
+private:
+  double step_length;
+  unsigned step_limit;
+  double accumulator = 0.0;
 };
 
 struct event
 {
-  enum
+  enum event_type
   {
     pressed,
     reliased,
     quit,
     mouse_motion,
-    mouse_click
+    // Mouse button released; mouse_button says which.
+    mouse_click,
+    mouse_down,
+    mouse_wheel
   } type;
-  enum
+  // Physical key positions, named after the US layout.
+  enum key_code
   {
     left,
     right,
@@ -86,10 +419,141 @@ struct event
     enter,
     escape,
     space,
+    a,
+    b,
+    c,
+    d,
+    e,
+    f,
+    g,
+    h,
+    i,
+    j,
+    k,
+    l,
+    m,
+    n,
+    o,
+    p,
+    q,
+    r,
+    s,
+    t,
+    u,
+    v,
+    w,
+    x,
+    y,
+    z,
+    num_0,
+    num_1,
+    num_2,
+    num_3,
+    num_4,
+    num_5,
+    num_6,
+    num_7,
+    num_8,
+    num_9,
+    f1,
+    f2,
+    f3,
+    f4,
+    f5,
+    f6,
+    f7,
+    f8,
+    f9,
+    f10,
+    f11,
+    f12,
+    tab,
+    backspace,
+    insert,
+    delete_key,
+    home,
+    end,
+    page_up,
+    page_down,
+    caps_lock,
+    left_shift,
+    right_shift,
+    left_ctrl,
+    right_ctrl,
+    left_alt,
+    right_alt,
+    left_super,
+    right_super,
+    minus,
+    equals,
+    left_bracket,
+    right_bracket,
+    backslash,
+    semicolon,
+    apostrophe,
+    grave,
+    comma,
+    period,
+    slash,
+    print_screen,
+    scroll_lock,
+    pause,
+    num_lock,
+    keypad_0,
+    keypad_1,
+    keypad_2,
+    keypad_3,
+    keypad_4,
+    keypad_5,
+    keypad_6,
+    keypad_7,
+    keypad_8,
+    keypad_9,
+    keypad_divide,
+    keypad_multiply,
+    keypad_minus,
+    keypad_plus,
+    keypad_period,
     undefined_key
   } key;
   int mouse_x = 0;
   int mouse_y = 0;
+  // Motion since the previous mouse_motion event. Consecutive motion events
+  // are merged into one, so this may cover several SDL events.
+  int mouse_dx = 0;
+  int mouse_dy = 0;
+  // 1 left, 2 middle, 3 right, 4 and 5 the side buttons.
+  uint8_t mouse_button = 0;
+  int wheel_x = 0;
+  int wheel_y = 0;
+};
+
+// Keyboard and mouse state as of the last event poll. Every query is a
+// table lookup.
+struct input_state
+{
+  static constexpr size_t key_count = event::undefined_key + 1;
+
+  bool is_down(event::key_code key) const { return keys_down[key]; }
+  // Went down / up during the last poll.
+  bool was_pressed(event::key_code key) const { return keys_pressed[key]; }
+  bool was_released(event::key_code key) const { return keys_released[key]; }
+  bool is_mouse_down(uint8_t button) const
+  {
+    return button < 32 && ((mouse_buttons >> button) & 1u) != 0;
+  }
+
+  bool keys_down[key_count] = {};
+  bool keys_pressed[key_count] = {};
+  bool keys_released[key_count] = {};
+  uint32_t mouse_buttons = 0;
+  int mouse_x = 0;
+  int mouse_y = 0;
+  // Accumulated over the last poll.
+  int mouse_dx = 0;
+  int mouse_dy = 0;
+  int wheel_x = 0;
+  int wheel_y = 0;
 };
 
 class engine
@@ -97,18 +561,316 @@ class engine
 public:
   virtual ~engine();
   virtual bool init(uint16_t ww, uint16_t wh, bool fullscren = false) = 0;
+  // Size of the GPU ring that render() streams vertices through. Takes
+  // effect immediately when called after init().
+  virtual void set_stream_buffer_budget(uint32_t bytes) = 0;
+  // Pops one event. When the queue is empty it is refilled with everything
+  // SDL has pending, once per drain: the call that finds it empty again
+  // returns false, so `while (read_input(e))` polls exactly once.
   virtual bool read_input(event& e) = 0;
+  // Refills the event queue and refreshes get_input() without popping.
+  virtual void poll_events() = 0;
+  virtual const input_state& get_input() const = 0;
+  // Maps a pack written by tools/resource_packer. Files are then looked up
+  // by path in the mounted packs first, the last mounted first, and only
+  // read from disk when no pack has them. init() mounts res.pack from the
+  // working directory when there is one.
+  virtual bool mount_resource_pack(std::string_view path) = 0;
+  // Textures loaded from files are shared per path: asking for a path that
+  // is already loaded, or still loading, returns the same texture with one
+  // more reference. release_texture() drops one and frees the texture with
+  // the last.
   virtual texture* create_texture(std::string_view path) = 0;
-  virtual void render(const std::vector<triangle>& vertex_buffer) = 0;
-  virtual void render(const std::vector<triangle>& vertex_buffer,
+  // Returns immediately with a placeholder. The image is decoded on a
+  // worker thread and uploaded over the following swap_buffers() calls,
+  // spending at most the upload budget (2 ms by default) per frame.
+  virtual texture* create_texture_async(std::string_view path) = 0;
+  virtual void set_texture_upload_budget(float milliseconds) = 0;
+  // Atlas sub-textures belong to their atlas and are ignored.
+  virtual void release_texture(texture* t) = 0;
+  // GPU memory the textures loaded from files may take. At the end of a
+  // frame over budget the least recently drawn are evicted; an evicted
+  // texture draws as the transparent placeholder and is reloaded through
+  // the create_texture_async() pipeline the next time it is drawn. 0, the
+  // default, never evicts.
+  virtual void set_texture_budget(uint64_t bytes) = 0;
+  // Pages are added on demand, so an atlas never runs out of space. The
+  // atlas owns everything created through it, and the engine owns the
+  // atlas until destroy_atlas() or destroy().
+  virtual texture_atlas* create_atlas(uint16_t page_width = 2048,
+                                      uint16_t page_height = 2048) = 0;
+  virtual texture* create_texture(std::string_view path,
+                                  texture_atlas& atlas) = 0;
+  // Frees the atlas with its pages and every texture created through it.
+  virtual void destroy_atlas(texture_atlas* atlas) = 0;
+  // Fonts are rendered with SDL_ttf. Glyphs are rasterized into an atlas
+  // shared by all fonts the first time they are drawn, and laid out text is
+  // cached per font and string, so text that stays the same is neither
+  // rasterized nor laid out again. Returns nullptr when the file cannot be
+  // opened.
+  virtual font* create_font(std::string_view path, uint16_t pixel_size) = 0;
+  virtual void destroy_font(font* f) = 0;
+
+  // Copies the vertices (a triangle list, or indexed by indices when that is
+  // not empty) into buffers owned by the mesh.
+  virtual mesh* create_mesh(const vertex* vertices,
+                            size_t vertex_count,
+                            index_span indices,
+                            mesh_usage usage) = 0;
+  mesh* create_mesh(const std::vector<vertex>& vertices,
+                    mesh_usage usage = mesh_usage::static_draw)
+  {
+    return create_mesh(vertices.data(), vertices.size(), index_span(), usage);
+  }
+  mesh* create_mesh(const std::vector<triangle>& triangles,
+                    mesh_usage usage = mesh_usage::static_draw)
+  {
+    return create_mesh(triangles.empty() ? nullptr : &triangles[0].v[0],
+                       triangles.size() * 3,
+                       index_span(),
+                       usage);
+  }
+  // Overwrites count vertices starting at first_vertex. Returns false, and
+  // changes nothing, when the range does not fit the mesh.
+  virtual bool update_mesh(mesh& m,
+                           size_t first_vertex,
+                           const vertex* vertices,
+                           size_t count) = 0;
+  // Texture coordinates are used as stored: atlas sub-textures are not
+  // remapped the way render() remaps them.
+  virtual void draw_mesh(const mesh& m,
+                         const texture* t = nullptr,
+                         const mat4& transform = mat4()) = 0;
+  virtual void destroy_mesh(mesh* m) = 0;
+
+  // Render targets start out cleared to transparent black. Returns nullptr
+  // when the framebuffer cannot be created.
+  virtual render_target* create_render_target(uint16_t width,
+                                              uint16_t height) = 0;
+  virtual void destroy_render_target(render_target* t) = 0;
+  // Sends the draws that follow into t, or back to the frame with nullptr.
+  // Batched draws submitted before the switch are flushed into the old
+  // target. swap_buffers() switches back to the frame.
+  virtual void set_render_target(render_target* t) = 0;
+  // Clears the current render target, or the frame.
+  virtual void clear(float r, float g, float b, float a) = 0;
+  // Renders the frame at scale times the window size into an offscreen
+  // buffer that swap_buffers() stretches over the window, so a slow GPU can
+  // shade fewer pixels. 1, the default, draws into the window directly.
+  // Returns false when the offscreen buffer cannot be created; the scale
+  // then goes back to 1 and retained mode is turned off.
+  virtual bool set_resolution_scale(float scale) = 0;
+  // Retained mode, for mostly static screens such as menus. The frame is
+  // kept offscreen and not cleared between frames; batches flushed into it
+  // are kept until swap_buffers(), which compares this frame's submit()
+  // calls with the last frame's, one by one in order, and repaints only
+  // the rectangles where they differ. A frame identical to the last draws
+  // nothing. Keep submitting the whole scene every frame, in a stable
+  // order. While it is on, the other draw calls only reach render targets,
+  // and clear() of the frame sets the color repainted regions start from.
+  // Returns false when the offscreen frame cannot be created.
+  virtual bool set_retained_mode(bool enabled) = 0;
+  // Repaints the whole frame at the next swap_buffers() in retained mode,
+  // for changes submissions do not show, such as new contents of a render
+  // target that the frame draws.
+  virtual void invalidate_frame() = 0;
+
+  virtual void render(const triangle* triangles, size_t count) = 0;
+  virtual void render(const triangle* triangles,
+                      size_t count,
                       const texture& t) = 0;
+  void render(const std::vector<triangle>& vertex_buffer)
+  {
+    render(vertex_buffer.data(), vertex_buffer.size());
+  }
+  void render(const std::vector<triangle>& vertex_buffer, const texture& t)
+  {
+    render(vertex_buffer.data(), vertex_buffer.size(), t);
+  }
+  // Indexed triangle lists, drawn with glDrawElements. t may be nullptr for
+  // untextured geometry.
+  virtual void render(const vertex* vertices,
+                      size_t vertex_count,
+                      index_span indices,
+                      const texture* t = nullptr) = 0;
+  virtual void render(const packed_vertex* vertices,
+                      size_t vertex_count,
+                      index_span indices,
+                      const texture* t = nullptr) = 0;
+  // Draws count quads with a single glDrawArraysInstanced. The per-instance
+  // data is all that is uploaded; corners are expanded on the GPU.
+  virtual void render_instanced(const sprite_instance* instances,
+                                size_t count,
+                                const texture* t = nullptr) = 0;
+  // Same quads, expanded on the CPU with the SIMD kernels of
+  // quad_builder.hxx straight into the vertex stream and drawn as plain
+  // triangles; for drivers where instancing many tiny quads is slow.
+  virtual void render_quads(const sprite_instance* instances,
+                            size_t count,
+                            const texture* t = nullptr) = 0;
+  // Batched submission. Triangles are collected until flush() (or
+  // swap_buffers()) and then drawn with one call per shader/texture/blend
+  // group. Draw order is kept between layers and between submissions with
+  // identical state, not between differently textured submissions that
+  // share a layer.
+  virtual void begin_batch() = 0;
+  virtual void submit(const triangle* triangles,
+                      size_t count,
+                      blend_mode blend = blend_mode::alpha,
+                      int16_t layer = 0) = 0;
+  virtual void submit(const triangle* triangles,
+                      size_t count,
+                      const texture& t,
+                      blend_mode blend = blend_mode::alpha,
+                      int16_t layer = 0) = 0;
+  void submit(const std::vector<triangle>& vertex_buffer,
+              blend_mode blend = blend_mode::alpha,
+              int16_t layer = 0)
+  {
+    submit(vertex_buffer.data(), vertex_buffer.size(), blend, layer);
+  }
+  void submit(const std::vector<triangle>& vertex_buffer,
+              const texture& t,
+              blend_mode blend = blend_mode::alpha,
+              int16_t layer = 0)
+  {
+    submit(vertex_buffer.data(), vertex_buffer.size(), t, blend, layer);
+  }
+  // Submits UTF-8 text like submit(), as one run of quads per glyph atlas
+  // page. The first baseline starts at (x, y) and a font pixel is scale
+  // world units; '\n' starts a new line. rgba is 0xRRGGBBAA.
+  virtual void submit_text(const font& f,
+                           std::string_view text,
+                           float x,
+                           float y,
+                           float scale = 1.f,
+                           uint32_t rgba = 0xffffffffu,
+                           blend_mode blend = blend_mode::alpha,
+                           int16_t layer = 0) = 0;
+  // Box submit_text() lays the text out in: from the pen origin to the end
+  // of the widest line, and from the ascender of the first line to the
+  // descender of the last.
+  virtual aabb measure_text(const font& f,
+                            std::string_view text,
+                            float x = 0.f,
+                            float y = 0.f,
+                            float scale = 1.f) = 0;
+  virtual void flush() = 0;
   virtual void swap_buffers() = 0;
+
+  // Particles are kept as structure of arrays per emitter and simulated by
+  // the engine: update_particles() integrates every emitter with SIMD
+  // kernels, split across worker threads, and draw_particles() writes an
+  // emitter's particles as sprite instances straight into the vertex stream
+  // for one render_instanced() style draw. Emitters spawn at (x, y).
+  virtual particle_emitter* create_particle_emitter(
+    const particle_settings& settings,
+    float x,
+    float y) = 0;
+  virtual void destroy_particle_emitter(particle_emitter* e) = 0;
+  // Moves where new particles spawn; live ones are not affected.
+  virtual void move_particle_emitter(particle_emitter& e,
+                                     float x,
+                                     float y) = 0;
+  // Spawns count particles with the next update, as far as max_particles
+  // allows.
+  virtual void emit_particles(particle_emitter& e, uint32_t count) = 0;
+  virtual void update_particles(float seconds) = 0;
+  virtual void draw_particles(const particle_emitter& e,
+                              const texture* t = nullptr) = 0;
+
+  // Transform from world to clip space for every draw, kept in the std140
+  // "camera" uniform block at binding 0 that all programs share. It is the
+  // identity until set, so vertex positions start out in clip space.
+  virtual void set_view_projection(const mat4& view_projection) = 0;
+  void set_camera(const camera_2d& camera)
+  {
+    set_view_projection(camera.view_projection());
+  }
+  // Applied before the camera to the render*() calls that follow, and to a
+  // batch as a whole by the flush() that draws it.
+  virtual void set_model_transform(const mat4& model) = 0;
+  // On by default. submit() drops triangles and draw_mesh() skips meshes
+  // that lie outside the view, judged with the camera and model transform
+  // in effect at the time of the call. For large levels, query a
+  // spatial_grid (spatial_grid.hxx) first so off-screen sprites are never
+  // submitted at all.
+  virtual void set_culling_enabled(bool enabled) = 0;
+  // On by default. flush() merges batched runs that differ only in their
+  // texture, up to 8 textures per draw, into one draw with a program that
+  // picks the texture per vertex. This helps when textures cannot share an
+  // atlas; the program costs a little more per pixel. Retained mode always
+  // draws one texture per draw.
+  virtual void set_multi_texture_batching(bool enabled) = 0;
+
+  // Scratch memory for data built during the current frame, such as the
+  // triangles passed to render() and submit(). It is bump allocated and
+  // reclaimed in bulk: memory from frame N is reused by frame N + 3, so it
+  // also outlives the threaded engine's replay of frame N. The memory is
+  // not initialized.
+  virtual void* allocate_frame_memory(size_t bytes, size_t alignment) = 0;
+  template<typename T>
+  T* allocate_frame(size_t count)
+  {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "frame memory is released without running destructors");
+    return static_cast<T*>(allocate_frame_memory(count * sizeof(T), alignof(T)));
+  }
+  // Returns false when the driver does not allow the change. init() asks
+  // for adaptive vsync.
+  virtual bool set_vsync(vsync_mode mode) = 0;
+  bool set_vsync(bool enabled)
+  {
+    return set_vsync(enabled ? vsync_mode::on : vsync_mode::off);
+  }
+  // Caps the frame rate by waiting at the end of swap_buffers(); 0 removes
+  // the cap. Useful with vsync off, or to run below the display's rate.
+  virtual void set_frame_rate_limit(float frames_per_second) = 0;
+  // Wall time between the two most recent swap_buffers() calls, including
+  // any vsync or limiter wait.
+  virtual double get_frame_seconds() const = 0;
+
+  // Rebuilds shader programs when their files under res/shaders change.
+  // Meant for development; off by default.
+  virtual void set_shader_hot_reload(bool enabled) = 0;
+
+  virtual void set_profiling_enabled(bool enabled) = 0;
+  virtual frame_stats get_frame_stats() const = 0;
+  // Chrome trace event JSON of everything recorded while profiling was on.
+  virtual bool write_profile_trace(std::string_view path) = 0;
+
+  // Captures read the window back through a ring of pixel buffers and are
+  // encoded on worker threads, so they never stall the frame: a frame is
+  // written a few frames after it was shown, and a recording skips frames
+  // rather than slow the game down when the encoder falls behind.
+  //
+  // Saves the next frame presented as an uncompressed PNG.
+  virtual void save_screenshot(std::string_view path) = 0;
+  // Appends every frame from the next one on to path as raw RGBA, top row
+  // first, at the window size the recording started with. ffmpeg reads it
+  // with -f rawvideo -pixel_format rgba -video_size WxH.
+  virtual bool start_recording(std::string_view path) = 0;
+  virtual void stop_recording() = 0;
+
+  // Writes every call that changes what is drawn, payload included, to a
+  // compact binary trace at path until stop_trace() or destroy(), for the
+  // engine_replay tool to replay offline. The trace only knows resources
+  // created while it runs, so start it right after init(). Input, queries
+  // and the profiling and capture calls are not recorded.
+  virtual bool start_trace(std::string_view path) = 0;
+  virtual void stop_trace() = 0;
   virtual void destroy() = 0;
 };
 
 engine*
 create_engine();
 
+// Same interface, but draw calls may be recorded from any thread and are
+// replayed on a dedicated render thread one frame behind. Resource creation
+// blocks until the render thread has run it.
+engine*
+create_threaded_engine();
+
 void
 destroy_engine(engine* e);
 
@@ -0,0 +1,1300 @@
+#include "engine_trace.hxx"
+#include "lz4.hxx"
+#include "profiler.hxx"
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace uchiha {
+
+enum class trace_op : uint8_t
+{
+  set_stream_buffer_budget,
+  mount_resource_pack,
+  create_texture,
+  create_texture_async,
+  set_texture_upload_budget,
+  release_texture,
+  set_texture_budget,
+  create_atlas,
+  create_atlas_texture,
+  create_font,
+  destroy_font,
+  create_mesh,
+  update_mesh,
+  draw_mesh,
+  destroy_mesh,
+  create_render_target,
+  destroy_render_target,
+  set_render_target,
+  clear,
+  set_resolution_scale,
+  set_retained_mode,
+  invalidate_frame,
+  render_triangles,
+  render_indexed,
+  render_indexed_packed,
+  render_instanced,
+  render_quads,
+  begin_batch,
+  submit,
+  submit_text,
+  flush,
+  create_particle_emitter,
+  destroy_particle_emitter,
+  move_particle_emitter,
+  emit_particles,
+  update_particles,
+  draw_particles,
+  set_view_projection,
+  set_model_transform,
+  set_culling_enabled,
+  set_multi_texture_batching,
+  set_vsync,
+  set_frame_rate_limit,
+  destroy_atlas
+};
+
+namespace {
+
+constexpr size_t array_alignment = 8;
+
+size_t
+align_up(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t
+index_size(index_type type)
+{
+  return type == index_type::u16 ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// Reads the records of one frame in the order trace_writer put them. A read
+// past the end marks the reader failed and returns zeros.
+class record_reader
+{
+public:
+  explicit record_reader(const std::vector<uint8_t>& records)
+    : data(records.data())
+    , size(records.size())
+  {}
+
+  bool done() const { return failed || offset >= size; }
+  bool ok() const { return !failed; }
+
+  template<typename T>
+  T get()
+  {
+    T value{};
+    if (failed || size - offset < sizeof(T)) {
+      failed = true;
+      return value;
+    }
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return value;
+  }
+
+  template<typename T>
+  const T* array(size_t count)
+  {
+    const size_t start = align_up(offset, array_alignment);
+    if (failed || start > size || count > (size - start) / sizeof(T)) {
+      failed = true;
+      return nullptr;
+    }
+    offset = start + count * sizeof(T);
+    return reinterpret_cast<const T*>(data + start);
+  }
+
+  std::string_view string()
+  {
+    const uint32_t length = get<uint32_t>();
+    if (failed || size - offset < length) {
+      failed = true;
+      return std::string_view();
+    }
+    const char* text = reinterpret_cast<const char*>(data + offset);
+    offset += length;
+    return std::string_view(text, length);
+  }
+
+  index_span indices(index_type type, size_t count)
+  {
+    if (type == index_type::u16) {
+      return index_span(array<uint16_t>(count), count);
+    }
+    return index_span(array<uint32_t>(count), count);
+  }
+
+private:
+  const uint8_t* data;
+  size_t size;
+  size_t offset = 0;
+  bool failed = false;
+};
+
+}
+
+bool
+trace_writer::start(std::string_view path,
+                    job_system& job_pool,
+                    uint16_t width,
+                    uint16_t height)
+{
+  stop();
+  file.open(std::string(path), std::ios::binary | std::ios::trunc);
+  if (!file) {
+    std::cerr << "error: Failed to open " << path
+              << " for tracing ( engine_trace.cxx: )" << std::endl;
+    return false;
+  }
+  trace_header header;
+  header.width = width;
+  header.height = height;
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  jobs = &job_pool;
+  recording = true;
+  write_failed = false;
+  return true;
+}
+
+void
+trace_writer::stop()
+{
+  if (!recording) {
+    return;
+  }
+  jobs->wait(writes);
+  // Calls after the last swap_buffers(), such as the game's cleanup, end up
+  // as one more frame without a frame time.
+  if (!records.empty()) {
+    writing.swap(records);
+    records.clear();
+    writing_seconds = 0.f;
+    write_frame();
+  }
+  file.close();
+  if (write_failed) {
+    std::cerr << "error: Failed to write the trace ( engine_trace.cxx: )"
+              << std::endl;
+  }
+  if (untraced_uses != 0) {
+    std::cerr << "error: " << untraced_uses
+              << " traced calls used resources created before the trace "
+                 "started ( engine_trace.cxx: )"
+              << std::endl;
+  }
+  recording = false;
+  jobs = nullptr;
+  ids.clear();
+  atlas_textures.clear();
+  next_id = 1;
+  untraced_uses = 0;
+  writing = std::vector<uint8_t>();
+  compressed = std::vector<uint8_t>();
+}
+
+void
+trace_writer::end_frame(double frame_seconds)
+{
+  if (!recording) {
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("end trace frame");
+  // The previous frame's write has had a whole frame to finish.
+  jobs->wait(writes);
+  writing.swap(records);
+  records.clear();
+  writing_seconds = static_cast<float>(frame_seconds);
+  jobs->run([this]() { write_frame(); }, &writes);
+}
+
+void
+trace_writer::write_frame()
+{
+  UCHIHA_PROFILE_SCOPE("write trace frame");
+  trace_frame_header header;
+  header.size = static_cast<uint32_t>(writing.size());
+  header.seconds = writing_seconds;
+  const uint8_t* stored = writing.data();
+  header.stored_size = header.size;
+  if (!writing.empty()) {
+    compressed.resize(lz4_compress_bound(writing.size()));
+    const size_t packed = lz4_compress(
+      writing.data(), writing.size(), compressed.data(), compressed.size());
+    // Frames that do not shrink are stored as they are.
+    if (packed != 0 && packed < writing.size()) {
+      stored = compressed.data();
+      header.stored_size = static_cast<uint32_t>(packed);
+    }
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(stored), header.stored_size);
+  if (!file) {
+    write_failed = true;
+  }
+}
+
+uint32_t
+trace_writer::add(const void* object)
+{
+  if (object == nullptr) {
+    return 0;
+  }
+  // A shared texture handed out again keeps its id.
+  auto inserted = ids.emplace(object, next_id);
+  if (inserted.second) {
+    ++next_id;
+  }
+  return inserted.first->second;
+}
+
+void
+trace_writer::forget(const void* object)
+{
+  ids.erase(object);
+}
+
+uint32_t
+trace_writer::id_of(const void* object)
+{
+  if (object == nullptr) {
+    return 0;
+  }
+  auto it = ids.find(object);
+  if (it == ids.end()) {
+    ++untraced_uses;
+    return 0;
+  }
+  return it->second;
+}
+
+void
+trace_writer::begin(trace_op op)
+{
+  records.push_back(static_cast<uint8_t>(op));
+}
+
+template<typename T>
+void
+trace_writer::put(const T& value)
+{
+  const size_t at = records.size();
+  records.resize(at + sizeof(T));
+  std::memcpy(records.data() + at, &value, sizeof(T));
+}
+
+void
+trace_writer::put_array(const void* data, size_t size)
+{
+  const size_t at = align_up(records.size(), array_alignment);
+  records.resize(at + size);
+  if (size > 0) {
+    std::memcpy(records.data() + at, data, size);
+  }
+}
+
+void
+trace_writer::put_string(std::string_view s)
+{
+  put(static_cast<uint32_t>(s.size()));
+  records.insert(records.end(), s.begin(), s.end());
+}
+
+void
+trace_writer::set_stream_buffer_budget(uint32_t bytes)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_stream_buffer_budget);
+  put(bytes);
+}
+
+void
+trace_writer::mount_resource_pack(std::string_view path)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::mount_resource_pack);
+  put_string(path);
+}
+
+void
+trace_writer::create_texture(const texture* t, std::string_view path)
+{
+  if (!recording || t == nullptr) {
+    return;
+  }
+  begin(trace_op::create_texture);
+  put(add(t));
+  put_string(path);
+}
+
+void
+trace_writer::create_texture_async(const texture* t, std::string_view path)
+{
+  if (!recording || t == nullptr) {
+    return;
+  }
+  begin(trace_op::create_texture_async);
+  put(add(t));
+  put_string(path);
+}
+
+void
+trace_writer::set_texture_upload_budget(float milliseconds)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_texture_upload_budget);
+  put(milliseconds);
+}
+
+void
+trace_writer::release_texture(const texture* t)
+{
+  if (!recording || t == nullptr) {
+    return;
+  }
+  // The id stays, as the texture may still have references.
+  begin(trace_op::release_texture);
+  put(id_of(t));
+}
+
+void
+trace_writer::set_texture_budget(uint64_t bytes)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_texture_budget);
+  put(bytes);
+}
+
+void
+trace_writer::create_atlas(const texture_atlas* atlas,
+                           uint16_t page_width,
+                           uint16_t page_height)
+{
+  if (!recording || atlas == nullptr) {
+    return;
+  }
+  begin(trace_op::create_atlas);
+  put(add(atlas));
+  put(page_width);
+  put(page_height);
+}
+
+void
+trace_writer::create_texture(const texture* t,
+                             std::string_view path,
+                             const texture_atlas& atlas)
+{
+  if (!recording || t == nullptr) {
+    return;
+  }
+  begin(trace_op::create_atlas_texture);
+  put(add(t));
+  put(id_of(&atlas));
+  put_string(path);
+  atlas_textures[&atlas].push_back(t);
+}
+
+void
+trace_writer::destroy_atlas(const texture_atlas* atlas)
+{
+  if (!recording || atlas == nullptr) {
+    return;
+  }
+  begin(trace_op::destroy_atlas);
+  put(id_of(atlas));
+  forget(atlas);
+  auto members = atlas_textures.find(atlas);
+  if (members != atlas_textures.end()) {
+    for (const void* t : members->second) {
+      forget(t);
+    }
+    atlas_textures.erase(members);
+  }
+}
+
+void
+trace_writer::create_font(const font* f,
+                          std::string_view path,
+                          uint16_t pixel_size)
+{
+  if (!recording || f == nullptr) {
+    return;
+  }
+  begin(trace_op::create_font);
+  put(add(f));
+  put(pixel_size);
+  put_string(path);
+}
+
+void
+trace_writer::destroy_font(const font* f)
+{
+  if (!recording || f == nullptr) {
+    return;
+  }
+  begin(trace_op::destroy_font);
+  put(id_of(f));
+  forget(f);
+}
+
+void
+trace_writer::create_mesh(const mesh* m,
+                          const vertex* vertices,
+                          size_t vertex_count,
+                          index_span indices,
+                          mesh_usage usage)
+{
+  if (!recording || m == nullptr) {
+    return;
+  }
+  const size_t index_count = indices.data != nullptr ? indices.count : 0;
+  begin(trace_op::create_mesh);
+  put(add(m));
+  put(usage);
+  put(indices.type);
+  put(static_cast<uint32_t>(vertex_count));
+  put(static_cast<uint32_t>(index_count));
+  put_array(vertices, vertex_count * sizeof(vertex));
+  put_array(indices.data, index_count * index_size(indices.type));
+}
+
+void
+trace_writer::update_mesh(const mesh& m,
+                          size_t first_vertex,
+                          const vertex* vertices,
+                          size_t count)
+{
+  if (!recording || vertices == nullptr) {
+    return;
+  }
+  begin(trace_op::update_mesh);
+  put(id_of(&m));
+  put(static_cast<uint32_t>(first_vertex));
+  put(static_cast<uint32_t>(count));
+  put_array(vertices, count * sizeof(vertex));
+}
+
+void
+trace_writer::draw_mesh(const mesh& m, const texture* t, const mat4& transform)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::draw_mesh);
+  put(id_of(&m));
+  put(id_of(t));
+  put(transform);
+}
+
+void
+trace_writer::destroy_mesh(const mesh* m)
+{
+  if (!recording || m == nullptr) {
+    return;
+  }
+  begin(trace_op::destroy_mesh);
+  put(id_of(m));
+  forget(m);
+}
+
+void
+trace_writer::create_render_target(const render_target* t,
+                                   uint16_t width,
+                                   uint16_t height)
+{
+  if (!recording || t == nullptr) {
+    return;
+  }
+  // Keyed as a texture, since that is how draws that read it pass it.
+  begin(trace_op::create_render_target);
+  put(add(static_cast<const texture*>(t)));
+  put(width);
+  put(height);
+}
+
+void
+trace_writer::destroy_render_target(const render_target* t)
+{
+  if (!recording || t == nullptr) {
+    return;
+  }
+  begin(trace_op::destroy_render_target);
+  put(id_of(static_cast<const texture*>(t)));
+  forget(static_cast<const texture*>(t));
+}
+
+void
+trace_writer::set_render_target(const render_target* t)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_render_target);
+  put(t != nullptr ? id_of(static_cast<const texture*>(t)) : 0u);
+}
+
+void
+trace_writer::clear(float r, float g, float b, float a)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::clear);
+  put(r);
+  put(g);
+  put(b);
+  put(a);
+}
+
+void
+trace_writer::set_resolution_scale(float scale)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_resolution_scale);
+  put(scale);
+}
+
+void
+trace_writer::set_retained_mode(bool enabled)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_retained_mode);
+  put(static_cast<uint8_t>(enabled));
+}
+
+void
+trace_writer::invalidate_frame()
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::invalidate_frame);
+}
+
+void
+trace_writer::render(const triangle* triangles,
+                     size_t count,
+                     const texture* t)
+{
+  if (!recording || triangles == nullptr) {
+    return;
+  }
+  begin(trace_op::render_triangles);
+  put(id_of(t));
+  put(static_cast<uint32_t>(count));
+  put_array(triangles, count * sizeof(triangle));
+}
+
+void
+trace_writer::render(const vertex* vertices,
+                     size_t vertex_count,
+                     index_span indices,
+                     const texture* t)
+{
+  if (!recording || vertices == nullptr || indices.data == nullptr) {
+    return;
+  }
+  begin(trace_op::render_indexed);
+  put(id_of(t));
+  put(indices.type);
+  put(static_cast<uint32_t>(vertex_count));
+  put(static_cast<uint32_t>(indices.count));
+  put_array(vertices, vertex_count * sizeof(vertex));
+  put_array(indices.data, indices.count * index_size(indices.type));
+}
+
+void
+trace_writer::render(const packed_vertex* vertices,
+                     size_t vertex_count,
+                     index_span indices,
+                     const texture* t)
+{
+  if (!recording || vertices == nullptr || indices.data == nullptr) {
+    return;
+  }
+  begin(trace_op::render_indexed_packed);
+  put(id_of(t));
+  put(indices.type);
+  put(static_cast<uint32_t>(vertex_count));
+  put(static_cast<uint32_t>(indices.count));
+  put_array(vertices, vertex_count * sizeof(packed_vertex));
+  put_array(indices.data, indices.count * index_size(indices.type));
+}
+
+void
+trace_writer::render_instanced(const sprite_instance* instances,
+                               size_t count,
+                               const texture* t)
+{
+  if (!recording || instances == nullptr) {
+    return;
+  }
+  begin(trace_op::render_instanced);
+  put(id_of(t));
+  put(static_cast<uint32_t>(count));
+  put_array(instances, count * sizeof(sprite_instance));
+}
+
+void
+trace_writer::render_quads(const sprite_instance* instances,
+                           size_t count,
+                           const texture* t)
+{
+  if (!recording || instances == nullptr) {
+    return;
+  }
+  begin(trace_op::render_quads);
+  put(id_of(t));
+  put(static_cast<uint32_t>(count));
+  put_array(instances, count * sizeof(sprite_instance));
+}
+
+void
+trace_writer::begin_batch()
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::begin_batch);
+}
+
+void
+trace_writer::submit(const triangle* triangles,
+                     size_t count,
+                     const texture* t,
+                     blend_mode blend,
+                     int16_t layer)
+{
+  if (!recording || triangles == nullptr) {
+    return;
+  }
+  begin(trace_op::submit);
+  put(id_of(t));
+  put(blend);
+  put(layer);
+  put(static_cast<uint32_t>(count));
+  put_array(triangles, count * sizeof(triangle));
+}
+
+void
+trace_writer::submit_text(const font& f,
+                          std::string_view text,
+                          float x,
+                          float y,
+                          float scale,
+                          uint32_t rgba,
+                          blend_mode blend,
+                          int16_t layer)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::submit_text);
+  put(id_of(&f));
+  put(x);
+  put(y);
+  put(scale);
+  put(rgba);
+  put(blend);
+  put(layer);
+  put_string(text);
+}
+
+void
+trace_writer::flush()
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::flush);
+}
+
+void
+trace_writer::create_particle_emitter(const particle_emitter* e,
+                                      const particle_settings& settings,
+                                      float x,
+                                      float y)
+{
+  if (!recording || e == nullptr) {
+    return;
+  }
+  begin(trace_op::create_particle_emitter);
+  put(add(e));
+  put(settings);
+  put(x);
+  put(y);
+}
+
+void
+trace_writer::destroy_particle_emitter(const particle_emitter* e)
+{
+  if (!recording || e == nullptr) {
+    return;
+  }
+  begin(trace_op::destroy_particle_emitter);
+  put(id_of(e));
+  forget(e);
+}
+
+void
+trace_writer::move_particle_emitter(const particle_emitter& e,
+                                    float x,
+                                    float y)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::move_particle_emitter);
+  put(id_of(&e));
+  put(x);
+  put(y);
+}
+
+void
+trace_writer::emit_particles(const particle_emitter& e, uint32_t count)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::emit_particles);
+  put(id_of(&e));
+  put(count);
+}
+
+void
+trace_writer::update_particles(float seconds)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::update_particles);
+  put(seconds);
+}
+
+void
+trace_writer::draw_particles(const particle_emitter& e, const texture* t)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::draw_particles);
+  put(id_of(&e));
+  put(id_of(t));
+}
+
+void
+trace_writer::set_view_projection(const mat4& view_projection)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_view_projection);
+  put(view_projection);
+}
+
+void
+trace_writer::set_model_transform(const mat4& model)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_model_transform);
+  put(model);
+}
+
+void
+trace_writer::set_culling_enabled(bool enabled)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_culling_enabled);
+  put(static_cast<uint8_t>(enabled));
+}
+
+void
+trace_writer::set_multi_texture_batching(bool enabled)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_multi_texture_batching);
+  put(static_cast<uint8_t>(enabled));
+}
+
+void
+trace_writer::set_vsync(vsync_mode mode)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_vsync);
+  put(mode);
+}
+
+void
+trace_writer::set_frame_rate_limit(float frames_per_second)
+{
+  if (!recording) {
+    return;
+  }
+  begin(trace_op::set_frame_rate_limit);
+  put(frames_per_second);
+}
+
+bool
+trace_file::open(std::string_view path)
+{
+  std::ifstream in(std::string(path), std::ios::binary | std::ios::ate);
+  if (!in) {
+    std::cerr << "error: Failed to open trace " << path
+              << " ( engine_trace.cxx: )" << std::endl;
+    return false;
+  }
+  bytes.resize(static_cast<size_t>(in.tellg()));
+  in.seekg(0);
+  in.read(reinterpret_cast<char*>(bytes.data()),
+          static_cast<std::streamsize>(bytes.size()));
+  if (!in || bytes.size() < sizeof(header)) {
+    std::cerr << "error: Failed to read trace " << path
+              << " ( engine_trace.cxx: )" << std::endl;
+    return false;
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (header.magic != trace_magic || header.version != trace_version) {
+    std::cerr << "error: " << path
+              << " is not a trace of this engine version ( engine_trace.cxx: )"
+              << std::endl;
+    return false;
+  }
+
+  frames.clear();
+  size_t offset = sizeof(header);
+  while (bytes.size() - offset >= sizeof(trace_frame_header)) {
+    trace_frame_header h;
+    std::memcpy(&h, bytes.data() + offset, sizeof(h));
+    offset += sizeof(h);
+    if (bytes.size() - offset < h.stored_size) {
+      break;
+    }
+    frames.push_back(frame{ offset, h.size, h.stored_size, h.seconds });
+    offset += h.stored_size;
+  }
+  // A game that crashed leaves the frame it was writing cut short.
+  if (offset != bytes.size()) {
+    std::cerr << "error: " << path
+              << " ends in a partial frame, which is skipped "
+                 "( engine_trace.cxx: )"
+              << std::endl;
+  }
+  return true;
+}
+
+bool
+trace_file::read_frame(size_t index, std::vector<uint8_t>& records) const
+{
+  const frame& f = frames[index];
+  records.resize(f.size);
+  if (f.stored_size == f.size) {
+    std::memcpy(records.data(), bytes.data() + f.offset, f.size);
+    return true;
+  }
+  return lz4_decompress(
+    bytes.data() + f.offset, f.stored_size, records.data(), records.size());
+}
+
+trace_player::trace_player(engine& replay_target,
+                           const trace_replay_options& replay_options)
+  : target(replay_target)
+  , options(replay_options)
+{
+  if (!options.paced) {
+    target.set_vsync(vsync_mode::off);
+    target.set_frame_rate_limit(0.f);
+  }
+  if (options.force_single_texture) {
+    target.set_multi_texture_batching(false);
+  }
+}
+
+template<typename T>
+void
+trace_player::store(std::vector<T*>& objects, uint32_t id, T* object)
+{
+  if (id == 0) {
+    return;
+  }
+  if (id >= objects.size()) {
+    objects.resize(size_t(id) + 1, nullptr);
+  }
+  objects[id] = object;
+}
+
+template<typename T>
+T*
+trace_player::find(const std::vector<T*>& objects, uint32_t id) const
+{
+  return id < objects.size() ? objects[id] : nullptr;
+}
+
+bool
+trace_player::play(const std::vector<uint8_t>& records)
+{
+  UCHIHA_PROFILE_SCOPE("replay frame");
+  record_reader in(records);
+  // Resources the replay failed to create are skipped by the draws that
+  // use them, or drawn untextured.
+  while (!in.done()) {
+    const auto op = static_cast<trace_op>(in.get<uint8_t>());
+    switch (op) {
+      case trace_op::set_stream_buffer_budget:
+        target.set_stream_buffer_budget(in.get<uint32_t>());
+        break;
+      case trace_op::mount_resource_pack:
+        target.mount_resource_pack(in.string());
+        break;
+      case trace_op::create_texture:
+      case trace_op::create_texture_async: {
+        const uint32_t id = in.get<uint32_t>();
+        const std::string_view path = in.string();
+        if (in.ok()) {
+          store(textures,
+                id,
+                op == trace_op::create_texture
+                  ? target.create_texture(path)
+                  : target.create_texture_async(path));
+        }
+        break;
+      }
+      case trace_op::set_texture_upload_budget:
+        target.set_texture_upload_budget(in.get<float>());
+        break;
+      case trace_op::release_texture:
+        target.release_texture(find(textures, in.get<uint32_t>()));
+        break;
+      case trace_op::set_texture_budget:
+        target.set_texture_budget(in.get<uint64_t>());
+        break;
+      case trace_op::create_atlas: {
+        const uint32_t id = in.get<uint32_t>();
+        const uint16_t page_width = in.get<uint16_t>();
+        const uint16_t page_height = in.get<uint16_t>();
+        if (in.ok()) {
+          store(atlases, id, target.create_atlas(page_width, page_height));
+        }
+        break;
+      }
+      case trace_op::create_atlas_texture: {
+        const uint32_t id = in.get<uint32_t>();
+        texture_atlas* atlas = find(atlases, in.get<uint32_t>());
+        const std::string_view path = in.string();
+        if (in.ok() && atlas != nullptr) {
+          store(textures, id, target.create_texture(path, *atlas));
+        }
+        break;
+      }
+      case trace_op::destroy_atlas: {
+        const uint32_t id = in.get<uint32_t>();
+        target.destroy_atlas(find(atlases, id));
+        store(atlases, id, static_cast<texture_atlas*>(nullptr));
+        break;
+      }
+      case trace_op::create_font: {
+        const uint32_t id = in.get<uint32_t>();
+        const uint16_t pixel_size = in.get<uint16_t>();
+        const std::string_view path = in.string();
+        if (in.ok()) {
+          store(fonts, id, target.create_font(path, pixel_size));
+        }
+        break;
+      }
+      case trace_op::destroy_font: {
+        const uint32_t id = in.get<uint32_t>();
+        target.destroy_font(find(fonts, id));
+        store(fonts, id, static_cast<font*>(nullptr));
+        break;
+      }
+      case trace_op::create_mesh: {
+        const uint32_t id = in.get<uint32_t>();
+        const auto usage = in.get<mesh_usage>();
+        const auto type = in.get<index_type>();
+        const uint32_t vertex_count = in.get<uint32_t>();
+        const uint32_t index_count = in.get<uint32_t>();
+        const vertex* vertices = in.array<vertex>(vertex_count);
+        const index_span indices = in.indices(type, index_count);
+        if (in.ok()) {
+          store(meshes,
+                id,
+                target.create_mesh(
+                  vertices,
+                  vertex_count,
+                  index_count > 0 ? indices : index_span(),
+                  usage));
+        }
+        break;
+      }
+      case trace_op::update_mesh: {
+        mesh* m = find(meshes, in.get<uint32_t>());
+        const uint32_t first_vertex = in.get<uint32_t>();
+        const uint32_t count = in.get<uint32_t>();
+        const vertex* vertices = in.array<vertex>(count);
+        if (in.ok() && m != nullptr) {
+          target.update_mesh(*m, first_vertex, vertices, count);
+        }
+        break;
+      }
+      case trace_op::draw_mesh: {
+        const mesh* m = find(meshes, in.get<uint32_t>());
+        const texture* t = find(textures, in.get<uint32_t>());
+        const mat4 transform = in.get<mat4>();
+        if (in.ok() && m != nullptr) {
+          target.draw_mesh(*m, t, transform);
+        }
+        break;
+      }
+      case trace_op::destroy_mesh: {
+        const uint32_t id = in.get<uint32_t>();
+        target.destroy_mesh(find(meshes, id));
+        store(meshes, id, static_cast<mesh*>(nullptr));
+        break;
+      }
+      case trace_op::create_render_target: {
+        const uint32_t id = in.get<uint32_t>();
+        const uint16_t width = in.get<uint16_t>();
+        const uint16_t height = in.get<uint16_t>();
+        if (in.ok()) {
+          render_target* t = target.create_render_target(width, height);
+          store(targets, id, t);
+          store(textures, id, static_cast<texture*>(t));
+        }
+        break;
+      }
+      case trace_op::destroy_render_target: {
+        const uint32_t id = in.get<uint32_t>();
+        target.destroy_render_target(find(targets, id));
+        store(targets, id, static_cast<render_target*>(nullptr));
+        store(textures, id, static_cast<texture*>(nullptr));
+        break;
+      }
+      case trace_op::set_render_target:
+        target.set_render_target(find(targets, in.get<uint32_t>()));
+        break;
+      case trace_op::clear: {
+        const float r = in.get<float>();
+        const float g = in.get<float>();
+        const float b = in.get<float>();
+        const float a = in.get<float>();
+        target.clear(r, g, b, a);
+        break;
+      }
+      case trace_op::set_resolution_scale:
+        target.set_resolution_scale(in.get<float>());
+        break;
+      case trace_op::set_retained_mode:
+        target.set_retained_mode(in.get<uint8_t>() != 0);
+        break;
+      case trace_op::invalidate_frame:
+        target.invalidate_frame();
+        break;
+      case trace_op::render_triangles: {
+        const texture* t = find(textures, in.get<uint32_t>());
+        const uint32_t count = in.get<uint32_t>();
+        const triangle* triangles = in.array<triangle>(count);
+        if (!in.ok()) {
+          break;
+        }
+        if (t != nullptr) {
+          target.render(triangles, count, *t);
+        } else {
+          target.render(triangles, count);
+        }
+        break;
+      }
+      case trace_op::render_indexed: {
+        const texture* t = find(textures, in.get<uint32_t>());
+        const auto type = in.get<index_type>();
+        const uint32_t vertex_count = in.get<uint32_t>();
+        const uint32_t index_count = in.get<uint32_t>();
+        const vertex* vertices = in.array<vertex>(vertex_count);
+        const index_span indices = in.indices(type, index_count);
+        if (in.ok()) {
+          target.render(vertices, vertex_count, indices, t);
+        }
+        break;
+      }
+      case trace_op::render_indexed_packed: {
+        const texture* t = find(textures, in.get<uint32_t>());
+        const auto type = in.get<index_type>();
+        const uint32_t vertex_count = in.get<uint32_t>();
+        const uint32_t index_count = in.get<uint32_t>();
+        const packed_vertex* vertices = in.array<packed_vertex>(vertex_count);
+        const index_span indices = in.indices(type, index_count);
+        if (in.ok()) {
+          target.render(vertices, vertex_count, indices, t);
+        }
+        break;
+      }
+      case trace_op::render_instanced:
+      case trace_op::render_quads: {
+        const texture* t = find(textures, in.get<uint32_t>());
+        const uint32_t count = in.get<uint32_t>();
+        const sprite_instance* instances = in.array<sprite_instance>(count);
+        if (!in.ok()) {
+          break;
+        }
+        if (op == trace_op::render_instanced) {
+          target.render_instanced(instances, count, t);
+        } else {
+          target.render_quads(instances, count, t);
+        }
+        break;
+      }
+      case trace_op::begin_batch:
+        target.begin_batch();
+        break;
+      case trace_op::submit: {
+        const texture* t = find(textures, in.get<uint32_t>());
+        const auto blend = in.get<blend_mode>();
+        const auto layer = in.get<int16_t>();
+        const uint32_t count = in.get<uint32_t>();
+        const triangle* triangles = in.array<triangle>(count);
+        if (!in.ok()) {
+          break;
+        }
+        if (t != nullptr) {
+          target.submit(triangles, count, *t, blend, layer);
+        } else {
+          target.submit(triangles, count, blend, layer);
+        }
+        if (options.flush_every_submission) {
+          target.flush();
+        }
+        break;
+      }
+      case trace_op::submit_text: {
+        const font* f = find(fonts, in.get<uint32_t>());
+        const float x = in.get<float>();
+        const float y = in.get<float>();
+        const float scale = in.get<float>();
+        const uint32_t rgba = in.get<uint32_t>();
+        const auto blend = in.get<blend_mode>();
+        const auto layer = in.get<int16_t>();
+        const std::string_view text = in.string();
+        if (!in.ok() || f == nullptr) {
+          break;
+        }
+        target.submit_text(*f, text, x, y, scale, rgba, blend, layer);
+        if (options.flush_every_submission) {
+          target.flush();
+        }
+        break;
+      }
+      case trace_op::flush:
+        target.flush();
+        break;
+      case trace_op::create_particle_emitter: {
+        const uint32_t id = in.get<uint32_t>();
+        const particle_settings settings = in.get<particle_settings>();
+        const float x = in.get<float>();
+        const float y = in.get<float>();
+        if (in.ok()) {
+          store(emitters, id, target.create_particle_emitter(settings, x, y));
+        }
+        break;
+      }
+      case trace_op::destroy_particle_emitter: {
+        const uint32_t id = in.get<uint32_t>();
+        target.destroy_particle_emitter(find(emitters, id));
+        store(emitters, id, static_cast<particle_emitter*>(nullptr));
+        break;
+      }
+      case trace_op::move_particle_emitter: {
+        particle_emitter* e = find(emitters, in.get<uint32_t>());
+        const float x = in.get<float>();
+        const float y = in.get<float>();
+        if (in.ok() && e != nullptr) {
+          target.move_particle_emitter(*e, x, y);
+        }
+        break;
+      }
+      case trace_op::emit_particles: {
+        particle_emitter* e = find(emitters, in.get<uint32_t>());
+        const uint32_t count = in.get<uint32_t>();
+        if (in.ok() && e != nullptr) {
+          target.emit_particles(*e, count);
+        }
+        break;
+      }
+      case trace_op::update_particles:
+        target.update_particles(in.get<float>());
+        break;
+      case trace_op::draw_particles: {
+        const particle_emitter* e = find(emitters, in.get<uint32_t>());
+        const texture* t = find(textures, in.get<uint32_t>());
+        if (in.ok() && e != nullptr) {
+          target.draw_particles(*e, t);
+        }
+        break;
+      }
+      case trace_op::set_view_projection:
+        target.set_view_projection(in.get<mat4>());
+        break;
+      case trace_op::set_model_transform:
+        target.set_model_transform(in.get<mat4>());
+        break;
+      case trace_op::set_culling_enabled:
+        target.set_culling_enabled(in.get<uint8_t>() != 0);
+        break;
+      case trace_op::set_multi_texture_batching: {
+        const bool enabled = in.get<uint8_t>() != 0;
+        target.set_multi_texture_batching(enabled &&
+                                          !options.force_single_texture);
+        break;
+      }
+      case trace_op::set_vsync: {
+        const auto mode = in.get<vsync_mode>();
+        if (options.paced) {
+          target.set_vsync(mode);
+        }
+        break;
+      }
+      case trace_op::set_frame_rate_limit: {
+        const float frames_per_second = in.get<float>();
+        if (options.paced) {
+          target.set_frame_rate_limit(frames_per_second);
+        }
+        break;
+      }
+      default:
+        std::cerr << "error: Unknown trace record "
+                  << static_cast<int>(op) << " ( engine_trace.cxx: )"
+                  << std::endl;
+        return false;
+    }
+  }
+  if (!in.ok()) {
+    std::cerr << "error: Trace record cut short ( engine_trace.cxx: )"
+              << std::endl;
+    return false;
+  }
+  target.swap_buffers();
+  return true;
+}
+
+}
@@ -0,0 +1,244 @@
+#pragma once
+#include "engine.hxx"
+#include "job_system.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uchiha {
+
+// Layout of a trace written by engine::start_trace(): a header, then one
+// frame header per swap_buffers() followed by that frame's calls. Calls and
+// their payloads are stored in host byte order and with the engine's own
+// structure layouts, so a trace is meant to be replayed by a build of the
+// same engine on the same kind of machine.
+constexpr uint32_t trace_magic = 0x52544355; // "UCTR"
+constexpr uint32_t trace_version = 1;
+
+struct trace_header
+{
+  uint32_t magic = trace_magic;
+  uint32_t version = trace_version;
+  uint16_t width = 0;
+  uint16_t height = 0;
+  uint32_t reserved = 0;
+};
+
+struct trace_frame_header
+{
+  uint32_t size = 0;
+  // A frame whose stored size differs from its size is one LZ4 block.
+  uint32_t stored_size = 0;
+  // The recorded frame's wall time, from engine::get_frame_seconds().
+  float seconds = 0.f;
+  uint32_t reserved = 0;
+};
+
+static_assert(sizeof(trace_header) == 16 && sizeof(trace_frame_header) == 16,
+              "trace structures are written as they are laid out");
+
+// Defined in engine_trace.cxx.
+enum class trace_op : uint8_t;
+
+// Recording half of engine::start_trace(). Every call that changes what is
+// drawn is appended to the current frame's records with its payload copied;
+// resources are named by ids handed out when they are created, so a trace
+// only knows about resources created while it was running. end_frame()
+// hands the frame to a job that compresses and writes it, which is waited
+// for one frame later. Every call is a no-op while no trace is running.
+class trace_writer
+{
+public:
+  bool start(std::string_view path,
+             job_system& jobs,
+             uint16_t width,
+             uint16_t height);
+  // Writes the frame recorded so far and closes the file.
+  void stop();
+  bool active() const { return recording; }
+  void end_frame(double frame_seconds);
+
+  void set_stream_buffer_budget(uint32_t bytes);
+  void mount_resource_pack(std::string_view path);
+  void create_texture(const texture* t, std::string_view path);
+  void create_texture_async(const texture* t, std::string_view path);
+  void set_texture_upload_budget(float milliseconds);
+  void release_texture(const texture* t);
+  void set_texture_budget(uint64_t bytes);
+  void create_atlas(const texture_atlas* atlas,
+                    uint16_t page_width,
+                    uint16_t page_height);
+  void create_texture(const texture* t,
+                      std::string_view path,
+                      const texture_atlas& atlas);
+  void destroy_atlas(const texture_atlas* atlas);
+  void create_font(const font* f, std::string_view path, uint16_t pixel_size);
+  void destroy_font(const font* f);
+  void create_mesh(const mesh* m,
+                   const vertex* vertices,
+                   size_t vertex_count,
+                   index_span indices,
+                   mesh_usage usage);
+  void update_mesh(const mesh& m,
+                   size_t first_vertex,
+                   const vertex* vertices,
+                   size_t count);
+  void draw_mesh(const mesh& m, const texture* t, const mat4& transform);
+  void destroy_mesh(const mesh* m);
+  void create_render_target(const render_target* t,
+                            uint16_t width,
+                            uint16_t height);
+  void destroy_render_target(const render_target* t);
+  void set_render_target(const render_target* t);
+  void clear(float r, float g, float b, float a);
+  void set_resolution_scale(float scale);
+  void set_retained_mode(bool enabled);
+  void invalidate_frame();
+  void render(const triangle* triangles, size_t count, const texture* t);
+  void render(const vertex* vertices,
+              size_t vertex_count,
+              index_span indices,
+              const texture* t);
+  void render(const packed_vertex* vertices,
+              size_t vertex_count,
+              index_span indices,
+              const texture* t);
+  void render_instanced(const sprite_instance* instances,
+                        size_t count,
+                        const texture* t);
+  void render_quads(const sprite_instance* instances,
+                    size_t count,
+                    const texture* t);
+  void begin_batch();
+  void submit(const triangle* triangles,
+              size_t count,
+              const texture* t,
+              blend_mode blend,
+              int16_t layer);
+  void submit_text(const font& f,
+                   std::string_view text,
+                   float x,
+                   float y,
+                   float scale,
+                   uint32_t rgba,
+                   blend_mode blend,
+                   int16_t layer);
+  void flush();
+  void create_particle_emitter(const particle_emitter* e,
+                               const particle_settings& settings,
+                               float x,
+                               float y);
+  void destroy_particle_emitter(const particle_emitter* e);
+  void move_particle_emitter(const particle_emitter& e, float x, float y);
+  void emit_particles(const particle_emitter& e, uint32_t count);
+  void update_particles(float seconds);
+  void draw_particles(const particle_emitter& e, const texture* t);
+  void set_view_projection(const mat4& view_projection);
+  void set_model_transform(const mat4& model);
+  void set_culling_enabled(bool enabled);
+  void set_multi_texture_batching(bool enabled);
+  void set_vsync(vsync_mode mode);
+  void set_frame_rate_limit(float frames_per_second);
+
+private:
+  // 0 stands for nullptr, and for resources the trace has not seen created.
+  uint32_t add(const void* object);
+  void forget(const void* object);
+  uint32_t id_of(const void* object);
+  void begin(trace_op op);
+  template<typename T>
+  void put(const T& value);
+  // Arrays start 8-byte aligned within the frame, so the player can hand
+  // them to the engine in place.
+  void put_array(const void* data, size_t size);
+  void put_string(std::string_view s);
+  void write_frame();
+
+  job_system* jobs = nullptr;
+  bool recording = false;
+  std::ofstream file;
+  std::unordered_map<const void*, uint32_t> ids;
+  // Textures created through each atlas, forgotten along with it.
+  std::unordered_map<const void*, std::vector<const void*>> atlas_textures;
+  uint32_t next_id = 1;
+  uint32_t untraced_uses = 0;
+  std::vector<uint8_t> records;
+  // Owned by the write job while writes is pending.
+  std::vector<uint8_t> writing;
+  std::vector<uint8_t> compressed;
+  float writing_seconds = 0.f;
+  bool write_failed = false;
+  job_counter writes;
+};
+
+// A trace read into memory, with the frames still compressed.
+class trace_file
+{
+public:
+  bool open(std::string_view path);
+
+  uint16_t width() const { return header.width; }
+  uint16_t height() const { return header.height; }
+  size_t frame_count() const { return frames.size(); }
+  float frame_seconds(size_t index) const { return frames[index].seconds; }
+  // Decompresses the calls of frame index into records.
+  bool read_frame(size_t index, std::vector<uint8_t>& records) const;
+
+private:
+  struct frame
+  {
+    size_t offset = 0;
+    uint32_t size = 0;
+    uint32_t stored_size = 0;
+    float seconds = 0.f;
+  };
+
+  trace_header header;
+  std::vector<uint8_t> bytes;
+  std::vector<frame> frames;
+};
+
+struct trace_replay_options
+{
+  // Flushes each submit() and submit_text() on its own, so the frame costs
+  // what it would without batching.
+  bool flush_every_submission = false;
+  // Turns multi-texture batching off, whatever the trace sets.
+  bool force_single_texture = false;
+  // Applies the recorded set_vsync() and set_frame_rate_limit(); without
+  // it frames are replayed as fast as possible.
+  bool paced = false;
+};
+
+// Issues the calls of a trace against an engine. The resources a frame
+// creates are kept by id for the frames after it; whatever the trace did
+// not destroy is left to engine::destroy().
+class trace_player
+{
+public:
+  trace_player(engine& target, const trace_replay_options& options);
+
+  // Replays one frame's records and ends it with swap_buffers(). Returns
+  // false, after the calls before it, at a record it cannot read.
+  bool play(const std::vector<uint8_t>& records);
+
+private:
+  template<typename T>
+  void store(std::vector<T*>& objects, uint32_t id, T* object);
+  template<typename T>
+  T* find(const std::vector<T*>& objects, uint32_t id) const;
+
+  engine& target;
+  trace_replay_options options;
+  std::vector<texture*> textures;
+  std::vector<texture_atlas*> atlases;
+  std::vector<font*> fonts;
+  std::vector<mesh*> meshes;
+  std::vector<render_target*> targets;
+  std::vector<particle_emitter*> emitters;
+};
+
+}
@@ -0,0 +1,233 @@
+#include "font.hxx"
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+namespace uchiha {
+
+glyph_atlas::glyph_atlas()
+  : atlas(page_size, page_size)
+{}
+
+bool
+glyph_atlas::add(const uint8_t* rgba, uint16_t width, uint16_t height, glyph& g)
+{
+  const texture* t = atlas.add(rgba, width, height);
+  if (t == nullptr) {
+    return false;
+  }
+  std::unique_ptr<atlas_texture>& page = pages[t->get_handle()];
+  if (page == nullptr) {
+    page = std::make_unique<atlas_texture>(
+      page_size, page_size, t->get_handle(), uv_rect());
+  }
+  g.page = page.get();
+  g.uv = t->get_uv_rect();
+  ++added;
+  return true;
+}
+
+font_impl::font_impl(glyph_atlas& glyphs)
+  : atlas(glyphs)
+{}
+
+font_impl::~font_impl()
+{
+  close();
+}
+
+bool
+font_impl::open(std::string_view path, uint16_t pixel_size)
+{
+  close();
+  handle = TTF_OpenFont(std::string(path).c_str(), pixel_size);
+  return opened(pixel_size);
+}
+
+bool
+font_impl::open(const resource_data& packed, uint16_t pixel_size)
+{
+  close();
+  const uint8_t* data = unpack(packed, unpacked);
+  SDL_RWops* stream =
+    data != nullptr
+      ? SDL_RWFromConstMem(data, static_cast<int>(packed.size))
+      : nullptr;
+  // SDL_ttf reads glyphs from the stream on demand and closes it with the
+  // font.
+  handle = stream != nullptr ? TTF_OpenFontRW(stream, 1, pixel_size) : nullptr;
+  return opened(pixel_size);
+}
+
+bool
+font_impl::opened(uint16_t pixel_size)
+{
+  if (handle == nullptr) {
+    std::cerr << "error: Failed to open font ( font.cxx: ) " << TTF_GetError()
+              << std::endl;
+    return false;
+  }
+  size = pixel_size;
+  line_height = static_cast<float>(TTF_FontLineSkip(handle));
+  ascender = static_cast<float>(TTF_FontAscent(handle));
+  // SDL_ttf reports the descent as a negative offset.
+  descender = static_cast<float>(-TTF_FontDescent(handle));
+  return true;
+}
+
+void
+font_impl::close()
+{
+  if (handle != nullptr) {
+    TTF_CloseFont(handle);
+    handle = nullptr;
+  }
+  unpacked = std::vector<uint8_t>();
+  glyphs.clear();
+}
+
+const glyph&
+font_impl::find_glyph(uint32_t codepoint) const
+{
+  auto found = glyphs.find(codepoint);
+  if (found != glyphs.end()) {
+    return found->second;
+  }
+  if (handle != nullptr && codepoint != '?' &&
+      TTF_GlyphIsProvided32(handle, codepoint) == 0) {
+    const glyph fallback = find_glyph('?');
+    return glyphs.emplace(codepoint, fallback).first->second;
+  }
+  return glyphs.emplace(codepoint, rasterize(codepoint)).first->second;
+}
+
+float
+font_impl::kerning(uint32_t previous, uint32_t codepoint) const
+{
+  if (handle == nullptr) {
+    return 0.f;
+  }
+  return static_cast<float>(
+    TTF_GetFontKerningSizeGlyphs32(handle, previous, codepoint));
+}
+
+glyph
+font_impl::rasterize(uint32_t codepoint) const
+{
+  glyph g;
+  int min_x = 0;
+  int max_x = 0;
+  int min_y = 0;
+  int max_y = 0;
+  int advance = 0;
+  if (handle == nullptr ||
+      TTF_GlyphMetrics32(
+        handle, codepoint, &min_x, &max_x, &min_y, &max_y, &advance) != 0) {
+    return g;
+  }
+  g.advance = static_cast<float>(advance);
+  if (max_x <= min_x || max_y <= min_y) {
+    return g;
+  }
+
+  SDL_Surface* rendered = TTF_RenderGlyph32_Blended(
+    handle, codepoint, SDL_Color{ 255, 255, 255, 255 });
+  SDL_Surface* image =
+    rendered != nullptr
+      ? SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_RGBA32, 0)
+      : nullptr;
+  SDL_FreeSurface(rendered);
+  if (image == nullptr) {
+    std::cerr << "error: Failed to rasterize glyph ( font.cxx: ) "
+              << TTF_GetError() << std::endl;
+    return g;
+  }
+
+  SDL_LockSurface(image);
+  const uint8_t* pixels = static_cast<const uint8_t*>(image->pixels);
+  auto alpha = [&](int x, int y) {
+    return pixels[static_cast<size_t>(y) * image->pitch + x * 4 + 3];
+  };
+  // The surface is a whole line high; only the covered pixels are packed.
+  int x0 = image->w;
+  int y0 = image->h;
+  int x1 = 0;
+  int y1 = 0;
+  for (int y = 0; y < image->h; ++y) {
+    for (int x = 0; x < image->w; ++x) {
+      if (alpha(x, y) != 0) {
+        x0 = std::min(x0, x);
+        y0 = std::min(y0, y);
+        x1 = std::max(x1, x + 1);
+        y1 = std::max(y1, y + 1);
+      }
+    }
+  }
+  if (x0 < x1) {
+    // A transparent pixel around the coverage, so the border the atlas
+    // extrudes is transparent too and filtering fades the edges out.
+    const int w = x1 - x0 + 2;
+    const int h = y1 - y0 + 2;
+    scratch.assign(static_cast<size_t>(w) * h * 4, 0);
+    for (int y = y0; y < y1; ++y) {
+      for (int x = x0; x < x1; ++x) {
+        uint8_t* out =
+          &scratch[(static_cast<size_t>(y - y0 + 1) * w + (x - x0 + 1)) * 4];
+        out[0] = out[1] = out[2] = 255;
+        out[3] = alpha(x, y);
+      }
+    }
+    if (atlas.add(scratch.data(),
+                  static_cast<uint16_t>(w),
+                  static_cast<uint16_t>(h),
+                  g)) {
+      // SDL_ttf puts the baseline at the ascent and shifts the pen right
+      // by a negative left bearing.
+      const int pen_x = std::max(0, -min_x);
+      g.left = static_cast<float>(x0 - 1 - pen_x);
+      g.top = ascender - static_cast<float>(y0 - 1);
+      g.width = static_cast<float>(w);
+      g.height = static_cast<float>(h);
+    }
+  }
+  SDL_UnlockSurface(image);
+  SDL_FreeSurface(image);
+  return g;
+}
+
+uint32_t
+next_codepoint(std::string_view& text)
+{
+  const auto byte = [&](size_t i) { return static_cast<uint8_t>(text[i]); };
+  const uint32_t replacement = 0xfffd;
+  const uint8_t lead = byte(0);
+  size_t length = 1;
+  uint32_t codepoint = lead;
+  if (lead >= 0xf0 && lead < 0xf8) {
+    length = 4;
+    codepoint = lead & 0x07u;
+  } else if (lead >= 0xe0) {
+    length = lead < 0xf0 ? 3 : 0;
+    codepoint = lead & 0x0fu;
+  } else if (lead >= 0xc0) {
+    length = 2;
+    codepoint = lead & 0x1fu;
+  } else if (lead >= 0x80) {
+    length = 0;
+  }
+  if (length == 0 || length > text.size()) {
+    text.remove_prefix(1);
+    return replacement;
+  }
+  for (size_t i = 1; i < length; ++i) {
+    if ((byte(i) & 0xc0u) != 0x80u) {
+      text.remove_prefix(1);
+      return replacement;
+    }
+    codepoint = (codepoint << 6) | (byte(i) & 0x3fu);
+  }
+  text.remove_prefix(length);
+  return codepoint;
+}
+
+}
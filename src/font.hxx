@@ -0,0 +1,96 @@
+#pragma once
+#include "engine.hxx"
+#include "resource_pack.hxx"
+#include "texture_atlas.hxx"
+#include <SDL2/SDL_ttf.h>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uchiha {
+
+// One rasterized glyph, measured in pixels from the pen position on the
+// baseline with y up.
+struct glyph
+{
+  // Whole atlas page the glyph lives on, or nullptr for glyphs without
+  // pixels such as the space. uv is the glyph's part of the page.
+  const texture* page = nullptr;
+  uv_rect uv;
+  float left = 0.f;
+  float top = 0.f;
+  float width = 0.f;
+  float height = 0.f;
+  float advance = 0.f;
+};
+
+// Atlas the glyphs of every font are packed into. Glyph quads carry their
+// own uv rectangle, so each page is also exposed as a texture covering all
+// of it: text on one page is drawn with a single texture.
+class glyph_atlas
+{
+public:
+  static constexpr uint16_t page_size = 1024;
+
+  glyph_atlas();
+
+  // Packs a white RGBA8 coverage image and fills in g.page and g.uv.
+  bool add(const uint8_t* rgba, uint16_t width, uint16_t height, glyph& g);
+  // Grows with every add(), which binds page textures behind the engine's
+  // state cache.
+  uint32_t glyph_count() const { return added; }
+
+private:
+  texture_atlas_impl atlas;
+  uint32_t added = 0;
+  std::unordered_map<uint32_t, std::unique_ptr<atlas_texture>> pages;
+};
+
+// SDL_ttf font opened at one pixel size. Glyphs are rasterized into the
+// glyph atlas the first time they are looked up and stay there for as long
+// as the atlas lives, even after the font is closed.
+class font_impl : public font
+{
+public:
+  explicit font_impl(glyph_atlas& glyphs);
+  ~font_impl() override;
+
+  bool open(std::string_view path, uint16_t pixel_size);
+  // Reads the font straight from a pack, which has to stay mapped while the
+  // font is open.
+  bool open(const resource_data& packed, uint16_t pixel_size);
+  void close();
+
+  uint16_t get_size() const override { return size; }
+  float get_line_height() const override { return line_height; }
+  float get_ascender() const { return ascender; }
+  float get_descender() const { return descender; }
+
+  const glyph& find_glyph(uint32_t codepoint) const;
+  float kerning(uint32_t previous, uint32_t codepoint) const;
+
+private:
+  // Takes the metrics from the handle just opened.
+  bool opened(uint16_t pixel_size);
+  glyph rasterize(uint32_t codepoint) const;
+
+  TTF_Font* handle = nullptr;
+  uint16_t size = 0;
+  float line_height = 0.f;
+  float ascender = 0.f;
+  float descender = 0.f;
+  glyph_atlas& atlas;
+  // A compressed pack entry, decompressed for as long as the font is open.
+  std::vector<uint8_t> unpacked;
+  mutable std::unordered_map<uint32_t, glyph> glyphs;
+  mutable std::vector<uint8_t> scratch;
+};
+
+// Decodes one code point from the front of text and advances it. Malformed
+// sequences decode as U+FFFD one byte at a time.
+uint32_t
+next_codepoint(std::string_view& text);
+
+}
@@ -0,0 +1,68 @@
+#include "frame_arena.hxx"
+#include <algorithm>
+
+namespace uchiha {
+
+namespace {
+
+uintptr_t
+align_up(uintptr_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+frame_arena::frame_arena(size_t bytes_per_frame)
+{
+  for (page& p : pages) {
+    p.capacity = std::max<size_t>(bytes_per_frame, 64);
+    p.data = std::make_unique<uint8_t[]>(p.capacity);
+  }
+}
+
+void*
+frame_arena::allocate(size_t size, size_t alignment)
+{
+  alignment = std::max<size_t>(alignment, 1);
+  page& p = pages[current];
+  const uintptr_t base = reinterpret_cast<uintptr_t>(p.data.get());
+  size_t used = p.used.load(std::memory_order_relaxed);
+  for (;;) {
+    size_t start = static_cast<size_t>(align_up(base + used, alignment) - base);
+    if (start + size > p.capacity) {
+      return allocate_overflow(p, size, alignment);
+    }
+    if (p.used.compare_exchange_weak(
+          used, start + size, std::memory_order_relaxed)) {
+      return p.data.get() + start;
+    }
+  }
+}
+
+void*
+frame_arena::allocate_overflow(page& p, size_t size, size_t alignment)
+{
+  const size_t block_size = size + alignment - 1;
+  std::lock_guard<std::mutex> lock(p.overflow_mutex);
+  p.overflow.push_back(std::make_unique<uint8_t[]>(block_size));
+  p.overflow_bytes += block_size;
+  uintptr_t address = reinterpret_cast<uintptr_t>(p.overflow.back().get());
+  return reinterpret_cast<void*>(align_up(address, alignment));
+}
+
+void
+frame_arena::next_frame()
+{
+  current = (current + 1) % frame_count;
+  page& p = pages[current];
+  if (!p.overflow.empty()) {
+    p.capacity += p.overflow_bytes;
+    p.data = std::make_unique<uint8_t[]>(p.capacity);
+    p.overflow.clear();
+    p.overflow_bytes = 0;
+  }
+  p.used.store(0, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace uchiha {
+
+// Backing store of engine::allocate_frame_memory(). One linear page per
+// frame in flight; allocate() bumps an atomic offset into the current page,
+// so any thread may allocate. When a page runs out, the excess comes from
+// overflow blocks, and the page is regrown to fit them the next time it is
+// reset, so a steady workload settles into one block per page.
+class frame_arena
+{
+public:
+  static constexpr size_t frame_count = 3;
+
+  explicit frame_arena(size_t bytes_per_frame = 1 << 20);
+
+  void* allocate(size_t size, size_t alignment);
+  // Makes the oldest page current and releases everything allocated in it.
+  // Must not run concurrently with allocate().
+  void next_frame();
+
+  size_t page_capacity() const { return pages[current].capacity; }
+
+private:
+  struct page
+  {
+    std::unique_ptr<uint8_t[]> data;
+    size_t capacity = 0;
+    std::atomic<size_t> used{ 0 };
+    std::mutex overflow_mutex;
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t overflow_bytes = 0;
+  };
+
+  void* allocate_overflow(page& p, size_t size, size_t alignment);
+
+  page pages[frame_count];
+  size_t current = 0;
+};
+
+}
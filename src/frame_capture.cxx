@@ -0,0 +1,379 @@
+#include "frame_capture.hxx"
+#include "profiler.hxx"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace uchiha {
+
+namespace {
+
+// Readbacks still in flight at destroy() are waited for this long.
+constexpr GLuint64 destroy_timeout_ns = 1000000000ull;
+
+struct crc_table
+{
+  uint32_t entries[256];
+  crc_table()
+  {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+      }
+      entries[i] = c;
+    }
+  }
+};
+
+uint32_t
+crc32(uint32_t crc, const uint8_t* data, size_t size)
+{
+  static const crc_table table;
+  crc = ~crc;
+  for (size_t i = 0; i < size; ++i) {
+    crc = table.entries[(crc ^ data[i]) & 0xffu] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint32_t
+adler32(const uint8_t* data, size_t size)
+{
+  uint32_t a = 1;
+  uint32_t b = 0;
+  while (size > 0) {
+    // The largest run whose sums cannot overflow before the modulo.
+    const size_t n = std::min<size_t>(size, 5552);
+    for (size_t i = 0; i < n; ++i) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521u;
+    b %= 65521u;
+    data += n;
+    size -= n;
+  }
+  return (b << 16) | a;
+}
+
+void
+put_u32(std::vector<uint8_t>& out, uint32_t v)
+{
+  out.push_back(static_cast<uint8_t>(v >> 24));
+  out.push_back(static_cast<uint8_t>(v >> 16));
+  out.push_back(static_cast<uint8_t>(v >> 8));
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+void
+write_chunk(std::ofstream& file,
+            const char* type,
+            const std::vector<uint8_t>& data)
+{
+  std::vector<uint8_t> header;
+  put_u32(header, static_cast<uint32_t>(data.size()));
+  header.insert(header.end(), type, type + 4);
+  uint32_t crc = crc32(0, header.data() + 4, 4);
+  crc = crc32(crc, data.data(), data.size());
+  std::vector<uint8_t> trailer;
+  put_u32(trailer, crc);
+  file.write(reinterpret_cast<const char*>(header.data()), 8);
+  file.write(reinterpret_cast<const char*>(data.data()),
+             static_cast<std::streamsize>(data.size()));
+  file.write(reinterpret_cast<const char*>(trailer.data()), 4);
+}
+
+}
+
+bool
+write_png(const std::string& path,
+          const uint8_t* rgba,
+          uint16_t width,
+          uint16_t height)
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    return false;
+  }
+  static const uint8_t signature[] = { 0x89, 'P', 'N', 'G', 0x0d, 0x0a,
+                                       0x1a, 0x0a };
+  file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+  std::vector<uint8_t> ihdr;
+  put_u32(ihdr, width);
+  put_u32(ihdr, height);
+  // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace.
+  ihdr.insert(ihdr.end(), { 8, 6, 0, 0, 0 });
+  write_chunk(file, "IHDR", ihdr);
+
+  // Every row starts with filter type 0. The zlib stream is a run of
+  // stored blocks, so the pixels are copied straight through.
+  const size_t row_size = size_t(width) * 4;
+  std::vector<uint8_t> raw((row_size + 1) * height);
+  for (size_t y = 0; y < height; ++y) {
+    uint8_t* out = raw.data() + y * (row_size + 1);
+    out[0] = 0;
+    std::memcpy(out + 1, rgba + y * row_size, row_size);
+  }
+  const size_t block_size = 65535;
+  std::vector<uint8_t> idat;
+  idat.reserve(raw.size() + raw.size() / block_size * 5 + 11);
+  idat.push_back(0x78);
+  idat.push_back(0x01);
+  size_t done = 0;
+  do {
+    const size_t n = std::min(block_size, raw.size() - done);
+    idat.push_back(done + n == raw.size() ? 1 : 0);
+    idat.push_back(static_cast<uint8_t>(n));
+    idat.push_back(static_cast<uint8_t>(n >> 8));
+    idat.push_back(static_cast<uint8_t>(~n));
+    idat.push_back(static_cast<uint8_t>(~n >> 8));
+    idat.insert(idat.end(), raw.begin() + done, raw.begin() + done + n);
+    done += n;
+  } while (done < raw.size());
+  put_u32(idat, adler32(raw.data(), raw.size()));
+  write_chunk(file, "IDAT", idat);
+  write_chunk(file, "IEND", std::vector<uint8_t>());
+  return static_cast<bool>(file);
+}
+
+void
+frame_capture::init(job_system& job_pool)
+{
+  jobs = &job_pool;
+}
+
+void
+frame_capture::destroy()
+{
+  // The last frames of a recording are still worth having, so the ones in
+  // flight are waited for here instead of dropped.
+  recording.reset();
+  screenshot_path.clear();
+  for (slot& s : slots) {
+    if (s.state == slot_state::reading) {
+      glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, destroy_timeout_ns);
+    }
+  }
+  update();
+  if (jobs != nullptr) {
+    jobs->wait(encodes);
+  }
+  for (slot& s : slots) {
+    if (s.buffer == 0) {
+      continue;
+    }
+    if (s.state == slot_state::encoding) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    if (s.fence != nullptr) {
+      glDeleteSync(s.fence);
+    }
+    glDeleteBuffers(1, &s.buffer);
+    s.buffer = 0;
+    s.buffer_size = 0;
+    s.fence = nullptr;
+    s.state = slot_state::free;
+    s.screenshot_path.clear();
+    s.video.reset();
+    s.mapped = nullptr;
+  }
+  next = 0;
+}
+
+void
+frame_capture::request_screenshot(std::string_view path)
+{
+  screenshot_path = path;
+}
+
+bool
+frame_capture::start_recording(std::string_view path)
+{
+  auto file = std::make_shared<video_file>();
+  file->out.open(std::string(path), std::ios::binary | std::ios::trunc);
+  if (!file->out) {
+    std::cerr << "error: Failed to open " << path
+              << " for recording ( frame_capture.cxx: )" << std::endl;
+    return false;
+  }
+  recording = std::move(file);
+  dropped = 0;
+  return true;
+}
+
+void
+frame_capture::stop_recording()
+{
+  recording.reset();
+}
+
+void
+frame_capture::read_frame(uint16_t width, uint16_t height)
+{
+  if (!wants_frame() || width == 0 || height == 0) {
+    return;
+  }
+  slot& s = slots[next];
+  if (s.state != slot_state::free) {
+    // A screenshot stays requested and is taken by a later frame.
+    if (recording != nullptr) {
+      ++dropped;
+    }
+    return;
+  }
+  UCHIHA_PROFILE_SCOPE("capture readback");
+  const size_t size = size_t(width) * height * 4;
+  if (s.buffer == 0) {
+    glGenBuffers(1, &s.buffer);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+  if (s.buffer_size != size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER,
+                 static_cast<GLsizeiptr>(size),
+                 nullptr,
+                 GL_STREAM_READ);
+    s.buffer_size = size;
+  }
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  s.state = slot_state::reading;
+  s.width = width;
+  s.height = height;
+  s.screenshot_path = std::move(screenshot_path);
+  screenshot_path.clear();
+  s.video = recording;
+  next = (next + 1) % ring_size;
+}
+
+void
+frame_capture::update()
+{
+  // Slots are visited oldest first and the fences pass in the same order,
+  // so the frames reach the encoder in the order they were read.
+  bool behind = false;
+  bool bound = false;
+  for (size_t k = 0; k < ring_size; ++k) {
+    slot& s = slots[(next + k) % ring_size];
+    if (s.state == slot_state::encoding &&
+        s.released.load(std::memory_order_acquire)) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+      bound = true;
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      s.mapped = nullptr;
+      s.state = slot_state::free;
+    }
+    if (s.state != slot_state::reading || behind) {
+      continue;
+    }
+    const GLenum status = glClientWaitSync(s.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      behind = true;
+      continue;
+    }
+    glDeleteSync(s.fence);
+    s.fence = nullptr;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.buffer);
+    bound = true;
+    s.mapped = static_cast<const uint8_t*>(
+      glMapBufferRange(GL_PIXEL_PACK_BUFFER,
+                       0,
+                       static_cast<GLsizeiptr>(s.buffer_size),
+                       GL_MAP_READ_BIT));
+    if (s.mapped == nullptr) {
+      std::cerr << "error: Failed to map capture buffer ( frame_capture.cxx: )"
+                << std::endl;
+      s.state = slot_state::free;
+      s.screenshot_path.clear();
+      s.video.reset();
+      continue;
+    }
+    s.state = slot_state::encoding;
+    s.released.store(false, std::memory_order_relaxed);
+    encode_task task;
+    task.source = &s;
+    task.width = s.width;
+    task.height = s.height;
+    task.screenshot_path = std::move(s.screenshot_path);
+    s.screenshot_path.clear();
+    task.video = std::move(s.video);
+    s.video.reset();
+    push(std::move(task));
+  }
+  if (bound) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+}
+
+void
+frame_capture::push(encode_task task)
+{
+  bool start = false;
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    queue.push_back(std::move(task));
+    start = !draining;
+    draining = true;
+  }
+  // One drain job at a time keeps the frames in order.
+  if (start) {
+    jobs->run([this]() { drain(); }, &encodes);
+  }
+}
+
+void
+frame_capture::drain()
+{
+  for (;;) {
+    encode_task task;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      if (queue.empty()) {
+        draining = false;
+        return;
+      }
+      task = std::move(queue.front());
+      queue.pop_front();
+    }
+    encode(task);
+  }
+}
+
+void
+frame_capture::encode(encode_task& task)
+{
+  UCHIHA_PROFILE_SCOPE("encode capture");
+  // GL returns the bottom row first.
+  const size_t row_size = size_t(task.width) * 4;
+  pixels.resize(row_size * task.height);
+  for (size_t y = 0; y < task.height; ++y) {
+    std::memcpy(pixels.data() + y * row_size,
+                task.source->mapped + (task.height - 1 - y) * row_size,
+                row_size);
+  }
+  task.source->released.store(true, std::memory_order_release);
+
+  if (!task.screenshot_path.empty() &&
+      !write_png(
+        task.screenshot_path, pixels.data(), task.width, task.height)) {
+    std::cerr << "error: Failed to write " << task.screenshot_path
+              << " ( frame_capture.cxx: )" << std::endl;
+  }
+  if (task.video != nullptr) {
+    video_file& v = *task.video;
+    if (v.width == 0) {
+      v.width = task.width;
+      v.height = task.height;
+    }
+    if (v.width == task.width && v.height == task.height) {
+      v.out.write(reinterpret_cast<const char*>(pixels.data()),
+                  static_cast<std::streamsize>(pixels.size()));
+    }
+  }
+}
+
+}
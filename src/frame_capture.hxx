@@ -0,0 +1,124 @@
+#pragma once
+#include "glad/glad.h"
+#include "job_system.hxx"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace uchiha {
+
+// Writes rgba, width * height pixels with the top row first, as a PNG with
+// stored (uncompressed) deflate blocks.
+bool
+write_png(const std::string& path,
+          const uint8_t* rgba,
+          uint16_t width,
+          uint16_t height);
+
+// Reads frames back without stalling. read_frame() queues glReadPixels into
+// one of a ring of pixel buffers and fences it; later frames map the
+// buffers whose fence has passed and hand them to an encode job, which
+// copies the pixels out and writes them. Frames arriving while every buffer
+// is still busy are dropped rather than waited for. Encoding runs on the
+// job system one frame at a time, in frame order.
+class frame_capture
+{
+public:
+  static constexpr size_t ring_size = 3;
+
+  void init(job_system& jobs);
+  // Finishes the readbacks in flight, waits for the encoder and frees the
+  // buffers. Must run on the GL thread.
+  void destroy();
+
+  void request_screenshot(std::string_view path);
+  // Every frame from the next one on is appended to path as raw RGBA, top
+  // row first, until stop_recording(). Frames of another size than the
+  // first are dropped.
+  bool start_recording(std::string_view path);
+  void stop_recording();
+  bool wants_frame() const
+  {
+    return !screenshot_path.empty() || recording != nullptr;
+  }
+
+  // Must run on the GL thread, after the frame is complete and with the
+  // framebuffer to capture bound for reading.
+  void read_frame(uint16_t width, uint16_t height);
+  // Hands finished readbacks to the encoder and recycles the buffers it
+  // has copied. Must run on the GL thread, once a frame.
+  void update();
+
+  // Frames skipped by the recording since it started because every buffer
+  // was busy.
+  uint32_t dropped_frames() const { return dropped; }
+
+private:
+  enum class slot_state : uint8_t
+  {
+    free,
+    reading,
+    encoding
+  };
+
+  // Shared by the frames of one recording, so frames still in flight
+  // when it stops are written before the file closes.
+  struct video_file
+  {
+    std::ofstream out;
+    uint16_t width = 0;
+    uint16_t height = 0;
+  };
+
+  struct slot
+  {
+    GLuint buffer = 0;
+    size_t buffer_size = 0;
+    GLsync fence = nullptr;
+    slot_state state = slot_state::free;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::string screenshot_path;
+    std::shared_ptr<video_file> video;
+    const uint8_t* mapped = nullptr;
+    // Set by the encoder once it has copied the mapped pixels.
+    std::atomic<bool> released{ false };
+  };
+
+  struct encode_task
+  {
+    slot* source = nullptr;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    std::string screenshot_path;
+    std::shared_ptr<video_file> video;
+  };
+
+  void push(encode_task task);
+  void drain();
+  void encode(encode_task& task);
+
+  job_system* jobs = nullptr;
+  slot slots[ring_size];
+  // The slot the next readback goes to; the oldest one in flight.
+  size_t next = 0;
+  std::string screenshot_path;
+  std::shared_ptr<video_file> recording;
+  uint32_t dropped = 0;
+
+  std::mutex queue_mutex;
+  std::deque<encode_task> queue;
+  bool draining = false;
+  job_counter encodes;
+  // Used by the encoder only.
+  std::vector<uint8_t> pixels;
+};
+
+}
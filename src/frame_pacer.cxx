@@ -0,0 +1,44 @@
+#include "frame_pacer.hxx"
+#include <thread>
+
+namespace uchiha {
+
+void
+frame_pacer::set_limit(float frames_per_second)
+{
+  limit_fps = frames_per_second > 0.f ? frames_per_second : 0.f;
+  interval = limit_fps > 0.f
+               ? std::chrono::duration_cast<clock::duration>(
+                   std::chrono::duration<double>(1.0 / limit_fps))
+               : clock::duration(0);
+  deadline = clock::now() + interval;
+}
+
+double
+frame_pacer::end_frame()
+{
+  clock::time_point now = clock::now();
+  if (interval.count() > 0) {
+    if (now < deadline) {
+      if (deadline - now > spin_margin) {
+        std::this_thread::sleep_until(deadline - spin_margin);
+      }
+      while ((now = clock::now()) < deadline) {
+        std::this_thread::yield();
+      }
+      deadline += interval;
+    } else {
+      // A frame that ran long restarts the schedule rather than letting the
+      // following frames run back to back to catch up.
+      deadline = now + interval;
+    }
+  }
+
+  last_delta =
+    started ? std::chrono::duration<double>(now - last_end).count() : 0.0;
+  last_end = now;
+  started = true;
+  return last_delta;
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <chrono>
+
+namespace uchiha {
+
+// Measures the time between swap_buffers() calls and, when a frame rate
+// limit is set, holds each frame back until its slot on a fixed schedule.
+// The wait sleeps until shortly before the deadline, because OS sleeps
+// overshoot by up to a scheduler tick, and spins the rest of the way.
+class frame_pacer
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  // 0 removes the limit.
+  void set_limit(float frames_per_second);
+  float limit() const { return limit_fps; }
+
+  // Call once per frame after presenting. Waits for the limiter if there is
+  // one and returns the seconds since the previous call.
+  double end_frame();
+  double last_frame_seconds() const { return last_delta; }
+
+private:
+  // Part of the wait that is spun instead of slept.
+  static constexpr std::chrono::microseconds spin_margin{ 2000 };
+
+  float limit_fps = 0.f;
+  clock::duration interval{ 0 };
+  clock::time_point deadline;
+  clock::time_point last_end;
+  bool started = false;
+  double last_delta = 0.0;
+};
+
+}
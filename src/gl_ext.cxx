@@ -0,0 +1,100 @@
+#include "gl_ext.hxx"
+
+namespace uchiha {
+namespace gl_ext {
+
+bool has_buffer_storage = false;
+buffer_storage_proc buffer_storage = nullptr;
+
+bool has_base_instance = false;
+draw_arrays_instanced_base_instance_proc draw_arrays_instanced_base_instance =
+  nullptr;
+
+bool has_program_binary = false;
+get_program_binary_proc get_program_binary = nullptr;
+program_binary_proc program_binary = nullptr;
+program_parameteri_proc program_parameteri = nullptr;
+
+bool has_texture_compression_s3tc = false;
+bool has_texture_compression_bptc = false;
+bool has_texture_compression_etc2 = false;
+bool has_texture_compression_astc = false;
+
+bool
+has_extension(std::string_view name)
+{
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; ++i) {
+    const GLubyte* ext = glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i));
+    if (ext && name == reinterpret_cast<const char*>(ext)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+context_version_at_least(int major, int minor)
+{
+  GLint ctx_major = 0;
+  GLint ctx_minor = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &ctx_major);
+  glGetIntegerv(GL_MINOR_VERSION, &ctx_minor);
+  return ctx_major > major || (ctx_major == major && ctx_minor >= minor);
+}
+
+void
+load(void* (*get_proc_address)(const char*))
+{
+  buffer_storage = nullptr;
+  // ARB_buffer_storage is a core extension, so its entry point carries no
+  // suffix either way.
+  if (context_version_at_least(4, 4) ||
+      has_extension("GL_ARB_buffer_storage")) {
+    buffer_storage =
+      reinterpret_cast<buffer_storage_proc>(get_proc_address("glBufferStorage"));
+  }
+  has_buffer_storage = buffer_storage != nullptr;
+
+  draw_arrays_instanced_base_instance = nullptr;
+  if (context_version_at_least(4, 2) ||
+      has_extension("GL_ARB_base_instance")) {
+    draw_arrays_instanced_base_instance =
+      reinterpret_cast<draw_arrays_instanced_base_instance_proc>(
+        get_proc_address("glDrawArraysInstancedBaseInstance"));
+  }
+  has_base_instance = draw_arrays_instanced_base_instance != nullptr;
+
+  get_program_binary = nullptr;
+  program_binary = nullptr;
+  program_parameteri = nullptr;
+  has_program_binary = false;
+  if (context_version_at_least(4, 1) ||
+      has_extension("GL_ARB_get_program_binary")) {
+    get_program_binary = reinterpret_cast<get_program_binary_proc>(
+      get_proc_address("glGetProgramBinary"));
+    program_binary =
+      reinterpret_cast<program_binary_proc>(get_proc_address("glProgramBinary"));
+    program_parameteri = reinterpret_cast<program_parameteri_proc>(
+      get_proc_address("glProgramParameteri"));
+    GLint formats = 0;
+    glGetIntegerv(num_program_binary_formats, &formats);
+    has_program_binary = get_program_binary != nullptr &&
+                         program_binary != nullptr &&
+                         program_parameteri != nullptr && formats > 0;
+  }
+
+  has_texture_compression_s3tc =
+    has_extension("GL_EXT_texture_compression_s3tc");
+  has_texture_compression_bptc =
+    context_version_at_least(4, 2) ||
+    has_extension("GL_ARB_texture_compression_bptc");
+  has_texture_compression_etc2 = context_version_at_least(4, 3) ||
+                                 has_extension("GL_ARB_ES3_compatibility");
+  has_texture_compression_astc =
+    has_extension("GL_KHR_texture_compression_astc_ldr");
+}
+
+}
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "glad/glad.h"
+#include <string_view>
+
+// Entry points newer than the GL 3.3 core profile that glad was generated
+// for. They are resolved at runtime and stay null when the context does not
+// expose them, so callers must check the matching has_* flag first.
+namespace uchiha {
+namespace gl_ext {
+
+constexpr GLbitfield map_persistent_bit = 0x0040;
+constexpr GLbitfield map_coherent_bit = 0x0080;
+constexpr GLenum program_binary_retrievable_hint = 0x8257;
+constexpr GLenum program_binary_length = 0x8741;
+constexpr GLenum num_program_binary_formats = 0x87FE;
+
+typedef void(APIENTRYP buffer_storage_proc)(GLenum target,
+                                            GLsizeiptr size,
+                                            const void* data,
+                                            GLbitfield flags);
+
+typedef void(APIENTRYP draw_arrays_instanced_base_instance_proc)(
+  GLenum mode,
+  GLint first,
+  GLsizei count,
+  GLsizei instance_count,
+  GLuint base_instance);
+
+typedef void(APIENTRYP get_program_binary_proc)(GLuint program,
+                                                GLsizei buffer_size,
+                                                GLsizei* length,
+                                                GLenum* binary_format,
+                                                void* binary);
+
+typedef void(APIENTRYP program_binary_proc)(GLuint program,
+                                            GLenum binary_format,
+                                            const void* binary,
+                                            GLsizei length);
+
+typedef void(APIENTRYP program_parameteri_proc)(GLuint program,
+                                                GLenum pname,
+                                                GLint value);
+
+extern bool has_buffer_storage;
+extern buffer_storage_proc buffer_storage;
+
+extern bool has_base_instance;
+extern draw_arrays_instanced_base_instance_proc
+  draw_arrays_instanced_base_instance;
+
+// GL 4.1 / ARB_get_program_binary, and the driver offers at least one
+// binary format.
+extern bool has_program_binary;
+extern get_program_binary_proc get_program_binary;
+extern program_binary_proc program_binary;
+extern program_parameteri_proc program_parameteri;
+
+// Compressed texture formats that are not part of GL 3.3 core.
+extern bool has_texture_compression_s3tc;
+extern bool has_texture_compression_bptc;
+extern bool has_texture_compression_etc2;
+extern bool has_texture_compression_astc;
+
+bool
+has_extension(std::string_view name);
+
+bool
+context_version_at_least(int major, int minor);
+
+void
+load(void* (*get_proc_address)(const char*));
+
+}
+}
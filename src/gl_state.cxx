@@ -0,0 +1,91 @@
+#include "gl_state.hxx"
+#include "profiler.hxx"
+
+namespace uchiha {
+
+void
+gl_state::use_program(GLuint p)
+{
+  if (program != p) {
+    glUseProgram(p);
+    program = p;
+    profiler::count_state_change();
+  }
+}
+
+void
+gl_state::bind_texture(GLuint unit, GLuint texture)
+{
+  if (unit >= max_texture_units) {
+    return;
+  }
+  if (textures[unit] == texture) {
+    return;
+  }
+  if (active_unit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_unit = unit;
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+  textures[unit] = texture;
+  profiler::count_texture_bind();
+}
+
+void
+gl_state::bind_vertex_array(GLuint vao)
+{
+  if (vertex_array != vao) {
+    glBindVertexArray(vao);
+    vertex_array = vao;
+    profiler::count_state_change();
+  }
+}
+
+void
+gl_state::set_blend(blend_mode mode)
+{
+  if (blend_known && blend == mode) {
+    return;
+  }
+  bool was_enabled = blend_known && blend != blend_mode::opaque;
+  switch (mode) {
+    case blend_mode::alpha:
+      if (!was_enabled) {
+        glEnable(GL_BLEND);
+      }
+      glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      break;
+    case blend_mode::additive:
+      if (!was_enabled) {
+        glEnable(GL_BLEND);
+      }
+      glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+      break;
+    case blend_mode::opaque:
+      glDisable(GL_BLEND);
+      break;
+  }
+  blend = mode;
+  blend_known = true;
+  profiler::count_state_change();
+}
+
+void
+gl_state::invalidate_textures()
+{
+  active_unit = unknown;
+  for (GLuint& t : textures) {
+    t = unknown;
+  }
+}
+
+void
+gl_state::invalidate()
+{
+  program = unknown;
+  vertex_array = unknown;
+  blend_known = false;
+  invalidate_textures();
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "engine.hxx"
+#include "glad/glad.h"
+#include <cstdint>
+
+namespace uchiha {
+
+// Shadow copy of the GL bindings the renderer changes per draw. Every setter
+// compares against the last value it issued and skips the GL call when
+// nothing would change. Code that binds behind its back (texture uploads,
+// for example) must call the matching invalidate_*().
+class gl_state
+{
+public:
+  static constexpr GLuint max_texture_units = 16;
+
+  void use_program(GLuint program);
+  void bind_texture(GLuint unit, GLuint texture);
+  void bind_vertex_array(GLuint vao);
+  void set_blend(blend_mode mode);
+
+  void invalidate_textures();
+  void invalidate();
+
+private:
+  // ~0u marks "unknown", which never compares equal to a real name.
+  static constexpr GLuint unknown = ~0u;
+
+  GLuint program = unknown;
+  GLuint vertex_array = unknown;
+  GLuint active_unit = unknown;
+  GLuint textures[max_texture_units] = {};
+  bool blend_known = false;
+  blend_mode blend = blend_mode::alpha;
+};
+
+}
@@ -0,0 +1,279 @@
+#include "input.hxx"
+#include "profiler.hxx"
+#include <SDL2/SDL.h>
+
+namespace uchiha {
+
+namespace {
+
+struct scancode_mapping
+{
+  SDL_Scancode scancode;
+  event::key_code key;
+};
+
+constexpr scancode_mapping scancode_mappings[] = {
+  { SDL_SCANCODE_LEFT, event::left },
+  { SDL_SCANCODE_RIGHT, event::right },
+  { SDL_SCANCODE_UP, event::top },
+  { SDL_SCANCODE_DOWN, event::bottom },
+  { SDL_SCANCODE_RETURN, event::enter },
+  { SDL_SCANCODE_KP_ENTER, event::enter },
+  { SDL_SCANCODE_ESCAPE, event::escape },
+  { SDL_SCANCODE_SPACE, event::space },
+  { SDL_SCANCODE_A, event::a },
+  { SDL_SCANCODE_B, event::b },
+  { SDL_SCANCODE_C, event::c },
+  { SDL_SCANCODE_D, event::d },
+  { SDL_SCANCODE_E, event::e },
+  { SDL_SCANCODE_F, event::f },
+  { SDL_SCANCODE_G, event::g },
+  { SDL_SCANCODE_H, event::h },
+  { SDL_SCANCODE_I, event::i },
+  { SDL_SCANCODE_J, event::j },
+  { SDL_SCANCODE_K, event::k },
+  { SDL_SCANCODE_L, event::l },
+  { SDL_SCANCODE_M, event::m },
+  { SDL_SCANCODE_N, event::n },
+  { SDL_SCANCODE_O, event::o },
+  { SDL_SCANCODE_P, event::p },
+  { SDL_SCANCODE_Q, event::q },
+  { SDL_SCANCODE_R, event::r },
+  { SDL_SCANCODE_S, event::s },
+  { SDL_SCANCODE_T, event::t },
+  { SDL_SCANCODE_U, event::u },
+  { SDL_SCANCODE_V, event::v },
+  { SDL_SCANCODE_W, event::w },
+  { SDL_SCANCODE_X, event::x },
+  { SDL_SCANCODE_Y, event::y },
+  { SDL_SCANCODE_Z, event::z },
+  { SDL_SCANCODE_0, event::num_0 },
+  { SDL_SCANCODE_1, event::num_1 },
+  { SDL_SCANCODE_2, event::num_2 },
+  { SDL_SCANCODE_3, event::num_3 },
+  { SDL_SCANCODE_4, event::num_4 },
+  { SDL_SCANCODE_5, event::num_5 },
+  { SDL_SCANCODE_6, event::num_6 },
+  { SDL_SCANCODE_7, event::num_7 },
+  { SDL_SCANCODE_8, event::num_8 },
+  { SDL_SCANCODE_9, event::num_9 },
+  { SDL_SCANCODE_F1, event::f1 },
+  { SDL_SCANCODE_F2, event::f2 },
+  { SDL_SCANCODE_F3, event::f3 },
+  { SDL_SCANCODE_F4, event::f4 },
+  { SDL_SCANCODE_F5, event::f5 },
+  { SDL_SCANCODE_F6, event::f6 },
+  { SDL_SCANCODE_F7, event::f7 },
+  { SDL_SCANCODE_F8, event::f8 },
+  { SDL_SCANCODE_F9, event::f9 },
+  { SDL_SCANCODE_F10, event::f10 },
+  { SDL_SCANCODE_F11, event::f11 },
+  { SDL_SCANCODE_F12, event::f12 },
+  { SDL_SCANCODE_TAB, event::tab },
+  { SDL_SCANCODE_BACKSPACE, event::backspace },
+  { SDL_SCANCODE_INSERT, event::insert },
+  { SDL_SCANCODE_DELETE, event::delete_key },
+  { SDL_SCANCODE_HOME, event::home },
+  { SDL_SCANCODE_END, event::end },
+  { SDL_SCANCODE_PAGEUP, event::page_up },
+  { SDL_SCANCODE_PAGEDOWN, event::page_down },
+  { SDL_SCANCODE_CAPSLOCK, event::caps_lock },
+  { SDL_SCANCODE_LSHIFT, event::left_shift },
+  { SDL_SCANCODE_RSHIFT, event::right_shift },
+  { SDL_SCANCODE_LCTRL, event::left_ctrl },
+  { SDL_SCANCODE_RCTRL, event::right_ctrl },
+  { SDL_SCANCODE_LALT, event::left_alt },
+  { SDL_SCANCODE_RALT, event::right_alt },
+  { SDL_SCANCODE_LGUI, event::left_super },
+  { SDL_SCANCODE_RGUI, event::right_super },
+  { SDL_SCANCODE_MINUS, event::minus },
+  { SDL_SCANCODE_EQUALS, event::equals },
+  { SDL_SCANCODE_LEFTBRACKET, event::left_bracket },
+  { SDL_SCANCODE_RIGHTBRACKET, event::right_bracket },
+  { SDL_SCANCODE_BACKSLASH, event::backslash },
+  { SDL_SCANCODE_SEMICOLON, event::semicolon },
+  { SDL_SCANCODE_APOSTROPHE, event::apostrophe },
+  { SDL_SCANCODE_GRAVE, event::grave },
+  { SDL_SCANCODE_COMMA, event::comma },
+  { SDL_SCANCODE_PERIOD, event::period },
+  { SDL_SCANCODE_SLASH, event::slash },
+  { SDL_SCANCODE_PRINTSCREEN, event::print_screen },
+  { SDL_SCANCODE_SCROLLLOCK, event::scroll_lock },
+  { SDL_SCANCODE_PAUSE, event::pause },
+  { SDL_SCANCODE_NUMLOCKCLEAR, event::num_lock },
+  { SDL_SCANCODE_KP_0, event::keypad_0 },
+  { SDL_SCANCODE_KP_1, event::keypad_1 },
+  { SDL_SCANCODE_KP_2, event::keypad_2 },
+  { SDL_SCANCODE_KP_3, event::keypad_3 },
+  { SDL_SCANCODE_KP_4, event::keypad_4 },
+  { SDL_SCANCODE_KP_5, event::keypad_5 },
+  { SDL_SCANCODE_KP_6, event::keypad_6 },
+  { SDL_SCANCODE_KP_7, event::keypad_7 },
+  { SDL_SCANCODE_KP_8, event::keypad_8 },
+  { SDL_SCANCODE_KP_9, event::keypad_9 },
+  { SDL_SCANCODE_KP_DIVIDE, event::keypad_divide },
+  { SDL_SCANCODE_KP_MULTIPLY, event::keypad_multiply },
+  { SDL_SCANCODE_KP_MINUS, event::keypad_minus },
+  { SDL_SCANCODE_KP_PLUS, event::keypad_plus },
+  { SDL_SCANCODE_KP_PERIOD, event::keypad_period },
+};
+
+// Dense scancode -> key_code table, expanded once from the list above.
+struct scancode_table
+{
+  event::key_code keys[SDL_NUM_SCANCODES];
+
+  scancode_table()
+  {
+    for (event::key_code& k : keys) {
+      k = event::undefined_key;
+    }
+    for (const scancode_mapping& m : scancode_mappings) {
+      keys[m.scancode] = m.key;
+    }
+  }
+};
+
+const scancode_table scancodes;
+
+event::key_code
+translate(SDL_Scancode scancode)
+{
+  return scancode >= 0 && scancode < SDL_NUM_SCANCODES
+           ? scancodes.keys[scancode]
+           : event::undefined_key;
+}
+
+}
+
+event*
+input_queue::back()
+{
+  return count == 0 ? nullptr : &ring[(head + count - 1) % capacity];
+}
+
+void
+input_queue::push(const event& e)
+{
+  if (count == capacity) {
+    ++dropped_events;
+    return;
+  }
+  ring[(head + count) % capacity] = e;
+  ++count;
+}
+
+void
+input_queue::poll()
+{
+  UCHIHA_PROFILE_SCOPE("poll events");
+  for (size_t k = 0; k < input_state::key_count; ++k) {
+    current.keys_pressed[k] = false;
+    current.keys_released[k] = false;
+  }
+  current.mouse_dx = 0;
+  current.mouse_dy = 0;
+  current.wheel_x = 0;
+  current.wheel_y = 0;
+  drained = true;
+
+  SDL_Event e;
+  while (SDL_PollEvent(&e)) {
+    event out;
+    out.mouse_x = current.mouse_x;
+    out.mouse_y = current.mouse_y;
+    switch (e.type) {
+      case SDL_QUIT:
+        out.type = event::quit;
+        push(out);
+        break;
+      case SDL_KEYDOWN:
+      case SDL_KEYUP: {
+        const bool down = e.type == SDL_KEYDOWN;
+        out.type = down ? event::pressed : event::reliased;
+        out.key = translate(e.key.keysym.scancode);
+        if (out.key != event::undefined_key && e.key.repeat == 0) {
+          current.keys_down[out.key] = down;
+          if (down) {
+            current.keys_pressed[out.key] = true;
+          } else {
+            current.keys_released[out.key] = true;
+          }
+        }
+        push(out);
+        break;
+      }
+      case SDL_MOUSEMOTION: {
+        current.mouse_x = e.motion.x;
+        current.mouse_y = e.motion.y;
+        current.mouse_dx += e.motion.xrel;
+        current.mouse_dy += e.motion.yrel;
+        event* last = back();
+        if (last != nullptr && last->type == event::mouse_motion) {
+          last->mouse_x = e.motion.x;
+          last->mouse_y = e.motion.y;
+          last->mouse_dx += e.motion.xrel;
+          last->mouse_dy += e.motion.yrel;
+          break;
+        }
+        out.type = event::mouse_motion;
+        out.mouse_x = e.motion.x;
+        out.mouse_y = e.motion.y;
+        out.mouse_dx = e.motion.xrel;
+        out.mouse_dy = e.motion.yrel;
+        push(out);
+        break;
+      }
+      case SDL_MOUSEBUTTONDOWN:
+      case SDL_MOUSEBUTTONUP: {
+        const bool down = e.type == SDL_MOUSEBUTTONDOWN;
+        out.type = down ? event::mouse_down : event::mouse_click;
+        out.mouse_button = e.button.button;
+        out.mouse_x = e.button.x;
+        out.mouse_y = e.button.y;
+        if (e.button.button < 32) {
+          const uint32_t bit = 1u << e.button.button;
+          if (down) {
+            current.mouse_buttons |= bit;
+          } else {
+            current.mouse_buttons &= ~bit;
+          }
+        }
+        push(out);
+        break;
+      }
+      case SDL_MOUSEWHEEL:
+        out.type = event::mouse_wheel;
+        out.wheel_x = e.wheel.x;
+        out.wheel_y = e.wheel.y;
+        current.wheel_x += e.wheel.x;
+        current.wheel_y += e.wheel.y;
+        push(out);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+bool
+input_queue::next(event& e)
+{
+  if (count == 0) {
+    if (drained) {
+      drained = false;
+      return false;
+    }
+    poll();
+    if (count == 0) {
+      drained = false;
+      return false;
+    }
+  }
+  e = ring[head];
+  head = (head + 1) % capacity;
+  --count;
+  return true;
+}
+
+}
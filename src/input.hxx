@@ -0,0 +1,38 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+
+namespace uchiha {
+
+// Fixed-capacity ring behind engine::read_input(). poll() drains SDL's
+// queue in one go, translating scancodes through a lookup table and
+// folding runs of mouse motion into a single event, so a high polling rate
+// mouse costs one queue slot per poll instead of one per report.
+class input_queue
+{
+public:
+  static constexpr size_t capacity = 256;
+
+  void poll();
+  // read_input() semantics: the first call on an empty queue polls, the
+  // next one that finds it empty returns false.
+  bool next(event& e);
+
+  const input_state& state() const { return current; }
+  // Events lost because the ring was full, since the start.
+  size_t dropped() const { return dropped_events; }
+
+private:
+  void push(const event& e);
+  event* back();
+
+  event ring[capacity];
+  size_t head = 0;
+  size_t count = 0;
+  size_t dropped_events = 0;
+  bool drained = false;
+  input_state current;
+};
+
+}
@@ -0,0 +1,230 @@
+#include "job_system.hxx"
+#include <algorithm>
+
+namespace uchiha {
+
+namespace {
+
+// The system the calling thread works for, and its deque there.
+thread_local const job_system* current_system = nullptr;
+thread_local size_t current_queue = 0;
+
+}
+
+job_system::~job_system()
+{
+  stop();
+}
+
+void
+job_system::start(size_t worker_count, bool main_thread_works)
+{
+  stop();
+  stopping = false;
+  callers_work = main_thread_works || worker_count == 0;
+  for (size_t i = 0; i < worker_count + 1; ++i) {
+    queues.push_back(std::make_unique<queue>());
+  }
+  for (size_t i = 0; i < worker_count; ++i) {
+    threads.emplace_back([this, i] { worker_loop(i); });
+  }
+}
+
+void
+job_system::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  threads.clear();
+  // Without workers, the queued jobs are run here.
+  while (!queues.empty() && run_one(queues.size() - 1)) {
+  }
+  queues.clear();
+}
+
+void
+job_system::run(std::function<void()> task,
+                job_counter* counter,
+                job_counter* after)
+{
+  if (counter != nullptr) {
+    counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+  job j{ std::move(task), counter };
+  if (after != nullptr) {
+    std::lock_guard<std::mutex> lock(after->mutex);
+    if (!after->done()) {
+      after->waiting.push_back(std::move(j));
+      return;
+    }
+  }
+  schedule(std::move(j));
+}
+
+void
+job_system::wait(job_counter& counter)
+{
+  const bool helps = current_system == this || callers_work;
+  // Outside the pool only the jobs of counter are run, unless there are no
+  // workers to run the others. Once none of them is left in the queues the
+  // rest are running, so the waiter sleeps until counter is done.
+  const job_counter* only =
+    current_system == this || threads.empty() ? nullptr : &counter;
+  const bool takes_any = helps && only == nullptr;
+  const size_t own = own_queue();
+  while (!counter.done()) {
+    if (helps && run_one(own, only)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    ++waiters;
+    (takes_any ? wake : finished).wait(lock, [&]() {
+      return counter.done() ||
+             (takes_any && queued.load(std::memory_order_acquire) > 0);
+    });
+    --waiters;
+  }
+  // The job that finished last may still hold the counter's lock.
+  std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+void
+job_system::parallel_for(size_t count,
+                         const std::function<void(size_t)>& task)
+{
+  if (count == 1) {
+    task(0);
+    return;
+  }
+  job_counter done;
+  for (size_t i = 0; i < count; ++i) {
+    run([&task, i]() { task(i); }, &done);
+  }
+  wait(done);
+}
+
+size_t
+job_system::own_queue() const
+{
+  return current_system == this ? current_queue : queues.size() - 1;
+}
+
+void
+job_system::schedule(job j)
+{
+  if (queues.empty()) {
+    // Not started: there is nobody else to run it.
+    j.task();
+    finish(j.counter);
+    return;
+  }
+  {
+    queue& q = *queues[own_queue()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.jobs.push_back(std::move(j));
+    queued.fetch_add(1, std::memory_order_release);
+  }
+  // Taking the lock orders this after a sleeper's check of queued.
+  { std::lock_guard<std::mutex> lock(sleep_mutex); }
+  wake.notify_one();
+}
+
+bool
+job_system::pop(size_t own, job& out, const job_counter* only)
+{
+  if (queued.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+  const size_t n = queues.size();
+  for (size_t k = 0; k < n; ++k) {
+    queue& q = *queues[(own + k) % n];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.jobs.empty()) {
+      continue;
+    }
+    if (only != nullptr) {
+      auto found =
+        std::find_if(q.jobs.begin(), q.jobs.end(), [only](const job& j) {
+          return j.counter == only;
+        });
+      if (found == q.jobs.end()) {
+        continue;
+      }
+      out = std::move(*found);
+      q.jobs.erase(found);
+    } else if (k == 0) {
+      out = std::move(q.jobs.back());
+      q.jobs.pop_back();
+    } else {
+      out = std::move(q.jobs.front());
+      q.jobs.pop_front();
+    }
+    queued.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool
+job_system::run_one(size_t own, const job_counter* only)
+{
+  job j;
+  if (!pop(own, j, only)) {
+    return false;
+  }
+  j.task();
+  finish(j.counter);
+  return true;
+}
+
+void
+job_system::finish(job_counter* counter)
+{
+  if (counter == nullptr) {
+    return;
+  }
+  std::vector<job> ready;
+  {
+    std::lock_guard<std::mutex> lock(counter->mutex);
+    if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    ready.swap(counter->waiting);
+  }
+  // From here on the counter may already be gone.
+  for (job& j : ready) {
+    schedule(std::move(j));
+  }
+  std::lock_guard<std::mutex> lock(sleep_mutex);
+  if (waiters != 0) {
+    wake.notify_all();
+    finished.notify_all();
+  }
+}
+
+void
+job_system::worker_loop(size_t index)
+{
+  current_system = this;
+  current_queue = index;
+  for (;;) {
+    if (run_one(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    wake.wait(lock, [this]() {
+      return stopping || queued.load(std::memory_order_acquire) > 0;
+    });
+    if (stopping && queued.load(std::memory_order_acquire) == 0) {
+      return;
+    }
+  }
+}
+
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace uchiha {
+
+class job_counter;
+
+struct job
+{
+  std::function<void()> task;
+  job_counter* counter = nullptr;
+};
+
+// Jobs started against it that have not finished yet. Jobs can be made to
+// start only once a counter has reached zero, and threads can wait() for
+// it. A counter has to outlive the jobs that count on it or depend on it.
+class job_counter
+{
+public:
+  job_counter() = default;
+  job_counter(const job_counter&) = delete;
+  job_counter& operator=(const job_counter&) = delete;
+
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+  friend class job_system;
+
+  std::atomic<uint32_t> pending{ 0 };
+  std::mutex mutex;
+  // Jobs to schedule once pending reaches zero.
+  std::vector<job> waiting;
+};
+
+// Work-stealing scheduler shared by the engine's subsystems. Every worker
+// has its own deque: it pushes and pops the back, so the jobs it spawns run
+// while their data is still in its cache, and idle workers steal from the
+// front of the others. Threads outside the pool push into one shared deque.
+class job_system
+{
+public:
+  job_system() = default;
+  job_system(const job_system&) = delete;
+  job_system& operator=(const job_system&) = delete;
+  ~job_system();
+
+  // With main_thread_works, threads outside the pool, the main thread above
+  // all, run the jobs of the counter they wait() for instead of sleeping, so
+  // the pool is usually started a thread smaller. They never pick up other
+  // jobs, so a long decode cannot hold up a frame. Without workers they run
+  // every job, and jobs only run inside wait().
+  void start(size_t worker_count, bool main_thread_works);
+  // Runs the jobs already queued, then joins all workers. Jobs still
+  // waiting on a counter are dropped.
+  void stop();
+
+  // Queues task. counter, when given, counts it until it has finished; with
+  // after it is not started before after has reached zero.
+  void run(std::function<void()> task,
+           job_counter* counter = nullptr,
+           job_counter* after = nullptr);
+  // Returns once counter has reached zero. Workers always run other jobs
+  // meanwhile, so jobs may wait on the jobs they spawn.
+  void wait(job_counter& counter);
+  // Runs task(i) for every i below count as jobs and waits for all of them.
+  void parallel_for(size_t count, const std::function<void(size_t)>& task);
+
+  size_t size() const { return threads.size(); }
+
+private:
+  struct queue
+  {
+    std::mutex mutex;
+    std::deque<job> jobs;
+  };
+
+  size_t own_queue() const;
+  void schedule(job j);
+  // With only set, takes nothing but jobs counted by only.
+  bool pop(size_t own, job& out, const job_counter* only = nullptr);
+  bool run_one(size_t own, const job_counter* only = nullptr);
+  void finish(job_counter* counter);
+  void worker_loop(size_t index);
+
+  std::vector<std::thread> threads;
+  // One per worker, then the one shared by threads outside the pool.
+  std::vector<std::unique_ptr<queue>> queues;
+  std::atomic<size_t> queued{ 0 };
+  std::mutex sleep_mutex;
+  // Workers and waiters that run any job sleep on wake, other waiters on
+  // finished.
+  std::condition_variable wake;
+  std::condition_variable finished;
+  size_t waiters = 0;
+  bool stopping = false;
+  bool callers_work = true;
+};
+
+}
@@ -0,0 +1,209 @@
+#include "lz4.hxx"
+#include <cstring>
+#include <vector>
+
+namespace uchiha {
+
+namespace {
+
+constexpr size_t min_match = 4;
+// The format ends every block with at least 5 literals, and the last match
+// starts no later than 12 bytes before the end.
+constexpr size_t last_literals = 5;
+constexpr size_t match_start_limit = 12;
+constexpr size_t max_offset = 65535;
+constexpr int hash_bits = 16;
+
+uint32_t
+read_u32(const uint8_t* p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint32_t
+hash_sequence(uint32_t sequence)
+{
+  return (sequence * 2654435761u) >> (32 - hash_bits);
+}
+
+class block_writer
+{
+public:
+  block_writer(uint8_t* dst, size_t capacity)
+    : out(dst)
+    , end(dst + capacity)
+  {}
+
+  // One sequence: the literals, then a match of match_length bytes at
+  // offset, or just the literals when match_length is 0.
+  bool sequence(const uint8_t* literals,
+                size_t literal_length,
+                size_t offset,
+                size_t match_length)
+  {
+    if (out == end) {
+      return false;
+    }
+    uint8_t* token = out++;
+    const size_t match_code = match_length != 0 ? match_length - min_match : 0;
+    *token = static_cast<uint8_t>((literal_length < 15 ? literal_length : 15)
+                                  << 4);
+    *token |= static_cast<uint8_t>(match_code < 15 ? match_code : 15);
+    if (!length(literal_length) ||
+        static_cast<size_t>(end - out) < literal_length) {
+      return false;
+    }
+    if (literal_length != 0) {
+      std::memcpy(out, literals, literal_length);
+      out += literal_length;
+    }
+    if (match_length == 0) {
+      return true;
+    }
+    if (end - out < 2) {
+      return false;
+    }
+    *out++ = static_cast<uint8_t>(offset);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    return length(match_code);
+  }
+
+  uint8_t* position() const { return out; }
+
+private:
+  // Length bytes after the token for a nibble that overflowed.
+  bool length(size_t value)
+  {
+    if (value < 15) {
+      return true;
+    }
+    value -= 15;
+    for (;;) {
+      if (out == end) {
+        return false;
+      }
+      if (value < 255) {
+        *out++ = static_cast<uint8_t>(value);
+        return true;
+      }
+      *out++ = 255;
+      value -= 255;
+    }
+  }
+
+  uint8_t* out;
+  uint8_t* end;
+};
+
+}
+
+size_t
+lz4_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity)
+{
+  block_writer writer(dst, capacity);
+  size_t anchor = 0;
+  if (size > match_start_limit) {
+    // Last position seen for each hashed 4 byte sequence, plus one so 0
+    // means none.
+    std::vector<uint32_t> table(size_t(1) << hash_bits, 0);
+    const size_t match_end_limit = size - last_literals;
+    size_t at = 0;
+    while (at + match_start_limit <= size) {
+      const uint32_t sequence = read_u32(src + at);
+      uint32_t& slot = table[hash_sequence(sequence)];
+      const size_t candidate = slot;
+      slot = static_cast<uint32_t>(at + 1);
+      if (candidate == 0 || at - (candidate - 1) > max_offset ||
+          read_u32(src + candidate - 1) != sequence) {
+        ++at;
+        continue;
+      }
+      const size_t match = candidate - 1;
+      size_t length = min_match;
+      while (at + length < match_end_limit &&
+             src[match + length] == src[at + length]) {
+        ++length;
+      }
+      if (!writer.sequence(src + anchor, at - anchor, at - match, length)) {
+        return 0;
+      }
+      at += length;
+      anchor = at;
+    }
+  }
+  if (!writer.sequence(src + anchor, size - anchor, 0, 0)) {
+    return 0;
+  }
+  return static_cast<size_t>(writer.position() - dst);
+}
+
+bool
+lz4_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size)
+{
+  size_t in = 0;
+  size_t out = 0;
+  // Reads the length bytes that follow a nibble of 15.
+  auto extend = [&](size_t& value) -> bool {
+    if (value != 15) {
+      return true;
+    }
+    uint8_t b = 0;
+    do {
+      if (in == size) {
+        return false;
+      }
+      b = src[in++];
+      value += b;
+    } while (b == 255);
+    return true;
+  };
+
+  while (in < size) {
+    const uint8_t token = src[in++];
+    size_t literal_length = token >> 4;
+    if (!extend(literal_length) || literal_length > size - in ||
+        literal_length > dst_size - out) {
+      return false;
+    }
+    if (literal_length != 0) {
+      std::memcpy(dst + out, src + in, literal_length);
+      in += literal_length;
+      out += literal_length;
+    }
+    if (in == size) {
+      break;
+    }
+
+    if (size - in < 2) {
+      return false;
+    }
+    const size_t offset = src[in] | size_t(src[in + 1]) << 8;
+    in += 2;
+    if (offset == 0 || offset > out) {
+      return false;
+    }
+    size_t match_length = token & 15u;
+    if (!extend(match_length)) {
+      return false;
+    }
+    match_length += min_match;
+    if (match_length > dst_size - out) {
+      return false;
+    }
+    // Matches may overlap what they produce, so short offsets are copied a
+    // byte at a time.
+    if (offset >= match_length) {
+      std::memcpy(dst + out, dst + out - offset, match_length);
+    } else {
+      for (size_t i = 0; i < match_length; ++i) {
+        dst[out + i] = dst[out - offset + i];
+      }
+    }
+    out += match_length;
+  }
+  return out == dst_size;
+}
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace uchiha {
+
+// Raw LZ4 blocks, as in the LZ4 block format description: no frame header,
+// no checksums, and the decompressed size has to be known by the caller.
+// Resource packs store it in their table of contents.
+
+// Worst case size of a compressed block of size bytes.
+constexpr size_t
+lz4_compress_bound(size_t size)
+{
+  return size + size / 255 + 16;
+}
+
+// Greedy single pass compressor. Returns the compressed size, or 0 when it
+// does not fit into capacity.
+size_t
+lz4_compress(const uint8_t* src, size_t size, uint8_t* dst, size_t capacity);
+
+// Fails on malformed input instead of reading or writing out of bounds, and
+// unless exactly dst_size bytes come out.
+bool
+lz4_decompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dst_size);
+
+}
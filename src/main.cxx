@@ -0,0 +1,144 @@
+#include "engine.hxx"
+#include <SDL2/SDL_main.h>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+int
+main(int argc, char** argv)
+{
+  bool threaded = false;
+  bool hot_reload = false;
+  bool half_resolution = false;
+  std::string font_path;
+  std::string trace_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg(argv[i]);
+    threaded = threaded || arg == "--threaded";
+    hot_reload = hot_reload || arg == "--hot-reload";
+    half_resolution = half_resolution || arg == "--half-resolution";
+    if (arg.substr(0, 7) == "--font=") {
+      font_path = std::string(arg.substr(7));
+    }
+    if (arg.substr(0, 8) == "--trace=") {
+      trace_path = std::string(arg.substr(8));
+    }
+  }
+  uchiha::engine* engine =
+    threaded ? uchiha::create_threaded_engine() : uchiha::create_engine();
+  engine->init(800, 600, false);
+  // With --trace=path.trace the session can be replayed by engine_replay.
+  if (!trace_path.empty()) {
+    engine->start_trace(trace_path);
+  }
+  engine->set_shader_hot_reload(hot_reload);
+  if (half_resolution) {
+    engine->set_resolution_scale(0.5f);
+  }
+
+  uchiha::texture* tx = engine->create_texture("res/black-horse.png");
+  // With --font=path.ttf the frame time is printed in the corner.
+  uchiha::font* hud_font =
+    font_path.empty() ? nullptr : engine->create_font(font_path, 18);
+
+  std::vector<uchiha::triangle> vertex_buffer;
+
+  uchiha::triangle tr0(
+    { 0.3f, -0.3f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+    { 0.0f, 0.3f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+    { -0.3f, -0.3f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f });
+  uchiha::triangle tr1(
+    { 0.6f, 0.3f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+    { 0.9f, 0.3f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+    { 0.75f, 0.6f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f });
+  vertex_buffer.push_back(tr0);
+  vertex_buffer.push_back(tr1);
+
+  std::vector<uchiha::triangle> vertex_buffer_01;
+  uchiha::triangle tr2(
+    { -0.1f, 0.1f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f },
+    { -0.1f, 0.4f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f },
+    { -0.4f, 0.1f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f });
+  uchiha::triangle tr3(
+    { -0.4f, 0.4f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f },
+    { -0.1f, 0.4f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f },
+    { -0.4f, 0.1f, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f, 0.0f, 1.0f });
+  vertex_buffer_01.push_back(tr2);
+  vertex_buffer_01.push_back(tr3);
+
+  // The scene never changes, so it is uploaded once.
+  uchiha::mesh* shapes = engine->create_mesh(vertex_buffer);
+  uchiha::mesh* tiles = engine->create_mesh(vertex_buffer_01);
+
+  // Arrow keys pan the camera, keypad plus and minus zoom it; the geometry
+  // itself is never touched.
+  uchiha::camera_2d camera;
+  uchiha::event e;
+  bool is_loop = true;
+  while (is_loop) {
+    while (engine->read_input(e)) {
+      switch (e.type) {
+        case uchiha::event::quit: {
+          std::cout << "event: quit" << std::endl;
+          is_loop = false;
+          break;
+        }
+        case uchiha::event::mouse_click: {
+          std::cout << "event: mouse click" << std::endl;
+          break;
+        }
+        case uchiha::event::pressed: {
+          std::cout << "event: key pressed" << std::endl;
+          std::cout << e.key << std::endl;
+          break;
+        }
+        case uchiha::event::reliased: {
+          std::cout << "event: key reliased" << std::endl;
+          std::cout << e.key << std::endl;
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    const uchiha::input_state& input = engine->get_input();
+    const float step = static_cast<float>(engine->get_frame_seconds());
+    camera.x += (input.is_down(uchiha::event::right) -
+                 input.is_down(uchiha::event::left)) *
+                step / camera.zoom;
+    camera.y += (input.is_down(uchiha::event::top) -
+                 input.is_down(uchiha::event::bottom)) *
+                step / camera.zoom;
+    if (input.is_down(uchiha::event::keypad_plus)) {
+      camera.zoom *= 1.f + step;
+    }
+    if (input.is_down(uchiha::event::keypad_minus)) {
+      camera.zoom /= 1.f + step;
+    }
+    engine->set_camera(camera);
+
+    engine->draw_mesh(*shapes);
+    engine->draw_mesh(*tiles, tx);
+    if (hud_font != nullptr) {
+      // Laid out in window pixels, independent of the camera.
+      char hud[32];
+      std::snprintf(hud,
+                    sizeof(hud),
+                    "%.2f ms",
+                    engine->get_frame_seconds() * 1000.0);
+      engine->set_view_projection(uchiha::mat4::ortho(0.f, 800.f, 0.f, 600.f));
+      engine->submit_text(*hud_font, hud, 8.f, 600.f - 8.f - 18.f);
+      engine->flush();
+    }
+    engine->swap_buffers();
+  }
+  engine->destroy_mesh(shapes);
+  engine->destroy_mesh(tiles);
+  engine->release_texture(tx);
+  engine->destroy_font(hud_font);
+  engine->destroy();
+  uchiha::destroy_engine(engine);
+  return 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "culling.hxx"
+#include "engine.hxx"
+#include "glad/glad.h"
+
+namespace uchiha {
+
+// Mesh with its own vertex buffer, optional index buffer and a vertex array
+// object that binds both, so drawing it is one VAO bind and one draw call.
+class mesh_impl : public mesh
+{
+public:
+  GLuint vertex_buffer = 0;
+  GLuint index_buffer = 0;
+  GLuint vertex_array = 0;
+  size_t vertex_count = 0;
+  size_t index_count = 0;
+  index_type indices = index_type::u16;
+  mesh_usage usage = mesh_usage::static_draw;
+  // Object space bounds for culling; partial updates only ever grow them.
+  bounds_3d bounds;
+
+  size_t get_vertex_count() const override { return vertex_count; }
+  size_t get_index_count() const override { return index_count; }
+};
+
+}
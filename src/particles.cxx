@@ -0,0 +1,279 @@
+#include "particles.hxx"
+#include "profiler.hxx"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UCHIHA_PARTICLES_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UCHIHA_PARTICLES_NEON 1
+#endif
+
+namespace uchiha {
+
+namespace {
+
+constexpr float two_pi = 6.28318530718f;
+
+float
+lerp(float a, float b, float t)
+{
+  return a + (b - a) * t;
+}
+
+uint8_t
+lerp_channel(uint32_t from, uint32_t to, int shift, float t)
+{
+  const float a = static_cast<float>((from >> shift) & 0xffu);
+  const float b = static_cast<float>((to >> shift) & 0xffu);
+  return static_cast<uint8_t>(lerp(a, b, t) + 0.5f);
+}
+
+}
+
+particle_emitter::~particle_emitter() {}
+
+particle_emitter_impl::particle_emitter_impl(const particle_settings& settings,
+                                             float x_position,
+                                             float y_position,
+                                             uint32_t seed)
+  : config(settings)
+  , origin_x(x_position)
+  , origin_y(y_position)
+  , rng(seed != 0 ? seed : 1)
+  , x(settings.max_particles)
+  , y(settings.max_particles)
+  , vx(settings.max_particles)
+  , vy(settings.max_particles)
+  , rotation(settings.max_particles)
+  , spin(settings.max_particles)
+  , age(settings.max_particles)
+  , age_rate(settings.max_particles)
+{}
+
+void
+particle_emitter_impl::move(float x_position, float y_position)
+{
+  origin_x = x_position;
+  origin_y = y_position;
+}
+
+float
+particle_emitter_impl::random()
+{
+  // xorshift32; the top 24 bits make a float in [0, 1).
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return static_cast<float>(rng >> 8) * (1.f / 16777216.f);
+}
+
+void
+particle_emitter_impl::spawn(float seconds)
+{
+  spawn_debt += config.rate * seconds;
+  const float whole = std::floor(spawn_debt);
+  spawn_debt -= whole;
+  // Whatever does not fit is dropped rather than owed, so a long frame or
+  // a full emitter does not end in a flood later.
+  const size_t wanted = static_cast<size_t>(whole) + pending_burst;
+  pending_burst = 0;
+  const size_t n = std::min(wanted, config.max_particles - count);
+  for (size_t i = count; i < count + n; ++i) {
+    const float radius = config.spawn_radius * std::sqrt(random());
+    const float around = two_pi * random();
+    x[i] = origin_x + radius * std::cos(around);
+    y[i] = origin_y + radius * std::sin(around);
+    const float heading =
+      config.direction + (random() - 0.5f) * config.spread;
+    const float speed = lerp(config.speed_min, config.speed_max, random());
+    vx[i] = speed * std::cos(heading);
+    vy[i] = speed * std::sin(heading);
+    rotation[i] = 0.f;
+    spin[i] = lerp(config.spin_min, config.spin_max, random());
+    age[i] = 0.f;
+    const float life = lerp(config.life_min, config.life_max, random());
+    age_rate[i] = life > 0.f ? 1.f / life : 1e30f;
+  }
+  count += n;
+}
+
+void
+particle_emitter_impl::integrate(size_t first, size_t last, float seconds)
+{
+  // Drag is applied as v * exp(-drag * t) over the step, which stays stable
+  // for any step length, and gravity as a constant acceleration.
+  const float damp = std::exp(-config.drag * seconds);
+  const float gx = config.gravity_x * seconds;
+  const float gy = config.gravity_y * seconds;
+  size_t i = first;
+#if defined(UCHIHA_PARTICLES_SSE2)
+  const __m128 dt4 = _mm_set1_ps(seconds);
+  const __m128 damp4 = _mm_set1_ps(damp);
+  const __m128 gx4 = _mm_set1_ps(gx);
+  const __m128 gy4 = _mm_set1_ps(gy);
+  for (; i + 4 <= last; i += 4) {
+    const __m128 nvx =
+      _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&vx[i]), damp4), gx4);
+    const __m128 nvy =
+      _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&vy[i]), damp4), gy4);
+    _mm_storeu_ps(&vx[i], nvx);
+    _mm_storeu_ps(&vy[i], nvy);
+    _mm_storeu_ps(&x[i],
+                  _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(nvx, dt4)));
+    _mm_storeu_ps(&y[i],
+                  _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(nvy, dt4)));
+    _mm_storeu_ps(&rotation[i],
+                  _mm_add_ps(_mm_loadu_ps(&rotation[i]),
+                             _mm_mul_ps(_mm_loadu_ps(&spin[i]), dt4)));
+    _mm_storeu_ps(&age[i],
+                  _mm_add_ps(_mm_loadu_ps(&age[i]),
+                             _mm_mul_ps(_mm_loadu_ps(&age_rate[i]), dt4)));
+  }
+#elif defined(UCHIHA_PARTICLES_NEON)
+  const float32x4_t damp4 = vdupq_n_f32(damp);
+  const float32x4_t gx4 = vdupq_n_f32(gx);
+  const float32x4_t gy4 = vdupq_n_f32(gy);
+  for (; i + 4 <= last; i += 4) {
+    const float32x4_t nvx = vmlaq_f32(gx4, vld1q_f32(&vx[i]), damp4);
+    const float32x4_t nvy = vmlaq_f32(gy4, vld1q_f32(&vy[i]), damp4);
+    vst1q_f32(&vx[i], nvx);
+    vst1q_f32(&vy[i], nvy);
+    vst1q_f32(&x[i], vmlaq_n_f32(vld1q_f32(&x[i]), nvx, seconds));
+    vst1q_f32(&y[i], vmlaq_n_f32(vld1q_f32(&y[i]), nvy, seconds));
+    vst1q_f32(
+      &rotation[i],
+      vmlaq_n_f32(vld1q_f32(&rotation[i]), vld1q_f32(&spin[i]), seconds));
+    vst1q_f32(
+      &age[i],
+      vmlaq_n_f32(vld1q_f32(&age[i]), vld1q_f32(&age_rate[i]), seconds));
+  }
+#endif
+  for (; i < last; ++i) {
+    vx[i] = vx[i] * damp + gx;
+    vy[i] = vy[i] * damp + gy;
+    x[i] += vx[i] * seconds;
+    y[i] += vy[i] * seconds;
+    rotation[i] += spin[i] * seconds;
+    age[i] += age_rate[i] * seconds;
+  }
+}
+
+void
+particle_emitter_impl::compact()
+{
+  for (size_t i = 0; i < count;) {
+    if (age[i] < 1.f) {
+      ++i;
+      continue;
+    }
+    const size_t last = --count;
+    x[i] = x[last];
+    y[i] = y[last];
+    vx[i] = vx[last];
+    vy[i] = vy[last];
+    rotation[i] = rotation[last];
+    spin[i] = spin[last];
+    age[i] = age[last];
+    age_rate[i] = age_rate[last];
+  }
+}
+
+void
+particle_emitter_impl::write_instances(sprite_instance* out,
+                                       size_t first,
+                                       size_t last) const
+{
+  for (size_t i = first; i < last; ++i, ++out) {
+    const float t = age[i];
+    const float size = lerp(config.size_start, config.size_end, t);
+    sprite_instance s;
+    s.x = x[i];
+    s.y = y[i];
+    s.scale_x = size;
+    s.scale_y = size;
+    s.rotation = rotation[i];
+    s.u0 = config.uv.u0;
+    s.v0 = config.uv.v0;
+    s.u1 = config.uv.u1;
+    s.v1 = config.uv.v1;
+    s.r = lerp_channel(config.color_start, config.color_end, 24, t);
+    s.g = lerp_channel(config.color_start, config.color_end, 16, t);
+    s.b = lerp_channel(config.color_start, config.color_end, 8, t);
+    s.a = lerp_channel(config.color_start, config.color_end, 0, t);
+    *out = s;
+  }
+}
+
+void
+particle_system::start(job_system& job_pool)
+{
+  jobs = &job_pool;
+}
+
+void
+particle_system::stop()
+{
+  emitters.clear();
+  live = 0;
+}
+
+particle_emitter_impl*
+particle_system::create(const particle_settings& settings, float x, float y)
+{
+  auto* e = new particle_emitter_impl(settings, x, y, next_seed);
+  next_seed = next_seed * 1664525u + 1013904223u;
+  return emitters.insert(std::unique_ptr<particle_emitter_impl>(e));
+}
+
+bool
+particle_system::destroy(particle_emitter* e)
+{
+  particle_emitter_impl* impl = emitters.find(e);
+  if (impl == nullptr) {
+    return false;
+  }
+  live -= impl->size();
+  emitters.erase(e);
+  return true;
+}
+
+void
+particle_system::update(float seconds)
+{
+  UCHIHA_PROFILE_SCOPE("update particles");
+  chunks.clear();
+  for (std::unique_ptr<particle_emitter_impl>& e : emitters) {
+    e->spawn(seconds);
+    for (size_t first = 0; first < e->size(); first += chunk_size) {
+      chunks.push_back(
+        chunk{ e.get(), first, std::min(first + chunk_size, e->size()) });
+    }
+  }
+  jobs->parallel_for(chunks.size(), [&](size_t i) {
+    chunks[i].emitter->integrate(chunks[i].first, chunks[i].last, seconds);
+  });
+  jobs->parallel_for(emitters.size(),
+                     [&](size_t i) { emitters[i].compact(); });
+
+  live = 0;
+  for (const std::unique_ptr<particle_emitter_impl>& e : emitters) {
+    live += e->size();
+  }
+}
+
+void
+particle_system::write_instances(const particle_emitter_impl& e,
+                                 sprite_instance* out)
+{
+  const size_t n = (e.size() + chunk_size - 1) / chunk_size;
+  jobs->parallel_for(n, [&](size_t i) {
+    const size_t first = i * chunk_size;
+    e.write_instances(
+      out + first, first, std::min(first + chunk_size, e.size()));
+  });
+}
+
+}
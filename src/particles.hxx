@@ -0,0 +1,104 @@
+#pragma once
+#include "engine.hxx"
+#include "job_system.hxx"
+#include "slot_map.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace uchiha {
+
+// Particles of one emitter as structure of arrays, so the integration
+// kernels stream through each attribute with full vector loads. Ages are
+// normalized: a particle is born at 0 and expires at 1.
+class particle_emitter_impl : public particle_emitter
+{
+public:
+  particle_emitter_impl(const particle_settings& settings,
+                        float x,
+                        float y,
+                        uint32_t seed);
+
+  void move(float x, float y);
+  void burst(uint32_t count) { pending_burst += count; }
+
+  // Spawns what the rate and the pending bursts call for. Runs before the
+  // particles are integrated, not concurrently with anything else on this
+  // emitter.
+  void spawn(float seconds);
+  // Moves [first, last) on by seconds. Disjoint ranges may be integrated on
+  // different threads at once.
+  void integrate(size_t first, size_t last, float seconds);
+  // Drops expired particles by moving the last ones into their place.
+  void compact();
+  // Writes [first, last) as instances into out, which may be mapped buffer
+  // memory: it is written front to back and never read.
+  void write_instances(sprite_instance* out, size_t first, size_t last) const;
+
+  size_t size() const { return count; }
+  const particle_settings& settings() const { return config; }
+
+private:
+  float random();
+
+  particle_settings config;
+  float origin_x = 0.f;
+  float origin_y = 0.f;
+  float spawn_debt = 0.f;
+  uint32_t pending_burst = 0;
+  uint32_t rng = 1;
+  size_t count = 0;
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> vx;
+  std::vector<float> vy;
+  std::vector<float> rotation;
+  std::vector<float> spin;
+  std::vector<float> age;
+  std::vector<float> age_rate;
+};
+
+// Owns the emitters and updates them as jobs. update() spawns on the
+// calling thread, then integrates every emitter in chunks across the job
+// system, then compacts the emitters in parallel. write_instances() splits
+// its output the same way.
+class particle_system
+{
+public:
+  // Particles per task; small emitters are a single task.
+  static constexpr size_t chunk_size = 8192;
+
+  void start(job_system& jobs);
+  // Frees every emitter.
+  void stop();
+
+  particle_emitter_impl* create(const particle_settings& settings,
+                                float x,
+                                float y);
+  // False for emitters this system did not create.
+  bool destroy(particle_emitter* e);
+
+  void update(float seconds);
+  // out needs room for e.size() instances.
+  void write_instances(const particle_emitter_impl& e, sprite_instance* out);
+
+  // Particles alive after the last update().
+  size_t live_count() const { return live; }
+
+private:
+  struct chunk
+  {
+    particle_emitter_impl* emitter = nullptr;
+    size_t first = 0;
+    size_t last = 0;
+  };
+
+  job_system* jobs = nullptr;
+  object_pool<particle_emitter_impl, particle_emitter> emitters;
+  std::vector<chunk> chunks;
+  uint32_t next_seed = 0x9e3779b9u;
+  size_t live = 0;
+};
+
+}
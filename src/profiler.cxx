@@ -0,0 +1,308 @@
+#include "profiler.hxx"
+#include "glad/glad.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace uchiha {
+namespace profiler {
+
+std::atomic<bool> enabled{ false };
+counters frame_counters;
+
+namespace {
+
+// Timer results are read this many frames after they were issued, by which
+// point the GPU has normally finished them and the read does not stall.
+constexpr size_t gpu_latency_frames = 3;
+// Recording stops once the trace holds this many events.
+constexpr size_t max_trace_events = 1 << 20;
+constexpr uint32_t gpu_track = 0;
+
+struct trace_event
+{
+  const char* name = nullptr;
+  uint64_t start_us = 0;
+  uint64_t duration_us = 0;
+  uint32_t track = 0;
+};
+
+struct frame_record
+{
+  uint64_t start_us = 0;
+  counters values;
+};
+
+struct gpu_query
+{
+  const char* name = nullptr;
+  GLuint begin = 0;
+  GLuint end = 0;
+  // Scopes open around this one when it began.
+  uint32_t depth = 0;
+};
+
+struct gpu_frame
+{
+  std::vector<GLuint> pool;
+  std::vector<gpu_query> issued;
+  uint64_t cpu_start_us = 0;
+};
+
+std::mutex trace_mutex;
+std::vector<trace_event> events;
+std::vector<frame_record> frames;
+uint64_t epoch_us = 0;
+
+gpu_frame gpu_frames[gpu_latency_frames + 1];
+size_t gpu_frame_index = 0;
+// Scopes begun and not yet ended, as indices into the current frame's
+// issued queries.
+std::vector<size_t> gpu_open;
+
+uint64_t frame_start_us = 0;
+frame_stats last_stats;
+
+uint32_t
+current_track()
+{
+  // Track 0 is reserved for the GPU timeline.
+  return static_cast<uint32_t>(
+           std::hash<std::thread::id>{}(std::this_thread::get_id()) %
+           0x7fffffff) +
+         1;
+}
+
+void
+append_event(const char* name, uint64_t start_us, uint64_t end_us, uint32_t track)
+{
+  if (events.size() < max_trace_events) {
+    events.push_back(trace_event{ name, start_us, end_us - start_us, track });
+  }
+}
+
+GLuint
+take_query(gpu_frame& f)
+{
+  GLuint query = 0;
+  if (f.pool.empty()) {
+    glGenQueries(1, &query);
+  } else {
+    query = f.pool.back();
+    f.pool.pop_back();
+  }
+  return query;
+}
+
+void
+resolve_gpu_frame(gpu_frame& f)
+{
+  uint64_t total_ns = 0;
+  GLuint64 first_ns = 0;
+  for (size_t i = 0; i < f.issued.size(); ++i) {
+    const gpu_query& q = f.issued[i];
+    GLuint64 begin_ns = 0;
+    GLuint64 end_ns = 0;
+    glGetQueryObjectui64v(q.begin, GL_QUERY_RESULT, &begin_ns);
+    glGetQueryObjectui64v(q.end, GL_QUERY_RESULT, &end_ns);
+    end_ns = std::max(end_ns, begin_ns);
+    if (i == 0) {
+      first_ns = begin_ns;
+    }
+    if (q.depth == 0) {
+      total_ns += end_ns - begin_ns;
+    }
+    // GPU timestamps are on the GPU's clock; the trace places them relative
+    // to the first scope, which is put at the start of the CPU frame that
+    // issued it.
+    const uint64_t start_us =
+      f.cpu_start_us + (begin_ns - std::min(begin_ns, first_ns)) / 1000;
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    append_event(
+      q.name, start_us, start_us + (end_ns - begin_ns) / 1000, gpu_track);
+  }
+  if (!f.issued.empty()) {
+    last_stats.gpu_milliseconds = static_cast<float>(total_ns) / 1.0e6f;
+  }
+  f.pool.reserve(f.pool.size() + f.issued.size() * 2);
+  for (const gpu_query& q : f.issued) {
+    f.pool.push_back(q.begin);
+    f.pool.push_back(q.end);
+  }
+  f.issued.clear();
+}
+
+// Closes every scope still open, so a frame's queries are complete before
+// it is handed on.
+void
+end_open_gpu_scopes()
+{
+  while (!gpu_open.empty()) {
+    end_gpu();
+  }
+}
+
+void
+write_escaped(std::ofstream& out, const char* s)
+{
+  for (; *s != '\0'; ++s) {
+    if (*s == '"' || *s == '\\') {
+      out << '\\';
+    }
+    out << *s;
+  }
+}
+
+}
+
+void
+set_enabled(bool on)
+{
+  if (on && epoch_us == 0) {
+    epoch_us = now_microseconds();
+  }
+  if (!on) {
+    end_open_gpu_scopes();
+  }
+  frame_start_us = now_microseconds();
+  frame_counters = counters();
+  enabled.store(on, std::memory_order_relaxed);
+}
+
+uint64_t
+now_microseconds()
+{
+  using namespace std::chrono;
+  return static_cast<uint64_t>(
+    duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+      .count());
+}
+
+void
+record_cpu(const char* name, uint64_t start_us, uint64_t end_us)
+{
+  uint32_t track = current_track();
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  append_event(name, start_us, end_us, track);
+}
+
+void
+begin_gpu(const char* name)
+{
+  gpu_frame& f = gpu_frames[gpu_frame_index];
+  gpu_query q;
+  q.name = name;
+  q.begin = take_query(f);
+  q.end = take_query(f);
+  q.depth = static_cast<uint32_t>(gpu_open.size());
+  glQueryCounter(q.begin, GL_TIMESTAMP);
+  gpu_open.push_back(f.issued.size());
+  f.issued.push_back(q);
+}
+
+void
+end_gpu()
+{
+  if (gpu_open.empty()) {
+    return;
+  }
+  const gpu_query& q = gpu_frames[gpu_frame_index].issued[gpu_open.back()];
+  glQueryCounter(q.end, GL_TIMESTAMP);
+  gpu_open.pop_back();
+}
+
+void
+end_frame()
+{
+  if (!enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  end_open_gpu_scopes();
+  uint64_t now = now_microseconds();
+  last_stats.cpu_milliseconds =
+    static_cast<float>(now - frame_start_us) / 1000.f;
+  last_stats.draw_calls = frame_counters.draw_calls;
+  last_stats.texture_binds = frame_counters.texture_binds;
+  last_stats.state_changes = frame_counters.state_changes;
+  last_stats.bytes_uploaded = frame_counters.bytes_uploaded;
+  last_stats.primitives_culled = frame_counters.primitives_culled;
+  {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    if (frames.size() < max_trace_events) {
+      frames.push_back(frame_record{ frame_start_us, frame_counters });
+    }
+    append_event("frame", frame_start_us, now, current_track());
+  }
+
+  gpu_frames[gpu_frame_index].cpu_start_us = frame_start_us;
+  gpu_frame_index = (gpu_frame_index + 1) % (gpu_latency_frames + 1);
+  resolve_gpu_frame(gpu_frames[gpu_frame_index]);
+
+  frame_counters = counters();
+  frame_start_us = now;
+}
+
+frame_stats
+last_frame()
+{
+  return last_stats;
+}
+
+bool
+write_trace(std::string_view path)
+{
+  std::ofstream out{ std::string(path) };
+  if (!out) {
+    std::cerr << "error: Failed to open trace file ( profiler.cxx:  )"
+              << std::endl;
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  out << "{\"traceEvents\":[\n";
+  out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+      << gpu_track << ",\"args\":{\"name\":\"GPU\"}}";
+  for (const trace_event& e : events) {
+    out << ",\n{\"name\":\"";
+    write_escaped(out, e.name);
+    out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.track
+        << ",\"ts\":" << (e.start_us - epoch_us)
+        << ",\"dur\":" << e.duration_us << "}";
+  }
+  for (const frame_record& f : frames) {
+    out << ",\n{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+        << (f.start_us - epoch_us) << ",\"args\":{\"draw_calls\":"
+        << f.values.draw_calls
+        << ",\"texture_binds\":" << f.values.texture_binds
+        << ",\"state_changes\":" << f.values.state_changes
+        << ",\"bytes_uploaded\":" << f.values.bytes_uploaded
+        << ",\"primitives_culled\":" << f.values.primitives_culled << "}}";
+  }
+  out << "\n]}\n";
+  return static_cast<bool>(out);
+}
+
+void
+destroy()
+{
+  set_enabled(false);
+  for (gpu_frame& f : gpu_frames) {
+    for (const gpu_query& q : f.issued) {
+      f.pool.push_back(q.begin);
+      f.pool.push_back(q.end);
+    }
+    f.issued.clear();
+    if (!f.pool.empty()) {
+      glDeleteQueries(static_cast<GLsizei>(f.pool.size()), f.pool.data());
+    }
+    f.pool.clear();
+  }
+}
+
+}
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "engine.hxx"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Frame profiler. CPU scopes and counters are recorded only while enabled;
+// when disabled each UCHIHA_PROFILE_* site costs a load and a branch, and
+// building with UCHIHA_NO_PROFILER removes the sites altogether.
+namespace uchiha {
+namespace profiler {
+
+struct counters
+{
+  uint32_t draw_calls = 0;
+  uint32_t texture_binds = 0;
+  uint32_t state_changes = 0;
+  uint64_t bytes_uploaded = 0;
+  uint32_t primitives_culled = 0;
+};
+
+extern std::atomic<bool> enabled;
+extern counters frame_counters;
+
+void
+set_enabled(bool on);
+
+uint64_t
+now_microseconds();
+
+// May be called from any thread. Scope names are stored, not copied, so
+// they must be string literals.
+void
+record_cpu(const char* name, uint64_t start_us, uint64_t end_us);
+
+// GPU scopes are timed with a GL_TIMESTAMP query at either end, so they
+// nest like CPU scopes; end_gpu() closes the innermost open one. The frame's
+// GPU time is that of its outermost scopes. Both must run on the GL thread.
+void
+begin_gpu(const char* name);
+void
+end_gpu();
+
+inline void
+count_draw()
+{
+  if (enabled.load(std::memory_order_relaxed)) {
+    ++frame_counters.draw_calls;
+  }
+}
+
+inline void
+count_texture_bind()
+{
+  if (enabled.load(std::memory_order_relaxed)) {
+    ++frame_counters.texture_binds;
+  }
+}
+
+inline void
+count_state_change()
+{
+  if (enabled.load(std::memory_order_relaxed)) {
+    ++frame_counters.state_changes;
+  }
+}
+
+inline void
+count_upload(size_t bytes)
+{
+  if (enabled.load(std::memory_order_relaxed)) {
+    frame_counters.bytes_uploaded += bytes;
+  }
+}
+
+inline void
+count_culled(size_t primitives)
+{
+  if (enabled.load(std::memory_order_relaxed)) {
+    frame_counters.primitives_culled += static_cast<uint32_t>(primitives);
+  }
+}
+
+// Closes the current frame and resolves the timer queries issued
+// gpu_latency_frames ago.
+void
+end_frame();
+
+frame_stats
+last_frame();
+
+// Writes everything recorded so far in Chrome's trace event format, for
+// chrome://tracing or ui.perfetto.dev.
+bool
+write_trace(std::string_view path);
+
+// Releases the query objects; must run on the GL thread before the context
+// goes away.
+void
+destroy();
+
+class cpu_scope
+{
+  const char* name;
+  uint64_t start;
+
+public:
+  explicit cpu_scope(const char* scope_name)
+    : name(scope_name)
+    , start(enabled.load(std::memory_order_relaxed) ? now_microseconds() : 0)
+  {}
+  ~cpu_scope()
+  {
+    if (start != 0) {
+      record_cpu(name, start, now_microseconds());
+    }
+  }
+  cpu_scope(const cpu_scope&) = delete;
+  cpu_scope& operator=(const cpu_scope&) = delete;
+};
+
+class gpu_scope
+{
+  bool open;
+
+public:
+  explicit gpu_scope(const char* name)
+    : open(enabled.load(std::memory_order_relaxed))
+  {
+    if (open) {
+      begin_gpu(name);
+    }
+  }
+  ~gpu_scope()
+  {
+    if (open) {
+      end_gpu();
+    }
+  }
+  gpu_scope(const gpu_scope&) = delete;
+  gpu_scope& operator=(const gpu_scope&) = delete;
+};
+
+}
+}
+
+#define UCHIHA_PROFILE_CONCAT_INNER(a, b) a##b
+#define UCHIHA_PROFILE_CONCAT(a, b) UCHIHA_PROFILE_CONCAT_INNER(a, b)
+
+#ifndef UCHIHA_NO_PROFILER
+#define UCHIHA_PROFILE_SCOPE(name)                                             \
+  ::uchiha::profiler::cpu_scope UCHIHA_PROFILE_CONCAT(profile_scope_,          \
+                                                      __LINE__)(name)
+#define UCHIHA_PROFILE_GPU_SCOPE(name)                                         \
+  ::uchiha::profiler::gpu_scope UCHIHA_PROFILE_CONCAT(profile_gpu_scope_,      \
+                                                      __LINE__)(name)
+#else
+#define UCHIHA_PROFILE_SCOPE(name)
+#define UCHIHA_PROFILE_GPU_SCOPE(name)
+#endif
@@ -0,0 +1,337 @@
+#include "quad_builder.hxx"
+#include "quad_builder_impl.hxx"
+#include <SDL2/SDL.h>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UCHIHA_QUAD_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UCHIHA_QUAD_NEON 1
+#endif
+
+namespace uchiha {
+
+namespace {
+
+// Reference kernel, also used where no vector unit is available.
+void
+build_quads_scalar(vertex* out,
+                   const sprite_instance* sprites,
+                   size_t count,
+                   const uv_rect& texture_rect)
+{
+  const float u_extent = texture_rect.u1 - texture_rect.u0;
+  const float v_extent = texture_rect.v1 - texture_rect.v0;
+  for (size_t i = 0; i < count; ++i) {
+    const sprite_instance& s = sprites[i];
+    const float sin_r = std::sin(s.rotation);
+    const float cos_r = std::cos(s.rotation);
+    const float half_w = s.scale_x * 0.5f;
+    const float half_h = s.scale_y * 0.5f;
+    const float ax = cos_r * half_w;
+    const float ay = sin_r * half_w;
+    const float bx = sin_r * half_h;
+    const float by = cos_r * half_h;
+    const float corner_x[4] = {
+      s.x - ax + bx, s.x + ax + bx, s.x - ax - bx, s.x + ax - bx
+    };
+    const float corner_y[4] = {
+      s.y - ay - by, s.y + ay - by, s.y - ay + by, s.y + ay + by
+    };
+    const float u0 = texture_rect.u0 + s.u0 * u_extent;
+    const float u1 = texture_rect.u0 + s.u1 * u_extent;
+    const float v0 = texture_rect.v0 + s.v0 * v_extent;
+    const float v1 = texture_rect.v0 + s.v1 * v_extent;
+    const float r = static_cast<float>(s.r) * (1.f / 255.f);
+    const float g = static_cast<float>(s.g) * (1.f / 255.f);
+    const float b = static_cast<float>(s.b) * (1.f / 255.f);
+    const float a = static_cast<float>(s.a) * (1.f / 255.f);
+
+    static constexpr int order[6] = { 0, 1, 2, 2, 1, 3 };
+    for (int k = 0; k < 6; ++k) {
+      const int corner = order[k];
+      write_vertex(*out++,
+                   corner_x[corner],
+                   corner_y[corner],
+                   r,
+                   g,
+                   b,
+                   a,
+                   (corner & 1) ? u1 : u0,
+                   (corner & 2) ? v0 : v1);
+    }
+  }
+}
+
+#if defined(UCHIHA_QUAD_SSE2)
+struct sse2
+{
+  using f = __m128;
+  static constexpr size_t width = 4;
+
+  static f load(const float* p) { return _mm_load_ps(p); }
+  static void store(float* p, f v) { _mm_store_ps(p, v); }
+  static f set(float v) { return _mm_set1_ps(v); }
+  static f add(f a, f b) { return _mm_add_ps(a, b); }
+  static f sub(f a, f b) { return _mm_sub_ps(a, b); }
+  static f mul(f a, f b) { return _mm_mul_ps(a, b); }
+  static void emit(vertex* out, const quad_lanes<width>& lanes, size_t n)
+  {
+    emit_sse(out, lanes, 0, n);
+  }
+
+  static f gather(const sprite_instance* s, float sprite_instance::*member)
+  {
+    return _mm_setr_ps(s[0].*member, s[1].*member, s[2].*member, s[3].*member);
+  }
+
+  static void colors(const sprite_instance* s, f& r, f& g, f& b, f& a)
+  {
+    const __m128i rgba = _mm_setr_epi32(packed_color(s[0]),
+                                        packed_color(s[1]),
+                                        packed_color(s[2]),
+                                        packed_color(s[3]));
+    const __m128i low_byte = _mm_set1_epi32(0xff);
+    r = _mm_cvtepi32_ps(_mm_and_si128(rgba, low_byte));
+    g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgba, 8), low_byte));
+    b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(rgba, 16), low_byte));
+    a = _mm_cvtepi32_ps(_mm_srli_epi32(rgba, 24));
+  }
+
+  static void sincos(f x, f& s, f& c)
+  {
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i two = _mm_set1_epi32(2);
+    const __m128i quadrant = _mm_cvtps_epi32(mul(x, set(two_over_pi)));
+    const f q = _mm_cvtepi32_ps(quadrant);
+    f r = sub(x, mul(q, set(half_pi_1)));
+    r = sub(r, mul(q, set(half_pi_2)));
+    r = sub(r, mul(q, set(half_pi_3)));
+    f sin_r;
+    f cos_r;
+    sincos_reduced<sse2>(r, sin_r, cos_r);
+
+    // Odd quadrants swap sine and cosine, the sign follows the quadrant.
+    const f swap = _mm_castsi128_ps(
+      _mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+    const f sin_sign =
+      _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+    const f cos_sign = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+    s = _mm_xor_ps(
+      _mm_or_ps(_mm_and_ps(swap, cos_r), _mm_andnot_ps(swap, sin_r)),
+      sin_sign);
+    c = _mm_xor_ps(
+      _mm_or_ps(_mm_and_ps(swap, sin_r), _mm_andnot_ps(swap, cos_r)),
+      cos_sign);
+  }
+};
+#endif
+
+#if defined(UCHIHA_QUAD_NEON)
+struct neon
+{
+  using f = float32x4_t;
+  static constexpr size_t width = 4;
+
+  static f load(const float* p) { return vld1q_f32(p); }
+  static void store(float* p, f v) { vst1q_f32(p, v); }
+  static f set(float v) { return vdupq_n_f32(v); }
+  static f add(f a, f b) { return vaddq_f32(a, b); }
+  static f sub(f a, f b) { return vsubq_f32(a, b); }
+  static f mul(f a, f b) { return vmulq_f32(a, b); }
+  static void emit(vertex* out, const quad_lanes<width>& lanes, size_t n)
+  {
+    uchiha::emit(out, lanes, n);
+  }
+
+  static f gather(const sprite_instance* s, float sprite_instance::*member)
+  {
+    f v = vdupq_n_f32(s[0].*member);
+    v = vsetq_lane_f32(s[1].*member, v, 1);
+    v = vsetq_lane_f32(s[2].*member, v, 2);
+    return vsetq_lane_f32(s[3].*member, v, 3);
+  }
+
+  static void colors(const sprite_instance* s, f& r, f& g, f& b, f& a)
+  {
+    uint32x4_t rgba = vdupq_n_u32(packed_color(s[0]));
+    rgba = vsetq_lane_u32(packed_color(s[1]), rgba, 1);
+    rgba = vsetq_lane_u32(packed_color(s[2]), rgba, 2);
+    rgba = vsetq_lane_u32(packed_color(s[3]), rgba, 3);
+    const uint32x4_t low_byte = vdupq_n_u32(0xff);
+    r = vcvtq_f32_u32(vandq_u32(rgba, low_byte));
+    g = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(rgba, 8), low_byte));
+    b = vcvtq_f32_u32(vandq_u32(vshrq_n_u32(rgba, 16), low_byte));
+    a = vcvtq_f32_u32(vshrq_n_u32(rgba, 24));
+  }
+
+  static void sincos(f x, f& s, f& c)
+  {
+    const uint32x4_t one = vdupq_n_u32(1);
+    const uint32x4_t two = vdupq_n_u32(2);
+    // ARMv7 only converts towards zero, so round half away first.
+    const f scaled = mul(x, set(two_over_pi));
+    const f bias = vbslq_f32(
+      vcltq_f32(scaled, set(0.f)), set(-0.5f), set(0.5f));
+    const int32x4_t quadrant = vcvtq_s32_f32(add(scaled, bias));
+    const f q = vcvtq_f32_s32(quadrant);
+    f r = sub(x, mul(q, set(half_pi_1)));
+    r = sub(r, mul(q, set(half_pi_2)));
+    r = sub(r, mul(q, set(half_pi_3)));
+    f sin_r;
+    f cos_r;
+    sincos_reduced<neon>(r, sin_r, cos_r);
+
+    const uint32x4_t bits = vreinterpretq_u32_s32(quadrant);
+    const uint32x4_t swap = vceqq_u32(vandq_u32(bits, one), one);
+    const uint32x4_t sin_sign = vshlq_n_u32(vandq_u32(bits, two), 30);
+    const uint32x4_t cos_sign =
+      vshlq_n_u32(vandq_u32(vaddq_u32(bits, one), two), 30);
+    s = vreinterpretq_f32_u32(veorq_u32(
+      vreinterpretq_u32_f32(vbslq_f32(swap, cos_r, sin_r)), sin_sign));
+    c = vreinterpretq_f32_u32(veorq_u32(
+      vreinterpretq_u32_f32(vbslq_f32(swap, sin_r, cos_r)), cos_sign));
+  }
+};
+#endif
+
+}
+
+simd_level
+detect_simd_level()
+{
+  static const simd_level level = []() {
+    for (simd_level l :
+         { simd_level::avx2, simd_level::sse2, simd_level::neon }) {
+      if (is_supported(l)) {
+        return l;
+      }
+    }
+    return simd_level::scalar;
+  }();
+  return level;
+}
+
+bool
+is_supported(simd_level level)
+{
+  switch (level) {
+    case simd_level::scalar:
+      return true;
+    case simd_level::sse2:
+#if defined(UCHIHA_QUAD_SSE2)
+      return SDL_HasSSE2() == SDL_TRUE;
+#else
+      return false;
+#endif
+    case simd_level::avx2:
+#if defined(UCHIHA_QUAD_AVX2)
+      return SDL_HasAVX2() == SDL_TRUE;
+#else
+      return false;
+#endif
+    case simd_level::neon:
+#if defined(UCHIHA_QUAD_NEON)
+      return SDL_HasNEON() == SDL_TRUE;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+const char*
+simd_level_name(simd_level level)
+{
+  switch (level) {
+    case simd_level::scalar:
+      return "scalar";
+    case simd_level::sse2:
+      return "sse2";
+    case simd_level::avx2:
+      return "avx2";
+    case simd_level::neon:
+      return "neon";
+  }
+  return "unknown";
+}
+
+void
+build_quads(vertex* out,
+            const sprite_instance* sprites,
+            size_t count,
+            const uv_rect& texture_rect)
+{
+  build_quads(out, sprites, count, texture_rect, detect_simd_level());
+}
+
+void
+build_quads(vertex* out,
+            const sprite_instance* sprites,
+            size_t count,
+            const uv_rect& texture_rect,
+            simd_level level)
+{
+  if (out == nullptr || sprites == nullptr || count == 0) {
+    return;
+  }
+  switch (is_supported(level) ? level : simd_level::scalar) {
+#if defined(UCHIHA_QUAD_AVX2)
+    case simd_level::avx2:
+      build_quads_avx2(out, sprites, count, texture_rect);
+      return;
+#endif
+#if defined(UCHIHA_QUAD_SSE2)
+    case simd_level::sse2:
+      build_quads_simd<sse2>(out, sprites, count, texture_rect);
+      return;
+#endif
+#if defined(UCHIHA_QUAD_NEON)
+    case simd_level::neon:
+      build_quads_simd<neon>(out, sprites, count, texture_rect);
+      return;
+#endif
+    default:
+      build_quads_scalar(out, sprites, count, texture_rect);
+      return;
+  }
+}
+
+void
+tint_vertices(vertex* vertices,
+              size_t count,
+              float r,
+              float g,
+              float b,
+              float a)
+{
+  // r, g, b and a are adjacent, so each vertex's color is one unaligned
+  // four lane load; wider vectors would straddle vertices.
+  size_t i = 0;
+#if defined(UCHIHA_QUAD_SSE2)
+  const __m128 tint = _mm_setr_ps(r, g, b, a);
+  for (; i < count; ++i) {
+    float* color = &vertices[i].r;
+    _mm_storeu_ps(color, _mm_mul_ps(_mm_loadu_ps(color), tint));
+  }
+#elif defined(UCHIHA_QUAD_NEON)
+  const float lanes[4] = { r, g, b, a };
+  const float32x4_t tint = vld1q_f32(lanes);
+  for (; i < count; ++i) {
+    float* color = &vertices[i].r;
+    vst1q_f32(color, vmulq_f32(vld1q_f32(color), tint));
+  }
+#endif
+  for (; i < count; ++i) {
+    vertex& v = vertices[i];
+    v.r *= r;
+    v.g *= g;
+    v.b *= b;
+    v.a *= a;
+  }
+}
+
+}
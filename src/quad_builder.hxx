@@ -0,0 +1,57 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+
+namespace uchiha {
+
+// Instruction sets the CPU geometry kernels have been written for, in order
+// of preference.
+enum class simd_level : uint8_t
+{
+  scalar,
+  sse2,
+  avx2,
+  neon
+};
+
+// Best level this build and CPU support, detected once.
+simd_level
+detect_simd_level();
+
+bool
+is_supported(simd_level level);
+
+const char*
+simd_level_name(simd_level level);
+
+// Expands every sprite into two triangles, six vertices, exactly as
+// instanced.vert does on the GPU, with the sprite's uv rectangle mapped into
+// texture_rect. out needs room for count * 6 vertices and may be mapped
+// buffer memory: it is written once, front to back, and never read.
+void
+build_quads(vertex* out,
+            const sprite_instance* sprites,
+            size_t count,
+            const uv_rect& texture_rect);
+
+// Same on an explicit level, for benchmarks and comparisons; unsupported
+// levels run the scalar kernel. Results match the scalar kernel to within
+// a few ulp, which the vectorized sine and cosine differ by.
+void
+build_quads(vertex* out,
+            const sprite_instance* sprites,
+            size_t count,
+            const uv_rect& texture_rect,
+            simd_level level);
+
+// Multiplies the color of count vertices by (r, g, b, a).
+void
+tint_vertices(vertex* vertices,
+              size_t count,
+              float r,
+              float g,
+              float b,
+              float a);
+
+}
@@ -0,0 +1,144 @@
+// Compiled with AVX2 enabled (see CMakeLists.txt) and only called after
+// detect_simd_level() has found AVX2, so nothing else belongs in here.
+#include "quad_builder_impl.hxx"
+
+#if defined(UCHIHA_QUAD_AVX2) && defined(__AVX2__)
+#include <immintrin.h>
+
+namespace uchiha {
+
+namespace {
+
+struct avx2
+{
+  using f = __m256;
+  static constexpr size_t width = 8;
+
+  static f load(const float* p) { return _mm256_load_ps(p); }
+  static void store(float* p, f v) { _mm256_store_ps(p, v); }
+  static f set(float v) { return _mm256_set1_ps(v); }
+  static f add(f a, f b) { return _mm256_add_ps(a, b); }
+  static f sub(f a, f b) { return _mm256_sub_ps(a, b); }
+  static f mul(f a, f b) { return _mm256_mul_ps(a, b); }
+  // Same as emit_sse(), with both halves transposed at once: the 256-bit
+  // unpacks and shuffles work within each 128-bit half, so lane i of rows[j]
+  // is sprite j in the low half and sprite j + 4 in the high half.
+  static void emit(vertex* out, const quad_lanes<width>& lanes, size_t n)
+  {
+    const __m256 r = load(lanes.r);
+    const __m256 g = load(lanes.g);
+    const __m256 b = load(lanes.b);
+    const __m256 a = load(lanes.a);
+    __m256 heads[4][4];
+    for (int corner = 0; corner < 4; ++corner) {
+      transpose(load(lanes.corner_x[corner]),
+                load(lanes.corner_y[corner]),
+                _mm256_setzero_ps(),
+                r,
+                heads[corner]);
+    }
+    __m256 tails[2][4];
+    transpose(g, b, a, load(lanes.u0), tails[0]);
+    transpose(g, b, a, load(lanes.u1), tails[1]);
+
+    static constexpr int order[6] = { 0, 1, 2, 2, 1, 3 };
+    for (size_t sprite = 0; sprite < n; ++sprite) {
+      const size_t row = sprite & 3;
+      const bool high = sprite >= 4;
+      const float top = lanes.v0[sprite];
+      const float bottom = lanes.v1[sprite];
+      for (int k = 0; k < 6; ++k, ++out) {
+        const int corner = order[k];
+        const __m256 head = heads[corner][row];
+        const __m256 tail = tails[corner & 1][row];
+        _mm_storeu_ps(&out->x,
+                      high ? _mm256_extractf128_ps(head, 1)
+                           : _mm256_castps256_ps128(head));
+        _mm_storeu_ps(&out->g,
+                      high ? _mm256_extractf128_ps(tail, 1)
+                           : _mm256_castps256_ps128(tail));
+        out->ty = (corner & 2) ? top : bottom;
+      }
+    }
+  }
+
+  static void transpose(f x, f y, f z, f w, f rows[4])
+  {
+    const f xy_low = _mm256_unpacklo_ps(x, y);
+    const f xy_high = _mm256_unpackhi_ps(x, y);
+    const f zw_low = _mm256_unpacklo_ps(z, w);
+    const f zw_high = _mm256_unpackhi_ps(z, w);
+    rows[0] = _mm256_shuffle_ps(xy_low, zw_low, 0x44);
+    rows[1] = _mm256_shuffle_ps(xy_low, zw_low, 0xee);
+    rows[2] = _mm256_shuffle_ps(xy_high, zw_high, 0x44);
+    rows[3] = _mm256_shuffle_ps(xy_high, zw_high, 0xee);
+  }
+
+  static f gather(const sprite_instance* s, float sprite_instance::*member)
+  {
+    return _mm256_setr_ps(s[0].*member,
+                          s[1].*member,
+                          s[2].*member,
+                          s[3].*member,
+                          s[4].*member,
+                          s[5].*member,
+                          s[6].*member,
+                          s[7].*member);
+  }
+
+  static void colors(const sprite_instance* s, f& r, f& g, f& b, f& a)
+  {
+    const __m256i rgba = _mm256_setr_epi32(packed_color(s[0]),
+                                           packed_color(s[1]),
+                                           packed_color(s[2]),
+                                           packed_color(s[3]),
+                                           packed_color(s[4]),
+                                           packed_color(s[5]),
+                                           packed_color(s[6]),
+                                           packed_color(s[7]));
+    const __m256i low_byte = _mm256_set1_epi32(0xff);
+    r = _mm256_cvtepi32_ps(_mm256_and_si256(rgba, low_byte));
+    g = _mm256_cvtepi32_ps(
+      _mm256_and_si256(_mm256_srli_epi32(rgba, 8), low_byte));
+    b = _mm256_cvtepi32_ps(
+      _mm256_and_si256(_mm256_srli_epi32(rgba, 16), low_byte));
+    a = _mm256_cvtepi32_ps(_mm256_srli_epi32(rgba, 24));
+  }
+
+  static void sincos(f x, f& s, f& c)
+  {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const __m256i quadrant = _mm256_cvtps_epi32(mul(x, set(two_over_pi)));
+    const f q = _mm256_cvtepi32_ps(quadrant);
+    f r = sub(x, mul(q, set(half_pi_1)));
+    r = sub(r, mul(q, set(half_pi_2)));
+    r = sub(r, mul(q, set(half_pi_3)));
+    f sin_r;
+    f cos_r;
+    sincos_reduced<avx2>(r, sin_r, cos_r);
+
+    const f swap = _mm256_castsi256_ps(
+      _mm256_cmpeq_epi32(_mm256_and_si256(quadrant, one), one));
+    const f sin_sign = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_and_si256(quadrant, two), 30));
+    const f cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(
+      _mm256_and_si256(_mm256_add_epi32(quadrant, one), two), 30));
+    s = _mm256_xor_ps(_mm256_blendv_ps(sin_r, cos_r, swap), sin_sign);
+    c = _mm256_xor_ps(_mm256_blendv_ps(cos_r, sin_r, swap), cos_sign);
+  }
+};
+
+}
+
+void
+build_quads_avx2(vertex* out,
+                 const sprite_instance* sprites,
+                 size_t count,
+                 const uv_rect& texture_rect)
+{
+  build_quads_simd<avx2>(out, sprites, count, texture_rect);
+}
+
+}
+#endif
@@ -0,0 +1,285 @@
+#pragma once
+#include "quad_builder.hxx"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Kernels shared by the translation units that are compiled for different
+// instruction sets. Everything here has internal linkage: an inline function
+// with external linkage used from the AVX2 unit could be compiled with AVX2
+// there, and the linker may keep that copy for every caller.
+
+namespace uchiha {
+
+#if defined(UCHIHA_QUAD_AVX2)
+void
+build_quads_avx2(vertex* out,
+                 const sprite_instance* sprites,
+                 size_t count,
+                 const uv_rect& texture_rect);
+#endif
+
+namespace {
+
+// Cody-Waite split of pi / 2 and the minimax polynomials of Cephes' sinf()
+// and cosf() on [-pi / 4, pi / 4]; the SIMD traits apply them per lane.
+constexpr float two_over_pi = 0.636619772367581343f;
+constexpr float half_pi_1 = 1.5703125f;
+constexpr float half_pi_2 = 4.837512969970703125e-4f;
+constexpr float half_pi_3 = 7.54978995489188216e-8f;
+constexpr float sin_c0 = -1.9515295891e-4f;
+constexpr float sin_c1 = 8.3321608736e-3f;
+constexpr float sin_c2 = -1.6666654611e-1f;
+constexpr float cos_c0 = 2.443315711809948e-5f;
+constexpr float cos_c1 = -1.388731625493765e-3f;
+constexpr float cos_c2 = 4.166664568298827e-2f;
+
+// Sine and cosine of r, which the caller has reduced to [-pi / 4, pi / 4].
+template<typename simd>
+void
+sincos_reduced(typename simd::f r, typename simd::f& s, typename simd::f& c)
+{
+  using f = typename simd::f;
+  const f r2 = simd::mul(r, r);
+  f ps = simd::add(simd::mul(simd::set(sin_c0), r2), simd::set(sin_c1));
+  ps = simd::add(simd::mul(ps, r2), simd::set(sin_c2));
+  s = simd::add(simd::mul(simd::mul(ps, r2), r), r);
+  f pc = simd::add(simd::mul(simd::set(cos_c0), r2), simd::set(cos_c1));
+  pc = simd::add(simd::mul(pc, r2), simd::set(cos_c2));
+  c = simd::add(simd::sub(simd::mul(simd::mul(pc, r2), r2),
+                          simd::mul(simd::set(0.5f), r2)),
+                simd::set(1.f));
+}
+
+// One block of quads in SoA form, as the SIMD kernels compute them and
+// emit() writes them out.
+template<size_t width>
+struct quad_lanes
+{
+  // Corners in triangle strip order: bottom left, bottom right, top left,
+  // top right.
+  alignas(32) float corner_x[4][width];
+  alignas(32) float corner_y[4][width];
+  // Texture coordinates and normalized colors.
+  alignas(32) float u0[width];
+  alignas(32) float v0[width];
+  alignas(32) float u1[width];
+  alignas(32) float v1[width];
+  alignas(32) float r[width];
+  alignas(32) float g[width];
+  alignas(32) float b[width];
+  alignas(32) float a[width];
+};
+
+// The r, g, b and a bytes of s as one little endian word, r lowest.
+inline int
+packed_color(const sprite_instance& s)
+{
+  return static_cast<int>(static_cast<uint32_t>(s.r) |
+                          static_cast<uint32_t>(s.g) << 8 |
+                          static_cast<uint32_t>(s.b) << 16 |
+                          static_cast<uint32_t>(s.a) << 24);
+}
+
+inline void
+write_vertex(vertex& v,
+             float x,
+             float y,
+             float r,
+             float g,
+             float b,
+             float a,
+             float tx,
+             float ty)
+{
+  v.x = x;
+  v.y = y;
+  v.z = 0.f;
+  v.r = r;
+  v.g = g;
+  v.b = b;
+  v.a = a;
+  v.tx = tx;
+  v.ty = ty;
+}
+
+// Writes the six vertices of each of the first n lanes; the winding matches
+// the strip instanced.vert draws. Everything is read into locals first: out
+// may alias lanes as far as the compiler knows, and would otherwise force a
+// reload after every store.
+template<size_t width>
+void
+emit(vertex* out, const quad_lanes<width>& lanes, size_t n)
+{
+  for (size_t lane = 0; lane < n; ++lane, out += 6) {
+    const float x0 = lanes.corner_x[0][lane];
+    const float y0 = lanes.corner_y[0][lane];
+    const float x1 = lanes.corner_x[1][lane];
+    const float y1 = lanes.corner_y[1][lane];
+    const float x2 = lanes.corner_x[2][lane];
+    const float y2 = lanes.corner_y[2][lane];
+    const float x3 = lanes.corner_x[3][lane];
+    const float y3 = lanes.corner_y[3][lane];
+    const float r = lanes.r[lane];
+    const float g = lanes.g[lane];
+    const float b = lanes.b[lane];
+    const float a = lanes.a[lane];
+    const float left = lanes.u0[lane];
+    const float right = lanes.u1[lane];
+    const float top = lanes.v0[lane];
+    const float bottom = lanes.v1[lane];
+    write_vertex(out[0], x0, y0, r, g, b, a, left, bottom);
+    write_vertex(out[1], x1, y1, r, g, b, a, right, bottom);
+    write_vertex(out[2], x2, y2, r, g, b, a, left, top);
+    write_vertex(out[3], x2, y2, r, g, b, a, left, top);
+    write_vertex(out[4], x1, y1, r, g, b, a, right, bottom);
+    write_vertex(out[5], x3, y3, r, g, b, a, right, top);
+  }
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// emit() for the four lanes from base on: transposing the SoA lanes into
+// vertex order takes 18 stores per quad instead of 54, which is what bounds
+// the scalar loop.
+template<size_t width>
+void
+emit_sse(vertex* out, const quad_lanes<width>& lanes, size_t base, size_t n)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 r = _mm_load_ps(lanes.r + base);
+  const __m128 g = _mm_load_ps(lanes.g + base);
+  const __m128 b = _mm_load_ps(lanes.b + base);
+  const __m128 a = _mm_load_ps(lanes.a + base);
+
+  // heads[corner][lane] is x, y, z, r and tails[side][lane] g, b, a, tx.
+  __m128 heads[4][4];
+  for (int corner = 0; corner < 4; ++corner) {
+    __m128 x = _mm_load_ps(lanes.corner_x[corner] + base);
+    __m128 y = _mm_load_ps(lanes.corner_y[corner] + base);
+    __m128 z = zero;
+    __m128 w = r;
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    heads[corner][0] = x;
+    heads[corner][1] = y;
+    heads[corner][2] = z;
+    heads[corner][3] = w;
+  }
+  __m128 tails[2][4];
+  for (int side = 0; side < 2; ++side) {
+    __m128 x = g;
+    __m128 y = b;
+    __m128 z = a;
+    __m128 w = _mm_load_ps((side == 0 ? lanes.u0 : lanes.u1) + base);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    tails[side][0] = x;
+    tails[side][1] = y;
+    tails[side][2] = z;
+    tails[side][3] = w;
+  }
+
+  static constexpr int order[6] = { 0, 1, 2, 2, 1, 3 };
+  for (size_t lane = 0; lane < n; ++lane) {
+    const float top = lanes.v0[base + lane];
+    const float bottom = lanes.v1[base + lane];
+    for (int k = 0; k < 6; ++k, ++out) {
+      const int corner = order[k];
+      _mm_storeu_ps(&out->x, heads[corner][lane]);
+      _mm_storeu_ps(&out->g, tails[corner & 1][lane]);
+      out->ty = (corner & 2) ? top : bottom;
+    }
+  }
+}
+#endif
+
+// simd provides width and a float vector type f with load(), store(),
+// set(), add(), sub(), mul(), sincos(), gather() of one float member of
+// width sprites, colors() to unpack their colors and emit() for a block.
+template<typename simd>
+void
+build_quads_simd(vertex* out,
+                 const sprite_instance* sprites,
+                 size_t count,
+                 const uv_rect& texture_rect)
+{
+  using f = typename simd::f;
+  constexpr size_t width = simd::width;
+  quad_lanes<width> lanes;
+  // The last partial block is padded by repeating its last sprite; the
+  // padding lanes are computed but never written out. The storage is raw
+  // so no sprite_instance constructor is instantiated here.
+  alignas(sprite_instance) unsigned char
+    padded[sizeof(sprite_instance) * width];
+
+  const f half = simd::set(0.5f);
+  const f u_origin = simd::set(texture_rect.u0);
+  const f v_origin = simd::set(texture_rect.v0);
+  const f u_extent = simd::set(texture_rect.u1 - texture_rect.u0);
+  const f v_extent = simd::set(texture_rect.v1 - texture_rect.v0);
+
+  for (size_t first = 0; first < count; first += width) {
+    const size_t n = count - first < width ? count - first : width;
+    const sprite_instance* block = sprites + first;
+    if (n < width) {
+      for (size_t lane = 0; lane < width; ++lane) {
+        std::memcpy(padded + lane * sizeof(sprite_instance),
+                    block + (lane < n ? lane : n - 1),
+                    sizeof(sprite_instance));
+      }
+      block = reinterpret_cast<const sprite_instance*>(padded);
+    }
+
+    f sin_r;
+    f cos_r;
+    simd::sincos(simd::gather(block, &sprite_instance::rotation), sin_r, cos_r);
+    const f half_w =
+      simd::mul(simd::gather(block, &sprite_instance::scale_x), half);
+    const f half_h =
+      simd::mul(simd::gather(block, &sprite_instance::scale_y), half);
+    // Rotated half extents along the quad's own x and y axes.
+    const f ax = simd::mul(cos_r, half_w);
+    const f ay = simd::mul(sin_r, half_w);
+    const f bx = simd::mul(sin_r, half_h);
+    const f by = simd::mul(cos_r, half_h);
+    const f x = simd::gather(block, &sprite_instance::x);
+    const f y = simd::gather(block, &sprite_instance::y);
+    const f left_x = simd::sub(x, ax);
+    const f left_y = simd::sub(y, ay);
+    const f right_x = simd::add(x, ax);
+    const f right_y = simd::add(y, ay);
+    simd::store(lanes.corner_x[0], simd::add(left_x, bx));
+    simd::store(lanes.corner_y[0], simd::sub(left_y, by));
+    simd::store(lanes.corner_x[1], simd::add(right_x, bx));
+    simd::store(lanes.corner_y[1], simd::sub(right_y, by));
+    simd::store(lanes.corner_x[2], simd::sub(left_x, bx));
+    simd::store(lanes.corner_y[2], simd::add(left_y, by));
+    simd::store(lanes.corner_x[3], simd::sub(right_x, bx));
+    simd::store(lanes.corner_y[3], simd::add(right_y, by));
+
+    const f u0 = simd::gather(block, &sprite_instance::u0);
+    const f u1 = simd::gather(block, &sprite_instance::u1);
+    const f v0 = simd::gather(block, &sprite_instance::v0);
+    const f v1 = simd::gather(block, &sprite_instance::v1);
+    simd::store(lanes.u0, simd::add(u_origin, simd::mul(u0, u_extent)));
+    simd::store(lanes.u1, simd::add(u_origin, simd::mul(u1, u_extent)));
+    simd::store(lanes.v0, simd::add(v_origin, simd::mul(v0, v_extent)));
+    simd::store(lanes.v1, simd::add(v_origin, simd::mul(v1, v_extent)));
+    f r;
+    f g;
+    f b;
+    f a;
+    simd::colors(block, r, g, b, a);
+    const f to_unit = simd::set(1.f / 255.f);
+    simd::store(lanes.r, simd::mul(r, to_unit));
+    simd::store(lanes.g, simd::mul(g, to_unit));
+    simd::store(lanes.b, simd::mul(b, to_unit));
+    simd::store(lanes.a, simd::mul(a, to_unit));
+
+    simd::emit(out + first * 6, lanes, n);
+  }
+}
+
+}
+
+}
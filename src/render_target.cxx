@@ -0,0 +1,69 @@
+#include "render_target.hxx"
+#include <iostream>
+
+namespace uchiha {
+
+bool
+render_target_impl::create(uint16_t width, uint16_t height)
+{
+  if (width == 0 || height == 0) {
+    std::cerr << "error: Render target must not be empty "
+                 "( render_target.cxx: )"
+              << std::endl;
+    return false;
+  }
+  target_width = width;
+  target_height = height;
+
+  glGenTextures(1, &gl_handle);
+  glBindTexture(GL_TEXTURE_2D, gl_handle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               GL_RGBA8,
+               width,
+               height,
+               0,
+               GL_RGBA,
+               GL_UNSIGNED_BYTE,
+               nullptr);
+
+  glGenFramebuffers(1, &framebuffer_handle);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_handle);
+  glFramebufferTexture2D(
+    GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gl_handle, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "error: Render target framebuffer is incomplete "
+                 "( render_target.cxx: )"
+              << std::endl;
+    destroy();
+    return false;
+  }
+
+  GLfloat clear_color[4] = {};
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, clear_color);
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glClearColor(clear_color[0], clear_color[1], clear_color[2], clear_color[3]);
+  return true;
+}
+
+void
+render_target_impl::destroy()
+{
+  if (framebuffer_handle != 0) {
+    glDeleteFramebuffers(1, &framebuffer_handle);
+    framebuffer_handle = 0;
+  }
+  if (gl_handle != 0) {
+    glDeleteTextures(1, &gl_handle);
+    gl_handle = 0;
+  }
+  target_width = 0;
+  target_height = 0;
+}
+
+}
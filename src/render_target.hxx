@@ -0,0 +1,29 @@
+#pragma once
+#include "engine.hxx"
+#include "glad/glad.h"
+
+namespace uchiha {
+
+// Framebuffer object with a single RGBA8 color texture. create() leaves the
+// framebuffer and the texture bound; the caller restores its own bindings.
+class render_target_impl : public render_target
+{
+  uint16_t target_width = 0;
+  uint16_t target_height = 0;
+  GLuint framebuffer_handle = 0;
+
+public:
+  bool create(uint16_t width, uint16_t height);
+  void destroy();
+
+  uint16_t get_width() const override { return target_width; }
+  uint16_t get_height() const override { return target_height; }
+  uv_rect get_uv_rect() const override
+  {
+    return uv_rect{ 0.f, 1.f, 1.f, 0.f };
+  }
+
+  GLuint framebuffer() const { return framebuffer_handle; }
+};
+
+}
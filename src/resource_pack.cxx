@@ -0,0 +1,214 @@
+#include "resource_pack.hxx"
+#include "lz4.hxx"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace uchiha {
+
+namespace {
+
+// Maps the whole file read-only. The handles are closed right away; the
+// mapping keeps the file alive on its own.
+const uint8_t*
+map_file(const std::string& path, size_t& size)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(),
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_FLAG_RANDOM_ACCESS,
+                            nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return nullptr;
+  }
+  LARGE_INTEGER file_size;
+  const uint8_t* view = nullptr;
+  if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+    HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping != nullptr) {
+      view = static_cast<const uint8_t*>(
+        MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+      CloseHandle(mapping);
+    }
+    size = static_cast<size_t>(file_size.QuadPart);
+  }
+  CloseHandle(file);
+  return view;
+#else
+  const int file = ::open(path.c_str(), O_RDONLY);
+  if (file < 0) {
+    return nullptr;
+  }
+  struct stat info;
+  void* view = MAP_FAILED;
+  if (fstat(file, &info) == 0 && info.st_size > 0) {
+    size = static_cast<size_t>(info.st_size);
+    view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+  }
+  ::close(file);
+  return view != MAP_FAILED ? static_cast<const uint8_t*>(view) : nullptr;
+#endif
+}
+
+void
+unmap_file(const uint8_t* view, size_t size)
+{
+#ifdef _WIN32
+  (void)size;
+  UnmapViewOfFile(view);
+#else
+  munmap(const_cast<uint8_t*>(view), size);
+#endif
+}
+
+}
+
+std::string
+normalize_pack_name(std::string_view name)
+{
+  std::string out;
+  out.reserve(name.size());
+  while (!name.empty()) {
+    const size_t end = name.find_first_of("/\\");
+    const std::string_view part = name.substr(0, end);
+    if (!part.empty() && part != ".") {
+      if (!out.empty()) {
+        out += '/';
+      }
+      out.append(part.data(), part.size());
+    }
+    name.remove_prefix(end == std::string_view::npos ? name.size() : end + 1);
+  }
+  return out;
+}
+
+uint64_t
+pack_name_hash(std::string_view normalized_name)
+{
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (char c : normalized_name) {
+    h ^= static_cast<uint8_t>(c);
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+resource_pack::~resource_pack()
+{
+  close();
+}
+
+bool
+resource_pack::open(std::string_view path)
+{
+  close();
+  size_t size = 0;
+  const uint8_t* view = map_file(std::string(path), size);
+  if (view == nullptr) {
+    return false;
+  }
+
+  // The pack is checked once here so lookups can trust every offset.
+  pack_header header;
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    std::memcpy(&header, view, sizeof(header));
+    valid = header.magic == pack_magic && header.version == pack_version &&
+            header.toc_offset % alignof(pack_entry) == 0 &&
+            header.toc_offset <= size &&
+            header.entry_count <=
+              (size - header.toc_offset) / sizeof(pack_entry) &&
+            header.names_offset <= size &&
+            header.names_size <= size - header.names_offset;
+  }
+  const auto* toc =
+    valid ? reinterpret_cast<const pack_entry*>(view + header.toc_offset)
+          : nullptr;
+  for (uint32_t i = 0; valid && i < header.entry_count; ++i) {
+    const pack_entry& e = toc[i];
+    valid = e.name_offset <= header.names_size &&
+            e.name_size <= header.names_size - e.name_offset &&
+            e.offset <= size && e.stored_size <= size - e.offset &&
+            (e.stored_size == e.size || e.stored_size != 0) &&
+            (i == 0 || toc[i - 1].name_hash <= e.name_hash);
+  }
+  if (!valid) {
+    std::cerr << "error: Not a resource pack ( resource_pack.cxx: ) " << path
+              << std::endl;
+    unmap_file(view, size);
+    return false;
+  }
+
+  mapping = view;
+  mapping_size = size;
+  entries = toc;
+  count = header.entry_count;
+  names = reinterpret_cast<const char*>(view + header.names_offset);
+  return true;
+}
+
+void
+resource_pack::close()
+{
+  if (mapping != nullptr) {
+    unmap_file(mapping, mapping_size);
+  }
+  mapping = nullptr;
+  mapping_size = 0;
+  entries = nullptr;
+  count = 0;
+  names = nullptr;
+}
+
+bool
+resource_pack::find(std::string_view name, resource_data& out) const
+{
+  const std::string normalized = normalize_pack_name(name);
+  const uint64_t hash = pack_name_hash(normalized);
+  const pack_entry* end = entries + count;
+  const pack_entry* e = std::lower_bound(
+    entries, end, hash, [](const pack_entry& entry, uint64_t h) {
+      return entry.name_hash < h;
+    });
+  for (; e != end && e->name_hash == hash; ++e) {
+    if (std::string_view(names + e->name_offset, e->name_size) == normalized) {
+      out.data = mapping + e->offset;
+      out.stored_size = e->stored_size;
+      out.size = e->size;
+      return true;
+    }
+  }
+  return false;
+}
+
+const uint8_t*
+unpack(const resource_data& entry, std::vector<uint8_t>& scratch)
+{
+  if (!entry.compressed()) {
+    return entry.data;
+  }
+  scratch.resize(entry.size);
+  if (!lz4_decompress(
+        entry.data, entry.stored_size, scratch.data(), scratch.size())) {
+    std::cerr << "error: Corrupt resource pack entry ( resource_pack.cxx: )"
+              << std::endl;
+    return nullptr;
+  }
+  return scratch.data();
+}
+
+}
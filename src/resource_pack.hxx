@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace uchiha {
+
+// Layout of a pack written by tools/resource_packer: a header, the table of
+// contents sorted by name hash, the names, and then the entries, each
+// starting on a pack_alignment boundary. Everything is little endian.
+constexpr uint32_t pack_magic = 0x4b415055; // "UPAK"
+constexpr uint32_t pack_version = 1;
+constexpr size_t pack_alignment = 64;
+
+struct pack_header
+{
+  uint32_t magic = pack_magic;
+  uint32_t version = pack_version;
+  uint32_t entry_count = 0;
+  uint32_t names_size = 0;
+  uint64_t toc_offset = 0;
+  uint64_t names_offset = 0;
+};
+
+struct pack_entry
+{
+  uint64_t name_hash = 0;
+  uint32_t name_offset = 0;
+  uint32_t name_size = 0;
+  uint64_t offset = 0;
+  // An entry whose stored size differs from its size is one LZ4 block.
+  uint32_t stored_size = 0;
+  uint32_t size = 0;
+};
+
+static_assert(sizeof(pack_header) == 32 && sizeof(pack_entry) == 32,
+              "pack structures are written as they are laid out");
+
+// Names are paths with '/' separators and without "." components, so
+// "res/./a.png" and "res\\a.png" both find "res/a.png".
+std::string
+normalize_pack_name(std::string_view name);
+
+uint64_t
+pack_name_hash(std::string_view normalized_name);
+
+// An entry as it is stored in a mapped pack.
+struct resource_data
+{
+  const uint8_t* data = nullptr;
+  size_t stored_size = 0;
+  size_t size = 0;
+
+  bool compressed() const { return stored_size != size; }
+};
+
+// Read-only memory mapping of a pack. Looking an entry up is a binary search
+// of the mapped table of contents and reading it does not copy, unless it
+// was compressed. Entries stay valid until the pack is closed.
+class resource_pack
+{
+public:
+  resource_pack() = default;
+  resource_pack(const resource_pack&) = delete;
+  resource_pack& operator=(const resource_pack&) = delete;
+  ~resource_pack();
+
+  // Maps path and checks that every entry lies inside of it.
+  bool open(std::string_view path);
+  void close();
+
+  bool find(std::string_view name, resource_data& out) const;
+
+  size_t entry_count() const { return count; }
+
+private:
+  const uint8_t* mapping = nullptr;
+  size_t mapping_size = 0;
+  const pack_entry* entries = nullptr;
+  size_t count = 0;
+  const char* names = nullptr;
+};
+
+// Bytes of entry: the mapped ones themselves when it is stored as is,
+// otherwise scratch holding them decompressed. Returns nullptr when the
+// compressed block is corrupt.
+const uint8_t*
+unpack(const resource_data& entry, std::vector<uint8_t>& scratch);
+
+}
@@ -0,0 +1,144 @@
+#include "shader.hxx"
+
+namespace uchiha {
+
+shader::shader(gl_state& gl, GLuint linked_program)
+  : state(gl)
+  , program(linked_program)
+{
+  resolve_uniforms();
+}
+
+shader::~shader()
+{
+  if (program != 0) {
+    glDeleteProgram(program);
+  }
+}
+
+void
+shader::replace(GLuint linked_program)
+{
+  // The state cache may still hold the old name, which GL is free to hand
+  // out again.
+  glDeleteProgram(program);
+  state.invalidate();
+  program = linked_program;
+  uniforms.clear();
+  resolve_uniforms();
+}
+
+// Looks every active uniform up once and gives each sampler its own texture
+// unit, so draws never query locations or touch sampler values. The camera
+// block is attached to the shared binding point here as well.
+void
+shader::resolve_uniforms()
+{
+  GLint count = 0;
+  GLint max_name_len = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
+  std::vector<char> name(static_cast<size_t>(max_name_len) + 1);
+
+  state.use_program(program);
+  GLint next_unit = 0;
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei name_len = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program,
+                       static_cast<GLuint>(i),
+                       static_cast<GLsizei>(name.size()),
+                       &name_len,
+                       &size,
+                       &type,
+                       name.data());
+    uniform u;
+    u.name.assign(name.data(), static_cast<size_t>(name_len));
+    u.location = glGetUniformLocation(program, u.name.c_str());
+    // Arrays are reported as "name[0]"; they are looked up by base name.
+    size_t bracket = u.name.find('[');
+    if (bracket != std::string::npos) {
+      u.name.resize(bracket);
+    }
+    if (type == GL_SAMPLER_2D) {
+      u.unit = next_unit;
+      u.size = size;
+      std::vector<GLint> units(static_cast<size_t>(size));
+      for (GLint& unit : units) {
+        unit = next_unit++;
+      }
+      glUniform1iv(u.location, size, units.data());
+    }
+    uniforms.push_back(std::move(u));
+  }
+
+  GLuint camera_block = glGetUniformBlockIndex(program, "camera");
+  if (camera_block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, camera_block, camera_binding);
+  }
+}
+
+shader::uniform*
+shader::find(std::string_view name)
+{
+  for (uniform& u : uniforms) {
+    if (u.name == name) {
+      return &u;
+    }
+  }
+  return nullptr;
+}
+
+void
+shader::set_uniform(std::string_view attr, const texture& t)
+{
+  uniform* u = find(attr);
+  if (u != nullptr && u->unit >= 0) {
+    state.bind_texture(static_cast<GLuint>(u->unit), t.get_handle());
+  }
+}
+
+void
+shader::set_uniform(std::string_view attr, size_t element, const texture& t)
+{
+  uniform* u = find(attr);
+  if (u != nullptr && u->unit >= 0 &&
+      element < static_cast<size_t>(u->size)) {
+    state.bind_texture(static_cast<GLuint>(u->unit) +
+                         static_cast<GLuint>(element),
+                       t.get_handle());
+  }
+}
+
+void
+shader::set_uniform(std::string_view attr, const uv_rect& r)
+{
+  uniform* u = find(attr);
+  if (u == nullptr) {
+    return;
+  }
+  if (u->has_value && u->value.u0 == r.u0 && u->value.v0 == r.v0 &&
+      u->value.u1 == r.u1 && u->value.v1 == r.v1) {
+    return;
+  }
+  use();
+  glUniform4f(u->location, r.u0, r.v0, r.u1, r.v1);
+  u->value = r;
+  u->has_value = true;
+}
+
+void
+shader::set_uniform(std::string_view attr, const mat4& m)
+{
+  uniform* u = find(attr);
+  if (u == nullptr || (u->has_value && u->matrix == m)) {
+    return;
+  }
+  use();
+  glUniformMatrix4fv(u->location, 1, GL_FALSE, m.m);
+  u->matrix = m;
+  u->has_value = true;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "engine.hxx"
+#include "gl_state.hxx"
+#include "glad/glad.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace uchiha {
+
+// A linked program plus the uniform locations resolved from it. The program
+// is built elsewhere (see shader_cache) and can be swapped for a rebuilt one
+// without invalidating pointers to the shader.
+class shader
+{
+public:
+  // Uniform block binding the "camera" block of every program is set to.
+  static constexpr GLuint camera_binding = 0;
+
+  // Takes ownership of program, which must be linked.
+  shader(gl_state& gl, GLuint program);
+  ~shader();
+  shader(const shader&) = delete;
+  shader& operator=(const shader&) = delete;
+
+  // Replaces the program, deleting the old one, and resolves the uniforms
+  // again. Uniform values set through set_uniform() are forgotten.
+  void replace(GLuint program);
+  GLuint handle() const { return program; }
+
+  void use() { state.use_program(program); }
+  void set_uniform(std::string_view attr, const texture& t);
+  // Binds t to element of a sampler array.
+  void set_uniform(std::string_view attr, size_t element, const texture& t);
+  void set_uniform(std::string_view attr, const uv_rect& r);
+  void set_uniform(std::string_view attr, const mat4& m);
+
+private:
+  struct uniform
+  {
+    std::string name;
+    GLint location = -1;
+    // Texture unit assigned to a sampler at link time, -1 otherwise. The
+    // elements of a sampler array get the units that follow it.
+    GLint unit = -1;
+    GLint size = 1;
+    bool has_value = false;
+    uv_rect value;
+    mat4 matrix;
+  };
+
+  void resolve_uniforms();
+  uniform* find(std::string_view name);
+
+  gl_state& state;
+  GLuint program = 0;
+  std::vector<uniform> uniforms;
+};
+
+}
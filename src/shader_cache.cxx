@@ -0,0 +1,370 @@
+#include "shader_cache.hxx"
+#include "gl_ext.hxx"
+#include "profiler.hxx"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <system_error>
+
+namespace uchiha {
+
+namespace {
+
+constexpr uint32_t binary_magic = 0x42504355; // "UCPB"
+constexpr uint32_t binary_version = 1;
+
+struct binary_header
+{
+  uint32_t magic = binary_magic;
+  uint32_t version = binary_version;
+  uint64_t key = 0;
+  uint32_t format = 0;
+  uint32_t length = 0;
+};
+
+constexpr auto hot_reload_interval = std::chrono::milliseconds(250);
+
+// FNV-1a, 64 bit.
+uint64_t
+hash_bytes(uint64_t h, const void* data, size_t size)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+uint64_t
+hash_string(uint64_t h, std::string_view s)
+{
+  // The terminator keeps "ab" + "c" apart from "a" + "bc".
+  h = hash_bytes(h, s.data(), s.size());
+  return hash_bytes(h, "", 1);
+}
+
+bool
+read_file(const std::string& path, std::string& out)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  out.assign(std::istreambuf_iterator<char>(file),
+             std::istreambuf_iterator<char>());
+  return !file.bad();
+}
+
+std::filesystem::file_time_type
+modification_time(const std::string& path)
+{
+  std::error_code ec;
+  std::filesystem::file_time_type t = std::filesystem::last_write_time(path, ec);
+  return ec ? std::filesystem::file_time_type() : t;
+}
+
+std::string
+gl_string(GLenum name)
+{
+  const GLubyte* s = glGetString(name);
+  return s ? reinterpret_cast<const char*>(s) : "";
+}
+
+}
+
+void
+shader_cache::init(gl_state& gl, std::string_view binary_directory)
+{
+  state = &gl;
+  binary_dir = binary_directory;
+  driver_hash = 0xcbf29ce484222325ull;
+  driver_hash = hash_string(driver_hash, gl_string(GL_VENDOR));
+  driver_hash = hash_string(driver_hash, gl_string(GL_RENDERER));
+  driver_hash = hash_string(driver_hash, gl_string(GL_VERSION));
+
+  if (!binary_dir.empty() && gl_ext::has_program_binary) {
+    std::error_code ec;
+    std::filesystem::create_directories(binary_dir, ec);
+    if (ec) {
+      std::cerr << "error: Failed to create shader cache directory "
+                << binary_dir << " ( shader_cache.cxx:  )" << std::endl;
+      binary_dir.clear();
+    }
+  }
+  last_check = std::chrono::steady_clock::now();
+}
+
+void
+shader_cache::destroy()
+{
+  entries.clear();
+}
+
+shader*
+shader_cache::load(std::string_view vertex_path,
+                   std::string_view fragment_path,
+                   const attribute_list& attributes)
+{
+  UCHIHA_PROFILE_SCOPE("load shader");
+  auto e = std::make_unique<entry>();
+  e->vertex_path = vertex_path;
+  e->fragment_path = fragment_path;
+  e->attributes = attributes;
+  e->vertex_time = modification_time(e->vertex_path);
+  e->fragment_time = modification_time(e->fragment_path);
+
+  GLuint program = build(*e);
+  if (program == 0) {
+    return nullptr;
+  }
+  e->program = std::make_unique<shader>(*state, program);
+  entries.push_back(std::move(e));
+  return entries.back()->program.get();
+}
+
+void
+shader_cache::update()
+{
+  if (!hot_reload) {
+    return;
+  }
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (now - last_check < hot_reload_interval) {
+    return;
+  }
+  last_check = now;
+  reload_changed();
+}
+
+size_t
+shader_cache::reload_changed()
+{
+  size_t replaced = 0;
+  for (const std::unique_ptr<entry>& e : entries) {
+    file_time vertex_time = modification_time(e->vertex_path);
+    file_time fragment_time = modification_time(e->fragment_path);
+    if (vertex_time == e->vertex_time && fragment_time == e->fragment_time) {
+      continue;
+    }
+    // Remember the times even when the build fails, so a broken file is
+    // reported once rather than on every check.
+    e->vertex_time = vertex_time;
+    e->fragment_time = fragment_time;
+    GLuint program = build(*e);
+    if (program == 0) {
+      continue;
+    }
+    e->program->replace(program);
+    ++replaced;
+    std::cerr << "info: Reloaded " << e->vertex_path << " + "
+              << e->fragment_path << std::endl;
+  }
+  return replaced;
+}
+
+GLuint
+shader_cache::build(const entry& e)
+{
+  std::string vertex_source;
+  std::string fragment_source;
+  if (!read_file(e.vertex_path, vertex_source)) {
+    std::cerr << "error: Failed to read " << e.vertex_path
+              << " ( shader_cache.cxx:  )" << std::endl;
+    return 0;
+  }
+  if (!read_file(e.fragment_path, fragment_source)) {
+    std::cerr << "error: Failed to read " << e.fragment_path
+              << " ( shader_cache.cxx:  )" << std::endl;
+    return 0;
+  }
+
+  uint64_t key = hash_string(driver_hash, vertex_source);
+  key = hash_string(key, fragment_source);
+  for (const auto& attr : e.attributes) {
+    key = hash_bytes(key, &attr.first, sizeof(attr.first));
+    key = hash_string(key, attr.second);
+  }
+
+  const bool use_binary = gl_ext::has_program_binary && !binary_dir.empty();
+  if (use_binary) {
+    GLuint program = load_binary(key);
+    if (program != 0) {
+      return program;
+    }
+  }
+
+  GLuint vertex_shader =
+    compile(GL_VERTEX_SHADER, vertex_source, e.vertex_path);
+  GLuint fragment_shader =
+    compile(GL_FRAGMENT_SHADER, fragment_source, e.fragment_path);
+  GLuint program = 0;
+  if (vertex_shader != 0 && fragment_shader != 0) {
+    program = link(vertex_shader, fragment_shader, e.attributes);
+    if (program == 0) {
+      std::cerr << "  while linking " << e.vertex_path << " + "
+                << e.fragment_path << std::endl;
+    }
+  }
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  if (program != 0 && use_binary) {
+    store_binary(key, program);
+  }
+  return program;
+}
+
+GLuint
+shader_cache::compile(GLenum type,
+                      const std::string& source,
+                      const std::string& path)
+{
+  GLuint shader = glCreateShader(type);
+  const char* src = source.c_str();
+  glShaderSource(shader, 1, &src, nullptr);
+  glCompileShader(shader);
+
+  GLint compile_status = 0;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &compile_status);
+  if (compile_status == 0) {
+    GLint info_len = 0;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &info_len);
+    std::vector<char> info(static_cast<size_t>(info_len) + 1);
+    glGetShaderInfoLog(shader, info_len, nullptr, info.data());
+    std::cerr << "error: Failed to compile " << path
+              << " ( shader_cache.cxx:  )\n"
+              << info.data() << std::endl;
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+GLuint
+shader_cache::link(GLuint vertex_shader,
+                   GLuint fragment_shader,
+                   const attribute_list& attributes)
+{
+  GLuint program = glCreateProgram();
+  if (program == 0) {
+    std::cerr << "error: Failed to create program ( shader_cache.cxx:  )"
+              << std::endl;
+    return 0;
+  }
+  glAttachShader(program, vertex_shader);
+  glAttachShader(program, fragment_shader);
+  for (const auto& attr : attributes) {
+    glBindAttribLocation(program, attr.first, attr.second.c_str());
+  }
+  if (gl_ext::has_program_binary) {
+    gl_ext::program_parameteri(
+      program, gl_ext::program_binary_retrievable_hint, GL_TRUE);
+  }
+  glLinkProgram(program);
+  glDetachShader(program, vertex_shader);
+  glDetachShader(program, fragment_shader);
+
+  GLint linked_status = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked_status);
+  if (linked_status == 0) {
+    GLint info_len = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_len);
+    std::vector<char> info(static_cast<size_t>(info_len) + 1);
+    glGetProgramInfoLog(program, info_len, nullptr, info.data());
+    std::cerr << "error: Failed to link program ( shader_cache.cxx:  )\n"
+              << info.data() << std::endl;
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+std::string
+shader_cache::binary_path(uint64_t key) const
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string name(16, '0');
+  for (size_t i = 0; i < 16; ++i) {
+    name[15 - i] = digits[(key >> (i * 4)) & 0xf];
+  }
+  return binary_dir + "/" + name + ".bin";
+}
+
+GLuint
+shader_cache::load_binary(uint64_t key)
+{
+  const std::string path = binary_path(key);
+  std::string bytes;
+  if (!read_file(path, bytes)) {
+    return 0;
+  }
+  binary_header header;
+  if (bytes.size() < sizeof(header)) {
+    return 0;
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (header.magic != binary_magic || header.version != binary_version ||
+      header.key != key || bytes.size() - sizeof(header) != header.length) {
+    return 0;
+  }
+
+  GLuint program = glCreateProgram();
+  gl_ext::program_binary(program,
+                         header.format,
+                         bytes.data() + sizeof(header),
+                         static_cast<GLsizei>(header.length));
+  GLint linked_status = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &linked_status);
+  if (linked_status == 0) {
+    // Usually a driver update that the version string did not reflect.
+    glDeleteProgram(program);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    return 0;
+  }
+  return program;
+}
+
+void
+shader_cache::store_binary(uint64_t key, GLuint program)
+{
+  GLint length = 0;
+  glGetProgramiv(program, gl_ext::program_binary_length, &length);
+  if (length <= 0) {
+    return;
+  }
+  binary_header header;
+  header.key = key;
+  std::vector<char> bytes(sizeof(header) + static_cast<size_t>(length));
+  GLsizei written = 0;
+  GLenum format = 0;
+  gl_ext::get_program_binary(
+    program, length, &written, &format, bytes.data() + sizeof(header));
+  if (written <= 0) {
+    return;
+  }
+  header.format = format;
+  header.length = static_cast<uint32_t>(written);
+  std::memcpy(bytes.data(), &header, sizeof(header));
+
+  // Written under a temporary name and renamed, so a crash never leaves a
+  // truncated binary behind for the next start.
+  const std::string path = binary_path(key);
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(),
+               static_cast<std::streamsize>(sizeof(header) + header.length));
+    if (!file) {
+      std::cerr << "error: Failed to write " << temporary
+                << " ( shader_cache.cxx:  )" << std::endl;
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temporary, path, ec);
+}
+
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "gl_state.hxx"
+#include "glad/glad.h"
+#include "shader.hxx"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace uchiha {
+
+// Builds shader programs from GLSL files and owns them.
+//
+// Every program is keyed by a hash of its sources, attribute bindings and
+// the driver's vendor/renderer/version strings. With GL 4.1 or
+// ARB_get_program_binary the linked binary is written to binary_directory
+// under that key, and the next run that asks for the same program restores
+// it with glProgramBinary() instead of compiling. A binary the driver
+// rejects is deleted and rebuilt from source.
+//
+// With hot reload on, update() checks the source files' modification times
+// a few times per second and relinks programs whose files changed. A
+// program that fails to build keeps running the last good version.
+class shader_cache
+{
+public:
+  using attribute_list = std::vector<std::pair<GLuint, std::string>>;
+
+  // An empty binary_directory disables the binary cache.
+  void init(gl_state& gl, std::string_view binary_directory);
+  void destroy();
+
+  // Null when the files cannot be read or the program does not build; the
+  // info log is printed to std::cerr.
+  shader* load(std::string_view vertex_path,
+               std::string_view fragment_path,
+               const attribute_list& attributes);
+
+  void set_hot_reload(bool enabled) { hot_reload = enabled; }
+  // Call once per frame.
+  void update();
+  // Rebuilds every program whose sources changed on disk. Returns the
+  // number of programs replaced.
+  size_t reload_changed();
+
+private:
+  using file_time = std::filesystem::file_time_type;
+
+  struct entry
+  {
+    std::string vertex_path;
+    std::string fragment_path;
+    attribute_list attributes;
+    file_time vertex_time;
+    file_time fragment_time;
+    std::unique_ptr<shader> program;
+  };
+
+  // 0 on failure.
+  GLuint build(const entry& e);
+  GLuint compile(GLenum type,
+                 const std::string& source,
+                 const std::string& path);
+  GLuint link(GLuint vertex_shader,
+              GLuint fragment_shader,
+              const attribute_list& attributes);
+  GLuint load_binary(uint64_t key);
+  void store_binary(uint64_t key, GLuint program);
+  std::string binary_path(uint64_t key) const;
+
+  gl_state* state = nullptr;
+  std::string binary_dir;
+  uint64_t driver_hash = 0;
+  std::vector<std::unique_ptr<entry>> entries;
+  bool hot_reload = false;
+  std::chrono::steady_clock::time_point last_check;
+};
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace uchiha {
+
+// Pool that keeps its values contiguous and hands out slot handles to them.
+// Erasing a value moves the last one into its place and bumps the
+// generation of its slot, so stale handles fail to resolve while the slot
+// is reused. Lookups are two array loads.
+template<typename T>
+class slot_map
+{
+public:
+  slot_handle insert(T value)
+  {
+    uint32_t index = 0;
+    if (free_slots.empty()) {
+      index = static_cast<uint32_t>(slots.size());
+      slots.push_back(slot());
+    } else {
+      index = free_slots.back();
+      free_slots.pop_back();
+    }
+    slots[index].dense = static_cast<uint32_t>(values.size());
+    values.push_back(std::move(value));
+    owners.push_back(index);
+    return slot_handle{ index, slots[index].generation };
+  }
+
+  T* get(slot_handle h)
+  {
+    return contains(h) ? &values[slots[h.index].dense] : nullptr;
+  }
+  const T* get(slot_handle h) const
+  {
+    return contains(h) ? &values[slots[h.index].dense] : nullptr;
+  }
+
+  bool contains(slot_handle h) const
+  {
+    return h.index < slots.size() && slots[h.index].generation == h.generation;
+  }
+
+  bool erase(slot_handle h)
+  {
+    if (!contains(h)) {
+      return false;
+    }
+    const uint32_t dense = slots[h.index].dense;
+    const uint32_t last = static_cast<uint32_t>(values.size() - 1);
+    if (dense != last) {
+      values[dense] = std::move(values[last]);
+      owners[dense] = owners[last];
+      slots[owners[dense]].dense = dense;
+    }
+    values.pop_back();
+    owners.pop_back();
+    ++slots[h.index].generation;
+    free_slots.push_back(h.index);
+    return true;
+  }
+
+  // Erases everything; handles given out so far stay stale.
+  void clear()
+  {
+    for (uint32_t index : owners) {
+      ++slots[index].generation;
+      free_slots.push_back(index);
+    }
+    values.clear();
+    owners.clear();
+  }
+
+  size_t size() const { return values.size(); }
+  bool empty() const { return values.empty(); }
+
+  // The values in no particular order; erase() reorders them.
+  T* begin() { return values.data(); }
+  T* end() { return values.data() + values.size(); }
+  const T* begin() const { return values.data(); }
+  const T* end() const { return values.data() + values.size(); }
+  T& operator[](size_t dense) { return values[dense]; }
+  const T& operator[](size_t dense) const { return values[dense]; }
+  slot_handle handle_at(size_t dense) const
+  {
+    return slot_handle{ owners[dense], slots[owners[dense]].generation };
+  }
+
+private:
+  struct slot
+  {
+    uint32_t dense = 0;
+    // Starts at 1, so a default slot_handle never resolves.
+    uint32_t generation = 1;
+  };
+
+  std::vector<T> values;
+  // Slot of each value.
+  std::vector<uint32_t> owners;
+  std::vector<slot> slots;
+  std::vector<uint32_t> free_slots;
+};
+
+// Owns objects that are handed out as pointers to their interface,
+// keeping the owning pointers in a slot map. Pointers coming back are
+// resolved through a table of the live objects, so one that was already
+// destroyed, or never came from this pool, is rejected without being read.
+template<typename T, typename Interface>
+class object_pool
+{
+public:
+  T* insert(std::unique_ptr<T> object)
+  {
+    T* p = object.get();
+    by_address.emplace(p, objects.insert(std::move(object)));
+    return p;
+  }
+
+  // nullptr unless object is alive in this pool.
+  T* find(const Interface* object) const
+  {
+    auto found = by_address.find(object);
+    return found != by_address.end() ? objects.get(found->second)->get()
+                                     : nullptr;
+  }
+
+  bool erase(const Interface* object)
+  {
+    auto found = by_address.find(object);
+    if (found == by_address.end()) {
+      return false;
+    }
+    objects.erase(found->second);
+    by_address.erase(found);
+    return true;
+  }
+
+  void clear()
+  {
+    objects.clear();
+    by_address.clear();
+  }
+
+  size_t size() const { return objects.size(); }
+  bool empty() const { return objects.empty(); }
+
+  // The objects in no particular order; erase() reorders them.
+  std::unique_ptr<T>* begin() { return objects.begin(); }
+  std::unique_ptr<T>* end() { return objects.end(); }
+  const std::unique_ptr<T>* begin() const { return objects.begin(); }
+  const std::unique_ptr<T>* end() const { return objects.end(); }
+  T& operator[](size_t dense) { return *objects[dense]; }
+  const T& operator[](size_t dense) const { return *objects[dense]; }
+
+private:
+  slot_map<std::unique_ptr<T>> objects;
+  std::unordered_map<const Interface*, slot_handle> by_address;
+};
+
+}
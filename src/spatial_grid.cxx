@@ -0,0 +1,272 @@
+#include "spatial_grid.hxx"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define UCHIHA_GRID_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UCHIHA_GRID_NEON 1
+#endif
+
+namespace uchiha {
+
+namespace {
+
+uint64_t
+cell_key(int32_t x, int32_t y)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) |
+         static_cast<uint32_t>(y);
+}
+
+bool
+overlaps(const aabb& a, const aabb& b)
+{
+  return a.max_x >= b.min_x && a.min_x <= b.max_x && a.max_y >= b.min_y &&
+         a.min_y <= b.max_y;
+}
+
+bool
+contains(const aabb& outer, const aabb& inner)
+{
+  return inner.min_x >= outer.min_x && inner.max_x <= outer.max_x &&
+         inner.min_y >= outer.min_y && inner.max_y <= outer.max_y;
+}
+
+void
+merge(aabb& into, const aabb& b)
+{
+  into.min_x = std::min(into.min_x, b.min_x);
+  into.min_y = std::min(into.min_y, b.min_y);
+  into.max_x = std::max(into.max_x, b.max_x);
+  into.max_y = std::max(into.max_y, b.max_y);
+}
+
+}
+
+spatial_grid::spatial_grid(float size)
+  : cell_size(size > 0.f ? size : 1.f)
+  , inverse_cell_size(1.f / (size > 0.f ? size : 1.f))
+{}
+
+uint32_t
+spatial_grid::cell_for(const aabb& bounds)
+{
+  const float center_x = (bounds.min_x + bounds.max_x) * 0.5f;
+  const float center_y = (bounds.min_y + bounds.max_y) * 0.5f;
+  const int32_t x =
+    static_cast<int32_t>(std::floor(center_x * inverse_cell_size));
+  const int32_t y =
+    static_cast<int32_t>(std::floor(center_y * inverse_cell_size));
+
+  const float left = static_cast<float>(x) * cell_size;
+  const float bottom = static_cast<float>(y) * cell_size;
+  max_overhang = std::max({ max_overhang,
+                            left - bounds.min_x,
+                            bounds.max_x - (left + cell_size),
+                            bottom - bounds.min_y,
+                            bounds.max_y - (bottom + cell_size) });
+
+  auto found = cell_lookup.find(cell_key(x, y));
+  if (found != cell_lookup.end()) {
+    return found->second;
+  }
+  const uint32_t index = static_cast<uint32_t>(cells.size());
+  cells.emplace_back();
+  cell_lookup.emplace(cell_key(x, y), index);
+  return index;
+}
+
+void
+spatial_grid::place(uint32_t handle, const aabb& bounds, uint32_t value)
+{
+  const uint32_t index = cell_for(bounds);
+  cell& c = cells[index];
+  if (c.values.empty()) {
+    c.loose = bounds;
+  } else {
+    merge(c.loose, bounds);
+  }
+  locations[handle] =
+    location{ index, static_cast<uint32_t>(c.values.size()) };
+  c.min_x.push_back(bounds.min_x);
+  c.min_y.push_back(bounds.min_y);
+  c.max_x.push_back(bounds.max_x);
+  c.max_y.push_back(bounds.max_y);
+  c.values.push_back(value);
+  c.handles.push_back(handle);
+}
+
+void
+spatial_grid::unplace(uint32_t handle)
+{
+  const location at = locations[handle];
+  cell& c = cells[at.cell];
+  const size_t last = c.values.size() - 1;
+  if (at.slot != last) {
+    c.min_x[at.slot] = c.min_x[last];
+    c.min_y[at.slot] = c.min_y[last];
+    c.max_x[at.slot] = c.max_x[last];
+    c.max_y[at.slot] = c.max_y[last];
+    c.values[at.slot] = c.values[last];
+    c.handles[at.slot] = c.handles[last];
+    locations[c.handles[at.slot]].slot = at.slot;
+  }
+  c.min_x.pop_back();
+  c.min_y.pop_back();
+  c.max_x.pop_back();
+  c.max_y.pop_back();
+  c.values.pop_back();
+  c.handles.pop_back();
+}
+
+uint32_t
+spatial_grid::insert(const aabb& bounds, uint32_t value)
+{
+  uint32_t handle;
+  if (!free_handles.empty()) {
+    handle = free_handles.back();
+    free_handles.pop_back();
+  } else {
+    handle = static_cast<uint32_t>(locations.size());
+    locations.emplace_back();
+  }
+  place(handle, bounds, value);
+  ++item_count;
+  return handle;
+}
+
+void
+spatial_grid::move(uint32_t handle, const aabb& bounds)
+{
+  if (handle >= locations.size() || locations[handle].cell == free_slot) {
+    return;
+  }
+  const location at = locations[handle];
+  const uint32_t value = cells[at.cell].values[at.slot];
+  unplace(handle);
+  place(handle, bounds, value);
+}
+
+void
+spatial_grid::remove(uint32_t handle)
+{
+  if (handle >= locations.size() || locations[handle].cell == free_slot) {
+    return;
+  }
+  unplace(handle);
+  locations[handle].cell = free_slot;
+  free_handles.push_back(handle);
+  --item_count;
+}
+
+void
+spatial_grid::clear()
+{
+  cell_lookup.clear();
+  cells.clear();
+  locations.clear();
+  free_handles.clear();
+  item_count = 0;
+  max_overhang = 0.f;
+}
+
+void
+spatial_grid::query_cell(const cell& c,
+                         const aabb& view,
+                         std::vector<uint32_t>& out) const
+{
+  if (c.values.empty() || !overlaps(c.loose, view)) {
+    return;
+  }
+  if (contains(view, c.loose)) {
+    out.insert(out.end(), c.values.begin(), c.values.end());
+    return;
+  }
+
+  const size_t n = c.values.size();
+  size_t i = 0;
+#if defined(UCHIHA_GRID_SSE2)
+  const __m128 view_min_x = _mm_set1_ps(view.min_x);
+  const __m128 view_min_y = _mm_set1_ps(view.min_y);
+  const __m128 view_max_x = _mm_set1_ps(view.max_x);
+  const __m128 view_max_y = _mm_set1_ps(view.max_y);
+  for (; i + 4 <= n; i += 4) {
+    __m128 hit = _mm_cmpge_ps(_mm_loadu_ps(&c.max_x[i]), view_min_x);
+    hit =
+      _mm_and_ps(hit, _mm_cmple_ps(_mm_loadu_ps(&c.min_x[i]), view_max_x));
+    hit =
+      _mm_and_ps(hit, _mm_cmpge_ps(_mm_loadu_ps(&c.max_y[i]), view_min_y));
+    hit =
+      _mm_and_ps(hit, _mm_cmple_ps(_mm_loadu_ps(&c.min_y[i]), view_max_y));
+    const int mask = _mm_movemask_ps(hit);
+    for (int lane = 0; lane < 4; ++lane) {
+      if (mask & (1 << lane)) {
+        out.push_back(c.values[i + static_cast<size_t>(lane)]);
+      }
+    }
+  }
+#elif defined(UCHIHA_GRID_NEON)
+  const float32x4_t view_min_x = vdupq_n_f32(view.min_x);
+  const float32x4_t view_min_y = vdupq_n_f32(view.min_y);
+  const float32x4_t view_max_x = vdupq_n_f32(view.max_x);
+  const float32x4_t view_max_y = vdupq_n_f32(view.max_y);
+  for (; i + 4 <= n; i += 4) {
+    uint32x4_t hit = vcgeq_f32(vld1q_f32(&c.max_x[i]), view_min_x);
+    hit = vandq_u32(hit, vcleq_f32(vld1q_f32(&c.min_x[i]), view_max_x));
+    hit = vandq_u32(hit, vcgeq_f32(vld1q_f32(&c.max_y[i]), view_min_y));
+    hit = vandq_u32(hit, vcleq_f32(vld1q_f32(&c.min_y[i]), view_max_y));
+    uint32_t lanes[4];
+    vst1q_u32(lanes, hit);
+    for (size_t lane = 0; lane < 4; ++lane) {
+      if (lanes[lane] != 0) {
+        out.push_back(c.values[i + lane]);
+      }
+    }
+  }
+#endif
+  for (; i < n; ++i) {
+    if (c.max_x[i] >= view.min_x && c.min_x[i] <= view.max_x &&
+        c.max_y[i] >= view.min_y && c.min_y[i] <= view.max_y) {
+      out.push_back(c.values[i]);
+    }
+  }
+}
+
+void
+spatial_grid::query(const aabb& view, std::vector<uint32_t>& out) const
+{
+  if (item_count == 0) {
+    return;
+  }
+  const double scale = inverse_cell_size;
+  const double x0 = std::floor((view.min_x - max_overhang) * scale);
+  const double x1 = std::floor((view.max_x + max_overhang) * scale);
+  const double y0 = std::floor((view.min_y - max_overhang) * scale);
+  const double y1 = std::floor((view.max_y + max_overhang) * scale);
+  const double range = (x1 - x0 + 1.0) * (y1 - y0 + 1.0);
+
+  // Zoomed far out, walking the allocated cells beats probing empty ones.
+  if (range > static_cast<double>(cells.size())) {
+    for (const cell& c : cells) {
+      query_cell(c, view, out);
+    }
+    return;
+  }
+  const int32_t first_x = static_cast<int32_t>(x0);
+  const int32_t last_x = static_cast<int32_t>(x1);
+  const int32_t first_y = static_cast<int32_t>(y0);
+  const int32_t last_y = static_cast<int32_t>(y1);
+  for (int32_t y = first_y; y <= last_y; ++y) {
+    for (int32_t x = first_x; x <= last_x; ++x) {
+      auto found = cell_lookup.find(cell_key(x, y));
+      if (found != cell_lookup.end()) {
+        query_cell(cells[found->second], view, out);
+      }
+    }
+  }
+}
+
+}
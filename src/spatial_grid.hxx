@@ -0,0 +1,78 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace uchiha {
+
+// Loose uniform grid over the bounds of many mostly static items, such as
+// the sprites of a level, for finding the ones a camera can see.
+//
+// Every item lives in the cell that contains its center, and each cell
+// keeps the union of its items' bounds. A query only visits the cells whose
+// loose bounds overlap the view: a cell inside the view contributes all of
+// its items without testing them, and a cell on the edge tests its items
+// four at a time on bounds stored per cell in SoA form. The cost is thus
+// proportional to the visible part of the level, not its size.
+//
+// Cells are allocated on demand, so the world is unbounded. Pick a cell
+// size of a few times the typical item size; items much larger than a cell
+// make every query visit more cells.
+class spatial_grid
+{
+public:
+  explicit spatial_grid(float cell_size = 256.f);
+
+  // Returns a handle for move() and remove(); value is what query() reports.
+  uint32_t insert(const aabb& bounds, uint32_t value);
+  void move(uint32_t handle, const aabb& bounds);
+  void remove(uint32_t handle);
+  void clear();
+  size_t size() const { return item_count; }
+
+  // Appends the values of all items whose bounds overlap view to out, in no
+  // particular order.
+  void query(const aabb& view, std::vector<uint32_t>& out) const;
+
+private:
+  struct cell
+  {
+    // Union of the bounds inserted since the cell was last empty.
+    aabb loose;
+    std::vector<float> min_x;
+    std::vector<float> min_y;
+    std::vector<float> max_x;
+    std::vector<float> max_y;
+    std::vector<uint32_t> values;
+    std::vector<uint32_t> handles;
+  };
+
+  struct location
+  {
+    uint32_t cell = 0;
+    uint32_t slot = 0;
+  };
+
+  static constexpr uint32_t free_slot = ~0u;
+
+  uint32_t cell_for(const aabb& bounds);
+  void place(uint32_t handle, const aabb& bounds, uint32_t value);
+  void unplace(uint32_t handle);
+  void query_cell(const cell& c,
+                  const aabb& view,
+                  std::vector<uint32_t>& out) const;
+
+  float cell_size;
+  float inverse_cell_size;
+  // Largest distance any item reaches beyond the cell holding its center.
+  float max_overhang = 0.f;
+  std::unordered_map<uint64_t, uint32_t> cell_lookup;
+  std::vector<cell> cells;
+  std::vector<location> locations;
+  std::vector<uint32_t> free_handles;
+  size_t item_count = 0;
+};
+
+}
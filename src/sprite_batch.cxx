@@ -0,0 +1,186 @@
+#include "sprite_batch.hxx"
+#include "culling.hxx"
+#include "texture_atlas.hxx"
+#include <algorithm>
+#include <cstring>
+
+namespace uchiha {
+
+namespace {
+uint64_t
+make_key(int16_t layer, uint32_t program, blend_mode blend, uint32_t texture)
+{
+  // The layer is biased so negative layers sort before positive ones.
+  uint64_t biased_layer = static_cast<uint16_t>(layer + 0x8000);
+  return (biased_layer << 48) | (static_cast<uint64_t>(program & 0xff) << 40) |
+         (static_cast<uint64_t>(blend) << 32) | texture;
+}
+}
+
+void
+sprite_batch::clear()
+{
+  vertices.clear();
+  commands.clear();
+  groups.clear();
+}
+
+size_t
+sprite_batch::add(const triangle* triangles,
+                  size_t count,
+                  uint32_t program,
+                  const texture* tex,
+                  const uv_rect& uv,
+                  blend_mode blend,
+                  int16_t layer,
+                  const mat4* cull)
+{
+  if (count == 0) {
+    return 0;
+  }
+  uint64_t key =
+    make_key(layer, program, blend, tex != nullptr ? tex->get_handle() : 0);
+  uint32_t first = static_cast<uint32_t>(vertices.size());
+  uint32_t n = static_cast<uint32_t>(count * 3);
+  vertices.resize(first + n);
+  size_t culled = 0;
+  if (cull == nullptr) {
+    copy_vertices(vertices.data() + first, &triangles[0].v[0], n, uv);
+  } else {
+    // Visible runs are copied whole, so culling costs no extra copy.
+    vertex* out = vertices.data() + first;
+    size_t run_start = 0;
+    for (size_t i = 0; i <= count; ++i) {
+      if (i < count && is_visible(triangles[i], *cull)) {
+        continue;
+      }
+      if (i > run_start) {
+        const size_t run = (i - run_start) * 3;
+        copy_vertices(out, &triangles[run_start].v[0], run, uv);
+        out += run;
+      }
+      run_start = i + 1;
+    }
+    n = static_cast<uint32_t>(out - (vertices.data() + first));
+    culled = count - n / 3;
+    vertices.resize(first + n);
+    if (n == 0) {
+      return culled;
+    }
+  }
+
+  // Consecutive submissions with the same state are merged right away.
+  if (!commands.empty() && commands.back().key == key) {
+    commands.back().vertex_count += n;
+    return culled;
+  }
+  command c;
+  c.key = key;
+  c.tex = tex;
+  c.first_vertex = first;
+  c.vertex_count = n;
+  commands.push_back(c);
+  return culled;
+}
+
+const std::vector<sprite_batch::group>&
+sprite_batch::build(vertex* out)
+{
+  groups.clear();
+  // Stable so that submissions sharing a key keep their painter's order.
+  std::stable_sort(commands.begin(),
+                   commands.end(),
+                   [](const command& a, const command& b) {
+                     return a.key < b.key;
+                   });
+
+  // Everything below the layer bits is GL state; atlas sub-textures on one
+  // page share a handle and therefore a group.
+  const uint64_t state_mask = (uint64_t(1) << 48) - 1;
+  uint64_t group_state = 0;
+  uint32_t written = 0;
+  for (const command& c : commands) {
+    std::memcpy(out + written,
+                vertices.data() + c.first_vertex,
+                c.vertex_count * sizeof(vertex));
+    if (!groups.empty() && (c.key & state_mask) == group_state) {
+      groups.back().vertex_count += c.vertex_count;
+    } else {
+      group g;
+      g.program = static_cast<uint32_t>((c.key >> 40) & 0xff);
+      g.blend = static_cast<blend_mode>((c.key >> 32) & 0xff);
+      g.tex = c.tex;
+      g.first_vertex = written;
+      g.vertex_count = c.vertex_count;
+      groups.push_back(g);
+      group_state = c.key & state_mask;
+    }
+    written += c.vertex_count;
+  }
+  return groups;
+}
+
+const std::vector<sprite_batch::group>&
+sprite_batch::build(slotted_vertex* out, uint32_t multi_program)
+{
+  groups.clear();
+  std::stable_sort(commands.begin(),
+                   commands.end(),
+                   [](const command& a, const command& b) {
+                     return a.key < b.key;
+                   });
+
+  // The texture bits are left out of the group state: a run only ends when
+  // the program or the blend mode changes, or when its slots are full.
+  const uint64_t state_mask = ((uint64_t(1) << 16) - 1) << 32;
+  uint64_t group_state = 0;
+  uint32_t written = 0;
+  for (const command& c : commands) {
+    group* g = !groups.empty() && (c.key & state_mask) == group_state
+                 ? &groups.back()
+                 : nullptr;
+    uint32_t slot = 0;
+    if (g != nullptr && c.tex != nullptr) {
+      const uint32_t handle = static_cast<uint32_t>(c.key);
+      while (slot < g->slot_count && g->slots[slot]->get_handle() != handle) {
+        ++slot;
+      }
+      if (slot == g->slot_count) {
+        if (g->slot_count == max_texture_slots) {
+          g = nullptr;
+          slot = 0;
+        } else {
+          g->slots[g->slot_count++] = c.tex;
+        }
+      }
+    }
+    if (g == nullptr) {
+      groups.emplace_back();
+      g = &groups.back();
+      g->program = static_cast<uint32_t>((c.key >> 40) & 0xff);
+      g->blend = static_cast<blend_mode>((c.key >> 32) & 0xff);
+      g->tex = c.tex;
+      g->first_vertex = written;
+      if (c.tex != nullptr) {
+        g->slots[0] = c.tex;
+        g->slot_count = 1;
+      }
+      group_state = c.key & state_mask;
+    }
+    const vertex* in = vertices.data() + c.first_vertex;
+    for (uint32_t i = 0; i < c.vertex_count; ++i) {
+      out[written + i].v = in[i];
+      out[written + i].slot = slot;
+    }
+    g->vertex_count += c.vertex_count;
+    written += c.vertex_count;
+  }
+  for (group& g : groups) {
+    if (g.slot_count > 1) {
+      g.program = multi_program;
+    }
+  }
+  return groups;
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "engine.hxx"
+#include "vertex_format.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace uchiha {
+
+// CPU side of engine::begin_batch()/submit()/flush(). Submissions are
+// appended to one staging array and tagged with a sort key; build() orders
+// them by (layer, program, blend, texture) and writes the vertices grouped so
+// every run of equal keys can be drawn with a single call.
+class sprite_batch
+{
+public:
+  // Textures one multi-texture group can sample from.
+  static constexpr size_t max_texture_slots = 8;
+
+  struct group
+  {
+    uint32_t program = 0;
+    blend_mode blend = blend_mode::alpha;
+    const texture* tex = nullptr;
+    uint32_t first_vertex = 0;
+    uint32_t vertex_count = 0;
+    // Set by the slotted build(): the texture of every slot its vertices
+    // name. Groups with a single slot keep their own program.
+    const texture* slots[max_texture_slots] = {};
+    uint32_t slot_count = 0;
+  };
+
+  void clear();
+  // With cull set, triangles that is_visible() rejects under that clip
+  // transform are left out. Returns the number left out.
+  size_t add(const triangle* triangles,
+             size_t count,
+             uint32_t program,
+             const texture* tex,
+             const uv_rect& uv,
+             blend_mode blend,
+             int16_t layer,
+             const mat4* cull = nullptr);
+
+  bool empty() const { return commands.empty(); }
+  size_t vertex_count() const { return vertices.size(); }
+  // The vertices add() copied, in submission order.
+  const vertex* staged_vertices() const { return vertices.data(); }
+
+  // Writes vertex_count() vertices into out in draw order and returns the
+  // state groups. The result stays valid until the next clear()/add().
+  const std::vector<group>& build(vertex* out);
+  // Like build(), but textured runs that differ only in their texture are
+  // merged into groups of up to max_texture_slots textures drawn with
+  // multi_program, and every vertex carries the slot of its texture.
+  const std::vector<group>& build(slotted_vertex* out, uint32_t multi_program);
+
+private:
+  struct command
+  {
+    uint64_t key = 0;
+    const texture* tex = nullptr;
+    uint32_t first_vertex = 0;
+    uint32_t vertex_count = 0;
+  };
+
+  std::vector<vertex> vertices;
+  std::vector<command> commands;
+  std::vector<group> groups;
+};
+
+}
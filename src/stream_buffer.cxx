@@ -0,0 +1,229 @@
+#include "stream_buffer.hxx"
+#include "gl_ext.hxx"
+#include "profiler.hxx"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace uchiha {
+
+bool
+stream_buffer::init(size_t capacity_in_bytes)
+{
+  position = 0;
+  frame_start = 0;
+  return allocate_storage(std::max<size_t>(capacity_in_bytes, 1));
+}
+
+void
+stream_buffer::destroy()
+{
+  drop_fences();
+  if (buffer != 0) {
+    if (persistent_data || mapped) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+    glDeleteBuffers(1, &buffer);
+  }
+  buffer = 0;
+  buffer_capacity = 0;
+  persistent_data = nullptr;
+  mapped = false;
+}
+
+bool
+stream_buffer::allocate_storage(size_t capacity_in_bytes)
+{
+  // The result is judged by glGetError(), so errors left by earlier calls
+  // must not count against it.
+  while (glGetError() != GL_NO_ERROR) {
+  }
+  // Immutable storage can not be respecified, so a persistent ring gets a
+  // fresh buffer object. Draws already queued keep the old one alive.
+  if (buffer != 0 && persistent_data) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+    persistent_data = nullptr;
+  }
+  if (buffer == 0) {
+    glGenBuffers(1, &buffer);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  buffer_capacity = capacity_in_bytes;
+  ++storage_generation;
+
+  if (gl_ext::has_buffer_storage) {
+    const GLbitfield flags =
+      GL_MAP_WRITE_BIT | gl_ext::map_persistent_bit | gl_ext::map_coherent_bit;
+    gl_ext::buffer_storage(GL_COPY_WRITE_BUFFER,
+                           static_cast<GLsizeiptr>(buffer_capacity),
+                           nullptr,
+                           flags);
+    persistent_data = static_cast<uint8_t*>(
+      glMapBufferRange(GL_COPY_WRITE_BUFFER,
+                       0,
+                       static_cast<GLsizeiptr>(buffer_capacity),
+                       flags));
+    if (persistent_data) {
+      return true;
+    }
+    std::cerr << "error: Failed to map persistent stream buffer, falling "
+                 "back to unsynchronized mapping ( stream_buffer.cxx:  )"
+              << std::endl;
+    glDeleteBuffers(1, &buffer);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  }
+
+  glBufferData(GL_COPY_WRITE_BUFFER,
+               static_cast<GLsizeiptr>(buffer_capacity),
+               nullptr,
+               GL_STREAM_DRAW);
+  return glGetError() == GL_NO_ERROR;
+}
+
+stream_buffer::range
+stream_buffer::map(size_t size, size_t alignment)
+{
+  range result;
+  if (size == 0) {
+    return result;
+  }
+  alignment = std::max<size_t>(alignment, 1);
+
+  if (size > buffer_capacity) {
+    // A single write larger than the whole budget: grow rather than fail.
+    drop_fences();
+    allocate_storage(std::max(buffer_capacity * 2, size));
+    position = 0;
+    frame_start = 0;
+  }
+
+  size_t offset = static_cast<size_t>(position % buffer_capacity);
+  size_t aligned = (offset + alignment - 1) / alignment * alignment;
+  if (aligned + size > buffer_capacity) {
+    position += buffer_capacity - offset;
+    aligned = 0;
+  } else {
+    position += aligned - offset;
+  }
+
+  if (position + size - frame_start > buffer_capacity) {
+    // This frame alone has used up the ring and would overwrite data the GPU
+    // has not consumed yet.
+    if (persistent_data) {
+      end_frame();
+      while (fence_count > 0) {
+        wait_oldest_fence();
+      }
+    } else {
+      drop_fences();
+      glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glBufferData(GL_COPY_WRITE_BUFFER,
+                   static_cast<GLsizeiptr>(buffer_capacity),
+                   nullptr,
+                   GL_STREAM_DRAW);
+      position = 0;
+      frame_start = 0;
+      aligned = 0;
+    }
+  }
+
+  // Wait for every earlier frame whose data lies in the range about to be
+  // overwritten. Usually those fences have long been signaled.
+  while (fence_count > 0 &&
+         fences[first_fence].start + buffer_capacity < position + size) {
+    wait_oldest_fence();
+  }
+
+  result.offset = aligned;
+  if (persistent_data) {
+    result.data = persistent_data + aligned;
+  } else {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    result.data = glMapBufferRange(GL_COPY_WRITE_BUFFER,
+                                   static_cast<GLintptr>(aligned),
+                                   static_cast<GLsizeiptr>(size),
+                                   GL_MAP_WRITE_BIT |
+                                     GL_MAP_INVALIDATE_RANGE_BIT |
+                                     GL_MAP_UNSYNCHRONIZED_BIT);
+    mapped = result.data != nullptr;
+  }
+  position += size;
+  if (result.data != nullptr) {
+    profiler::count_upload(size);
+  }
+  return result;
+}
+
+void
+stream_buffer::commit()
+{
+  if (mapped) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    mapped = false;
+  }
+}
+
+size_t
+stream_buffer::write(const void* data, size_t size, size_t alignment)
+{
+  range r = map(size, alignment);
+  if (r.data) {
+    std::memcpy(r.data, data, size);
+  }
+  commit();
+  return r.offset;
+}
+
+void
+stream_buffer::end_frame()
+{
+  if (position == frame_start) {
+    return;
+  }
+  if (fence_count == max_frames_in_flight) {
+    wait_oldest_fence();
+  }
+  size_t slot = (first_fence + fence_count) % max_frames_in_flight;
+  fences[slot].sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  fences[slot].start = frame_start;
+  ++fence_count;
+  frame_start = position;
+}
+
+void
+stream_buffer::wait_oldest_fence()
+{
+  frame_fence& f = fences[first_fence];
+  const GLuint64 timeout_ns = 1000000;
+  for (;;) {
+    GLenum status =
+      glClientWaitSync(f.sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+    if (status != GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+  }
+  glDeleteSync(f.sync);
+  f.sync = nullptr;
+  first_fence = (first_fence + 1) % max_frames_in_flight;
+  --fence_count;
+}
+
+void
+stream_buffer::drop_fences()
+{
+  while (fence_count > 0) {
+    glDeleteSync(fences[first_fence].sync);
+    fences[first_fence].sync = nullptr;
+    first_fence = (first_fence + 1) % max_frames_in_flight;
+    --fence_count;
+  }
+  frame_start = position;
+}
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "glad/glad.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace uchiha {
+
+// Ring-buffered GL buffer object for data that is rewritten every frame.
+// Writes are appended into storage allocated once at init(), and a fence is
+// placed at the end of every frame so a range is only reused after the GPU
+// has finished reading it. With GL 4.4 / ARB_buffer_storage the whole ring
+// stays persistently mapped, otherwise each write maps its own range
+// unsynchronized.
+class stream_buffer
+{
+public:
+  struct range
+  {
+    void* data = nullptr;
+    size_t offset = 0;
+  };
+
+  bool init(size_t capacity_in_bytes);
+  void destroy();
+
+  // Reserves size bytes at an offset that is a multiple of alignment and
+  // returns a pointer the caller may write into until commit().
+  range map(size_t size, size_t alignment);
+  void commit();
+  // Convenience for map() + memcpy + commit(); returns the offset.
+  size_t write(const void* data, size_t size, size_t alignment);
+
+  // Fences everything written since the previous call. Must be called once
+  // per frame after the last draw that reads from the buffer.
+  void end_frame();
+
+  GLuint handle() const { return buffer; }
+  size_t capacity() const { return buffer_capacity; }
+  bool is_persistent() const { return persistent_data != nullptr; }
+  // Changes whenever handle() may have changed, so cached vertex array
+  // objects know when to re-point their attributes.
+  uint32_t generation() const { return storage_generation; }
+
+private:
+  struct frame_fence
+  {
+    GLsync sync = nullptr;
+    uint64_t start = 0;
+  };
+
+  static constexpr size_t max_frames_in_flight = 8;
+
+  bool allocate_storage(size_t capacity_in_bytes);
+  void wait_oldest_fence();
+  void drop_fences();
+
+  GLuint buffer = 0;
+  size_t buffer_capacity = 0;
+  uint32_t storage_generation = 0;
+  uint8_t* persistent_data = nullptr;
+  bool mapped = false;
+
+  // Positions are monotonic byte counters; the ring offset is
+  // position % buffer_capacity.
+  uint64_t position = 0;
+  uint64_t frame_start = 0;
+
+  frame_fence fences[max_frames_in_flight];
+  size_t first_fence = 0;
+  size_t fence_count = 0;
+};
+
+}
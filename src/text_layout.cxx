@@ -0,0 +1,134 @@
+#include "text_layout.hxx"
+#include <algorithm>
+#include <functional>
+
+namespace uchiha {
+
+void
+layout_text(const font_impl& f, std::string_view text, text_layout& out)
+{
+  out.quads.clear();
+  out.runs.clear();
+  std::vector<const texture*> pages;
+
+  float pen_x = 0.f;
+  float baseline = 0.f;
+  float widest = 0.f;
+  uint32_t previous = 0;
+  while (!text.empty()) {
+    const uint32_t codepoint = next_codepoint(text);
+    if (codepoint == '\n') {
+      widest = std::max(widest, pen_x);
+      pen_x = 0.f;
+      baseline -= f.get_line_height();
+      previous = 0;
+      continue;
+    }
+    if (previous != 0) {
+      pen_x += f.kerning(previous, codepoint);
+    }
+    const glyph& g = f.find_glyph(codepoint);
+    if (g.page != nullptr) {
+      sprite_instance q;
+      q.x = pen_x + g.left + g.width * 0.5f;
+      q.y = baseline + g.top - g.height * 0.5f;
+      q.scale_x = g.width;
+      q.scale_y = g.height;
+      q.u0 = g.uv.u0;
+      q.v0 = g.uv.v0;
+      q.u1 = g.uv.u1;
+      q.v1 = g.uv.v1;
+      out.quads.push_back(q);
+      pages.push_back(g.page);
+    }
+    pen_x += g.advance;
+    previous = codepoint;
+  }
+  widest = std::max(widest, pen_x);
+  out.bounds.min_x = 0.f;
+  out.bounds.max_x = widest;
+  out.bounds.min_y = baseline - f.get_descender();
+  out.bounds.max_y = f.get_ascender();
+
+  // Nearly all text fits on one page; the sort only matters once the
+  // atlas has grown a second one.
+  const bool one_page =
+    std::all_of(pages.begin(), pages.end(), [&](const texture* p) {
+      return p == pages.front();
+    });
+  if (!one_page) {
+    std::vector<uint32_t> order(out.quads.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return std::less<const texture*>()(pages[a], pages[b]);
+    });
+    std::vector<sprite_instance> sorted(out.quads.size());
+    std::vector<const texture*> sorted_pages(pages.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+      sorted[i] = out.quads[order[i]];
+      sorted_pages[i] = pages[order[i]];
+    }
+    out.quads.swap(sorted);
+    pages.swap(sorted_pages);
+  }
+  for (uint32_t i = 0; i < pages.size(); ++i) {
+    if (out.runs.empty() || out.runs.back().page != pages[i]) {
+      out.runs.push_back(text_layout::run{ pages[i], i, 0 });
+    }
+    ++out.runs.back().count;
+  }
+}
+
+const text_layout&
+text_layout_cache::get(const font_impl& f, std::string_view text)
+{
+  const uint64_t key = std::hash<std::string_view>()(text) * 31u +
+                       std::hash<const void*>()(&f);
+  entry& e = entries[key];
+  if (e.f != &f || e.text != text) {
+    e.f = &f;
+    e.text.assign(text.data(), text.size());
+    layout_text(f, text, e.layout);
+  }
+  e.last_used = frame;
+  return e.layout;
+}
+
+void
+text_layout_cache::remove(const font_impl& f)
+{
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (it->second.f == &f) {
+      it = entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void
+text_layout_cache::end_frame()
+{
+  ++frame;
+  // A sweep every few frames is plenty for an idle limit this long.
+  if (frame % 32 != 0) {
+    return;
+  }
+  for (auto it = entries.begin(); it != entries.end();) {
+    if (frame - it->second.last_used > max_idle_frames) {
+      it = entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void
+text_layout_cache::clear()
+{
+  entries.clear();
+}
+
+}
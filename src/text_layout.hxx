@@ -0,0 +1,66 @@
+#pragma once
+#include "engine.hxx"
+#include "font.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uchiha {
+
+// Glyph quads of a string in pixels, relative to the start of its first
+// baseline with y up, and grouped so each atlas page is one run.
+struct text_layout
+{
+  struct run
+  {
+    const texture* page = nullptr;
+    uint32_t first = 0;
+    uint32_t count = 0;
+  };
+
+  std::vector<sprite_instance> quads;
+  std::vector<run> runs;
+  // Advance box: from the pen origin to the widest line, and from the
+  // ascender of the first line to the descender of the last.
+  aabb bounds;
+};
+
+// Lays text out in f, one line per '\n', with kerning.
+void
+layout_text(const font_impl& f, std::string_view text, text_layout& out);
+
+// Layouts by font and text, so text that stays the same is laid out once
+// and then costs a lookup. The font's pixel size is part of the font.
+// Entries that go unused for max_idle_frames are dropped by end_frame().
+class text_layout_cache
+{
+public:
+  static constexpr uint64_t max_idle_frames = 120;
+
+  const text_layout& get(const font_impl& f, std::string_view text);
+  // Drops every layout of f, for when it is closed.
+  void remove(const font_impl& f);
+  void end_frame();
+  void clear();
+
+  size_t size() const { return entries.size(); }
+
+private:
+  struct entry
+  {
+    const font_impl* f = nullptr;
+    std::string text;
+    text_layout layout;
+    uint64_t last_used = 0;
+  };
+
+  // Keyed by a hash of both, so a lookup does not allocate. Two strings
+  // with the same hash take turns in one entry.
+  std::unordered_map<uint64_t, entry> entries;
+  uint64_t frame = 0;
+};
+
+}
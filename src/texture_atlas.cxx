@@ -0,0 +1,234 @@
+#include "texture_atlas.hxx"
+#include "profiler.hxx"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace uchiha {
+
+// One pixel on every side of an image is filled with its edge pixels so that
+// linear filtering never picks up a neighbour.
+static constexpr uint16_t atlas_padding = 1;
+
+void
+skyline_packer::init(uint16_t width, uint16_t height)
+{
+  atlas_width = width;
+  atlas_height = height;
+  skyline.clear();
+  segment s;
+  s.width = width;
+  skyline.push_back(s);
+}
+
+bool
+skyline_packer::fit(size_t index, uint16_t w, uint16_t h, uint16_t& y) const
+{
+  uint32_t x = skyline[index].x;
+  if (x + w > atlas_width) {
+    return false;
+  }
+  uint32_t top = 0;
+  uint32_t width_left = w;
+  for (size_t i = index; width_left > 0; ++i) {
+    if (i == skyline.size()) {
+      return false;
+    }
+    top = std::max<uint32_t>(top, skyline[i].y);
+    if (top + h > atlas_height) {
+      return false;
+    }
+    width_left -= std::min<uint32_t>(width_left, skyline[i].width);
+  }
+  y = static_cast<uint16_t>(top);
+  return true;
+}
+
+bool
+skyline_packer::pack(uint16_t w, uint16_t h, uint16_t& x, uint16_t& y)
+{
+  size_t best_index = skyline.size();
+  uint16_t best_y = UINT16_MAX;
+  uint16_t best_width = UINT16_MAX;
+  for (size_t i = 0; i < skyline.size(); ++i) {
+    uint16_t candidate_y = 0;
+    if (!fit(i, w, h, candidate_y)) {
+      continue;
+    }
+    if (candidate_y < best_y ||
+        (candidate_y == best_y && skyline[i].width < best_width)) {
+      best_index = i;
+      best_y = candidate_y;
+      best_width = skyline[i].width;
+    }
+  }
+  if (best_index == skyline.size()) {
+    return false;
+  }
+
+  x = skyline[best_index].x;
+  y = best_y;
+
+  segment placed;
+  placed.x = x;
+  placed.y = static_cast<uint16_t>(best_y + h);
+  placed.width = w;
+  skyline.insert(skyline.begin() + static_cast<std::ptrdiff_t>(best_index),
+                 placed);
+
+  // Trim the segments now covered by the new one.
+  size_t i = best_index + 1;
+  while (i < skyline.size()) {
+    segment& prev = skyline[i - 1];
+    segment& cur = skyline[i];
+    uint32_t prev_end = prev.x + prev.width;
+    if (cur.x >= prev_end) {
+      break;
+    }
+    uint32_t shrink = prev_end - cur.x;
+    if (cur.width <= shrink) {
+      skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(i));
+      continue;
+    }
+    cur.x = static_cast<uint16_t>(cur.x + shrink);
+    cur.width = static_cast<uint16_t>(cur.width - shrink);
+    break;
+  }
+
+  // Merge neighbours that ended up at the same height.
+  for (size_t j = 0; j + 1 < skyline.size();) {
+    if (skyline[j].y == skyline[j + 1].y) {
+      skyline[j].width =
+        static_cast<uint16_t>(skyline[j].width + skyline[j + 1].width);
+      skyline.erase(skyline.begin() + static_cast<std::ptrdiff_t>(j + 1));
+    } else {
+      ++j;
+    }
+  }
+  return true;
+}
+
+texture_atlas_impl::texture_atlas_impl(uint16_t page_width,
+                                       uint16_t page_height)
+  : default_page_width(page_width)
+  , default_page_height(page_height)
+{}
+
+texture_atlas_impl::~texture_atlas_impl()
+{
+  for (page& p : pages) {
+    glDeleteTextures(1, &p.handle);
+  }
+}
+
+texture_atlas_impl::page*
+texture_atlas_impl::add_page(uint16_t width, uint16_t height)
+{
+  page p;
+  p.width = width;
+  p.height = height;
+  p.packer.init(width, height);
+
+  glGenTextures(1, &p.handle);
+  glBindTexture(GL_TEXTURE_2D, p.handle);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  std::vector<uint8_t> clear(static_cast<size_t>(width) * height * 4, 0);
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               GL_RGBA8,
+               width,
+               height,
+               0,
+               GL_RGBA,
+               GL_UNSIGNED_BYTE,
+               clear.data());
+  pages.push_back(std::move(p));
+  return &pages.back();
+}
+
+texture*
+texture_atlas_impl::add(const uint8_t* rgba, uint16_t width, uint16_t height)
+{
+  if (rgba == nullptr || width == 0 || height == 0) {
+    return nullptr;
+  }
+  uint32_t padded_w = width + 2u * atlas_padding;
+  uint32_t padded_h = height + 2u * atlas_padding;
+  if (padded_w > UINT16_MAX || padded_h > UINT16_MAX) {
+    std::cerr << "error: Image is too large for an atlas ( texture_atlas.cxx:  )"
+              << std::endl;
+    return nullptr;
+  }
+  uint16_t pw = static_cast<uint16_t>(padded_w);
+  uint16_t ph = static_cast<uint16_t>(padded_h);
+
+  page* target = nullptr;
+  uint16_t x = 0;
+  uint16_t y = 0;
+  for (page& p : pages) {
+    if (p.packer.pack(pw, ph, x, y)) {
+      target = &p;
+      break;
+    }
+  }
+  if (target == nullptr) {
+    target = add_page(std::max(default_page_width, pw),
+                      std::max(default_page_height, ph));
+    if (!target->packer.pack(pw, ph, x, y)) {
+      return nullptr;
+    }
+  }
+
+  // Build the padded copy with the border extruded from the edge pixels.
+  std::vector<uint8_t> padded(static_cast<size_t>(pw) * ph * 4);
+  for (uint32_t row = 0; row < ph; ++row) {
+    uint32_t src_row = std::min<uint32_t>(
+      row > atlas_padding ? row - atlas_padding : 0, height - 1u);
+    for (uint32_t col = 0; col < pw; ++col) {
+      uint32_t src_col = std::min<uint32_t>(
+        col > atlas_padding ? col - atlas_padding : 0, width - 1u);
+      std::memcpy(&padded[(static_cast<size_t>(row) * pw + col) * 4],
+                  &rgba[(static_cast<size_t>(src_row) * width + src_col) * 4],
+                  4);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, target->handle);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D,
+                  0,
+                  x,
+                  y,
+                  pw,
+                  ph,
+                  GL_RGBA,
+                  GL_UNSIGNED_BYTE,
+                  padded.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  profiler::count_upload(padded.size());
+
+  uv_rect uv;
+  uv.u0 = static_cast<float>(x + atlas_padding) / target->width;
+  uv.v0 = static_cast<float>(y + atlas_padding) / target->height;
+  uv.u1 = static_cast<float>(x + atlas_padding + width) / target->width;
+  uv.v1 = static_cast<float>(y + atlas_padding + height) / target->height;
+  textures.push_back(
+    std::make_unique<atlas_texture>(width, height, target->handle, uv));
+  return textures.back().get();
+}
+
+void
+copy_vertices(vertex* out, const vertex* in, size_t count, const uv_rect& uv)
+{
+  float du = uv.u1 - uv.u0;
+  float dv = uv.v1 - uv.v0;
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = in[i];
+    out[i].tx = uv.u0 + in[i].tx * du;
+    out[i].ty = uv.v0 + in[i].ty * dv;
+  }
+}
+
+}
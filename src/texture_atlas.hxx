@@ -0,0 +1,90 @@
+#pragma once
+#include "engine.hxx"
+#include "glad/glad.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace uchiha {
+
+// Skyline bottom-left rectangle packer. Keeps the top edge of the packed
+// area as a list of horizontal segments and places every rectangle at the
+// lowest position where it fits, preferring the narrowest segment on ties.
+class skyline_packer
+{
+public:
+  void init(uint16_t width, uint16_t height);
+  bool pack(uint16_t w, uint16_t h, uint16_t& x, uint16_t& y);
+
+private:
+  struct segment
+  {
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint16_t width = 0;
+  };
+
+  bool fit(size_t index, uint16_t w, uint16_t h, uint16_t& y) const;
+
+  uint16_t atlas_width = 0;
+  uint16_t atlas_height = 0;
+  std::vector<segment> skyline;
+};
+
+// Sub-rectangle of an atlas page. get_handle() is the page texture, so all
+// images on one page share a batch key.
+class atlas_texture : public texture
+{
+  uint16_t texture_width = 0;
+  uint16_t texture_height = 0;
+  uv_rect rect;
+
+public:
+  atlas_texture(uint16_t width, uint16_t height, GLuint page, uv_rect uv)
+    : texture_width(width)
+    , texture_height(height)
+    , rect(uv)
+  {
+    gl_handle = page;
+  }
+  uint16_t get_width() const override { return texture_width; }
+  uint16_t get_height() const override { return texture_height; }
+  uv_rect get_uv_rect() const override { return rect; }
+};
+
+class texture_atlas_impl : public texture_atlas
+{
+public:
+  texture_atlas_impl(uint16_t page_width, uint16_t page_height);
+  ~texture_atlas_impl() override;
+
+  // Packs an RGBA8 image and returns its sub-texture, or nullptr when the
+  // image can not be placed. Images larger than a page get a page of their
+  // own.
+  texture* add(const uint8_t* rgba, uint16_t width, uint16_t height);
+  size_t get_page_count() const override { return pages.size(); }
+
+private:
+  struct page
+  {
+    GLuint handle = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    skyline_packer packer;
+  };
+
+  page* add_page(uint16_t width, uint16_t height);
+
+  uint16_t default_page_width = 0;
+  uint16_t default_page_height = 0;
+  std::vector<page> pages;
+  std::vector<std::unique_ptr<atlas_texture>> textures;
+};
+
+// Copies vertices while mapping their texture coordinates from [0, 1] into
+// the sub-rectangle a texture occupies.
+void
+copy_vertices(vertex* out, const vertex* in, size_t count, const uv_rect& uv);
+
+}
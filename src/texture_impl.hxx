@@ -0,0 +1,53 @@
+#pragma once
+#include "engine.hxx"
+#include "glad/glad.h"
+
+namespace uchiha {
+
+// Texture backed by its own GL texture object. Asynchronously loaded
+// textures start out pointing at a shared placeholder and are switched over
+// by the texture loader with assign() once their upload has finished; the
+// texture registry puts evicted textures back on the placeholder.
+class texture_impl : public texture
+{
+  uint16_t texture_width = 0;
+  uint16_t texture_height = 0;
+  bool ready = true;
+
+public:
+  texture_impl(uint16_t width, uint16_t height, GLuint handle)
+    : texture_width(width)
+    , texture_height(height)
+  {
+    gl_handle = handle;
+  }
+  uint16_t get_width() const override { return texture_width; }
+  uint16_t get_height() const override { return texture_height; }
+  bool is_ready() const override { return ready; }
+
+  void assign(uint16_t width, uint16_t height, GLuint handle)
+  {
+    texture_width = width;
+    texture_height = height;
+    gl_handle = handle;
+    ready = true;
+  }
+  void set_pending() { ready = false; }
+  void set_slot(slot_handle s) { slot = s; }
+  // Hands the GL object back while keeping the size, so layout code that
+  // asks for it is not affected by eviction.
+  void evict(GLuint placeholder)
+  {
+    gl_handle = placeholder;
+    ready = false;
+  }
+  // Settles a load that failed: the texture keeps its size and draws as
+  // the placeholder for good.
+  void fail(GLuint placeholder)
+  {
+    gl_handle = placeholder;
+    ready = true;
+  }
+};
+
+}
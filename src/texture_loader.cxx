@@ -0,0 +1,251 @@
+#include "texture_loader.hxx"
+#include "profiler.hxx"
+#include "stb_image.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace uchiha {
+
+// Bytes copied through the pixel buffer per glTexSubImage2D call.
+static constexpr size_t upload_chunk_size = 256 * 1024;
+
+void
+texture_loader::start(job_system& job_pool)
+{
+  jobs = &job_pool;
+}
+
+void
+texture_loader::stop()
+{
+  if (jobs != nullptr) {
+    jobs->wait(decodes);
+  }
+  for (decoded_image& d : decoded) {
+    stbi_image_free(d.pixels);
+  }
+  decoded.clear();
+  decoding.clear();
+  cancelled.clear();
+  requests_in_flight = 0;
+  for (upload& u : uploads) {
+    stbi_image_free(u.image.pixels);
+    if (u.handle != 0) {
+      glDeleteTextures(1, &u.handle);
+    }
+  }
+  uploads.clear();
+  failed.clear();
+  if (pixel_buffer != 0) {
+    glDeleteBuffers(1, &pixel_buffer);
+    pixel_buffer = 0;
+  }
+}
+
+void
+texture_loader::request(texture_impl* target,
+                        std::string_view path,
+                        const resource_data& packed)
+{
+  target->set_pending();
+  uint64_t number = 0;
+  {
+    std::lock_guard<std::mutex> lock(decoded_mutex);
+    ++requests_in_flight;
+    number = next_request++;
+    decoding.emplace(number, target);
+  }
+  auto decode = [this, target, number, packed, file = std::string(path)]() {
+    UCHIHA_PROFILE_SCOPE("decode texture");
+    decoded_image d;
+    d.target = target;
+    d.path = file;
+    int channels = 0;
+    std::vector<uint8_t> scratch;
+    const uint8_t* bytes =
+      packed.data != nullptr ? unpack(packed, scratch) : nullptr;
+    if (bytes != nullptr) {
+      d.pixels = stbi_load_from_memory(bytes,
+                                       static_cast<int>(packed.size),
+                                       &d.width,
+                                       &d.height,
+                                       &channels,
+                                       STBI_rgb_alpha);
+    } else {
+      d.pixels = stbi_load(
+        file.c_str(), &d.width, &d.height, &channels, STBI_rgb_alpha);
+    }
+    std::lock_guard<std::mutex> lock(decoded_mutex);
+    decoding.erase(number);
+    auto dropped = std::find(cancelled.begin(), cancelled.end(), number);
+    if (dropped != cancelled.end()) {
+      cancelled.erase(dropped);
+      stbi_image_free(d.pixels);
+      --requests_in_flight;
+      return;
+    }
+    decoded.push_back(std::move(d));
+  };
+  jobs->run(std::move(decode), &decodes);
+}
+
+void
+texture_loader::cancel(texture_impl* target)
+{
+  for (auto it = uploads.begin(); it != uploads.end();) {
+    if (it->image.target == target) {
+      stbi_image_free(it->image.pixels);
+      if (it->handle != 0) {
+        glDeleteTextures(1, &it->handle);
+      }
+      it = uploads.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  std::lock_guard<std::mutex> lock(decoded_mutex);
+  for (auto it = decoded.begin(); it != decoded.end();) {
+    if (it->target == target) {
+      stbi_image_free(it->pixels);
+      it = decoded.erase(it);
+      --requests_in_flight;
+    } else {
+      ++it;
+    }
+  }
+  for (const auto& [number, running] : decoding) {
+    if (running == target) {
+      cancelled.push_back(number);
+    }
+  }
+}
+
+bool
+texture_loader::idle()
+{
+  std::lock_guard<std::mutex> lock(decoded_mutex);
+  return requests_in_flight == 0 && uploads.empty();
+}
+
+texture_loader::chunk_result
+texture_loader::upload_chunk(upload& u)
+{
+  const decoded_image& img = u.image;
+  if (u.handle == 0) {
+    glGenTextures(1, &u.handle);
+    glBindTexture(GL_TEXTURE_2D, u.handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 GL_RGBA8,
+                 img.width,
+                 img.height,
+                 0,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 nullptr);
+  } else {
+    glBindTexture(GL_TEXTURE_2D, u.handle);
+  }
+  if (pixel_buffer == 0) {
+    glGenBuffers(1, &pixel_buffer);
+  }
+
+  size_t row_size = static_cast<size_t>(img.width) * 4;
+  int rows = static_cast<int>(std::max<size_t>(1, upload_chunk_size / row_size));
+  rows = std::min(rows, img.height - u.rows_done);
+  size_t chunk_size = row_size * static_cast<size_t>(rows);
+
+  // Orphaning the buffer for every chunk lets the driver keep copying the
+  // previous one while this one is being filled.
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER,
+               static_cast<GLsizeiptr>(chunk_size),
+               nullptr,
+               GL_STREAM_DRAW);
+  void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                               0,
+                               static_cast<GLsizeiptr>(chunk_size),
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (dst == nullptr) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return chunk_result::stalled;
+  }
+  std::memcpy(dst, img.pixels + row_size * u.rows_done, chunk_size);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D,
+                  0,
+                  0,
+                  u.rows_done,
+                  img.width,
+                  rows,
+                  GL_RGBA,
+                  GL_UNSIGNED_BYTE,
+                  nullptr);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  profiler::count_upload(chunk_size);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  u.rows_done += rows;
+
+  if (u.rows_done < img.height) {
+    return chunk_result::more;
+  }
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  img.target->assign(static_cast<uint16_t>(img.width),
+                     static_cast<uint16_t>(img.height),
+                     u.handle);
+  return chunk_result::done;
+}
+
+void
+texture_loader::process_uploads(double budget_ms)
+{
+  UCHIHA_PROFILE_SCOPE("texture uploads");
+  using clock = std::chrono::steady_clock;
+  const clock::time_point start = clock::now();
+  failed.clear();
+  {
+    std::lock_guard<std::mutex> lock(decoded_mutex);
+    while (!decoded.empty()) {
+      upload u;
+      u.image = std::move(decoded.front());
+      decoded.pop_front();
+      --requests_in_flight;
+      if (u.image.pixels == nullptr || u.image.width <= 0 ||
+          u.image.height <= 0) {
+        std::cerr << "error: Failed to load texture " << u.image.path
+                  << " ( texture_loader.cxx: )" << std::endl;
+        stbi_image_free(u.image.pixels);
+        failed.push_back(u.image.target);
+        continue;
+      }
+      uploads.push_back(std::move(u));
+    }
+  }
+
+  // At least one chunk goes out per frame, however small the budget.
+  while (!uploads.empty()) {
+    upload& u = uploads.front();
+    const chunk_result result = upload_chunk(u);
+    if (result == chunk_result::stalled) {
+      break;
+    }
+    if (result == chunk_result::done) {
+      stbi_image_free(u.image.pixels);
+      uploads.pop_front();
+    }
+    std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+    if (elapsed.count() >= budget_ms) {
+      break;
+    }
+  }
+}
+
+}
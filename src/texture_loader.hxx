@@ -0,0 +1,87 @@
+#pragma once
+#include "glad/glad.h"
+#include "job_system.hxx"
+#include "resource_pack.hxx"
+#include "texture_impl.hxx"
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uchiha {
+
+// Background half of engine::create_texture_async(). Jobs decode images
+// with stb_image; process_uploads() then streams the pixels to the GPU
+// through a pixel buffer object a few rows at a time, so a large image is
+// spread over as many frames as the per-frame budget requires.
+class texture_loader
+{
+public:
+  void start(job_system& jobs);
+  // Waits for the decodes still running and drops uploads that did not
+  // finish.
+  void stop();
+
+  // With a packed entry the image is decoded from it instead of from the
+  // file at path; the pack has to stay mapped until the load is done.
+  void request(texture_impl* target,
+               std::string_view path,
+               const resource_data& packed = resource_data());
+  // Drops every pending load into target, which may be freed afterwards.
+  // Must run on the GL thread.
+  void cancel(texture_impl* target);
+  // Must run on the GL thread. Binds GL_TEXTURE_2D on the active unit.
+  void process_uploads(double budget_ms);
+  // The targets whose image could not be decoded, found by the last
+  // process_uploads(). They are still pending; the caller settles them.
+  const std::vector<texture_impl*>& failed_loads() const { return failed; }
+  bool idle();
+
+private:
+  struct decoded_image
+  {
+    texture_impl* target = nullptr;
+    std::string path;
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+  };
+
+  struct upload
+  {
+    decoded_image image;
+    GLuint handle = 0;
+    int rows_done = 0;
+  };
+
+  enum class chunk_result : uint8_t
+  {
+    more,
+    done,
+    // The pixel buffer could not be mapped; the chunk is tried again next
+    // frame.
+    stalled
+  };
+
+  // Advances the front upload by one chunk.
+  chunk_result upload_chunk(upload& u);
+
+  job_system* jobs = nullptr;
+  job_counter decodes;
+  std::mutex decoded_mutex;
+  std::deque<decoded_image> decoded;
+  size_t requests_in_flight = 0;
+  // Decodes still running by request number, and the requests cancelled
+  // meanwhile: their image is dropped as soon as it has been decoded.
+  uint64_t next_request = 0;
+  std::unordered_map<uint64_t, texture_impl*> decoding;
+  std::vector<uint64_t> cancelled;
+  std::deque<upload> uploads;
+  std::vector<texture_impl*> failed;
+  GLuint pixel_buffer = 0;
+};
+
+}
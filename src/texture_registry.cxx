@@ -0,0 +1,189 @@
+#include "texture_registry.hxx"
+#include <algorithm>
+
+namespace uchiha {
+
+uint64_t
+rgba8_texture_bytes(uint32_t width, uint32_t height)
+{
+  uint64_t bytes = 0;
+  for (;;) {
+    bytes += static_cast<uint64_t>(width) * height * 4;
+    if (width <= 1 && height <= 1) {
+      return bytes;
+    }
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+}
+
+texture_impl*
+texture_registry::acquire(std::string_view path)
+{
+  auto found = by_path.find(std::string(path));
+  if (found == by_path.end()) {
+    return nullptr;
+  }
+  entry& e = *entries.get(found->second);
+  ++e.references;
+  return e.target;
+}
+
+void
+texture_registry::add(std::string_view path, texture_impl* t, uint64_t bytes)
+{
+  entry e;
+  e.path = std::string(path);
+  e.target = t;
+  e.references = 1;
+  e.bytes = bytes;
+  e.last_used = frame;
+  e.state = t->is_ready() ? residency::resident : residency::loading;
+  if (e.state == residency::resident) {
+    if (e.bytes == 0) {
+      e.bytes = rgba8_texture_bytes(t->get_width(), t->get_height());
+    }
+    bytes_resident += e.bytes;
+  }
+  const slot_handle h = entries.insert(std::move(e));
+  by_path.emplace(entries.get(h)->path, h);
+  by_object.emplace(t, h);
+  t->set_slot(h);
+}
+
+void
+texture_registry::remove(slot_handle h)
+{
+  entry& e = *entries.get(h);
+  e.target->set_slot(slot_handle());
+  by_path.erase(e.path);
+  by_object.erase(e.target);
+  entries.erase(h);
+}
+
+texture_registry::release_result
+texture_registry::release(const texture* t)
+{
+  release_result result;
+  auto owned = by_object.find(t);
+  if (owned == by_object.end()) {
+    return result;
+  }
+  const slot_handle h = owned->second;
+  entry& e = *entries.get(h);
+  if (--e.references > 0) {
+    return result;
+  }
+  // A load may have finished since the last end_frame() noticed.
+  const bool loaded = e.state == residency::resident ||
+                      (e.state == residency::loading && e.target->is_ready());
+  if (loaded) {
+    GLuint handle = e.target->get_handle();
+    glDeleteTextures(1, &handle);
+  }
+  if (e.state == residency::resident) {
+    bytes_resident -= e.bytes;
+  }
+  result.target = e.target;
+  result.loading = e.state == residency::loading && !loaded;
+  remove(h);
+  return result;
+}
+
+texture_registry::reload_request
+texture_registry::touch(const texture& t)
+{
+  reload_request request;
+  entry* found = entries.get(t.get_slot());
+  if (found == nullptr) {
+    return request;
+  }
+  entry& e = *found;
+  e.last_used = frame;
+  if (e.state == residency::evicted) {
+    e.state = residency::loading;
+    request.target = e.target;
+    request.path = &e.path;
+  }
+  return request;
+}
+
+void
+texture_registry::fail(texture_impl& t)
+{
+  t.fail(placeholder);
+  entry* found = entries.get(t.get_slot());
+  if (found == nullptr) {
+    return;
+  }
+  found->state = residency::failed;
+  found->bytes = 0;
+}
+
+void
+texture_registry::evict(entry& e)
+{
+  GLuint handle = e.target->get_handle();
+  glDeleteTextures(1, &handle);
+  e.target->evict(placeholder);
+  e.state = residency::evicted;
+  bytes_resident -= e.bytes;
+  ++last_evicted;
+}
+
+void
+texture_registry::end_frame()
+{
+  last_evicted = 0;
+  for (entry& e : entries) {
+    if (e.state == residency::loading && e.target->is_ready()) {
+      e.state = residency::resident;
+      if (e.bytes == 0) {
+        e.bytes =
+          rgba8_texture_bytes(e.target->get_width(), e.target->get_height());
+      }
+      bytes_resident += e.bytes;
+    }
+  }
+
+  if (budget != 0 && bytes_resident > budget) {
+    candidates.clear();
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+      if (entries[i].state == residency::resident &&
+          entries[i].last_used < frame) {
+        candidates.push_back(i);
+      }
+    }
+    std::sort(candidates.begin(),
+              candidates.end(),
+              [&](uint32_t a, uint32_t b) {
+                return entries[a].last_used < entries[b].last_used;
+              });
+    for (uint32_t i : candidates) {
+      if (bytes_resident <= budget) {
+        break;
+      }
+      evict(entries[i]);
+    }
+  }
+  ++frame;
+}
+
+void
+texture_registry::destroy()
+{
+  for (entry& e : entries) {
+    if (e.state == residency::resident ||
+        (e.state == residency::loading && e.target->is_ready())) {
+      GLuint handle = e.target->get_handle();
+      glDeleteTextures(1, &handle);
+    }
+    delete e.target;
+  }
+  entries.clear();
+  by_path.clear();
+  by_object.clear();
+  bytes_resident = 0;
+}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include "glad/glad.h"
+#include "slot_map.hxx"
+#include "texture_impl.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace uchiha {
+
+// Owns the textures engine::create_texture() loads from files: one per path,
+// reference counted, and kept within a GPU memory budget by evicting the
+// least recently drawn ones at the end of a frame. An evicted texture keeps
+// its object and size and draws as the placeholder until the engine has
+// reloaded it, which it does the first time the texture is drawn again.
+//
+// Entries live in a slot map and every texture carries its slot, so the
+// lookup done for each draw is an array load rather than a hash. release()
+// goes through a table of the registered textures instead, so a texture
+// that was already freed is never read.
+class texture_registry
+{
+public:
+  struct reload_request
+  {
+    texture_impl* target = nullptr;
+    const std::string* path = nullptr;
+  };
+
+  struct release_result
+  {
+    texture_impl* target = nullptr;
+    bool loading = false;
+  };
+
+  // Evicted textures are pointed at handle until they are reloaded.
+  void set_placeholder(GLuint handle) { placeholder = handle; }
+
+  // Returns the texture registered for path with one more reference, or
+  // nullptr.
+  texture_impl* acquire(std::string_view path);
+  // Registers a texture with one reference and gives it its slot. bytes may
+  // be 0 for a texture that is still loading; it is then estimated from the
+  // size once ready.
+  void add(std::string_view path, texture_impl* t, uint64_t bytes);
+  // Drops a reference. With the last one the texture is unregistered and
+  // its GL object deleted, and the result names the object for the caller
+  // to free, after cancelling its load when loading is set. The result is
+  // empty for textures the registry does not own, including ones already
+  // freed.
+  release_result release(const texture* t);
+
+  // Marks t as drawn in the current frame. When t had been evicted the
+  // returned request names it and where it came from; it then counts as
+  // loading until it is ready again.
+  reload_request touch(const texture& t);
+  // Settles a load into t that failed: t draws as the placeholder from now
+  // on, owns no GL object and is neither evicted nor reloaded.
+  void fail(texture_impl& t);
+
+  // 0 disables eviction.
+  void set_budget(uint64_t bytes) { budget = bytes; }
+  // Picks up textures that finished loading, then evicts down to the
+  // budget. Textures drawn in the frame that is ending are never evicted.
+  void end_frame();
+
+  uint64_t resident_bytes() const { return bytes_resident; }
+  uint32_t evicted_last_frame() const { return last_evicted; }
+
+  // Deletes every texture, whatever its reference count.
+  void destroy();
+
+private:
+  enum class residency : uint8_t
+  {
+    loading,
+    resident,
+    evicted,
+    failed
+  };
+
+  struct entry
+  {
+    std::string path;
+    texture_impl* target = nullptr;
+    uint32_t references = 0;
+    // GPU memory while resident; 0 until known.
+    uint64_t bytes = 0;
+    uint64_t last_used = 0;
+    residency state = residency::loading;
+  };
+
+  void remove(slot_handle h);
+  void evict(entry& e);
+
+  GLuint placeholder = 0;
+  uint64_t budget = 0;
+  uint64_t bytes_resident = 0;
+  uint64_t frame = 1;
+  uint32_t last_evicted = 0;
+  slot_map<entry> entries;
+  std::unordered_map<std::string, slot_handle> by_path;
+  std::unordered_map<const texture*, slot_handle> by_object;
+  std::vector<uint32_t> candidates;
+};
+
+// GPU memory of an RGBA8 texture with its full mip chain.
+uint64_t
+rgba8_texture_bytes(uint32_t width, uint32_t height);
+
+}
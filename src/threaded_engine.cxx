@@ -0,0 +1,737 @@
+#include "threaded_engine.hxx"
+#include "profiler.hxx"
+#include <iostream>
+
+namespace uchiha {
+
+namespace {
+
+std::atomic<uint64_t> next_engine_id{ 1 };
+
+}
+
+threaded_engine::threaded_engine()
+  : id(next_engine_id.fetch_add(1))
+{}
+
+threaded_engine::~threaded_engine()
+{
+  stop_render_thread();
+  destroy_engine(backend);
+}
+
+bool
+threaded_engine::init(uint16_t ww, uint16_t wh, bool fullscreen)
+{
+  // The window and its events stay on this thread; only the context moves.
+  backend = create_engine();
+  if (!backend->init(ww, wh, fullscreen)) {
+    destroy_engine(backend);
+    backend = nullptr;
+    return false;
+  }
+  if (!make_context_current(*backend, false)) {
+    std::cerr << "error: Failed to release GL context ( threaded_engine.cxx:  )"
+              << std::endl;
+    backend->destroy();
+    destroy_engine(backend);
+    backend = nullptr;
+    return false;
+  }
+
+  quit = false;
+  render_thread = std::thread([this]() { render_loop(); });
+  bool current = false;
+  call([&]() { current = make_context_current(*backend, true); });
+  if (!current) {
+    std::cerr << "error: Failed to make GL context current on the render "
+                 "thread ( threaded_engine.cxx:  )"
+              << std::endl;
+    stop_render_thread();
+    make_context_current(*backend, true);
+    backend->destroy();
+    destroy_engine(backend);
+    backend = nullptr;
+    return false;
+  }
+  return true;
+}
+
+command_buffer*
+threaded_engine::current_buffer()
+{
+  thread_local uint64_t owner = 0;
+  thread_local recorder* mine = nullptr;
+  if (owner != id) {
+    std::lock_guard<std::mutex> lock(recorders_mutex);
+    size_t n = recorder_count.load(std::memory_order_relaxed);
+    if (n == max_recording_threads) {
+      std::cerr << "error: Too many threads recording draw commands "
+                   "( threaded_engine.cxx:  )"
+                << std::endl;
+      return nullptr;
+    }
+    recorders[n] = std::make_unique<recorder>();
+    mine = recorders[n].get();
+    recorder_count.store(n + 1, std::memory_order_release);
+    owner = id;
+  }
+  return &mine->slots[record_slot.load(std::memory_order_acquire)];
+}
+
+void
+threaded_engine::call(const std::function<void()>& fn) const
+{
+  if (!render_thread.joinable()) {
+    fn();
+    return;
+  }
+  std::lock_guard<std::mutex> serialize(call_mutex);
+  std::unique_lock<std::mutex> lock(mutex);
+  pending_call = &fn;
+  wake.notify_one();
+  done.wait(lock, [this]() { return pending_call == nullptr; });
+}
+
+void
+threaded_engine::render_loop()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+    wake.wait(lock,
+              [this]() { return quit || pending_call != nullptr || frame_ready; });
+    if (pending_call != nullptr) {
+      const std::function<void()>* fn = pending_call;
+      lock.unlock();
+      (*fn)();
+      lock.lock();
+      pending_call = nullptr;
+      done.notify_all();
+      continue;
+    }
+    if (frame_ready) {
+      frame_ready = false;
+      const size_t slot = replay_slot;
+      const size_t count = recorder_count.load(std::memory_order_acquire);
+      lock.unlock();
+      {
+        UCHIHA_PROFILE_SCOPE("replay");
+        for (size_t i = 0; i < count; ++i) {
+          recorders[i]->slots[slot].replay(*backend);
+        }
+      }
+      backend->swap_buffers();
+      lock.lock();
+      frame_in_flight = false;
+      done.notify_all();
+      continue;
+    }
+    break;
+  }
+  lock.unlock();
+  make_context_current(*backend, false);
+}
+
+void
+threaded_engine::stop_render_thread()
+{
+  if (!render_thread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_one();
+  render_thread.join();
+}
+
+void
+threaded_engine::set_stream_buffer_budget(uint32_t bytes)
+{
+  call([&]() { backend->set_stream_buffer_budget(bytes); });
+}
+
+bool
+threaded_engine::read_input(event& e)
+{
+  return backend->read_input(e);
+}
+
+void
+threaded_engine::poll_events()
+{
+  backend->poll_events();
+}
+
+const input_state&
+threaded_engine::get_input() const
+{
+  return backend->get_input();
+}
+
+bool
+threaded_engine::mount_resource_pack(std::string_view path)
+{
+  bool mounted = false;
+  call([&]() { mounted = backend->mount_resource_pack(path); });
+  return mounted;
+}
+
+texture*
+threaded_engine::create_texture(std::string_view path)
+{
+  texture* t = nullptr;
+  call([&]() { t = backend->create_texture(path); });
+  return t;
+}
+
+texture*
+threaded_engine::create_texture_async(std::string_view path)
+{
+  texture* t = nullptr;
+  call([&]() { t = backend->create_texture_async(path); });
+  return t;
+}
+
+void
+threaded_engine::set_texture_upload_budget(float milliseconds)
+{
+  call([&]() { backend->set_texture_upload_budget(milliseconds); });
+}
+
+void
+threaded_engine::release_texture(texture* t)
+{
+  if (t == nullptr) {
+    return;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->release_texture(t);
+  }
+}
+
+void
+threaded_engine::set_texture_budget(uint64_t bytes)
+{
+  call([&]() { backend->set_texture_budget(bytes); });
+}
+
+texture_atlas*
+threaded_engine::create_atlas(uint16_t page_width, uint16_t page_height)
+{
+  texture_atlas* a = nullptr;
+  call([&]() { a = backend->create_atlas(page_width, page_height); });
+  return a;
+}
+
+texture*
+threaded_engine::create_texture(std::string_view path, texture_atlas& atlas)
+{
+  texture* t = nullptr;
+  call([&]() { t = backend->create_texture(path, atlas); });
+  return t;
+}
+
+void
+threaded_engine::destroy_atlas(texture_atlas* atlas)
+{
+  if (atlas == nullptr) {
+    return;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->destroy_atlas(atlas);
+  }
+}
+
+font*
+threaded_engine::create_font(std::string_view path, uint16_t pixel_size)
+{
+  font* f = nullptr;
+  call([&]() { f = backend->create_font(path, pixel_size); });
+  return f;
+}
+
+void
+threaded_engine::destroy_font(font* f)
+{
+  if (f == nullptr) {
+    return;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->destroy_font(f);
+  }
+}
+
+mesh*
+threaded_engine::create_mesh(const vertex* vertices,
+                             size_t vertex_count,
+                             index_span indices,
+                             mesh_usage usage)
+{
+  mesh* m = nullptr;
+  call([&]() {
+    m = backend->create_mesh(vertices, vertex_count, indices, usage);
+  });
+  return m;
+}
+
+bool
+threaded_engine::update_mesh(mesh& m,
+                             size_t first_vertex,
+                             const vertex* vertices,
+                             size_t count)
+{
+  if (vertices == nullptr || first_vertex > m.get_vertex_count() ||
+      count > m.get_vertex_count() - first_vertex) {
+    std::cerr << "error: Mesh update out of range ( threaded_engine.cxx:  )"
+              << std::endl;
+    return false;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->update_mesh(m, first_vertex, vertices, count);
+    return true;
+  }
+  return false;
+}
+
+void
+threaded_engine::draw_mesh(const mesh& m,
+                           const texture* tx,
+                           const mat4& transform)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->draw_mesh(m, tx, transform);
+  }
+}
+
+void
+threaded_engine::destroy_mesh(mesh* m)
+{
+  if (m == nullptr) {
+    return;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->destroy_mesh(m);
+  }
+}
+
+render_target*
+threaded_engine::create_render_target(uint16_t width, uint16_t height)
+{
+  render_target* t = nullptr;
+  call([&]() { t = backend->create_render_target(width, height); });
+  return t;
+}
+
+void
+threaded_engine::destroy_render_target(render_target* t)
+{
+  if (t == nullptr) {
+    return;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->destroy_render_target(t);
+  }
+}
+
+void
+threaded_engine::set_render_target(render_target* t)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->set_render_target(t);
+  }
+}
+
+void
+threaded_engine::clear(float r, float g, float b, float a)
+{
+  if (command_buffer* buffer = current_buffer()) {
+    buffer->clear(r, g, b, a);
+  }
+}
+
+bool
+threaded_engine::set_resolution_scale(float scale)
+{
+  command_buffer* b = current_buffer();
+  if (b == nullptr) {
+    return false;
+  }
+  b->set_resolution_scale(scale);
+  return true;
+}
+
+bool
+threaded_engine::set_retained_mode(bool enabled)
+{
+  command_buffer* b = current_buffer();
+  if (b == nullptr) {
+    return false;
+  }
+  b->set_retained_mode(enabled);
+  return true;
+}
+
+void
+threaded_engine::invalidate_frame()
+{
+  if (command_buffer* b = current_buffer()) {
+    b->invalidate_frame();
+  }
+}
+
+void
+threaded_engine::render(const triangle* triangles, size_t count)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->render(triangles, count, nullptr);
+  }
+}
+
+void
+threaded_engine::render(const triangle* triangles,
+                        size_t count,
+                        const texture& tx)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->render(triangles, count, &tx);
+  }
+}
+
+void
+threaded_engine::render(const vertex* vertices,
+                        size_t vertex_count,
+                        index_span indices,
+                        const texture* tx)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->render(vertices, vertex_count, indices, tx);
+  }
+}
+
+void
+threaded_engine::render(const packed_vertex* vertices,
+                        size_t vertex_count,
+                        index_span indices,
+                        const texture* tx)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->render(vertices, vertex_count, indices, tx);
+  }
+}
+
+void
+threaded_engine::render_instanced(const sprite_instance* instances,
+                                  size_t count,
+                                  const texture* tx)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->render_instanced(instances, count, tx);
+  }
+}
+
+void
+threaded_engine::render_quads(const sprite_instance* instances,
+                              size_t count,
+                              const texture* tx)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->render_quads(instances, count, tx);
+  }
+}
+
+void
+threaded_engine::begin_batch()
+{
+  if (command_buffer* b = current_buffer()) {
+    b->begin_batch();
+  }
+}
+
+void
+threaded_engine::submit(const triangle* triangles,
+                        size_t count,
+                        blend_mode blend,
+                        int16_t layer)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->submit(triangles, count, nullptr, blend, layer);
+  }
+}
+
+void
+threaded_engine::submit(const triangle* triangles,
+                        size_t count,
+                        const texture& tx,
+                        blend_mode blend,
+                        int16_t layer)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->submit(triangles, count, &tx, blend, layer);
+  }
+}
+
+void
+threaded_engine::submit_text(const font& f,
+                             std::string_view text,
+                             float x,
+                             float y,
+                             float scale,
+                             uint32_t rgba,
+                             blend_mode blend,
+                             int16_t layer)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->submit_text(f, text, x, y, scale, rgba, blend, layer);
+  }
+}
+
+aabb
+threaded_engine::measure_text(const font& f,
+                              std::string_view text,
+                              float x,
+                              float y,
+                              float scale)
+{
+  aabb box;
+  call([&]() { box = backend->measure_text(f, text, x, y, scale); });
+  return box;
+}
+
+void
+threaded_engine::flush()
+{
+  if (command_buffer* b = current_buffer()) {
+    b->flush();
+  }
+}
+
+void
+threaded_engine::swap_buffers()
+{
+  {
+    UCHIHA_PROFILE_SCOPE("wait for render thread");
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return !frame_in_flight; });
+
+    // The slot recording switches to was replayed by the frame just waited
+    // for, so it can be emptied.
+    const size_t recorded = record_slot.load(std::memory_order_relaxed);
+    const size_t next = recorded ^ 1;
+    const size_t count = recorder_count.load(std::memory_order_acquire);
+    for (size_t i = 0; i < count; ++i) {
+      recorders[i]->slots[next].clear();
+    }
+    record_slot.store(next, std::memory_order_release);
+    frame_memory.next_frame();
+
+    replay_slot = recorded;
+    frame_ready = true;
+    frame_in_flight = true;
+    wake.notify_one();
+  }
+  UCHIHA_PROFILE_SCOPE("frame limiter");
+  pacer.end_frame();
+}
+
+particle_emitter*
+threaded_engine::create_particle_emitter(const particle_settings& settings,
+                                         float x,
+                                         float y)
+{
+  particle_emitter* e = nullptr;
+  call([&]() { e = backend->create_particle_emitter(settings, x, y); });
+  return e;
+}
+
+void
+threaded_engine::destroy_particle_emitter(particle_emitter* e)
+{
+  if (e == nullptr) {
+    return;
+  }
+  if (command_buffer* b = current_buffer()) {
+    b->destroy_particle_emitter(e);
+  }
+}
+
+void
+threaded_engine::move_particle_emitter(particle_emitter& e, float x, float y)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->move_particle_emitter(e, x, y);
+  }
+}
+
+void
+threaded_engine::emit_particles(particle_emitter& e, uint32_t count)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->emit_particles(e, count);
+  }
+}
+
+void
+threaded_engine::update_particles(float seconds)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->update_particles(seconds);
+  }
+}
+
+void
+threaded_engine::draw_particles(const particle_emitter& e, const texture* t)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->draw_particles(e, t);
+  }
+}
+
+void
+threaded_engine::set_view_projection(const mat4& view_projection)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->set_view_projection(view_projection);
+  }
+}
+
+void
+threaded_engine::set_model_transform(const mat4& model)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->set_model_transform(model);
+  }
+}
+
+void
+threaded_engine::set_culling_enabled(bool enabled)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->set_culling_enabled(enabled);
+  }
+}
+
+void
+threaded_engine::set_multi_texture_batching(bool enabled)
+{
+  if (command_buffer* b = current_buffer()) {
+    b->set_multi_texture_batching(enabled);
+  }
+}
+
+void*
+threaded_engine::allocate_frame_memory(size_t bytes, size_t alignment)
+{
+  return frame_memory.allocate(bytes, alignment);
+}
+
+bool
+threaded_engine::set_vsync(vsync_mode mode)
+{
+  bool result = false;
+  call([&]() { result = backend->set_vsync(mode); });
+  return result;
+}
+
+void
+threaded_engine::set_frame_rate_limit(float frames_per_second)
+{
+  pacer.set_limit(frames_per_second);
+}
+
+double
+threaded_engine::get_frame_seconds() const
+{
+  return pacer.last_frame_seconds();
+}
+
+void
+threaded_engine::set_shader_hot_reload(bool enabled)
+{
+  call([&]() { backend->set_shader_hot_reload(enabled); });
+}
+
+void
+threaded_engine::set_profiling_enabled(bool enabled)
+{
+  call([&]() { backend->set_profiling_enabled(enabled); });
+}
+
+frame_stats
+threaded_engine::get_frame_stats() const
+{
+  frame_stats stats;
+  call([&]() { stats = backend->get_frame_stats(); });
+  return stats;
+}
+
+bool
+threaded_engine::write_profile_trace(std::string_view path)
+{
+  bool result = false;
+  call([&]() { result = backend->write_profile_trace(path); });
+  return result;
+}
+
+void
+threaded_engine::save_screenshot(std::string_view path)
+{
+  call([&]() { backend->save_screenshot(path); });
+}
+
+bool
+threaded_engine::start_recording(std::string_view path)
+{
+  bool result = false;
+  call([&]() { result = backend->start_recording(path); });
+  return result;
+}
+
+void
+threaded_engine::stop_recording()
+{
+  call([&]() { backend->stop_recording(); });
+}
+
+// The backend records what it replays, so the trace shows the calls in the
+// order the GPU saw them.
+bool
+threaded_engine::start_trace(std::string_view path)
+{
+  bool result = false;
+  call([&]() { result = backend->start_trace(path); });
+  return result;
+}
+
+void
+threaded_engine::stop_trace()
+{
+  call([&]() { backend->stop_trace(); });
+}
+
+void
+threaded_engine::destroy()
+{
+  if (backend == nullptr) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return !frame_in_flight; });
+  }
+  stop_render_thread();
+  // SDL wants the window torn down on the thread that created it.
+  make_context_current(*backend, true);
+  backend->destroy();
+  destroy_engine(backend);
+  backend = nullptr;
+}
+
+engine*
+create_threaded_engine()
+{
+  return new threaded_engine();
+}
+
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include "command_buffer.hxx"
+#include "engine.hxx"
+#include "frame_arena.hxx"
+#include "frame_pacer.hxx"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace uchiha {
+
+// Moves the GL context of an engine made by create_engine() to or from the
+// calling thread. Defined next to the immediate engine in engine.cxx.
+bool
+make_context_current(engine& e, bool current);
+
+// Frontend returned by create_threaded_engine(). Draw calls from any thread
+// are recorded into that thread's command buffer; swap_buffers() hands the
+// frame to a render thread that owns the GL context and replays it into an
+// immediate engine while the caller goes on recording the next frame.
+// Everything else that needs GL (resource creation, budgets, profiler
+// readback) runs on the render thread as a blocking call.
+//
+// Threads other than the caller of swap_buffers() must have finished
+// recording for the frame before it is called. Within one frame the
+// recordings of different threads are replayed in the order those threads
+// first recorded anything, each in its own recording order.
+class threaded_engine final : public engine
+{
+public:
+  threaded_engine();
+  ~threaded_engine() override;
+
+  bool init(uint16_t ww, uint16_t wh, bool fullscreen) override;
+  void set_stream_buffer_budget(uint32_t bytes) override;
+  bool read_input(event& e) override;
+  void poll_events() override;
+  const input_state& get_input() const override;
+  bool mount_resource_pack(std::string_view path) override;
+  texture* create_texture(std::string_view path) override;
+  texture* create_texture_async(std::string_view path) override;
+  void set_texture_upload_budget(float milliseconds) override;
+  // Recorded, so draws recorded earlier in the frame still see the texture.
+  void release_texture(texture* t) override;
+  void set_texture_budget(uint64_t bytes) override;
+  texture_atlas* create_atlas(uint16_t page_width,
+                              uint16_t page_height) override;
+  texture* create_texture(std::string_view path,
+                          texture_atlas& atlas) override;
+  // Recorded, so draws recorded earlier in the frame still see its pages.
+  void destroy_atlas(texture_atlas* atlas) override;
+  font* create_font(std::string_view path, uint16_t pixel_size) override;
+  // Recorded, so text submitted earlier in the frame is still laid out.
+  void destroy_font(font* f) override;
+  mesh* create_mesh(const vertex* vertices,
+                    size_t vertex_count,
+                    index_span indices,
+                    mesh_usage usage) override;
+  bool update_mesh(mesh& m,
+                   size_t first_vertex,
+                   const vertex* vertices,
+                   size_t count) override;
+  void draw_mesh(const mesh& m,
+                 const texture* tx,
+                 const mat4& transform) override;
+  // Deferred to the replay of the current frame, after its draws.
+  void destroy_mesh(mesh* m) override;
+  render_target* create_render_target(uint16_t width,
+                                      uint16_t height) override;
+  // Recorded like the draws, so they apply in recording order.
+  void destroy_render_target(render_target* t) override;
+  void set_render_target(render_target* t) override;
+  void clear(float r, float g, float b, float a) override;
+  // Settings are recorded, so the draws recorded before them in the frame
+  // replay with the old ones, as on the immediate engine. The two below are
+  // applied on the render thread, so they cannot report a failure to create
+  // the offscreen frame; the render thread logs it instead.
+  bool set_resolution_scale(float scale) override;
+  bool set_retained_mode(bool enabled) override;
+  void invalidate_frame() override;
+  using engine::create_mesh;
+  using engine::render;
+  using engine::set_vsync;
+  using engine::submit;
+
+  void render(const triangle* triangles, size_t count) override;
+  void render(const triangle* triangles,
+              size_t count,
+              const texture& tx) override;
+  void render(const vertex* vertices,
+              size_t vertex_count,
+              index_span indices,
+              const texture* tx) override;
+  void render(const packed_vertex* vertices,
+              size_t vertex_count,
+              index_span indices,
+              const texture* tx) override;
+  void render_instanced(const sprite_instance* instances,
+                        size_t count,
+                        const texture* tx) override;
+  void render_quads(const sprite_instance* instances,
+                    size_t count,
+                    const texture* tx) override;
+  void begin_batch() override;
+  void submit(const triangle* triangles,
+              size_t count,
+              blend_mode blend,
+              int16_t layer) override;
+  void submit(const triangle* triangles,
+              size_t count,
+              const texture& tx,
+              blend_mode blend,
+              int16_t layer) override;
+  void submit_text(const font& f,
+                   std::string_view text,
+                   float x,
+                   float y,
+                   float scale,
+                   uint32_t rgba,
+                   blend_mode blend,
+                   int16_t layer) override;
+  // Blocks until the render thread has laid the text out.
+  aabb measure_text(const font& f,
+                    std::string_view text,
+                    float x,
+                    float y,
+                    float scale) override;
+  void flush() override;
+  void swap_buffers() override;
+  particle_emitter* create_particle_emitter(const particle_settings& settings,
+                                            float x,
+                                            float y) override;
+  // Recorded like the draws; emitters are simulated on the render thread.
+  void destroy_particle_emitter(particle_emitter* e) override;
+  void move_particle_emitter(particle_emitter& e, float x, float y) override;
+  void emit_particles(particle_emitter& e, uint32_t count) override;
+  void update_particles(float seconds) override;
+  void draw_particles(const particle_emitter& e, const texture* t) override;
+  void set_view_projection(const mat4& view_projection) override;
+  void set_model_transform(const mat4& model) override;
+  // Recorded, like set_resolution_scale().
+  void set_culling_enabled(bool enabled) override;
+  void set_multi_texture_batching(bool enabled) override;
+  void* allocate_frame_memory(size_t bytes, size_t alignment) override;
+  bool set_vsync(vsync_mode mode) override;
+  void set_frame_rate_limit(float frames_per_second) override;
+  double get_frame_seconds() const override;
+  void set_shader_hot_reload(bool enabled) override;
+  void set_profiling_enabled(bool enabled) override;
+  frame_stats get_frame_stats() const override;
+  bool write_profile_trace(std::string_view path) override;
+  void save_screenshot(std::string_view path) override;
+  bool start_recording(std::string_view path) override;
+  void stop_recording() override;
+  bool start_trace(std::string_view path) override;
+  void stop_trace() override;
+  void destroy() override;
+
+private:
+  // One per recording thread. While the render thread replays one slot the
+  // owner records into the other.
+  struct recorder
+  {
+    command_buffer slots[2];
+  };
+
+  static constexpr size_t max_recording_threads = 64;
+
+  // Null once max_recording_threads threads have recorded.
+  command_buffer* current_buffer();
+  // Runs fn on the render thread and waits for it to return.
+  void call(const std::function<void()>& fn) const;
+  void render_loop();
+  void stop_render_thread();
+
+  // Tells this engine's recorders apart from those of an earlier engine
+  // that lived at the same address.
+  const uint64_t id;
+  engine* backend = nullptr;
+  std::thread render_thread;
+
+  // Recorders are only ever appended, and never move once published.
+  std::unique_ptr<recorder> recorders[max_recording_threads];
+  std::atomic<size_t> recorder_count{ 0 };
+  std::mutex recorders_mutex;
+  std::atomic<size_t> record_slot{ 0 };
+  frame_arena frame_memory;
+  // Paces the recording thread; the backend's own limiter stays off.
+  frame_pacer pacer;
+
+  mutable std::mutex mutex;
+  mutable std::condition_variable wake;
+  mutable std::condition_variable done;
+  mutable std::mutex call_mutex;
+  mutable const std::function<void()>* pending_call = nullptr;
+  size_t replay_slot = 0;
+  bool frame_ready = false;
+  bool frame_in_flight = false;
+  bool quit = false;
+};
+
+}
@@ -0,0 +1,106 @@
+#include "engine.hxx"
+#include <cmath>
+
+namespace uchiha {
+
+mat4
+mat4::translation(float x, float y, float z)
+{
+  mat4 r;
+  r.m[12] = x;
+  r.m[13] = y;
+  r.m[14] = z;
+  return r;
+}
+
+mat4
+mat4::scale(float x, float y, float z)
+{
+  mat4 r;
+  r.m[0] = x;
+  r.m[5] = y;
+  r.m[10] = z;
+  return r;
+}
+
+mat4
+mat4::rotation_z(float radians)
+{
+  const float c = std::cos(radians);
+  const float s = std::sin(radians);
+  mat4 r;
+  r.m[0] = c;
+  r.m[1] = s;
+  r.m[4] = -s;
+  r.m[5] = c;
+  return r;
+}
+
+mat4
+mat4::ortho(float left,
+            float right,
+            float bottom,
+            float top,
+            float near_z,
+            float far_z)
+{
+  // Unlike glOrtho() z is not flipped, so the default box is the identity.
+  mat4 r;
+  r.m[0] = 2.f / (right - left);
+  r.m[5] = 2.f / (top - bottom);
+  r.m[10] = 2.f / (far_z - near_z);
+  r.m[12] = -(right + left) / (right - left);
+  r.m[13] = -(top + bottom) / (top - bottom);
+  r.m[14] = -(far_z + near_z) / (far_z - near_z);
+  return r;
+}
+
+bool
+mat4::operator==(const mat4& other) const
+{
+  for (int i = 0; i < 16; ++i) {
+    if (m[i] != other.m[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+mat4
+operator*(const mat4& a, const mat4& b)
+{
+  mat4 r;
+  for (int column = 0; column < 4; ++column) {
+    for (int row = 0; row < 4; ++row) {
+      float sum = 0.f;
+      for (int k = 0; k < 4; ++k) {
+        sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+      }
+      r.m[column * 4 + row] = sum;
+    }
+  }
+  return r;
+}
+
+mat4
+camera_2d::view_projection() const
+{
+  const float half_width = width * 0.5f / zoom;
+  const float half_height = height * 0.5f / zoom;
+  return mat4::ortho(-half_width, half_width, -half_height, half_height) *
+         mat4::rotation_z(-rotation) * mat4::translation(-x, -y);
+}
+
+aabb
+camera_2d::visible_bounds() const
+{
+  const float half_width = width * 0.5f / zoom;
+  const float half_height = height * 0.5f / zoom;
+  const float c = std::fabs(std::cos(rotation));
+  const float s = std::fabs(std::sin(rotation));
+  const float extent_x = half_width * c + half_height * s;
+  const float extent_y = half_width * s + half_height * c;
+  return aabb{ x - extent_x, y - extent_y, x + extent_x, y + extent_y };
+}
+
+}
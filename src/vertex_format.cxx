@@ -0,0 +1,87 @@
+#include "vertex_format.hxx"
+#include <algorithm>
+#include <cstring>
+
+namespace uchiha {
+
+static uint8_t
+to_unorm8(float v)
+{
+  return static_cast<uint8_t>(std::clamp(v, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+static uint16_t
+to_unorm16(float v)
+{
+  return static_cast<uint16_t>(std::clamp(v, 0.f, 1.f) * 65535.f + 0.5f);
+}
+
+uint16_t
+float_to_half(float f)
+{
+  uint32_t bits = 0;
+  std::memcpy(&bits, &f, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000u;
+  uint32_t exponent = (bits >> 23) & 0xffu;
+  uint32_t mantissa = bits & 0x7fffffu;
+
+  if (exponent == 0xffu) {
+    return static_cast<uint16_t>(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+  }
+  int32_t half_exponent = static_cast<int32_t>(exponent) - 127 + 15;
+  if (half_exponent >= 31) {
+    return static_cast<uint16_t>(sign | 0x7c00u);
+  }
+  if (half_exponent <= 0) {
+    if (half_exponent < -10) {
+      return static_cast<uint16_t>(sign);
+    }
+    mantissa |= 0x800000u;
+    uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+    uint32_t half_mantissa = mantissa >> shift;
+    uint32_t round_bit = 1u << (shift - 1);
+    if ((mantissa & round_bit) && (mantissa & (3 * round_bit - 1))) {
+      ++half_mantissa;
+    }
+    return static_cast<uint16_t>(sign | half_mantissa);
+  }
+  uint32_t half = sign | (static_cast<uint32_t>(half_exponent) << 10) |
+                  (mantissa >> 13);
+  // Round to nearest even; a carry correctly bumps the exponent.
+  if ((mantissa & 0x1000u) && (mantissa & 0x2fffu)) {
+    ++half;
+  }
+  return static_cast<uint16_t>(half);
+}
+
+packed_vertex
+pack_vertex(const vertex& v)
+{
+  packed_vertex p;
+  p.x = float_to_half(v.x);
+  p.y = float_to_half(v.y);
+  p.r = to_unorm8(v.r);
+  p.g = to_unorm8(v.g);
+  p.b = to_unorm8(v.b);
+  p.a = to_unorm8(v.a);
+  p.tx = to_unorm16(v.tx);
+  p.ty = to_unorm16(v.ty);
+  return p;
+}
+
+void
+copy_vertices(packed_vertex* out,
+              const packed_vertex* in,
+              size_t count,
+              const uv_rect& uv)
+{
+  float du = (uv.u1 - uv.u0) / 65535.f;
+  float dv = (uv.v1 - uv.v0) / 65535.f;
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = in[i];
+    out[i].tx = to_unorm16(uv.u0 + in[i].tx * du);
+    out[i].ty = to_unorm16(uv.v0 + in[i].ty * dv);
+  }
+}
+
+}
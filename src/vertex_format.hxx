@@ -0,0 +1,34 @@
+#pragma once
+#include "engine.hxx"
+#include <cstddef>
+#include <cstdint>
+
+namespace uchiha {
+
+// Layouts the renderer streams; each one has its own vertex array object.
+enum class vertex_format : uint8_t
+{
+  full,
+  packed,
+  instance,
+  slotted
+};
+
+constexpr size_t vertex_format_count = 4;
+
+// vertex plus the sampler of the multi-texture batch program it reads from.
+// The vertex comes first, so the other batch programs read this layout too.
+struct slotted_vertex
+{
+  vertex v;
+  uint32_t slot = 0;
+};
+
+// packed_vertex counterpart of copy_vertices().
+void
+copy_vertices(packed_vertex* out,
+              const packed_vertex* in,
+              size_t count,
+              const uv_rect& uv);
+
+}
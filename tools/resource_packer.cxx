@@ -0,0 +1,147 @@
+// Offline resource packer: writes files into one pack that the engine maps
+// at startup instead of opening each of them. Entries are named by their
+// path as given, so run it from the directory the engine runs from.
+//
+//   resource_packer [--lz4] <output.pack> <file>...
+//
+// With --lz4, entries that shrink are stored LZ4 compressed. Already
+// compressed formats such as png are kept as they are.
+
+#include "lz4.hxx"
+#include "resource_pack.hxx"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct input
+{
+  std::string name;
+  std::vector<uint8_t> stored;
+  uint32_t size = 0;
+};
+
+bool
+read_file(const char* path, std::vector<uint8_t>& out)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  out.assign(std::istreambuf_iterator<char>(file),
+             std::istreambuf_iterator<char>());
+  return !file.bad();
+}
+
+size_t
+align_up(size_t value)
+{
+  return (value + uchiha::pack_alignment - 1) & ~(uchiha::pack_alignment - 1);
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+  int first = 1;
+  bool lz4 = false;
+  if (argc > 1 && std::strcmp(argv[1], "--lz4") == 0) {
+    lz4 = true;
+    ++first;
+  }
+  if (argc - first < 2) {
+    std::cerr << "usage: resource_packer [--lz4] <output.pack> <file>..."
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  const char* output = argv[first];
+
+  std::vector<input> inputs;
+  for (int i = first + 1; i < argc; ++i) {
+    input in;
+    in.name = uchiha::normalize_pack_name(argv[i]);
+    if (!read_file(argv[i], in.stored) || in.stored.size() > UINT32_MAX) {
+      std::cerr << "error: Failed to read " << argv[i]
+                << " ( resource_packer.cxx:  )" << std::endl;
+      return EXIT_FAILURE;
+    }
+    in.size = static_cast<uint32_t>(in.stored.size());
+    if (lz4 && !in.stored.empty()) {
+      std::vector<uint8_t> packed(uchiha::lz4_compress_bound(in.size));
+      const size_t packed_size = uchiha::lz4_compress(
+        in.stored.data(), in.stored.size(), packed.data(), packed.size());
+      if (packed_size != 0 && packed_size < in.stored.size()) {
+        packed.resize(packed_size);
+        in.stored.swap(packed);
+      }
+    }
+    inputs.push_back(std::move(in));
+  }
+
+  std::vector<uchiha::pack_entry> toc(inputs.size());
+  std::string names;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    toc[i].name_hash = uchiha::pack_name_hash(inputs[i].name);
+    toc[i].name_offset = static_cast<uint32_t>(names.size());
+    toc[i].name_size = static_cast<uint32_t>(inputs[i].name.size());
+    toc[i].stored_size = static_cast<uint32_t>(inputs[i].stored.size());
+    toc[i].size = inputs[i].size;
+    names += inputs[i].name;
+  }
+
+  uchiha::pack_header header;
+  header.entry_count = static_cast<uint32_t>(toc.size());
+  header.names_size = static_cast<uint32_t>(names.size());
+  header.toc_offset = sizeof(header);
+  header.names_offset = header.toc_offset + toc.size() * sizeof(toc[0]);
+  size_t offset = align_up(header.names_offset + names.size());
+  for (uchiha::pack_entry& e : toc) {
+    e.offset = offset;
+    offset = align_up(offset + e.stored_size);
+  }
+
+  // Entries are laid out in command line order; only the table is sorted.
+  std::vector<size_t> order(toc.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return toc[a].name_hash < toc[b].name_hash;
+  });
+  std::vector<uchiha::pack_entry> sorted(toc.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    sorted[i] = toc[order[i]];
+  }
+
+  std::ofstream file(output, std::ios::binary);
+  auto write = [&](const void* data, size_t size) {
+    file.write(static_cast<const char*>(data),
+               static_cast<std::streamsize>(size));
+  };
+  auto pad = [&](size_t to) {
+    static const char zeros[uchiha::pack_alignment] = {};
+    write(zeros, to - static_cast<size_t>(file.tellp()));
+  };
+  write(&header, sizeof(header));
+  write(sorted.data(), sorted.size() * sizeof(sorted[0]));
+  write(names.data(), names.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    pad(toc[i].offset);
+    write(inputs[i].stored.data(), inputs[i].stored.size());
+  }
+  pad(offset);
+  if (!file) {
+    std::cerr << "error: Failed to write " << output
+              << " ( resource_packer.cxx:  )" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
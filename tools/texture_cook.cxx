@@ -0,0 +1,278 @@
+// Offline texture cooker: converts an image into a mipmapped BC1 (opaque)
+// or BC3 (with alpha) DDS that the engine uploads without decoding.
+//
+//   texture_cook <input.png> <output.dds>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+struct image
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> rgba;
+};
+
+image
+downsample(const image& src)
+{
+  image dst;
+  dst.width = std::max<uint32_t>(1, src.width / 2);
+  dst.height = std::max<uint32_t>(1, src.height / 2);
+  dst.rgba.resize(size_t(dst.width) * dst.height * 4);
+  for (uint32_t y = 0; y < dst.height; ++y) {
+    for (uint32_t x = 0; x < dst.width; ++x) {
+      uint32_t x0 = std::min(x * 2, src.width - 1);
+      uint32_t x1 = std::min(x * 2 + 1, src.width - 1);
+      uint32_t y0 = std::min(y * 2, src.height - 1);
+      uint32_t y1 = std::min(y * 2 + 1, src.height - 1);
+      for (uint32_t c = 0; c < 4; ++c) {
+        uint32_t sum = src.rgba[(size_t(y0) * src.width + x0) * 4 + c] +
+                       src.rgba[(size_t(y0) * src.width + x1) * 4 + c] +
+                       src.rgba[(size_t(y1) * src.width + x0) * 4 + c] +
+                       src.rgba[(size_t(y1) * src.width + x1) * 4 + c];
+        dst.rgba[(size_t(y) * dst.width + x) * 4 + c] =
+          static_cast<uint8_t>((sum + 2) / 4);
+      }
+    }
+  }
+  return dst;
+}
+
+uint16_t
+to_565(const uint8_t* c)
+{
+  return static_cast<uint16_t>(((c[0] * 31 + 127) / 255) << 11 |
+                               ((c[1] * 63 + 127) / 255) << 5 |
+                               ((c[2] * 31 + 127) / 255));
+}
+
+void
+from_565(uint16_t v, int* out)
+{
+  out[0] = ((v >> 11) & 31) * 255 / 31;
+  out[1] = ((v >> 5) & 63) * 255 / 63;
+  out[2] = (v & 31) * 255 / 31;
+}
+
+// Bounding box endpoints, inset by 1/16 of the range to pull them towards
+// the cluster, with every texel snapped to the nearest of the 4 colors.
+void
+encode_color_block(const uint8_t block[16][4], uint8_t* out)
+{
+  int lo[3] = { 255, 255, 255 };
+  int hi[3] = { 0, 0, 0 };
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      lo[c] = std::min<int>(lo[c], block[i][c]);
+      hi[c] = std::max<int>(hi[c], block[i][c]);
+    }
+  }
+  uint8_t max_color[3];
+  uint8_t min_color[3];
+  for (int c = 0; c < 3; ++c) {
+    int inset = (hi[c] - lo[c]) / 16;
+    max_color[c] = static_cast<uint8_t>(hi[c] - inset);
+    min_color[c] = static_cast<uint8_t>(lo[c] + inset);
+  }
+  uint16_t c0 = to_565(max_color);
+  uint16_t c1 = to_565(min_color);
+  if (c0 < c1) {
+    std::swap(c0, c1);
+  }
+
+  int palette[4][3];
+  from_565(c0, palette[0]);
+  from_565(c1, palette[1]);
+  for (int c = 0; c < 3; ++c) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+  }
+
+  uint32_t indices = 0;
+  if (c0 != c1) {
+    for (int i = 0; i < 16; ++i) {
+      int best = 0;
+      int best_distance = 1 << 30;
+      for (int p = 0; p < 4; ++p) {
+        int distance = 0;
+        for (int c = 0; c < 3; ++c) {
+          int d = block[i][c] - palette[p][c];
+          distance += d * d;
+        }
+        if (distance < best_distance) {
+          best_distance = distance;
+          best = p;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (i * 2);
+    }
+  }
+  out[0] = static_cast<uint8_t>(c0);
+  out[1] = static_cast<uint8_t>(c0 >> 8);
+  out[2] = static_cast<uint8_t>(c1);
+  out[3] = static_cast<uint8_t>(c1 >> 8);
+  std::memcpy(out + 4, &indices, 4);
+}
+
+void
+encode_alpha_block(const uint8_t block[16][4], uint8_t* out)
+{
+  int a0 = 0;
+  int a1 = 255;
+  for (int i = 0; i < 16; ++i) {
+    a0 = std::max<int>(a0, block[i][3]);
+    a1 = std::min<int>(a1, block[i][3]);
+  }
+  int palette[8] = { a0, a1 };
+  for (int i = 2; i < 8; ++i) {
+    palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+  }
+
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    for (int i = 0; i < 16; ++i) {
+      int best = 0;
+      for (int p = 1; p < 8; ++p) {
+        if (std::abs(block[i][3] - palette[p]) <
+            std::abs(block[i][3] - palette[best])) {
+          best = p;
+        }
+      }
+      indices |= static_cast<uint64_t>(best) << (i * 3);
+    }
+  }
+  out[0] = static_cast<uint8_t>(a0);
+  out[1] = static_cast<uint8_t>(a1);
+  for (int i = 0; i < 6; ++i) {
+    out[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+  }
+}
+
+void
+encode_level(const image& img, bool with_alpha, std::vector<uint8_t>& out)
+{
+  const size_t block_bytes = with_alpha ? 16 : 8;
+  for (uint32_t by = 0; by < img.height; by += 4) {
+    for (uint32_t bx = 0; bx < img.width; bx += 4) {
+      uint8_t block[16][4];
+      for (uint32_t i = 0; i < 16; ++i) {
+        // Edge blocks repeat the last row / column.
+        uint32_t x = std::min(bx + i % 4, img.width - 1);
+        uint32_t y = std::min(by + i / 4, img.height - 1);
+        std::memcpy(block[i], &img.rgba[(size_t(y) * img.width + x) * 4], 4);
+      }
+      size_t at = out.size();
+      out.resize(at + block_bytes);
+      if (with_alpha) {
+        encode_alpha_block(block, &out[at]);
+        encode_color_block(block, &out[at + 8]);
+      } else {
+        encode_color_block(block, &out[at]);
+      }
+    }
+  }
+}
+
+void
+put_u32(std::vector<uint8_t>& out, size_t offset, uint32_t value)
+{
+  std::memcpy(&out[offset], &value, 4);
+}
+
+std::vector<uint8_t>
+dds_header(uint32_t width,
+           uint32_t height,
+           uint32_t mip_count,
+           uint32_t base_size,
+           bool with_alpha)
+{
+  std::vector<uint8_t> h(128, 0);
+  std::memcpy(&h[0], "DDS ", 4);
+  put_u32(h, 4, 124);
+  // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+  put_u32(h, 8, 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);
+  put_u32(h, 12, height);
+  put_u32(h, 16, width);
+  put_u32(h, 20, base_size);
+  put_u32(h, 28, mip_count);
+  put_u32(h, 76, 32);
+  put_u32(h, 80, 0x4); // DDPF_FOURCC
+  std::memcpy(&h[84], with_alpha ? "DXT5" : "DXT1", 4);
+  // TEXTURE | MIPMAP | COMPLEX
+  put_u32(h, 108, 0x1000 | 0x400000 | 0x8);
+  return h;
+}
+
+}
+
+int
+main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "usage: texture_cook <input> <output.dds>" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int width, height, channels;
+  unsigned char* pixels =
+    stbi_load(argv[1], &width, &height, &channels, STBI_rgb_alpha);
+  if (pixels == nullptr) {
+    std::cerr << "error: Failed to load " << argv[1]
+              << " ( texture_cook.cxx:  )" << std::endl;
+    return EXIT_FAILURE;
+  }
+  image level;
+  level.width = static_cast<uint32_t>(width);
+  level.height = static_cast<uint32_t>(height);
+  level.rgba.assign(pixels, pixels + size_t(width) * height * 4);
+  stbi_image_free(pixels);
+
+  bool with_alpha = false;
+  for (size_t i = 3; i < level.rgba.size(); i += 4) {
+    if (level.rgba[i] != 255) {
+      with_alpha = true;
+      break;
+    }
+  }
+
+  std::vector<uint8_t> blocks;
+  uint32_t mip_count = 0;
+  uint32_t base_size = 0;
+  for (;;) {
+    encode_level(level, with_alpha, blocks);
+    if (mip_count++ == 0) {
+      base_size = static_cast<uint32_t>(blocks.size());
+    }
+    if (level.width == 1 && level.height == 1) {
+      break;
+    }
+    level = downsample(level);
+  }
+
+  std::ofstream file(argv[2], std::ios::binary);
+  std::vector<uint8_t> header = dds_header(static_cast<uint32_t>(width),
+                                           static_cast<uint32_t>(height),
+                                           mip_count,
+                                           base_size,
+                                           with_alpha);
+  file.write(reinterpret_cast<const char*>(header.data()),
+             static_cast<std::streamsize>(header.size()));
+  file.write(reinterpret_cast<const char*>(blocks.data()),
+             static_cast<std::streamsize>(blocks.size()));
+  if (!file) {
+    std::cerr << "error: Failed to write " << argv[2]
+              << " ( texture_cook.cxx:  )" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}